@@ -0,0 +1,297 @@
+#include <fcntl.h> // for open()
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>       // for memset()
+#include <sys/resource.h> // for getrusage()
+#include <time.h>         // for clock_gettime()
+#include <unistd.h>       // for write(), lseek(), unlink()
+
+#include "../src/batch.h"
+#include "../src/memo.h"
+
+/*
+ * How batch evaluation scales with the number of cores: the same lines, with
+ * an evaluator that's expensive on purpose, are run with 1, 2, 4 & 8 worker
+ * threads. Prints one "<name> <seconds>" line per worker count, which is what
+ * bin/bench reads. (on a machine with fewer cores than workers, the extra
+ * workers only show the pipeline's own overhead.)
+ *
+ * Then a single line of LONG_LINE_MB MB is echoed a fragment at a time, which
+ * fails if the process grows by more than a few chunks' worth while it runs,
+ * since that's all it should take.
+ *
+ * Last, a replay where most lines are commands that come up again & again
+ * (drawn from a Zipf distribution, like real ones), & the rest come up once,
+ * is run without & with a cache of outputs that holds about half of the
+ * commands. The cache's hit rate goes to stderr.
+ */
+
+#define LINES 25000
+
+// how many rounds of hashing each line takes, for a few microseconds a line
+#define EVAL_ROUNDS 200
+
+#define CHUNK_SIZE (16 * 1024)
+
+#define LONG_LINE_MB 64
+#define MAX_LONG_LINE_GROWTH_MB 16
+
+#define REPLAY_LINES 50000
+#define REPLAY_COMMANDS 5000
+#define REPLAY_ONE_OFF_PERCENT 20
+#define REPLAY_WORKERS 2
+#define MEMO_SIZE (256 * 1024)
+
+static double run(int in, int out, size_t num_workers);
+static double run_long_line(int out);
+static int replay_file(void);
+static double run_replay(int in, int out, bool memoize);
+static bool eval_line(const char *line, size_t len, struct AppendBuffer *out,
+                      void *ctx);
+static bool echo_fragment(const char *fragment, size_t len, bool first,
+                          bool last, struct AppendBuffer *out, void *ctx);
+static int temp_file(void);
+static size_t peak_rss_kb(void);
+static double now(void);
+
+int main(void) {
+  int out = open("/dev/null", O_WRONLY);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    return EXIT_FAILURE;
+  }
+
+  // first, while the process is as small as it gets
+  printf("batch/long-line-%dM %.9f\n", LONG_LINE_MB, run_long_line(out));
+
+  int in = temp_file();
+  for (int i = 0; i < LINES; ++i) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "replayed command %d\n", i);
+    if (write(in, line, len) != len) {
+      perror("failed to write input file");
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("batch/workers-1 %.9f\n", run(in, out, 1));
+  printf("batch/workers-2 %.9f\n", run(in, out, 2));
+  printf("batch/workers-4 %.9f\n", run(in, out, 4));
+  printf("batch/workers-8 %.9f\n", run(in, out, 8));
+
+  close(in);
+
+  int replay = replay_file();
+  printf("batch/replay-50K %.9f\n", run_replay(replay, out, false));
+  printf("batch/replay-50K-memo %.9f\n", run_replay(replay, out, true));
+  close(replay);
+  close(out);
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * evaluates all of `in` & returns how long it took, in seconds.
+ */
+static double run(int in, int out, size_t num_workers) {
+  lseek(in, 0, SEEK_SET);
+
+  struct BatchOptions options = {
+      .num_workers = num_workers,
+      .chunk_size = CHUNK_SIZE,
+  };
+
+  double start = now();
+  if (batch_run(in, out, eval_line, NULL, &options) != BATCH_DONE) {
+    fputs("batch failed\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  return now() - start;
+}
+
+/*
+ * echoes a line of LONG_LINE_MB MB with the default chunk size & returns how
+ * long it took, in seconds.
+ */
+static double run_long_line(int out) {
+  int in = temp_file();
+
+  static char block[1024 * 1024];
+  memset(block, 'x', sizeof(block));
+  for (int i = 0; i < LONG_LINE_MB; ++i) {
+    if (write(in, block, sizeof(block)) != sizeof(block)) {
+      perror("failed to write input file");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (write(in, "\n", 1) != 1) {
+    perror("failed to write input file");
+    exit(EXIT_FAILURE);
+  }
+  lseek(in, 0, SEEK_SET);
+
+  struct BatchOptions options = {.eval_fragment = echo_fragment};
+
+  size_t rss_before = peak_rss_kb();
+  double start = now();
+  if (batch_run(in, out, eval_line, NULL, &options) != BATCH_DONE) {
+    fputs("batch failed\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  double elapsed = now() - start;
+
+  size_t growth = peak_rss_kb() - rss_before;
+  if (growth > MAX_LONG_LINE_GROWTH_MB * 1024) {
+    fprintf(stderr, "a %d MB line took %zu KB, more than a few chunks\n",
+            LONG_LINE_MB, growth);
+    exit(EXIT_FAILURE);
+  }
+
+  close(in);
+
+  return elapsed;
+}
+
+/*
+ * writes REPLAY_LINES lines, most of them one of REPLAY_COMMANDS commands
+ * drawn from a Zipf distribution, to a file.
+ */
+static int replay_file(void) {
+  static double cumulative[REPLAY_COMMANDS];
+  double total = 0;
+  for (int i = 0; i < REPLAY_COMMANDS; ++i) {
+    total += 1.0 / (i + 1);
+    cumulative[i] = total;
+  }
+
+  int in = temp_file();
+  uint64_t state = 42;
+  for (int i = 0; i < REPLAY_LINES; ++i) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    unsigned roll = (state >> 33) % 100;
+    double x = (double)(state >> 11) / (1ULL << 53) * total;
+
+    char line[64];
+    int len;
+    if (roll < REPLAY_ONE_OFF_PERCENT) {
+      len = snprintf(line, sizeof(line), "one-off command %d\n", i);
+    } else {
+      // the first command whose cumulative weight is past x
+      int lo = 0;
+      int hi = REPLAY_COMMANDS - 1;
+      while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cumulative[mid] < x) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      len = snprintf(line, sizeof(line), "replayed command %d\n", lo);
+    }
+
+    if (write(in, line, len) != len) {
+      perror("failed to write input file");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  return in;
+}
+
+/*
+ * evaluates all of `in`, caching the outputs if `memoize` is set, & returns
+ * how long it took, in seconds.
+ */
+static double run_replay(int in, int out, bool memoize) {
+  lseek(in, 0, SEEK_SET);
+
+  struct BatchOptions options = {
+      .num_workers = REPLAY_WORKERS,
+      .chunk_size = CHUNK_SIZE,
+      .memo = memoize ? memo_init(MEMO_SIZE) : NULL,
+  };
+  if (memoize && options.memo == NULL) {
+    fputs("failed to allocate the cache\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  double start = now();
+  if (batch_run(in, out, eval_line, NULL, &options) != BATCH_DONE) {
+    fputs("batch failed\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  double elapsed = now() - start;
+
+  if (memoize) {
+    struct MemoStats stats;
+    memo_stats(options.memo, &stats);
+    fprintf(stderr,
+            "memo: %.1f%% hits, saved %.1f ms, %llu admitted, %llu "
+            "rejected, %llu evicted\n",
+            100.0 * stats.hits / (stats.hits + stats.misses),
+            stats.saved_ns / 1e6, (unsigned long long)stats.admitted,
+            (unsigned long long)stats.rejected,
+            (unsigned long long)stats.evicted);
+    memo_free(options.memo);
+  }
+
+  return elapsed;
+}
+
+/*
+ * stands in for an expensive evaluator: hashes the line over & over, then
+ * writes the hash.
+ */
+static bool eval_line(const char *line, size_t len, struct AppendBuffer *out,
+                      void *ctx) {
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+  for (int round = 0; round < EVAL_ROUNDS; ++round) {
+    for (size_t i = 0; i < len; ++i) {
+      hash = (hash ^ (unsigned char)line[i]) * 1099511628211ULL;
+    }
+  }
+
+  char result[32];
+  int result_len =
+      snprintf(result, sizeof(result), "%016llx\n", (unsigned long long)hash);
+
+  return abuf_append(out, result, result_len);
+}
+
+static bool echo_fragment(const char *fragment, size_t len, bool first,
+                          bool last, struct AppendBuffer *out, void *ctx) {
+  return (!first || abuf_append(out, "you said: ", 10)) &&
+         abuf_append(out, fragment, len) &&
+         (!last || abuf_append(out, "\n", 1));
+}
+
+// a file that's deleted once it's closed
+static int temp_file(void) {
+  char path[] = "/tmp/bench-batch-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    perror("failed to create input file");
+    exit(EXIT_FAILURE);
+  }
+  unlink(path);
+
+  return fd;
+}
+
+static size_t peak_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for strlen()
+#include <time.h>   // for clock_gettime()
+
+#include "../src/command.h"
+
+/*
+ * What finding out whether a line is a command costs, which every line pays.
+ * Prints one "<name> <seconds>" line, which is what bin/bench reads:
+ *
+ * - command/find-10M: 10M lines, mostly regular input (including lines that
+ *   start like a command, or with ':' or 'e'), with a command now & then.
+ */
+
+#define LOOKUPS 10000000
+
+static const char *lines[] = {
+    "hello",
+    "git status",
+    "echo something",
+    "exit now",
+    ":)",
+    "make -j8 && make test",
+    "e",
+    ":historian",
+    "ls -la /tmp",
+    ":history 10",
+    "cargo build --release",
+    ":searching",
+    "exit",
+    "print(1 + 2)",
+    ":repeat 3 hi",
+    "select * from users where id = 42;",
+};
+
+#define NUM_LINES (sizeof(lines) / sizeof(lines[0]))
+
+static double find(void);
+static double now(void);
+
+int main(void) {
+  printf("command/find-10M %.9f\n", find());
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * returns how long the lookups took, in seconds.
+ */
+static double find(void) {
+  size_t lens[NUM_LINES];
+  for (size_t i = 0; i < NUM_LINES; ++i) {
+    lens[i] = strlen(lines[i]);
+  }
+
+  // so the lookups aren't optimized away
+  uint64_t found = 0;
+
+  double start = now();
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    size_t line = i % NUM_LINES;
+    size_t args;
+    found += command_find(lines[line], lens[line], &args);
+  }
+  double elapsed = now() - start;
+
+  if (found == 0) {
+    fputs("no commands found\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  return elapsed;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <vector>
+
+#include <fcntl.h>  // for open()
+#include <time.h>   // for clock_gettime()
+#include <unistd.h> // for pipe(), write(), close()
+
+#include "../src/executor.hpp"
+
+/*
+ * How many sessions one core can serve: sessions run as coroutines on one
+ * executor (so one thread), each reading lines from its own pipe, while a
+ * feeder task types a line into every pipe per round. Prints one
+ * "<name> <seconds>" line per session count, which is what bin/bench reads;
+ * with the same lines per session, time growing linearly with the number of
+ * sessions means each one costs the same no matter how many there are.
+ */
+
+#define LINES_PER_SESSION 20
+
+struct Pipes {
+  std::vector<int> readers;
+  std::vector<int> writers;
+};
+
+static double serve(size_t num_sessions);
+static rl::Task session_task(rl::Executor &executor, int fd, int out,
+                             std::pmr::memory_resource *pool,
+                             size_t *num_lines);
+static rl::Task feeder_task(rl::Executor &executor, std::vector<int> &writers);
+static double now(void);
+
+int main(void) {
+  printf("coro/sessions-1K %.9f\n", serve(1000));
+  printf("coro/sessions-8K %.9f\n", serve(8000));
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * runs `num_sessions` sessions until their input ends & returns how long it
+ * took, in seconds.
+ */
+static double serve(size_t num_sessions) {
+  int out = open("/dev/null", O_WRONLY);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    exit(EXIT_FAILURE);
+  }
+
+  Pipes pipes;
+  for (size_t i = 0; i < num_sessions; ++i) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+      perror("failed to create pipe");
+      exit(EXIT_FAILURE);
+    }
+    pipes.readers.push_back(fds[0]);
+    pipes.writers.push_back(fds[1]);
+  }
+
+  size_t num_lines = 0;
+  std::pmr::unsynchronized_pool_resource pool;
+
+  double start = now();
+  {
+    rl::Executor executor;
+    for (int fd : pipes.readers) {
+      executor.spawn(session_task(executor, fd, out, &pool, &num_lines));
+    }
+    executor.spawn(feeder_task(executor, pipes.writers));
+    executor.run();
+  }
+  double elapsed = now() - start;
+
+  rl_cleanup();
+  close(out);
+
+  if (num_lines != num_sessions * LINES_PER_SESSION) {
+    fprintf(stderr, "read %zu lines, expected %zu\n", num_lines,
+            num_sessions * LINES_PER_SESSION);
+    exit(EXIT_FAILURE);
+  }
+
+  return elapsed;
+}
+
+/*
+ * a session reading lines until its input ends.
+ */
+static rl::Task session_task(rl::Executor &executor, int fd, int out,
+                             std::pmr::memory_resource *pool,
+                             size_t *num_lines) {
+  {
+    rl::AsyncSession session(executor, fd, out, 1024, pool);
+    while (auto result = co_await session.read_line("> ")) {
+      *num_lines += !result.line.empty();
+    }
+  }
+
+  close(fd);
+}
+
+/*
+ * types a line into every session each round, letting the sessions catch up
+ * in between, then ends their input.
+ */
+static rl::Task feeder_task(rl::Executor &executor, std::vector<int> &writers) {
+  char line[64];
+
+  for (int round = 0; round < LINES_PER_SESSION; ++round) {
+    for (size_t i = 0; i < writers.size(); ++i) {
+      int len = snprintf(line, sizeof(line), "session %zu says %d\r", i, round);
+      if (write(writers[i], line, len) != len) {
+        perror("failed to write to session");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    co_await executor.yield();
+  }
+
+  for (int fd : writers) {
+    close(fd);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
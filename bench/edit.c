@@ -0,0 +1,173 @@
+#include <fcntl.h> // for open()
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for memset(), memcpy()
+#include <time.h>   // for clock_gettime()
+#include <unistd.h> // for write(), lseek(), unlink()
+
+#include "../src/readline.h"
+
+/*
+ * Times the line editor on big inputs, driven headlessly from a file & drawn
+ * to /dev/null. Prints one "<name> <seconds>" line per case, which is what
+ * bin/bench reads.
+ */
+
+#define LINE_CHARS 1000000
+#define HISTORY_LINES 100000
+
+static double run(int in, int out, size_t line_size);
+static double run_batched(int in, int out, size_t max_len);
+static void write_keys(int fd, const char *keys, size_t len);
+static void write_repeated(int fd, char c, size_t n);
+static void reset(int fd);
+static double now(void);
+
+int main(void) {
+  int out = open("/dev/null", O_WRONLY);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    return EXIT_FAILURE;
+  }
+
+  char path[] = "/tmp/bench-edit-XXXXXX";
+  int in = mkstemp(path);
+  if (in == -1) {
+    perror("failed to create input file");
+    return EXIT_FAILURE;
+  }
+  unlink(path);
+
+  // typing at the end of a long line
+  reset(in);
+  write_repeated(in, 'a', LINE_CHARS);
+  write_keys(in, "\r", 1);
+  printf("edit/type-1M %.9f\n", run(in, out, LINE_CHARS + 16));
+
+  // pasting in front of half a line
+  reset(in);
+  write_repeated(in, 'a', LINE_CHARS / 2);
+  write_keys(in, "\x01", 1);
+  write_repeated(in, 'b', LINE_CHARS / 2);
+  write_keys(in, "\r", 1);
+  printf("edit/paste-at-start-1M %.9f\n", run(in, out, LINE_CHARS + 16));
+
+  // deleting a long line one Backspace at a time
+  reset(in);
+  write_repeated(in, 'a', LINE_CHARS);
+  write_repeated(in, 0x7f, LINE_CHARS);
+  write_keys(in, "\r", 1);
+  printf("edit/backspace-1M %.9f\n", run(in, out, LINE_CHARS + 16));
+
+  // entering lines, then walking all the way back up the history
+  reset(in);
+  char line[32];
+  for (int i = 0; i < HISTORY_LINES; ++i) {
+    int len = snprintf(line, sizeof(line), "line %d\r", i);
+    write_keys(in, line, len);
+  }
+  for (int i = 0; i < HISTORY_LINES; ++i) {
+    write_keys(in, "\x1b[A", 3);
+  }
+  write_keys(in, "\r", 1);
+  printf("edit/history-walk-100K %.9f\n", run(in, out, 1024));
+
+  // pasting many lines, read a line at a time & then all at once
+  reset(in);
+  for (int i = 0; i < HISTORY_LINES; ++i) {
+    int len = snprintf(line, sizeof(line), "line %d\r", i);
+    write_keys(in, line, len);
+  }
+  printf("edit/paste-lines-100K %.9f\n", run(in, out, 1024));
+  printf("edit/paste-lines-100K-batched %.9f\n", run_batched(in, out, 1023));
+
+  close(in);
+  close(out);
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * reads lines from the start of `in` until it runs out & returns how long it
+ * took, in seconds.
+ */
+static double run(int in, int out, size_t line_size) {
+  char *line = malloc(line_size);
+  if (line == NULL) {
+    perror("failed to allocate line");
+    exit(EXIT_FAILURE);
+  }
+
+  lseek(in, 0, SEEK_SET);
+  rl_set_headless(in, out);
+
+  double start = now();
+  while (rl_read_line(line, line_size, "> ") == RL_SUCCESS) {
+  }
+  double elapsed = now() - start;
+
+  rl_cleanup();
+  free(line);
+
+  return elapsed;
+}
+
+/*
+ * like `run`, but with `rl_read_lines`, so the lines that are there already
+ * are read all at once.
+ */
+static double run_batched(int in, int out, size_t max_len) {
+  lseek(in, 0, SEEK_SET);
+  rl_set_headless(in, out);
+
+  const struct RLLine *lines;
+  size_t count;
+  size_t read = 0;
+
+  double start = now();
+  while (rl_read_lines(max_len, "> ", &lines, &count) == RL_SUCCESS) {
+    read += count;
+  }
+  double elapsed = now() - start;
+
+  rl_cleanup();
+
+  if (read != HISTORY_LINES) {
+    fprintf(stderr, "read %zu lines instead of %d\n", read, HISTORY_LINES);
+    exit(EXIT_FAILURE);
+  }
+
+  return elapsed;
+}
+
+static void write_keys(int fd, const char *keys, size_t len) {
+  if (write(fd, keys, len) != (ssize_t)len) {
+    perror("failed to write input file");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void write_repeated(int fd, char c, size_t n) {
+  char buf[65536];
+  memset(buf, c, sizeof(buf));
+
+  while (n > 0) {
+    size_t len = n < sizeof(buf) ? n : sizeof(buf);
+    write_keys(fd, buf, len);
+    n -= len;
+  }
+}
+
+static void reset(int fd) {
+  if (ftruncate(fd, 0) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+    perror("failed to reset input file");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
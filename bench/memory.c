@@ -0,0 +1,190 @@
+#include <fcntl.h>  // for open()
+#include <malloc.h> // for malloc_trim()
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for strlen()
+#include <unistd.h> // for pipe(), write(), sysconf()
+
+#include "../src/readline.h"
+
+/*
+ * How much memory a server full of mostly idle sessions takes: every session
+ * types a history's worth of lines & then half of another one, which it's
+ * still "typing" when the memory is measured, before & after the idle ones
+ * (all but 1 in 10) are compacted with `rl_session_compact`.
+ *
+ * Each session counts what it allocates through its allocator function, so
+ * the footprint is the editor's own, per session. The RSS of the whole
+ * process is shown too, though it hardly moves when the sessions are
+ * compacted: what's freed is spread between blocks that are still in use, so
+ * malloc keeps it. That's why another 10K sessions are started afterwards,
+ * to see how much of them fits in it instead of growing the process.
+ *
+ * The sessions all read from the same pipe, one after the other, so 10K of
+ * them don't need 20K fds. It's not timed, so bin/bench doesn't run it:
+ * `make bench-memory` does.
+ */
+
+#define SESSIONS 10000
+#define HISTORY_LINES 20
+#define ACTIVE_EVERY 10 // 1 in 10 sessions isn't idle, & isn't compacted
+
+struct Usage {
+  size_t bytes; // allocated right now
+};
+
+static void type_lines(int fd, struct RLSession *session, int id);
+static void *count_alloc(void *ctx, void *ptr, size_t old_size,
+                         size_t new_size);
+static void report(const char *what, struct Usage *usage);
+static size_t rss(void);
+
+int main(void) {
+  int out = open("/dev/null", O_WRONLY);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    return EXIT_FAILURE;
+  }
+
+  int fds[2];
+  if (pipe(fds) == -1) {
+    perror("failed to create pipe");
+    return EXIT_FAILURE;
+  }
+
+  static struct RLSession *sessions[SESSIONS], *more[SESSIONS];
+  static struct Usage usage[SESSIONS], more_usage[SESSIONS];
+
+  size_t rss_start = rss();
+
+  for (int i = 0; i < SESSIONS; ++i) {
+    sessions[i] = rl_session_init(fds[0], out, 0, count_alloc, &usage[i]);
+    if (sessions[i] == NULL) {
+      fputs("failed to allocate session\n", stderr);
+      return EXIT_FAILURE;
+    }
+    type_lines(fds[1], sessions[i], i);
+  }
+
+  printf("%d sessions, %d lines of history each, 1 in %d still typing\n\n",
+         SESSIONS, HISTORY_LINES, ACTIVE_EVERY);
+  printf("%-12s %14s %14s %14s %14s\n", "", "min/session", "mean/session",
+         "max/session", "RSS/session");
+
+  report("typing", usage);
+  size_t before = rss();
+
+  for (int i = 0; i < SESSIONS; ++i) {
+    if (i % ACTIVE_EVERY != 0) {
+      rl_session_compact(sessions[i]);
+    }
+  }
+
+  malloc_trim(0);
+  report("compacted", usage);
+  size_t after = rss();
+
+  for (int i = 0; i < SESSIONS; ++i) {
+    more[i] = rl_session_init(fds[0], out, 0, count_alloc, &more_usage[i]);
+    if (more[i] == NULL) {
+      fputs("failed to allocate session\n", stderr);
+      return EXIT_FAILURE;
+    }
+    type_lines(fds[1], more[i], i);
+  }
+  size_t after_more = rss();
+
+  printf("\nRSS: %zu KB at start\n"
+         "     %zu KB with %d sessions typing\n"
+         "     %zu KB once the idle ones are compacted\n"
+         "     %zu KB with %d more sessions typing (+%zu KB, vs +%zu KB for "
+         "the first ones)\n",
+         rss_start / 1024, before / 1024, SESSIONS, after / 1024,
+         after_more / 1024, SESSIONS, (after_more - after) / 1024,
+         (before - rss_start) / 1024);
+
+  for (int i = 0; i < SESSIONS; ++i) {
+    rl_session_free(sessions[i]);
+    rl_session_free(more[i]);
+  }
+  rl_cleanup();
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * types the session's history, then half a line that's left pending.
+ */
+static void type_lines(int fd, struct RLSession *session, int id) {
+  const char *line;
+  size_t len;
+
+  for (int i = 0; i <= HISTORY_LINES; ++i) {
+    char keys[128];
+    int n = i < HISTORY_LINES
+                ? snprintf(keys, sizeof(keys),
+                           "session %d ran command number %d --verbose\r", id,
+                           i)
+                : snprintf(keys, sizeof(keys), "session %d is typing", id);
+    if (write(fd, keys, n) != n) {
+      perror("failed to write keys");
+      exit(EXIT_FAILURE);
+    }
+
+    enum ReadLineResult result =
+        rl_session_try_read_line(session, "> ", &line, &len);
+    if (result != (i < HISTORY_LINES ? RL_SUCCESS : RL_PENDING)) {
+      fprintf(stderr, "session %d: unexpected result %d\n", id, result);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/*
+ * malloc(), counting what's allocated.
+ */
+static void *count_alloc(void *ctx, void *ptr, size_t old_size,
+                         size_t new_size) {
+  struct Usage *usage = ctx;
+
+  if (new_size == 0) {
+    free(ptr);
+    usage->bytes -= ptr != NULL ? old_size : 0;
+    return NULL;
+  }
+
+  void *block = realloc(ptr, new_size);
+  if (block != NULL) {
+    usage->bytes += new_size - (ptr != NULL ? old_size : 0);
+  }
+  return block;
+}
+
+static void report(const char *what, struct Usage *usage) {
+  size_t min = (size_t)-1, max = 0, total = 0;
+  for (int i = 0; i < SESSIONS; ++i) {
+    min = usage[i].bytes < min ? usage[i].bytes : min;
+    max = usage[i].bytes > max ? usage[i].bytes : max;
+    total += usage[i].bytes;
+  }
+
+  printf("%-12s %12zu B %12zu B %12zu B %12zu B\n", what, min,
+         total / SESSIONS, max, rss() / SESSIONS);
+}
+
+// the resident set size of the process, in bytes
+static size_t rss(void) {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == NULL) {
+    return 0;
+  }
+
+  size_t pages = 0, resident = 0;
+  if (fscanf(statm, "%zu %zu", &pages, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(statm);
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
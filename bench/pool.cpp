@@ -0,0 +1,234 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>  // for open()
+#include <time.h>   // for clock_gettime()
+#include <unistd.h> // for pipe(), write(), close()
+
+#include "../src/pool.hpp"
+
+/*
+ * The evaluator pool, both ways it's meant to be used. Prints one
+ * "<name> <seconds>" line per case, which is what bin/bench reads:
+ *
+ * - pool/sessions-1K: sessions on one executor, like bench/coro.cpp, with
+ *   every line evaluated on the pool.
+ * - pool/light-behind-heavy: how long a session with a few cheap lines waits
+ *   while heavy sessions have lots of expensive lines queued. with sessions
+ *   taking turns, it's about one expensive line per heavy session for each
+ *   cheap one, instead of all of them.
+ */
+
+#define SESSIONS 1000
+#define LINES_PER_SESSION 10
+
+#define HEAVY_SESSIONS 8
+#define HEAVY_TASKS 200
+#define LIGHT_TASKS 50
+
+// how many rounds of hashing an expensive line takes
+#define HEAVY_ROUNDS 2000
+#define LIGHT_ROUNDS 20
+
+static double serve(rl::EvalPool &pool);
+static rl::Task session_task(rl::Executor &executor, rl::EvalPool &pool, int fd,
+                             int out, std::pmr::memory_resource *resource,
+                             size_t *num_lines);
+static rl::Task feeder_task(rl::Executor &executor, std::vector<int> &writers);
+static double light_behind_heavy(rl::EvalPool &pool);
+static uint64_t eval(const char *line, size_t len, int rounds);
+static double now(void);
+
+int main(void) {
+  rl::EvalPool pool;
+
+  printf("pool/sessions-1K %.9f\n", serve(pool));
+  printf("pool/light-behind-heavy %.9f\n", light_behind_heavy(pool));
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * runs the sessions until their input ends & returns how long it took, in
+ * seconds.
+ */
+static double serve(rl::EvalPool &pool) {
+  int out = open("/dev/null", O_WRONLY);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<int> readers, writers;
+  for (size_t i = 0; i < SESSIONS; ++i) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+      perror("failed to create pipe");
+      exit(EXIT_FAILURE);
+    }
+    readers.push_back(fds[0]);
+    writers.push_back(fds[1]);
+  }
+
+  size_t num_lines = 0;
+  std::pmr::unsynchronized_pool_resource resource;
+
+  double start = now();
+  {
+    rl::Executor executor;
+    for (int fd : readers) {
+      executor.spawn(
+          session_task(executor, pool, fd, out, &resource, &num_lines));
+    }
+    executor.spawn(feeder_task(executor, writers));
+    executor.run();
+  }
+  double elapsed = now() - start;
+
+  rl_cleanup();
+  close(out);
+
+  if (num_lines != SESSIONS * LINES_PER_SESSION) {
+    fprintf(stderr, "evaluated %zu lines, expected %d\n", num_lines,
+            SESSIONS * LINES_PER_SESSION);
+    exit(EXIT_FAILURE);
+  }
+
+  return elapsed;
+}
+
+/*
+ * a session evaluating the lines it reads on the pool, until its input ends.
+ */
+static rl::Task session_task(rl::Executor &executor, rl::EvalPool &pool, int fd,
+                             int out, std::pmr::memory_resource *resource,
+                             size_t *num_lines) {
+  {
+    rl::AsyncSession session(executor, fd, out, 1024, resource);
+    rl::EvalQueue queue(executor, pool);
+
+    while (auto result = co_await session.read_line("> ")) {
+      uint64_t hash = 0;
+      co_await queue.eval([&](rl::CancelToken) {
+        hash = eval(result.line.data(), result.line.size(), LIGHT_ROUNDS);
+      });
+      *num_lines += hash != 0;
+    }
+  }
+
+  close(fd);
+}
+
+/*
+ * types a line into every session each round, letting the sessions catch up
+ * in between, then ends their input.
+ */
+static rl::Task feeder_task(rl::Executor &executor, std::vector<int> &writers) {
+  char line[64];
+
+  for (int round = 0; round < LINES_PER_SESSION; ++round) {
+    for (size_t i = 0; i < writers.size(); ++i) {
+      int len = snprintf(line, sizeof(line), "session %zu says %d\r", i, round);
+      if (write(writers[i], line, len) != len) {
+        perror("failed to write to session");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    co_await executor.yield();
+  }
+
+  for (int fd : writers) {
+    close(fd);
+  }
+}
+
+struct Light {
+  std::mutex lock;
+  std::condition_variable done_cond;
+  int num_done = 0;
+};
+
+static const char line[] = "an expensive line to evaluate";
+
+// so the heavy & light lines' hashes aren't optimized away
+static std::atomic<uint64_t> sink;
+
+/*
+ * queues up the heavy sessions' lines, then the light session's, & returns
+ * how long it took for the light session's to be done, in seconds.
+ */
+static double light_behind_heavy(rl::EvalPool &pool) {
+  std::vector<PoolSession *> heavy;
+  for (int i = 0; i < HEAVY_SESSIONS; ++i) {
+    heavy.push_back(pool_session_init(pool.get()));
+  }
+  PoolSession *light_session = pool_session_init(pool.get());
+
+  auto heavy_fn = [](PoolTask *, void *) {
+    sink += eval(line, sizeof(line) - 1, HEAVY_ROUNDS);
+  };
+  auto light_fn = [](PoolTask *, void *) {
+    sink += eval(line, sizeof(line) - 1, LIGHT_ROUNDS);
+  };
+  auto light_done = [](void *arg, bool) {
+    auto *light = static_cast<Light *>(arg);
+    std::lock_guard<std::mutex> lock(light->lock);
+    if (++light->num_done == LIGHT_TASKS) {
+      light->done_cond.notify_one();
+    }
+  };
+
+  for (int task = 0; task < HEAVY_TASKS; ++task) {
+    for (PoolSession *session : heavy) {
+      pool_submit(session, heavy_fn, nullptr, nullptr);
+    }
+  }
+
+  Light light;
+  double start = now();
+  for (int task = 0; task < LIGHT_TASKS; ++task) {
+    pool_submit(light_session, light_fn, light_done, &light);
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(light.lock);
+    light.done_cond.wait(lock, [&] { return light.num_done == LIGHT_TASKS; });
+  }
+  double elapsed = now() - start;
+
+  // the heavy sessions' leftovers are dropped, not run
+  for (PoolSession *session : heavy) {
+    pool_session_free(session);
+  }
+  pool_session_free(light_session);
+
+  return elapsed;
+}
+
+/*
+ * stands in for an expensive evaluator: hashes the line over & over.
+ */
+static uint64_t eval(const char *line, size_t len, int rounds) {
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+  for (int round = 0; round < rounds; ++round) {
+    for (size_t i = 0; i < len; ++i) {
+      hash = (hash ^ (unsigned char)line[i]) * 1099511628211ULL;
+    }
+  }
+
+  return hash;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,390 @@
+#define _GNU_SOURCE // for accept4(), mkdtemp()
+
+#include <errno.h>
+#include <poll.h>    // for poll()
+#include <pthread.h> // for pthread_create(), pthread_join()
+#include <pty.h>     // for openpty()
+#include <signal.h>  // for kill(), signal()
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h> // for socket(), bind(), listen(), accept(), connect()
+#include <sys/un.h>     // for struct sockaddr_un
+#include <sys/wait.h>   // for waitpid()
+#include <time.h>       // for clock_gettime(), nanosleep()
+#include <unistd.h>     // for fork(), execl(), read(), write()
+
+/*
+ * How long it takes a key typed into bin/repl-client to show up on its
+ * terminal, when bin/repl-server is a round trip away: a proxy thread between
+ * them holds everything it forwards for LINK_DELAY_MS each way, & the client
+ * runs in a pseudo terminal, where keys are typed KEY_INTERVAL_MS apart, with
+ * its local echo on & then off (REPL_PREDICT=0).
+ *
+ * Every key is a letter that's typed only once, & that doesn't show up in
+ * the prompt or in any of the escape sequences the client draws with, so the
+ * first time it shows up in the terminal's output is its echo. It's not timed
+ * by bin/bench, since it's mostly sleeping: `make bench-remote` runs it.
+ */
+
+#define LINK_DELAY_MS 50
+#define KEY_INTERVAL_MS 40
+
+#define KEYS "abcdefghijklnopqrstuvwxyzBDEFGILMNOPQRST"
+#define NUM_KEYS (sizeof(KEYS) - 1)
+
+#define MAX_PENDING 4096
+
+// something a proxy holds until it's due
+struct Chunk {
+  double due;
+  int to;
+  size_t len;
+  char data[512];
+};
+
+struct Proxy {
+  int listener;
+  const char *server_path;
+
+  struct Chunk pending[MAX_PENDING];
+  size_t head, tail;
+
+  size_t from_server; // bytes the server sent the client
+};
+
+static void run(const char *client, const char *server_path,
+                const char *proxy_path, bool predict);
+static void *proxy_thread(void *arg);
+static size_t hold(struct Proxy *proxy, int from, int to);
+static int listen_on(const char *path);
+static int connect_to(const char *path);
+static void report(const char *what, double *latencies, size_t count,
+                   size_t bytes);
+static int compare_doubles(const void *a, const void *b);
+static double now(void);
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  // bin/bench-remote runs bin/repl-server & bin/repl-client next to it
+  char server[4096], client[4096];
+  const char *slash = strrchr(argv[0], '/');
+  int dir_len = slash != NULL ? (int)(slash - argv[0]) : 1;
+  const char *dir = slash != NULL ? argv[0] : ".";
+  snprintf(server, sizeof(server), "%.*s/repl-server", dir_len, dir);
+  snprintf(client, sizeof(client), "%.*s/repl-client", dir_len, dir);
+
+  // the proxy writes to the client after it's gone
+  signal(SIGPIPE, SIG_IGN);
+
+  char tmp[] = "/tmp/bench-remote-XXXXXX";
+  if (mkdtemp(tmp) == NULL) {
+    perror("failed to create temporary directory");
+    return EXIT_FAILURE;
+  }
+
+  char server_path[64], proxy_path[64];
+  snprintf(server_path, sizeof(server_path), "%s/server.sock", tmp);
+  snprintf(proxy_path, sizeof(proxy_path), "%s/proxy.sock", tmp);
+
+  pid_t server_pid = fork();
+  if (server_pid == -1) {
+    perror("failed to fork");
+    return EXIT_FAILURE;
+  }
+  if (server_pid == 0) {
+    execl(server, server, server_path, (char *)NULL);
+    perror("failed to run bin/repl-server");
+    _exit(EXIT_FAILURE);
+  }
+
+  // wait for the server to listen
+  for (int tries = 0;; ++tries) {
+    int fd = connect_to(server_path);
+    if (fd != -1) {
+      close(fd);
+      break;
+    }
+    if (tries == 100) {
+      fputs("bin/repl-server didn't start\n", stderr);
+      return EXIT_FAILURE;
+    }
+    nanosleep(&(struct timespec){.tv_nsec = 10 * 1000 * 1000}, NULL);
+  }
+
+  printf("%zu keys typed %d ms apart, %d ms round trip\n\n", NUM_KEYS,
+         KEY_INTERVAL_MS, 2 * LINK_DELAY_MS);
+  printf("%-18s %10s %10s %10s %12s\n", "key to echo", "p50", "p99", "max",
+         "server B/key");
+
+  run(client, server_path, proxy_path, true);
+  run(client, server_path, proxy_path, false);
+
+  kill(server_pid, SIGTERM);
+  waitpid(server_pid, NULL, 0);
+
+  unlink(server_path);
+  unlink(proxy_path);
+  rmdir(tmp);
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * types the keys into a client through the proxy, & reports how long they
+ * took to show up.
+ */
+static void run(const char *client, const char *server_path,
+                const char *proxy_path, bool predict) {
+  static struct Proxy proxy;
+  proxy.listener = listen_on(proxy_path);
+  proxy.server_path = server_path;
+  proxy.head = proxy.tail = 0;
+  proxy.from_server = 0;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, proxy_thread, &proxy) != 0) {
+    fputs("failed to start proxy\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  int master, slave;
+  struct winsize size = {.ws_row = 24, .ws_col = 80};
+  if (openpty(&master, &slave, NULL, NULL, &size) == -1) {
+    perror("failed to open pseudo terminal");
+    exit(EXIT_FAILURE);
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("failed to fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(master);
+    setsid();
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    close(slave);
+    setenv("REPL_PREDICT", predict ? "1" : "0", 1);
+    execl(client, client, proxy_path, (char *)NULL);
+    perror("failed to run bin/repl-client");
+    _exit(EXIT_FAILURE);
+  }
+  close(slave);
+
+  double sent[NUM_KEYS], latencies[NUM_KEYS];
+  size_t num_sent = 0, num_echoed = 0;
+  bool echoed[NUM_KEYS] = {false};
+  bool prompted = false;
+  double next_key = 0;
+
+  while (num_echoed < NUM_KEYS) {
+    double t = now();
+    if (prompted && num_sent < NUM_KEYS && t >= next_key) {
+      if (write(master, &KEYS[num_sent], 1) != 1) {
+        perror("failed to type key");
+        exit(EXIT_FAILURE);
+      }
+      sent[num_sent++] = t;
+      next_key = t + KEY_INTERVAL_MS / 1000.0;
+    }
+
+    int timeout = num_sent < NUM_KEYS && prompted
+                      ? (int)((next_key - now()) * 1000) + 1
+                      : 1000;
+    struct pollfd pfd = {.fd = master, .events = POLLIN};
+    int n = poll(&pfd, 1, timeout < 0 ? 0 : timeout);
+    if (n == 0 && !prompted) {
+      fputs("bin/repl-client didn't draw its prompt\n", stderr);
+      exit(EXIT_FAILURE);
+    }
+    if (n <= 0) {
+      continue;
+    }
+
+    char out[4096];
+    ssize_t len = read(master, out, sizeof(out));
+    if (len <= 0) {
+      fputs("bin/repl-client exited\n", stderr);
+      exit(EXIT_FAILURE);
+    }
+
+    double received = now();
+    prompted = prompted || memchr(out, '>', len) != NULL;
+    for (ssize_t i = 0; i < len; ++i) {
+      const char *key = memchr(KEYS, out[i], num_sent);
+      if (key != NULL && !echoed[key - KEYS]) {
+        echoed[key - KEYS] = true;
+        latencies[key - KEYS] = received - sent[key - KEYS];
+        ++num_echoed;
+      }
+    }
+  }
+
+  // let the server's last lines come in, so all it sent is counted
+  for (double end = now() + 3 * LINK_DELAY_MS / 1000.0; now() < end;) {
+    struct pollfd pfd = {.fd = master, .events = POLLIN};
+    char out[4096];
+    if (poll(&pfd, 1, (int)((end - now()) * 1000) + 1) == 1 &&
+        read(master, out, sizeof(out)) <= 0) {
+      break;
+    }
+  }
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  close(master);
+
+  // the proxy stops once the client is gone
+  pthread_join(thread, NULL);
+  close(proxy.listener);
+  unlink(proxy_path);
+
+  report(predict ? "local echo" : "no local echo", latencies, NUM_KEYS,
+         proxy.from_server);
+}
+
+/*
+ * forwards one connection to the server & back, each way LINK_DELAY_MS late,
+ * until the client closes it.
+ */
+static void *proxy_thread(void *arg) {
+  struct Proxy *proxy = arg;
+
+  int client = accept(proxy->listener, NULL, NULL);
+  int server = connect_to(proxy->server_path);
+  if (client == -1 || server == -1) {
+    perror("proxy failed to connect");
+    exit(EXIT_FAILURE);
+  }
+
+  bool open = true;
+  while (open || proxy->head != proxy->tail) {
+    double t = now();
+
+    // send what's due
+    while (proxy->head != proxy->tail &&
+           proxy->pending[proxy->head].due <= t) {
+      struct Chunk *chunk = &proxy->pending[proxy->head];
+      if (write(chunk->to, chunk->data, chunk->len) != (ssize_t)chunk->len) {
+        open = false;
+      }
+      proxy->head = (proxy->head + 1) % MAX_PENDING;
+    }
+
+    int timeout = -1;
+    if (proxy->head != proxy->tail) {
+      timeout = (int)((proxy->pending[proxy->head].due - t) * 1000) + 1;
+    }
+    if (!open) {
+      if (timeout == -1) {
+        break;
+      }
+      nanosleep(&(struct timespec){.tv_nsec = timeout * 1000 * 1000}, NULL);
+      continue;
+    }
+
+    struct pollfd fds[2] = {
+        {.fd = client, .events = POLLIN},
+        {.fd = server, .events = POLLIN},
+    };
+    if (poll(fds, 2, timeout) == -1 && errno != EINTR) {
+      perror("proxy failed to poll");
+      exit(EXIT_FAILURE);
+    }
+
+    if (fds[0].revents != 0) {
+      hold(proxy, client, server);
+    }
+    if (fds[1].revents != 0) {
+      proxy->from_server += hold(proxy, server, client);
+    }
+
+    // the client closing its end is the end of the run
+    if (fds[0].revents & (POLLHUP | POLLERR)) {
+      open = false;
+    }
+  }
+
+  close(client);
+  close(server);
+
+  return NULL;
+}
+
+// reads what `from` sent, to send it to `to` once it's due. returns how
+// many bytes that was.
+static size_t hold(struct Proxy *proxy, int from, int to) {
+  struct Chunk *chunk = &proxy->pending[proxy->tail];
+
+  ssize_t n = read(from, chunk->data, sizeof(chunk->data));
+  if (n <= 0) {
+    return 0;
+  }
+
+  chunk->due = now() + LINK_DELAY_MS / 1000.0;
+  chunk->to = to;
+  chunk->len = n;
+
+  proxy->tail = (proxy->tail + 1) % MAX_PENDING;
+  if (proxy->tail == proxy->head) {
+    fputs("proxy holds too much\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  return n;
+}
+
+static int listen_on(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(fd, 1) == -1) {
+    perror("failed to listen on proxy socket");
+    exit(EXIT_FAILURE);
+  }
+
+  return fd;
+}
+
+static int connect_to(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd != -1 &&
+      connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static void report(const char *what, double *latencies, size_t count,
+                   size_t bytes) {
+  qsort(latencies, count, sizeof(double), compare_doubles);
+
+  printf("%-18s %7.2f ms %7.2f ms %7.2f ms %12.1f\n", what,
+         latencies[count / 2] * 1000, latencies[count * 99 / 100] * 1000,
+         latencies[count - 1] * 1000, (double)bytes / count);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,673 @@
+#include <ctype.h> // for isspace()
+#include <math.h>  // for sqrt(), fabs()
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for strcmp(), memcpy()
+
+#include "../src/vector.h"
+
+/*
+ * Runs every benchmark program a number of times, compares the results with
+ * the baseline, and reports which ones got slower (or faster) by more than
+ * the noise.
+ *
+ * A benchmark program prints one "<name> <seconds>" line per case. Each run
+ * of the program gives every case one sample, & it's run again until the
+ * mean of every case is known to within TARGET_ERROR (or MAX_REPS runs, on a
+ * very noisy machine). The noise threshold of a case
+ * comes from the spread of its samples & of the baseline's: a change is only
+ * flagged if it's more than NOISE_SIGMAS standard errors (and at least
+ * MIN_CHANGE) away from the baseline.
+ *
+ * usage: bench [--update [NAME...]] [--reps N]
+ *
+ *   --update  add the cases the baseline doesn't have yet to it, instead of
+ *             comparing. the cases it has are kept as they are, unless they're
+ *             named after --update, in which case they're re-recorded.
+ *   --reps N  run each program at least N times (default 10)
+ */
+
+#define BASELINE_PATH "bench/baseline.json"
+#define BASELINE_VERSION 1
+#define REPORT_PATH "bench_output.txt"
+
+#define DEFAULT_REPS 10
+#define MAX_REPS 50
+#define TARGET_ERROR 0.02
+#define NOISE_SIGMAS 3.0
+#define MIN_CHANGE 0.01
+
+#define NAME_LEN 64
+
+// the benchmark programs. `make bench` builds them.
+static const char *programs[] = {
+    "./bin/bench-edit",
+    "./bin/bench-session",
+    "./bin/bench-coro",
+    "./bin/bench-batch",
+    "./bin/bench-pool",
+    "./bin/bench-timer",
+    "./bin/bench-command",
+    "./bin/bench-startup",
+};
+
+struct Case {
+  char name[NAME_LEN];
+
+  struct Vector *samples; // double, in seconds
+
+  // from the samples, or read from the baseline
+  double mean;
+  double stddev;
+  size_t reps;
+};
+
+enum Verdict {
+  VERDICT_SAME,
+  VERDICT_FASTER,
+  VERDICT_SLOWER,
+  VERDICT_NEW,
+  VERDICT_MISSING,
+};
+
+static bool run_program(const char *program, struct Vector *cases);
+static struct Case *find_case(struct Vector *cases, const char *name);
+static void compute_stats(struct Case *c);
+static bool is_stable(struct Vector *cases, size_t first);
+static enum Verdict compare(const struct Case *base, const struct Case *cur,
+                            double *change, double *noise);
+
+static bool read_baseline(const char *path, struct Vector *cases);
+static bool write_baseline(const char *path, struct Vector *cases);
+static bool update_baseline(const char *path, struct Vector *current,
+                            char **names, size_t num_names);
+
+static void skip_space(const char **p);
+static bool expect(const char **p, char c);
+static bool parse_string(const char **p, char *out, size_t size);
+static bool parse_number(const char **p, double *out);
+static bool skip_value(const char **p);
+
+static void free_cases(struct Vector *cases);
+static void format_time(char *buf, size_t size, double seconds);
+
+int main(int argc, char **argv) {
+  bool update = false;
+  long reps = DEFAULT_REPS;
+
+  // the cases --update re-records, which are in `argv`
+  char **names = NULL;
+  size_t num_names = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--update") == 0) {
+      update = true;
+      names = &argv[i + 1];
+      while (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+        ++num_names;
+        ++i;
+      }
+    } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+      reps = strtol(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [--update [NAME...]] [--reps N]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (reps < 2) {
+    fprintf(stderr, "--reps must be at least 2\n");
+    return EXIT_FAILURE;
+  }
+
+  struct Vector *current = vector_init(sizeof(struct Case), 0);
+  struct Vector *baseline = vector_init(sizeof(struct Case), 0);
+  if (current == NULL || baseline == NULL) {
+    fprintf(stderr, "failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  size_t num_programs = sizeof(programs) / sizeof(programs[0]);
+  for (size_t i = 0; i < num_programs; ++i) {
+    // a program's cases are all its own, so they come after the ones before
+    size_t first = vector_length(current);
+
+    long rep = 0;
+    while (rep < reps || (rep < MAX_REPS && !is_stable(current, first))) {
+      ++rep;
+      fprintf(stderr, "\r%s: run %ld", programs[i], rep);
+      if (!run_program(programs[i], current)) {
+        fprintf(stderr, "\n%s failed\n", programs[i]);
+        return EXIT_FAILURE;
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+
+  is_stable(current, 0);
+
+  if (update) {
+    bool ok = update_baseline(BASELINE_PATH, current, names, num_names);
+    free_cases(current);
+    free_cases(baseline);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (!read_baseline(BASELINE_PATH, baseline)) {
+    fprintf(stderr,
+            "failed to read %s, run `make bench-baseline` to create it\n",
+            BASELINE_PATH);
+    return EXIT_FAILURE;
+  }
+
+  FILE *report = fopen(REPORT_PATH, "w");
+  if (report == NULL) {
+    perror("failed to open " REPORT_PATH);
+    return EXIT_FAILURE;
+  }
+
+  char header[160];
+  snprintf(header, sizeof(header), "%-28s %18s %18s %8s %7s  %s\n",
+           "benchmark", "baseline", "current", "change", "noise", "verdict");
+  fputs(header, stdout);
+  fputs(header, report);
+
+  size_t slower = 0;
+
+  // everything that was run, in order, then whatever the baseline has that
+  // wasn't
+  size_t num_rows = vector_length(current) + vector_length(baseline);
+  for (size_t i = 0; i < num_rows; ++i) {
+    struct Case *cur = NULL;
+    struct Case *base = NULL;
+    if (i < vector_length(current)) {
+      cur = vector_get(current, i);
+      base = find_case(baseline, cur->name);
+    } else {
+      base = vector_get(baseline, i - vector_length(current));
+      if (find_case(current, base->name) != NULL) {
+        continue;
+      }
+    }
+
+    double change = 0, noise = 0;
+    enum Verdict verdict = compare(base, cur, &change, &noise);
+
+    // times are the mean of the samples, with their standard deviation
+    char base_time[32] = "-", cur_time[32] = "-";
+    char change_str[16] = "", noise_str[16] = "";
+    if (base != NULL) {
+      char t[16];
+      format_time(t, sizeof(t), base->mean);
+      snprintf(base_time, sizeof(base_time), "%s (%.1f%%)", t,
+               100 * base->stddev / base->mean);
+    }
+    if (cur != NULL) {
+      char t[16];
+      format_time(t, sizeof(t), cur->mean);
+      snprintf(cur_time, sizeof(cur_time), "%s (%.1f%%)", t,
+               100 * cur->stddev / cur->mean);
+    }
+    if (base != NULL && cur != NULL) {
+      snprintf(change_str, sizeof(change_str), "%+.1f%%", 100 * change);
+      snprintf(noise_str, sizeof(noise_str), "%.1f%%", 100 * noise);
+    }
+
+    static const char *verdicts[] = {
+        [VERDICT_SAME] = "same",       [VERDICT_FASTER] = "faster",
+        [VERDICT_SLOWER] = "SLOWER",   [VERDICT_NEW] = "new",
+        [VERDICT_MISSING] = "missing",
+    };
+
+    char row[256];
+    snprintf(row, sizeof(row), "%-28s %18s %18s %8s %7s  %s\n",
+             base != NULL ? base->name : cur->name, base_time, cur_time,
+             change_str, noise_str, verdicts[verdict]);
+    fputs(row, stdout);
+    fputs(row, report);
+
+    if (verdict == VERDICT_SLOWER) {
+      ++slower;
+    }
+  }
+
+  char summary[128];
+  if (slower > 0) {
+    snprintf(summary, sizeof(summary), "\n%zu benchmark%s got slower\n",
+             slower, slower == 1 ? "" : "s");
+  } else {
+    snprintf(summary, sizeof(summary), "\nno regressions\n");
+  }
+  fputs(summary, stdout);
+  fputs(summary, report);
+
+  fclose(report);
+  free_cases(current);
+  free_cases(baseline);
+
+  return slower > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * runs a benchmark program once & adds a sample to each case it prints.
+ */
+static bool run_program(const char *program, struct Vector *cases) {
+  FILE *out = popen(program, "r");
+  if (out == NULL) {
+    return false;
+  }
+
+  bool ok = true;
+  char line[256];
+  while (fgets(line, sizeof(line), out) != NULL) {
+    char name[NAME_LEN];
+    double seconds;
+    if (sscanf(line, "%63s %lf", name, &seconds) != 2) {
+      continue;
+    }
+
+    struct Case *c = find_case(cases, name);
+    if (c == NULL) {
+      struct Case new_case = {.samples = vector_init(sizeof(double), 0)};
+      memcpy(new_case.name, name, sizeof(name));
+      if (new_case.samples == NULL || !vector_push(cases, &new_case)) {
+        ok = false;
+        break;
+      }
+      c = vector_get(cases, vector_length(cases) - 1);
+    }
+
+    if (!vector_push(c->samples, &seconds)) {
+      ok = false;
+      break;
+    }
+  }
+
+  return pclose(out) == 0 && ok;
+}
+
+static struct Case *find_case(struct Vector *cases, const char *name) {
+  for (size_t i = 0; i < vector_length(cases); ++i) {
+    struct Case *c = vector_get(cases, i);
+    if (strcmp(c->name, name) == 0) {
+      return c;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * computes the stats of the cases from `first` on, & returns whether all their
+ * means are known to within TARGET_ERROR (one standard error).
+ */
+static bool is_stable(struct Vector *cases, size_t first) {
+  bool stable = true;
+
+  for (size_t i = first; i < vector_length(cases); ++i) {
+    struct Case *c = vector_get(cases, i);
+    compute_stats(c);
+
+    double error = c->stddev / sqrt(c->reps);
+    stable = stable && error <= TARGET_ERROR * c->mean;
+  }
+
+  return stable;
+}
+
+static void compute_stats(struct Case *c) {
+  size_t n = vector_length(c->samples);
+  double *samples = vector_data(c->samples);
+
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += samples[i];
+  }
+  c->mean = sum / n;
+
+  double squares = 0;
+  for (size_t i = 0; i < n; ++i) {
+    squares += (samples[i] - c->mean) * (samples[i] - c->mean);
+  }
+  c->stddev = n > 1 ? sqrt(squares / (n - 1)) : 0;
+  c->reps = n;
+}
+
+/*
+ * compares a case with its baseline. `change` is set to the relative change
+ * of the mean, & `noise` to the smallest relative change that counts, which
+ * is NOISE_SIGMAS standard errors of the difference of the means (or
+ * MIN_CHANGE if that's bigger).
+ */
+static enum Verdict compare(const struct Case *base, const struct Case *cur,
+                            double *change, double *noise) {
+  if (base == NULL) {
+    return VERDICT_NEW;
+  }
+  if (cur == NULL) {
+    return VERDICT_MISSING;
+  }
+
+  double stderr_diff = sqrt(base->stddev * base->stddev / base->reps +
+                            cur->stddev * cur->stddev / cur->reps);
+
+  *change = (cur->mean - base->mean) / base->mean;
+  *noise = NOISE_SIGMAS * stderr_diff / base->mean;
+  if (*noise < MIN_CHANGE) {
+    *noise = MIN_CHANGE;
+  }
+
+  if (fabs(*change) <= *noise) {
+    return VERDICT_SAME;
+  }
+
+  return *change > 0 ? VERDICT_SLOWER : VERDICT_FASTER;
+}
+
+/*
+ * reads a baseline written by `write_baseline`:
+ *
+ *   {
+ *     "version": 1,
+ *     "benchmarks": {
+ *       "<name>": {"mean": <seconds>, "stddev": <seconds>, "reps": <n>},
+ *       ...
+ *     }
+ *   }
+ *
+ * keys it doesn't know are skipped. a different version is an error.
+ */
+static bool read_baseline(const char *path, struct Vector *cases) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char *json = malloc(size + 1);
+  if (json == NULL || fread(json, 1, size, file) != (size_t)size) {
+    free(json);
+    fclose(file);
+    return false;
+  }
+  json[size] = '\0';
+  fclose(file);
+
+  const char *p = json;
+  double version = 0;
+  bool ok = expect(&p, '{');
+
+  while (ok && !expect(&p, '}')) {
+    char key[NAME_LEN];
+    ok = parse_string(&p, key, sizeof(key)) && expect(&p, ':');
+    if (!ok) {
+      break;
+    }
+
+    if (strcmp(key, "version") == 0) {
+      ok = parse_number(&p, &version);
+    } else if (strcmp(key, "benchmarks") == 0) {
+      ok = expect(&p, '{');
+      while (ok && !expect(&p, '}')) {
+        struct Case c = {0};
+        double reps = 0;
+        ok = parse_string(&p, c.name, sizeof(c.name)) && expect(&p, ':') &&
+             expect(&p, '{');
+
+        while (ok && !expect(&p, '}')) {
+          char field[NAME_LEN];
+          ok = parse_string(&p, field, sizeof(field)) && expect(&p, ':');
+          if (!ok) {
+            break;
+          }
+
+          if (strcmp(field, "mean") == 0) {
+            ok = parse_number(&p, &c.mean);
+          } else if (strcmp(field, "stddev") == 0) {
+            ok = parse_number(&p, &c.stddev);
+          } else if (strcmp(field, "reps") == 0) {
+            ok = parse_number(&p, &reps);
+          } else {
+            ok = skip_value(&p);
+          }
+          expect(&p, ',');
+        }
+
+        c.reps = reps;
+        ok = ok && c.mean > 0 && c.reps > 0 && vector_push(cases, &c);
+        expect(&p, ',');
+      }
+    } else {
+      ok = skip_value(&p);
+    }
+    expect(&p, ',');
+  }
+
+  free(json);
+
+  if (ok && version != BASELINE_VERSION) {
+    fprintf(stderr, "%s is version %g, expected %d\n", path, version,
+            BASELINE_VERSION);
+    ok = false;
+  }
+
+  return ok;
+}
+
+static bool write_baseline(const char *path, struct Vector *cases) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+
+  fprintf(file, "{\n  \"version\": %d,\n  \"benchmarks\": {\n",
+          BASELINE_VERSION);
+
+  for (size_t i = 0; i < vector_length(cases); ++i) {
+    struct Case *c = vector_get(cases, i);
+    fprintf(file,
+            "    \"%s\": {\"mean\": %.9f, \"stddev\": %.9f, \"reps\": %zu}%s\n",
+            c->name, c->mean, c->stddev, c->reps,
+            i + 1 < vector_length(cases) ? "," : "");
+  }
+
+  fprintf(file, "  }\n}\n");
+
+  return fclose(file) == 0;
+}
+
+/*
+ * adds the cases that were run but aren't in the baseline to it, & re-records
+ * the ones in `names`. the rest of the baseline is kept as it is, so a case
+ * that got slower since isn't folded in by recording a new one. a missing
+ * baseline is created from all of the cases.
+ */
+static bool update_baseline(const char *path, struct Vector *current,
+                            char **names, size_t num_names) {
+  struct Vector *baseline = vector_init(sizeof(struct Case), 0);
+  struct Vector *merged = vector_init(sizeof(struct Case), 0);
+  if (baseline == NULL || merged == NULL) {
+    fprintf(stderr, "failed to allocate memory\n");
+    return false;
+  }
+
+  FILE *existing = fopen(path, "r");
+  if (existing != NULL) {
+    fclose(existing);
+    if (!read_baseline(path, baseline)) {
+      fprintf(stderr, "failed to read %s\n", path);
+      free_cases(baseline);
+      vector_free(merged);
+      return false;
+    }
+  }
+
+  size_t added = 0, refreshed = 0;
+  bool ok = true;
+
+  // in the order they were run, then whatever the baseline has that wasn't
+  for (size_t i = 0; ok && i < vector_length(current); ++i) {
+    struct Case *cur = vector_get(current, i);
+    struct Case *base = find_case(baseline, cur->name);
+
+    bool named = false;
+    for (size_t j = 0; j < num_names; ++j) {
+      named = named || strcmp(names[j], cur->name) == 0;
+    }
+
+    struct Case c = base != NULL && !named ? *base : *cur;
+    c.samples = NULL; // owned by `current`
+    added += base == NULL;
+    refreshed += base != NULL && named;
+    ok = vector_push(merged, &c);
+  }
+  for (size_t i = 0; ok && i < vector_length(baseline); ++i) {
+    struct Case *base = vector_get(baseline, i);
+    if (find_case(current, base->name) == NULL) {
+      ok = vector_push(merged, base);
+    }
+  }
+
+  for (size_t i = 0; i < num_names; ++i) {
+    if (find_case(current, names[i]) == NULL) {
+      fprintf(stderr, "no benchmark is called %s\n", names[i]);
+      ok = false;
+    }
+  }
+
+  if (ok && !write_baseline(path, merged)) {
+    fprintf(stderr, "failed to write %s\n", path);
+    ok = false;
+  }
+  if (ok) {
+    printf("added %zu & re-recorded %zu results in %s\n", added, refreshed,
+           path);
+  }
+
+  free_cases(baseline);
+  free_cases(merged);
+  return ok;
+}
+
+// ----- a small JSON reader, just enough for the baseline ----- //
+
+static void skip_space(const char **p) {
+  while (isspace((unsigned char)**p)) {
+    ++*p;
+  }
+}
+
+/*
+ * skips `c` (& the space before it) if it's next, & returns whether it was.
+ */
+static bool expect(const char **p, char c) {
+  skip_space(p);
+  if (**p != c) {
+    return false;
+  }
+
+  ++*p;
+  return true;
+}
+
+/*
+ * names are plain, so escapes are kept as they are.
+ */
+static bool parse_string(const char **p, char *out, size_t size) {
+  if (!expect(p, '"')) {
+    return false;
+  }
+
+  size_t len = 0;
+  while (**p != '"') {
+    if (**p == '\0' || len == size - 1) {
+      return false;
+    }
+    if (**p == '\\' && (*p)[1] != '\0') {
+      out[len++] = *(*p)++;
+      if (len == size - 1) {
+        return false;
+      }
+    }
+    out[len++] = *(*p)++;
+  }
+
+  out[len] = '\0';
+  ++*p;
+  return true;
+}
+
+static bool parse_number(const char **p, double *out) {
+  skip_space(p);
+
+  char *end;
+  *out = strtod(*p, &end);
+  if (end == *p) {
+    return false;
+  }
+
+  *p = end;
+  return true;
+}
+
+static bool skip_value(const char **p) {
+  skip_space(p);
+
+  if (**p == '"') {
+    char buf[4096];
+    return parse_string(p, buf, sizeof(buf));
+  }
+
+  if (**p == '{' || **p == '[') {
+    char close = **p == '{' ? '}' : ']';
+    ++*p;
+    while (!expect(p, close)) {
+      if (close == '}') {
+        char key[4096];
+        if (!parse_string(p, key, sizeof(key)) || !expect(p, ':')) {
+          return false;
+        }
+      }
+      if (!skip_value(p)) {
+        return false;
+      }
+      expect(p, ',');
+    }
+    return true;
+  }
+
+  // true, false, null & numbers
+  const char *start = *p;
+  while (**p != '\0' && **p != ',' && **p != '}' && **p != ']' &&
+         !isspace((unsigned char)**p)) {
+    ++*p;
+  }
+  return *p != start;
+}
+
+static void free_cases(struct Vector *cases) {
+  for (size_t i = 0; i < vector_length(cases); ++i) {
+    struct Case *c = vector_get(cases, i);
+    if (c->samples != NULL) {
+      vector_free(c->samples);
+    }
+  }
+
+  vector_free(cases);
+}
+
+static void format_time(char *buf, size_t size, double seconds) {
+  if (seconds < 1e-3) {
+    snprintf(buf, size, "%.2fus", seconds * 1e6);
+  } else if (seconds < 1) {
+    snprintf(buf, size, "%.2fms", seconds * 1e3);
+  } else {
+    snprintf(buf, size, "%.2fs", seconds);
+  }
+}
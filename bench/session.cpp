@@ -0,0 +1,121 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>  // for open()
+#include <time.h>   // for clock_gettime()
+#include <unistd.h> // for write(), lseek(), unlink()
+
+#include "../src/readline.hpp"
+
+/*
+ * Reads the same lines the way a C++ caller would with `rl_read_line` (into a
+ * fixed buffer, then copied into a `std::string`) & with `rl::Session` (a
+ * `std::string_view` into the session, no copy, on a pool resource). Prints
+ * one "<name> <seconds>" line per case, which is what bin/bench reads.
+ */
+
+#define LINES 100000
+#define LINE_SIZE 4096
+
+static double copy_lines(int in, int out);
+static double view_lines(int in, int out);
+static void write_keys(int fd, const char *keys, size_t len);
+static double now(void);
+
+// keeps the compiler from dropping the lines read
+static size_t total_len;
+
+int main(void) {
+  int out = open("/dev/null", O_WRONLY);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    return EXIT_FAILURE;
+  }
+
+  char path[] = "/tmp/bench-session-XXXXXX";
+  int in = mkstemp(path);
+  if (in == -1) {
+    perror("failed to create input file");
+    return EXIT_FAILURE;
+  }
+  unlink(path);
+
+  // lines of a few dozen characters, like commands typed into a service
+  std::string keys;
+  char line[64];
+  for (int i = 0; i < LINES; ++i) {
+    int len = snprintf(line, sizeof(line), "set key-%d value-%d ttl=%d\r", i,
+                       i * 7, i % 300);
+    keys.append(line, len);
+  }
+  write_keys(in, keys.data(), keys.size());
+
+  printf("session/copy-100K %.9f\n", copy_lines(in, out));
+  printf("session/view-100K %.9f\n", view_lines(in, out));
+
+  close(in);
+  close(out);
+
+  return total_len > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * the wrapping-by-hand way: a fixed buffer, & a copy of every line.
+ */
+static double copy_lines(int in, int out) {
+  std::vector<char> buf(LINE_SIZE);
+
+  lseek(in, 0, SEEK_SET);
+  rl_set_headless(in, out);
+
+  double start = now();
+  while (rl_read_line(buf.data(), buf.size(), const_cast<char *>("> ")) ==
+         RL_SUCCESS) {
+    std::string line(buf.data());
+    total_len += line.size();
+  }
+  double elapsed = now() - start;
+
+  rl_cleanup();
+
+  return elapsed;
+}
+
+/*
+ * the session way: views into the session's history, allocated from a pool.
+ */
+static double view_lines(int in, int out) {
+  lseek(in, 0, SEEK_SET);
+
+  std::pmr::unsynchronized_pool_resource pool;
+
+  double start = now();
+  {
+    rl::Session session(in, out, LINE_SIZE - 1, &pool);
+    while (auto result = session.read_line("> ")) {
+      total_len += result.line.size();
+    }
+  }
+  double elapsed = now() - start;
+
+  rl_cleanup();
+
+  return elapsed;
+}
+
+static void write_keys(int fd, const char *keys, size_t len) {
+  if (write(fd, keys, len) != (ssize_t)len) {
+    perror("failed to write input file");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,257 @@
+#define _GNU_SOURCE // for mkdtemp(), realpath()
+
+#include <limits.h> // for PATH_MAX
+#include <poll.h>   // for poll()
+#include <pty.h>    // for openpty()
+#include <signal.h> // for kill()
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h> // for waitpid()
+#include <time.h>     // for clock_gettime()
+#include <unistd.h>   // for fork(), execl(), read(), write()
+
+/*
+ * How long bin/repl takes to start, since tools spawn one per request: it's
+ * run in a pseudo terminal that answers its cursor position queries like a
+ * terminal would, in a home directory with a ~/.replrc, RUNS times over.
+ * Prints one "<name> <seconds>" line per case, which is what bin/bench reads:
+ *
+ * - startup/first-prompt: from the fork until the first byte of the prompt,
+ *   which is whatever comes after the blank line that ends the welcome text.
+ * - startup/ready: from the fork until a key typed as soon as the prompt
+ *   shows up is drawn, i.e. until the REPL takes input.
+ *
+ * Both are averages over the runs. bin/repl is expected next to this program.
+ */
+
+#define RUNS 20
+
+// a config of a realistic size, so loading it is part of starting up
+#define CONFIG                                                                 \
+  "set editing-mode emacs\n"                                                   \
+  "set keymap emacs\n"                                                         \
+  "\"\\C-xk\": kill-whole-line\n"                                              \
+  "Control-t: backward-kill-word\n"                                            \
+  "\"\\ed\": kill-word\n"                                                      \
+  "set keymap vi-command\n"                                                    \
+  "\"zz\": kill-line\n"
+
+// what's typed once the prompt shows up. it's in neither the prompt nor the
+// escape sequences the REPL draws with, so the first one in the output is
+// its echo.
+#define KEY '#'
+
+// where the output is (see `track_cursor`)
+struct Screen {
+  unsigned row;
+  unsigned col;
+  bool in_escape;
+};
+
+static void run(const char *repl, const char *home, double *first_prompt,
+                double *ready);
+static void answer_queries(int master, const char *data, size_t len,
+                           struct Screen *screen);
+static void track_cursor(struct Screen *screen, char c);
+static void write_config(const char *home);
+static double now(void);
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  // it's run from another directory, so its path can't be relative
+  char path[4096], repl[PATH_MAX];
+  const char *slash = strrchr(argv[0], '/');
+  int dir_len = slash != NULL ? (int)(slash - argv[0]) : 1;
+  const char *dir = slash != NULL ? argv[0] : ".";
+  snprintf(path, sizeof(path), "%.*s/repl", dir_len, dir);
+  if (realpath(path, repl) == NULL) {
+    perror("failed to find bin/repl");
+    return EXIT_FAILURE;
+  }
+
+  char home[] = "/tmp/bench-startup-XXXXXX";
+  if (mkdtemp(home) == NULL) {
+    perror("failed to create home directory");
+    return EXIT_FAILURE;
+  }
+  write_config(home);
+
+  // the first run also writes the config's cache, like a previous session
+  // would have
+  double first_prompt_total = 0;
+  double ready_total = 0;
+  for (int i = 0; i <= RUNS; ++i) {
+    double first_prompt = 0, ready = 0;
+    run(repl, home, &first_prompt, &ready);
+    if (i > 0) {
+      first_prompt_total += first_prompt;
+      ready_total += ready;
+    }
+  }
+
+  printf("startup/first-prompt %.9f\n", first_prompt_total / RUNS);
+  printf("startup/ready %.9f\n", ready_total / RUNS);
+
+  char command[4200];
+  snprintf(command, sizeof(command), "rm -rf '%s'", home);
+  if (system(command) != 0) {
+    fprintf(stderr, "failed to remove %s\n", home);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * starts bin/repl once, & measures how long it takes to show its prompt &
+ * to take input, in seconds.
+ */
+static void run(const char *repl, const char *home, double *first_prompt,
+                double *ready) {
+  int master, slave;
+  struct winsize size = {.ws_row = 24, .ws_col = 80};
+  if (openpty(&master, &slave, NULL, NULL, &size) == -1) {
+    perror("failed to open pseudo terminal");
+    exit(EXIT_FAILURE);
+  }
+
+  double start = now();
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("failed to fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(master);
+    setsid();
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    dup2(slave, STDERR_FILENO);
+    close(slave);
+    if (chdir(home) == -1) {
+      _exit(EXIT_FAILURE);
+    }
+    setenv("HOME", home, 1);
+    setenv("TERM", "xterm-256color", 1);
+    unsetenv("XDG_CACHE_HOME");
+    unsetenv("REPL_INPUTRC");
+    execl(repl, repl, (char *)NULL);
+    perror("failed to run bin/repl");
+    _exit(EXIT_FAILURE);
+  }
+  close(slave);
+
+  struct Screen screen = {.row = 1, .col = 1};
+  const char *welcome_end = "\r\n\r\n";
+  size_t welcome_matched = 0;
+  bool prompted = false;
+  bool echoed = false;
+
+  while (!echoed) {
+    struct pollfd pfd = {.fd = master, .events = POLLIN};
+    if (poll(&pfd, 1, 5000) != 1) {
+      fputs("bin/repl didn't show its prompt\n", stderr);
+      exit(EXIT_FAILURE);
+    }
+
+    char data[4096];
+    ssize_t n = read(master, data, sizeof(data));
+    if (n <= 0) {
+      fputs("bin/repl exited before taking input\n", stderr);
+      exit(EXIT_FAILURE);
+    }
+    double t = now();
+
+    // a terminal answers as soon as it gets the query, before any key
+    answer_queries(master, data, n, &screen);
+
+    for (ssize_t i = 0; i < n && !echoed; ++i) {
+      if (!prompted) {
+        if (welcome_matched == strlen(welcome_end)) {
+          prompted = true;
+          *first_prompt = t - start;
+
+          char key = KEY;
+          if (write(master, &key, 1) != 1) {
+            perror("failed to type key");
+            exit(EXIT_FAILURE);
+          }
+        } else if (data[i] == welcome_end[welcome_matched]) {
+          ++welcome_matched;
+        } else {
+          welcome_matched = data[i] == welcome_end[0];
+        }
+      } else if (data[i] == KEY) {
+        echoed = true;
+        *ready = t - start;
+      }
+    }
+  }
+
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+  close(master);
+}
+
+/*
+ * answers every cursor position query in the output with where the cursor
+ * would be on a real terminal.
+ */
+static void answer_queries(int master, const char *data, size_t len,
+                           struct Screen *screen) {
+  for (size_t i = 0; i < len; ++i) {
+    if (i + 4 <= len && memcmp(&data[i], "\x1b[6n", 4) == 0) {
+      char report[32];
+      int report_len = snprintf(report, sizeof(report), "\x1b[%u;%uR",
+                                screen->row, screen->col);
+      if (write(master, report, report_len) != report_len) {
+        perror("failed to answer cursor position query");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    track_cursor(screen, data[i]);
+  }
+}
+
+/*
+ * moves the cursor over a byte of output. escape sequences aren't followed,
+ * which is good enough for text & a prompt.
+ */
+static void track_cursor(struct Screen *screen, char c) {
+  if (screen->in_escape) {
+    screen->in_escape = c < '@' || c > '~' || c == '[';
+    return;
+  }
+
+  if (c == '\x1b') {
+    screen->in_escape = true;
+  } else if (c == '\r') {
+    screen->col = 1;
+  } else if (c == '\n') {
+    screen->row = screen->row < 24 ? screen->row + 1 : 24;
+  } else if ((unsigned char)c >= ' ') {
+    ++screen->col;
+  }
+}
+
+static void write_config(const char *home) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/.replrc", home);
+
+  FILE *f = fopen(path, "w");
+  if (f == NULL || fputs(CONFIG, f) == EOF || fclose(f) != 0) {
+    perror("failed to write ~/.replrc");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
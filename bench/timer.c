@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h> // for clock_gettime()
+
+#include "../src/timer.h"
+
+/*
+ * The timer wheel under the load a process full of sessions puts on it.
+ * Prints one "<name> <seconds>" line per case, which is what bin/bench reads:
+ *
+ * - timer/restart-10K: 10K sessions' idle timeouts pushed back on every key
+ *   press, 2M key presses in all, while the time moves on.
+ * - timer/expire-1M: 1M timers spread over 10 minutes, all expiring, with
+ *   the time advanced as an event loop would, by the wheel's own timeouts.
+ */
+
+#define SESSIONS 10000
+#define KEY_PRESSES 2000000
+#define IDLE_TIMEOUT_MS (5 * 60 * 1000)
+
+#define TIMERS 1000000
+#define SPREAD_MS (10 * 60 * 1000)
+
+static double restart(void);
+static double expire(void);
+static void count_expired(struct Timer *timer, void *arg);
+static uint32_t next_random(uint32_t *state);
+static double now(void);
+
+static struct Timer timers[TIMERS];
+
+int main(void) {
+  printf("timer/restart-10K %.9f\n", restart());
+  printf("timer/expire-1M %.9f\n", expire());
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * returns how long the key presses took, in seconds.
+ */
+static double restart(void) {
+  uint64_t time = 1000;
+  struct TimerWheel *wheel = timer_wheel_init(time);
+  if (wheel == NULL) {
+    fputs("failed to allocate timer wheel\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t expired = 0;
+  for (int i = 0; i < SESSIONS; ++i) {
+    timer_init(&timers[i], count_expired, &expired);
+    timer_start(wheel, &timers[i], time + IDLE_TIMEOUT_MS);
+  }
+
+  uint32_t random = 42;
+
+  double start = now();
+  for (int i = 0; i < KEY_PRESSES; ++i) {
+    // a key press every 10us on average, from a random session
+    if (i % 100 == 0) {
+      timer_wheel_advance(wheel, ++time);
+    }
+    struct Timer *timer = &timers[next_random(&random) % SESSIONS];
+    timer_start(wheel, timer, time + IDLE_TIMEOUT_MS);
+  }
+  double elapsed = now() - start;
+
+  if (expired != 0) {
+    fprintf(stderr, "%zu idle timeouts expired, expected none\n", expired);
+    exit(EXIT_FAILURE);
+  }
+
+  timer_wheel_free(wheel);
+
+  return elapsed;
+}
+
+/*
+ * returns how long starting & expiring the timers took, in seconds.
+ */
+static double expire(void) {
+  uint64_t time = 1000;
+  struct TimerWheel *wheel = timer_wheel_init(time);
+  if (wheel == NULL) {
+    fputs("failed to allocate timer wheel\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t random = 42;
+  size_t expired = 0;
+
+  double start = now();
+  for (int i = 0; i < TIMERS; ++i) {
+    timer_init(&timers[i], count_expired, &expired);
+    timer_start(wheel, &timers[i], time + 1 + next_random(&random) % SPREAD_MS);
+  }
+
+  int timeout;
+  while ((timeout = timer_wheel_timeout(wheel, time)) != -1) {
+    time += timeout;
+    timer_wheel_advance(wheel, time);
+  }
+  double elapsed = now() - start;
+
+  if (expired != TIMERS) {
+    fprintf(stderr, "%zu timers expired, expected %d\n", expired, TIMERS);
+    exit(EXIT_FAILURE);
+  }
+
+  timer_wheel_free(wheel);
+
+  return elapsed;
+}
+
+static void count_expired(struct Timer *timer, void *arg) {
+  size_t *expired = arg;
+  ++*expired;
+}
+
+// xorshift32
+static uint32_t next_random(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
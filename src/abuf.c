@@ -0,0 +1,114 @@
+#include <assert.h>
+#include <errno.h>  // for errno, EINTR, EAGAIN
+#include <string.h> // for memcpy()
+#include <unistd.h> // for write()
+
+#include "abuf.h"
+
+/**
+ * makes sure that at least `extra` more bytes can be appended without another
+ * allocation. returns false if memory allocation fails.
+ *
+ * @param ab the buffer to grow
+ * @param extra the number of bytes that will be appended
+ */
+bool abuf_reserve(struct AppendBuffer *ab, size_t extra) {
+  assert(ab != NULL);
+
+  if (ab->len + extra <= ab->capacity) {
+    return true;
+  }
+
+  // grow geometrically so that appending byte by byte stays linear
+  size_t new_capacity = ab->capacity == 0 ? 64 : ab->capacity;
+  while (new_capacity < ab->len + extra) {
+    new_capacity *= 2;
+  }
+
+  char *data = mem_realloc(ab->allocator, ab->data, ab->capacity, new_capacity);
+  if (data == NULL) {
+    return false;
+  }
+
+  ab->data = data;
+  ab->capacity = new_capacity;
+
+  return true;
+}
+
+/**
+ * appends `len` bytes from `s` to the buffer. returns false if memory
+ * allocation fails.
+ *
+ * @param ab the buffer to append to
+ * @param s the bytes to append
+ * @param len the number of bytes to append
+ */
+bool abuf_append(struct AppendBuffer *ab, const char *s, size_t len) {
+  assert(ab != NULL);
+  assert(s != NULL || len == 0);
+
+  if (!abuf_reserve(ab, len)) {
+    return false;
+  }
+
+  memcpy(&ab->data[ab->len], s, len);
+  ab->len += len;
+
+  return true;
+}
+
+/**
+ * empties the buffer but keeps the allocated memory around for reuse.
+ *
+ * @param ab the buffer to clear
+ */
+void abuf_clear(struct AppendBuffer *ab) {
+  assert(ab != NULL);
+
+  ab->len = 0;
+}
+
+/**
+ * frees the memory held by the buffer. the buffer can be reused afterwards.
+ *
+ * @param ab the buffer to free
+ */
+void abuf_free(struct AppendBuffer *ab) {
+  assert(ab != NULL);
+
+  mem_free(ab->allocator, ab->data, ab->capacity);
+  ab->data = NULL;
+  ab->len = 0;
+  ab->capacity = 0;
+}
+
+/**
+ * writes the whole buffer to `fd` and clears it.
+ *
+ * @param ab the buffer to write
+ * @param fd the file descriptor to write to
+ *
+ * @return `true` if everything was written, else `false`
+ */
+bool abuf_flush(struct AppendBuffer *ab, int fd) {
+  assert(ab != NULL);
+
+  size_t written = 0;
+  while (written < ab->len) {
+    ssize_t n = write(fd, &ab->data[written], ab->len - written);
+    if (n == -1) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+
+      return false;
+    }
+
+    written += n;
+  }
+
+  abuf_clear(ab);
+
+  return true;
+}
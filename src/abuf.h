@@ -0,0 +1,40 @@
+#ifndef ABUF_H
+#define ABUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * a growable byte buffer. everything that has to go to the terminal is first
+ * appended to one of these, so that a whole frame can be sent with a single
+ * `write()`.
+ */
+struct AppendBuffer {
+  char *data;
+  size_t len;
+  size_t capacity;
+
+  // where `data` comes from, NULL for malloc(). it MUST outlive the buffer.
+  const struct Allocator *allocator;
+};
+
+#define ABUF_INIT {NULL, 0, 0, NULL}
+
+bool abuf_append(struct AppendBuffer *ab, const char *s, size_t len);
+bool abuf_reserve(struct AppendBuffer *ab, size_t extra);
+void abuf_clear(struct AppendBuffer *ab);
+void abuf_free(struct AppendBuffer *ab);
+
+bool abuf_flush(struct AppendBuffer *ab, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
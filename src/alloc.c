@@ -0,0 +1,89 @@
+#include <stddef.h>
+#include <stdint.h> // for SIZE_MAX
+#include <stdlib.h> // for malloc(), realloc(), free()
+#include <string.h> // for memset()
+
+#include "./alloc.h"
+
+/*
+ * Every function here takes the allocator to use, & a NULL allocator means
+ * plain malloc(), so code that doesn't care about allocators doesn't need
+ * one.
+ */
+
+/**
+ * allocates `size` bytes. returns NULL if allocation fails.
+ *
+ * @param a the allocator to use, or NULL for malloc()
+ * @param size the number of bytes to allocate
+ */
+void *mem_alloc(const struct Allocator *a, size_t size) {
+  if (a == NULL) {
+    return malloc(size);
+  }
+
+  return a->fn(a->ctx, NULL, 0, size);
+}
+
+/**
+ * allocates zeroed room for `count` elements of `size` bytes. returns NULL if
+ * allocation fails.
+ *
+ * @param a the allocator to use, or NULL for malloc()
+ * @param count the number of elements
+ * @param size the size of each element
+ */
+void *mem_calloc(const struct Allocator *a, size_t count, size_t size) {
+  if (a == NULL) {
+    return calloc(count, size);
+  }
+
+  if (size != 0 && count > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  void *ptr = a->fn(a->ctx, NULL, 0, count * size);
+  if (ptr != NULL) {
+    memset(ptr, 0, count * size);
+  }
+
+  return ptr;
+}
+
+/**
+ * resizes a block, keeping its contents. returns NULL if allocation fails, in
+ * which case `ptr` is left as is.
+ *
+ * @param a the allocator `ptr` came from, or NULL for malloc()
+ * @param ptr the block to resize, or NULL to allocate a new one
+ * @param old_size the current size of the block
+ * @param new_size the size it should have. it MUST NOT be 0.
+ */
+void *mem_realloc(const struct Allocator *a, void *ptr, size_t old_size,
+                  size_t new_size) {
+  if (a == NULL) {
+    return realloc(ptr, new_size);
+  }
+
+  return a->fn(a->ctx, ptr, ptr == NULL ? 0 : old_size, new_size);
+}
+
+/**
+ * frees a block. freeing NULL does nothing.
+ *
+ * @param a the allocator `ptr` came from, or NULL for malloc()
+ * @param ptr the block to free
+ * @param size the size of the block
+ */
+void mem_free(const struct Allocator *a, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  if (a == NULL) {
+    free(ptr);
+    return;
+  }
+
+  a->fn(a->ctx, ptr, size, 0);
+}
@@ -0,0 +1,32 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+/*
+ * allocates, grows, shrinks or frees a block, like Lua's `lua_Alloc`:
+ *
+ *   - `ptr` is NULL: allocate `new_size` bytes
+ *   - `new_size` is 0: free `ptr`, which is `old_size` bytes, & return NULL
+ *   - otherwise: resize `ptr` from `old_size` to `new_size` bytes, keeping
+ *     its contents, like `realloc`
+ *
+ * it returns NULL if it can't allocate, in which case `ptr` is left as is.
+ * the old size is always given, so allocators that need the size to free a
+ * block (like a C++ `memory_resource`) can be used.
+ */
+typedef void *(*AllocFn)(void *ctx, void *ptr, size_t old_size,
+                         size_t new_size);
+
+struct Allocator {
+  AllocFn fn;
+  void *ctx;
+};
+
+void *mem_alloc(const struct Allocator *a, size_t size);
+void *mem_calloc(const struct Allocator *a, size_t count, size_t size);
+void *mem_realloc(const struct Allocator *a, void *ptr, size_t old_size,
+                  size_t new_size);
+void mem_free(const struct Allocator *a, void *ptr, size_t size);
+
+#endif
@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h> // for uint16_t, uint64_t
+#include <string.h> // for memcpy()
+
+#include "base64.h"
+
+static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*
+ * The encoder works on 12 bits at a time instead of 6: `pairs[i]` holds the
+ * two output characters for the 12-bit value i, so every 3 input bytes take
+ * two table lookups & two 16-bit stores. The main loop goes further and
+ * pulls 6 input bytes out of a single 64-bit load, writing 8 characters per
+ * iteration.
+ *
+ * The table is laid out by the compiler, so it's never written to & any
+ * thread can encode at any time.
+ */
+
+// the character for a 6-bit value, like `alphabet[v]`
+#define CHAR(v)                                                                \
+  ((v) < 26   ? 'A' + (v)                                                      \
+   : (v) < 52 ? 'a' + (v) - 26                                                 \
+   : (v) < 62 ? '0' + (v) - 52                                                 \
+   : (v) == 62 ? '+'                                                           \
+               : '/')
+
+// the two characters for a 12-bit value, in the order they're stored in
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PAIR(i) (uint16_t)(CHAR((i) >> 6) << 8 | CHAR((i) & 0x3f))
+#else
+#define PAIR(i) (uint16_t)(CHAR((i) >> 6) | CHAR((i) & 0x3f) << 8)
+#endif
+
+#define PAIRS4(i) PAIR(i), PAIR((i) + 1), PAIR((i) + 2), PAIR((i) + 3)
+#define PAIRS16(i)                                                             \
+  PAIRS4(i), PAIRS4((i) + 4), PAIRS4((i) + 8), PAIRS4((i) + 12)
+#define PAIRS64(i)                                                             \
+  PAIRS16(i), PAIRS16((i) + 16), PAIRS16((i) + 32), PAIRS16((i) + 48)
+#define PAIRS256(i)                                                            \
+  PAIRS64(i), PAIRS64((i) + 64), PAIRS64((i) + 128), PAIRS64((i) + 192)
+#define PAIRS1024(i)                                                           \
+  PAIRS256(i), PAIRS256((i) + 256), PAIRS256((i) + 512), PAIRS256((i) + 768)
+
+static const uint16_t pairs[4096] = {
+    PAIRS1024(0),
+    PAIRS1024(1024),
+    PAIRS1024(2048),
+    PAIRS1024(3072),
+};
+
+/*
+ * loads 8 bytes as a big-endian number, so that src[0] ends up in the top
+ * byte.
+ */
+static inline uint64_t load_be64(const unsigned char *src) {
+  uint64_t v;
+  memcpy(&v, src, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/**
+ * the number of characters `base64_encode` writes for `len` input bytes
+ * (including the padding).
+ */
+size_t base64_encoded_len(size_t len) { return (len + 2) / 3 * 4; }
+
+/**
+ * encodes `len` bytes from `src` as base64 (with padding) into `dst`.
+ *
+ * @param dst where to write the encoded text. it must have room for
+ * `base64_encoded_len(len)` characters. it's NOT null-terminated.
+ * @param src the bytes to encode
+ * @param len the number of bytes to encode
+ */
+void base64_encode(char *dst, const void *src, size_t len) {
+  assert(dst != NULL);
+  assert(src != NULL || len == 0);
+
+  const unsigned char *in = src;
+
+  // 6 bytes in, 8 characters out. it loads 8 bytes, so it has to stop while
+  // there are at least 8 left.
+  while (len >= 8) {
+    uint64_t v = load_be64(in);
+    uint16_t out[4] = {
+        pairs[(v >> 52) & 0xfff],
+        pairs[(v >> 40) & 0xfff],
+        pairs[(v >> 28) & 0xfff],
+        pairs[(v >> 16) & 0xfff],
+    };
+    memcpy(dst, out, sizeof(out));
+
+    in += 6;
+    len -= 6;
+    dst += 8;
+  }
+
+  // 3 bytes in, 4 characters out
+  while (len >= 3) {
+    uint32_t v = (uint32_t)in[0] << 16 | (uint32_t)in[1] << 8 | in[2];
+    uint16_t out[2] = {pairs[v >> 12], pairs[v & 0xfff]};
+    memcpy(dst, out, sizeof(out));
+
+    in += 3;
+    len -= 3;
+    dst += 4;
+  }
+
+  // whatever is left gets padded with '='
+  if (len == 1) {
+    dst[0] = alphabet[in[0] >> 2];
+    dst[1] = alphabet[(in[0] & 0x03) << 4];
+    dst[2] = '=';
+    dst[3] = '=';
+  } else if (len == 2) {
+    dst[0] = alphabet[in[0] >> 2];
+    dst[1] = alphabet[(in[0] & 0x03) << 4 | in[1] >> 4];
+    dst[2] = alphabet[(in[1] & 0x0f) << 2];
+    dst[3] = '=';
+  }
+}
+
+/**
+ * encodes `len` bytes from `src` as base64 straight into the free space at the
+ * end of `ab`, without an intermediate copy. returns false if memory
+ * allocation fails.
+ *
+ * @param ab the buffer to append the encoded text to
+ * @param src the bytes to encode
+ * @param len the number of bytes to encode
+ */
+bool base64_encode_append(struct AppendBuffer *ab, const void *src,
+                          size_t len) {
+  assert(ab != NULL);
+
+  size_t encoded_len = base64_encoded_len(len);
+  if (!abuf_reserve(ab, encoded_len)) {
+    return false;
+  }
+
+  base64_encode(&ab->data[ab->len], src, len);
+  ab->len += encoded_len;
+
+  return true;
+}
@@ -0,0 +1,14 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "abuf.h"
+
+size_t base64_encoded_len(size_t len);
+void base64_encode(char *dst, const void *src, size_t len);
+bool base64_encode_append(struct AppendBuffer *ab, const void *src,
+                          size_t len);
+
+#endif
@@ -0,0 +1,659 @@
+#define _GNU_SOURCE // for memrchr()
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>    // for poll()
+#include <pthread.h> // for pthread_create() & related functions
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h> // for memchr(), memrchr(), memcpy(), memmove()
+#include <time.h>   // for clock_gettime()
+#include <unistd.h> // for read(), write(), pipe(), sysconf()
+
+#include "./abuf.h"
+#include "./batch.h"
+
+/*
+ * Evaluates lines in parallel while writing the results in input order: a
+ * reader thread splits the input into chunks of whole lines, worker threads
+ * evaluate the chunks, & the calling thread writes their outputs out as soon
+ * as every chunk before them is written.
+ *
+ * The chunks in flight live in a ring of `max_in_flight` slots, indexed by
+ * their sequence number, which is both the work queue & the reorder buffer:
+ * the reader waits for a free slot before reading more, so memory stays
+ * bounded no matter how far the workers get ahead of the writer.
+ *
+ * A line longer than a chunk would have to be read whole before it could be
+ * evaluated, so with `eval_fragment` it's cut into chunks of its own instead,
+ * & memory stays bounded by the chunk size however long the line is. The
+ * workers pass those over, & the writer evaluates them as it gets to them,
+ * so the fragments of a line are evaluated in order.
+ */
+
+struct Chunk {
+  // whole lines, the last one maybe without a newline, or a fragment of a
+  // line that's longer than a chunk
+  char *input;
+  size_t input_len;
+
+  struct AppendBuffer output;
+
+  bool done;    // evaluated
+  bool stopped; // the evaluator asked to stop at one of its lines
+
+  // part of a line longer than a chunk, for the writer to evaluate (see
+  // `eval_fragment`), & whether it's the line's first or last part
+  bool fragment;
+  bool first;
+  bool last;
+};
+
+struct Batch {
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready; // a chunk was read, or the input ended
+  pthread_cond_t chunk_done; // a chunk was evaluated, or the input ended
+  pthread_cond_t slot_free;  // a chunk was written out
+
+  struct Chunk *slots;
+  size_t max_in_flight;
+
+  // sequence numbers of the next chunk read, evaluated & written. the chunks
+  // in [next_write, next_read) are in flight, & those in [next_eval,
+  // next_read) wait for a worker.
+  uint64_t next_read;
+  uint64_t next_eval;
+  uint64_t next_write;
+
+  bool input_done;
+  bool read_failed;
+
+  // set to stop every thread early. workers check it between lines.
+  _Atomic bool cancelled;
+
+  // the reader is woken up with a byte on this pipe when it's cancelled, so
+  // it never hangs on an input that stays open
+  int wake[2];
+
+  int in_fd;
+  size_t chunk_size;
+  BatchEvalFn eval;
+  BatchFragmentFn eval_fragment;
+  void *ctx;
+
+  struct MemoCache *memo;
+};
+
+static void *reader_main(void *arg);
+static void *worker_main(void *arg);
+static enum BatchResult write_chunks(struct Batch *b, int out_fd);
+static bool read_more(struct Batch *b, struct AppendBuffer *pending,
+                      bool wait, bool *eof);
+static size_t find_cut(const char *data, size_t len, size_t chunk_size,
+                       size_t *scanned);
+static size_t find_fragment(const char *data, size_t len, size_t chunk_size,
+                            bool eof, size_t *scanned, bool *last);
+static void eval_chunk(struct Batch *b, struct Chunk *chunk);
+static void eval_fragment(struct Batch *b, struct Chunk *chunk);
+static void cancel(struct Batch *b);
+static uint64_t now_ns(void);
+
+/**
+ * reads lines from `in_fd` until it ends, evaluates them in parallel & writes
+ * their outputs to `out_fd` in the same order as the lines. it returns once
+ * everything is written, or as soon as the evaluator asks to stop.
+ *
+ * @param in_fd where the lines are read from
+ * @param out_fd where the outputs are written to
+ * @param eval evaluates a line
+ * @param ctx passed to `eval` as is
+ * @param options how many workers to use, how much to keep in flight & where
+ * to cache outputs, or NULL for the defaults
+ *
+ * @return why it stopped
+ */
+enum BatchResult batch_run(int in_fd, int out_fd, BatchEvalFn eval, void *ctx,
+                           const struct BatchOptions *options) {
+  assert(eval != NULL);
+
+  struct BatchOptions opts = {0};
+  if (options != NULL) {
+    opts = *options;
+  }
+
+  if (opts.num_workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opts.num_workers = cpus > 0 ? cpus : 1;
+  }
+  if (opts.chunk_size == 0) {
+    opts.chunk_size = BATCH_DEFAULT_CHUNK_SIZE;
+  }
+  if (opts.max_in_flight == 0) {
+    opts.max_in_flight =
+        opts.num_workers * BATCH_DEFAULT_IN_FLIGHT_PER_WORKER;
+  }
+
+  struct Batch b = {
+      .max_in_flight = opts.max_in_flight,
+      .in_fd = in_fd,
+      .chunk_size = opts.chunk_size,
+      .eval = eval,
+      .eval_fragment = opts.eval_fragment,
+      .ctx = ctx,
+      .memo = opts.memo,
+  };
+
+  b.slots = calloc(b.max_in_flight, sizeof(struct Chunk));
+  if (b.slots == NULL) {
+    return BATCH_ERROR;
+  }
+
+  if (pipe(b.wake) == -1) {
+    free(b.slots);
+    return BATCH_ERROR;
+  }
+
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.work_ready, NULL);
+  pthread_cond_init(&b.chunk_done, NULL);
+  pthread_cond_init(&b.slot_free, NULL);
+
+  pthread_t *workers = calloc(opts.num_workers, sizeof(pthread_t));
+  size_t num_started = 0;
+
+  pthread_t reader;
+  bool reader_started =
+      workers != NULL && pthread_create(&reader, NULL, reader_main, &b) == 0;
+
+  if (reader_started) {
+    for (; num_started < opts.num_workers; ++num_started) {
+      if (pthread_create(&workers[num_started], NULL, worker_main, &b) != 0) {
+        break;
+      }
+    }
+  }
+
+  enum BatchResult result = BATCH_ERROR;
+  if (num_started > 0) {
+    result = write_chunks(&b, out_fd);
+  } else {
+    cancel(&b);
+  }
+
+  // the workers & the reader are done, or cancelled, by now
+  for (size_t i = 0; i < num_started; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+  if (reader_started) {
+    pthread_join(reader, NULL);
+  }
+
+  if (result == BATCH_DONE && b.read_failed) {
+    result = BATCH_ERROR;
+  }
+
+  for (size_t i = 0; i < b.max_in_flight; ++i) {
+    free(b.slots[i].input);
+    abuf_free(&b.slots[i].output);
+  }
+
+  close(b.wake[0]);
+  close(b.wake[1]);
+  pthread_cond_destroy(&b.slot_free);
+  pthread_cond_destroy(&b.chunk_done);
+  pthread_cond_destroy(&b.work_ready);
+  pthread_mutex_destroy(&b.lock);
+  free(workers);
+  free(b.slots);
+
+  return result;
+}
+
+/*
+ * splits the input into chunks of whole lines, & hands them to the workers
+ * as slots free up.
+ */
+static void *reader_main(void *arg) {
+  struct Batch *b = arg;
+
+  struct AppendBuffer pending = ABUF_INIT;
+  size_t scanned = 0; // how much of `pending` is known to have no newline
+  bool eof = false;
+  bool failed = false;
+
+  // whether a line longer than a chunk is being cut into fragments, & whether
+  // the next one is its first
+  bool fragments = false;
+  bool first = false;
+
+  while (!atomic_load(&b->cancelled)) {
+    size_t cut;
+    bool last = false;
+
+    if (fragments) {
+      cut = find_fragment(pending.data, pending.len, b->chunk_size, eof,
+                          &scanned, &last);
+
+      // the fragment isn't a chunk long yet, & doesn't end the line either
+      if (cut == 0 && !last) {
+        if (!read_more(b, &pending, true, &eof)) {
+          failed = !atomic_load(&b->cancelled);
+          break;
+        }
+        continue;
+      }
+    } else {
+      cut = find_cut(pending.data, pending.len, b->chunk_size, &scanned);
+
+      // a line that doesn't fit in a chunk isn't read any further than one
+      if (cut == 0 && pending.len >= b->chunk_size &&
+          b->eval_fragment != NULL) {
+        fragments = true;
+        first = true;
+        scanned = 0;
+        continue;
+      }
+
+      // a chunk is filled up with whatever input is there already, but lines
+      // that are complete aren't held back waiting for more. a line that
+      // isn't complete yet is waited for.
+      if (!eof && (cut == 0 || pending.len < b->chunk_size)) {
+        size_t len = pending.len;
+        if (!read_more(b, &pending, cut == 0, &eof)) {
+          failed = !atomic_load(&b->cancelled);
+          break;
+        }
+
+        if (pending.len > len || eof) {
+          continue;
+        }
+      }
+
+      // the input ended, maybe without a newline after the last line
+      if (cut == 0) {
+        if (pending.len == 0) {
+          break;
+        }
+        cut = pending.len;
+      }
+    }
+
+    // (the last fragment of a line may be empty)
+    char *input = malloc(cut > 0 ? cut : 1);
+    if (input == NULL) {
+      failed = true;
+      break;
+    }
+
+    memcpy(input, pending.data, cut);
+    memmove(pending.data, &pending.data[cut], pending.len - cut);
+    pending.len -= cut;
+    scanned = 0;
+
+    pthread_mutex_lock(&b->lock);
+
+    while (b->next_read - b->next_write >= b->max_in_flight &&
+           !atomic_load(&b->cancelled)) {
+      pthread_cond_wait(&b->slot_free, &b->lock);
+    }
+
+    if (atomic_load(&b->cancelled)) {
+      pthread_mutex_unlock(&b->lock);
+      free(input);
+      break;
+    }
+
+    struct Chunk *chunk = &b->slots[b->next_read % b->max_in_flight];
+    chunk->input = input;
+    chunk->input_len = cut;
+    chunk->done = false;
+    chunk->stopped = false;
+    chunk->fragment = fragments;
+    chunk->first = first;
+    chunk->last = last;
+    ++b->next_read;
+
+    first = false;
+    fragments = fragments && !last;
+
+    pthread_cond_signal(&b->work_ready);
+    pthread_mutex_unlock(&b->lock);
+  }
+
+  abuf_free(&pending);
+
+  pthread_mutex_lock(&b->lock);
+  b->input_done = true;
+  b->read_failed = failed;
+  pthread_cond_broadcast(&b->work_ready);
+  pthread_cond_broadcast(&b->chunk_done);
+  pthread_mutex_unlock(&b->lock);
+
+  if (failed) {
+    cancel(b);
+  }
+
+  return NULL;
+}
+
+/*
+ * evaluates chunks in the order they were read, until there are no more.
+ */
+static void *worker_main(void *arg) {
+  struct Batch *b = arg;
+
+  pthread_mutex_lock(&b->lock);
+
+  while (true) {
+    while (b->next_eval == b->next_read && !b->input_done &&
+           !atomic_load(&b->cancelled)) {
+      pthread_cond_wait(&b->work_ready, &b->lock);
+    }
+
+    if (atomic_load(&b->cancelled) || b->next_eval == b->next_read) {
+      break;
+    }
+
+    struct Chunk *chunk = &b->slots[b->next_eval % b->max_in_flight];
+    ++b->next_eval;
+
+    pthread_mutex_unlock(&b->lock);
+    if (!chunk->fragment) {
+      eval_chunk(b, chunk);
+    }
+    pthread_mutex_lock(&b->lock);
+
+    chunk->done = true;
+    pthread_cond_broadcast(&b->chunk_done);
+  }
+
+  pthread_mutex_unlock(&b->lock);
+
+  return NULL;
+}
+
+/*
+ * writes the outputs of the chunks out in order, as they're evaluated. runs
+ * on the thread that called `batch_run`.
+ */
+static enum BatchResult write_chunks(struct Batch *b, int out_fd) {
+  enum BatchResult result = BATCH_DONE;
+
+  pthread_mutex_lock(&b->lock);
+
+  while (true) {
+    struct Chunk *chunk = &b->slots[b->next_write % b->max_in_flight];
+
+    while (!atomic_load(&b->cancelled) &&
+           (b->next_write == b->next_read ? !b->input_done : !chunk->done)) {
+      pthread_cond_wait(&b->chunk_done, &b->lock);
+    }
+
+    if (atomic_load(&b->cancelled)) {
+      result = BATCH_ERROR;
+      break;
+    }
+
+    if (b->next_write == b->next_read) {
+      break; // all of the input is written out
+    }
+
+    pthread_mutex_unlock(&b->lock);
+
+    if (chunk->fragment) {
+      eval_fragment(b, chunk);
+    }
+
+    bool ok = abuf_flush(&chunk->output, out_fd);
+    bool stopped = chunk->stopped;
+
+    free(chunk->input);
+    chunk->input = NULL;
+    abuf_clear(&chunk->output);
+
+    pthread_mutex_lock(&b->lock);
+
+    ++b->next_write;
+    pthread_cond_signal(&b->slot_free);
+
+    if (!ok || stopped) {
+      result = ok ? BATCH_STOPPED : BATCH_ERROR;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&b->lock);
+
+  // whatever is still in flight is thrown away
+  if (result != BATCH_DONE) {
+    cancel(b);
+  }
+
+  return result;
+}
+
+/**
+ * reads the next block of input onto the end of `pending`.
+ *
+ * @param wait whether to wait for input (until the batch is cancelled) if
+ * there's none yet
+ * @param eof set once the input ends
+ *
+ * @return `false` if reading failed or the batch was cancelled, else `true`
+ */
+static bool read_more(struct Batch *b, struct AppendBuffer *pending, bool wait,
+                      bool *eof) {
+  if (!abuf_reserve(pending, b->chunk_size)) {
+    return false;
+  }
+
+  struct pollfd fds[2] = {
+      {.fd = b->in_fd, .events = POLLIN},
+      {.fd = b->wake[0], .events = POLLIN},
+  };
+
+  while (true) {
+    int ready = poll(fds, 2, wait ? -1 : 0);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    if (fds[1].revents != 0) {
+      return false;
+    }
+
+    if (ready == 0) {
+      return true;
+    }
+
+    ssize_t n = read(b->in_fd, &pending->data[pending->len], b->chunk_size);
+    if (n == -1) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return false;
+    }
+
+    if (n == 0) {
+      *eof = true;
+    }
+
+    pending->len += n;
+    return true;
+  }
+}
+
+/**
+ * finds where the next chunk ends: after the last newline in the first
+ * `chunk_size` bytes, or, if a line is longer than that, after that line.
+ *
+ * @param data the input read so far
+ * @param len the length of the input
+ * @param chunk_size how much input a chunk should have
+ * @param scanned how much of the input is known to have no newline in it,
+ * so that a long line isn't scanned again on every read. it's updated.
+ *
+ * @return the length of the chunk, or 0 if no line ends in `data`
+ */
+static size_t find_cut(const char *data, size_t len, size_t chunk_size,
+                       size_t *scanned) {
+  if (len == 0) {
+    return 0;
+  }
+
+  size_t limit = len < chunk_size ? len : chunk_size;
+  if (*scanned < limit) {
+    const char *newline = memrchr(data, '\n', limit);
+    if (newline != NULL) {
+      return newline - data + 1;
+    }
+    *scanned = limit;
+  }
+
+  const char *newline = memchr(&data[*scanned], '\n', len - *scanned);
+  if (newline != NULL) {
+    return newline - data + 1;
+  }
+
+  *scanned = len;
+  return 0;
+}
+
+/**
+ * finds where the next fragment of a line that's longer than a chunk ends:
+ * after its newline, if there's one in the first `chunk_size` bytes, or else
+ * after `chunk_size` bytes.
+ *
+ * @param data the input read so far, starting with the fragment
+ * @param len the length of the input
+ * @param chunk_size how much input a fragment should have at most
+ * @param eof whether the input ended, which ends the line too
+ * @param scanned how much of the input is known to have no newline in it.
+ * it's updated.
+ * @param last set to whether the fragment is the last of the line
+ *
+ * @return the length of the fragment, or 0 if there isn't enough input for
+ * one yet (unless it's the last, which can be empty)
+ */
+static size_t find_fragment(const char *data, size_t len, size_t chunk_size,
+                            bool eof, size_t *scanned, bool *last) {
+  size_t limit = len < chunk_size ? len : chunk_size;
+  if (*scanned < limit) {
+    const char *newline = memchr(&data[*scanned], '\n', limit - *scanned);
+    if (newline != NULL) {
+      *scanned = 0;
+      *last = true;
+      return newline - data + 1;
+    }
+    *scanned = limit;
+  }
+
+  if (len >= chunk_size) {
+    // a "\r" waits for the next fragment, in case it's a "\r\n"
+    size_t cut = data[chunk_size - 1] == '\r' && chunk_size > 1
+                     ? chunk_size - 1
+                     : chunk_size;
+    *scanned = 0;
+    return cut;
+  }
+
+  if (eof) {
+    *scanned = 0;
+    *last = true;
+    return len;
+  }
+
+  return 0;
+}
+
+/*
+ * evaluates every line of a chunk into its output.
+ */
+static void eval_chunk(struct Batch *b, struct Chunk *chunk) {
+  const char *line = chunk->input;
+  const char *end = chunk->input + chunk->input_len;
+
+  while (line < end && !atomic_load(&b->cancelled)) {
+    const char *newline = memchr(line, '\n', end - line);
+    const char *line_end = newline != NULL ? newline : end;
+
+    // lines from Windows end with "\r\n"
+    size_t len = line_end - line;
+    if (len > 0 && line[len - 1] == '\r') {
+      --len;
+    }
+
+    if (b->memo != NULL && memo_lookup(b->memo, line, len, &chunk->output)) {
+      line = newline != NULL ? newline + 1 : end;
+      continue;
+    }
+
+    size_t output_start = chunk->output.len;
+    uint64_t start = b->memo != NULL ? now_ns() : 0;
+
+    if (!b->eval(line, len, &chunk->output, b->ctx)) {
+      chunk->stopped = true;
+      break;
+    }
+
+    if (b->memo != NULL) {
+      memo_store(b->memo, line, len, chunk->output.data + output_start,
+                 chunk->output.len - output_start, now_ns() - start);
+    }
+
+    line = newline != NULL ? newline + 1 : end;
+  }
+}
+
+/*
+ * evaluates a fragment of a line that's longer than a chunk into its output.
+ * runs on the writer's thread, once the fragments before it are written.
+ */
+static void eval_fragment(struct Batch *b, struct Chunk *chunk) {
+  size_t len = chunk->input_len;
+
+  // the line's newline (or "\r\n") ends its last fragment
+  if (chunk->last && len > 0 && chunk->input[len - 1] == '\n') {
+    --len;
+    if (len > 0 && chunk->input[len - 1] == '\r') {
+      --len;
+    }
+  }
+
+  if (!b->eval_fragment(chunk->input, len, chunk->first, chunk->last,
+                        &chunk->output, b->ctx)) {
+    chunk->stopped = true;
+  }
+}
+
+/*
+ * stops every thread as soon as it can.
+ */
+static void cancel(struct Batch *b) {
+  pthread_mutex_lock(&b->lock);
+
+  // the reader may be waiting on the input
+  if (!atomic_exchange(&b->cancelled, true)) {
+    char c = 0;
+    ssize_t n = write(b->wake[1], &c, 1);
+    (void)n;
+  }
+
+  pthread_cond_broadcast(&b->work_ready);
+  pthread_cond_broadcast(&b->chunk_done);
+  pthread_cond_broadcast(&b->slot_free);
+
+  pthread_mutex_unlock(&b->lock);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,59 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "abuf.h"
+#include "memo.h"
+
+/*
+ * evaluates a line (without its newline) by appending its output to `out`.
+ * it runs on worker threads, so it MUST be thread-safe. returning false stops
+ * the batch once the output of the lines before it is written (e.g. on
+ * "exit", or if the output can't be allocated). either way it's
+ * `BATCH_STOPPED`, so an evaluator that stops for more than one reason keeps
+ * which one in `ctx`.
+ */
+typedef bool (*BatchEvalFn)(const char *line, size_t len,
+                            struct AppendBuffer *out, void *ctx);
+
+/*
+ * evaluates a line that's longer than a chunk a fragment at a time, as it's
+ * read, so it's never held in memory whole: `first` is set on its first
+ * fragment & `last` on its last one (which may be empty). the newline isn't
+ * part of it. the fragments are evaluated one after the other, in order, on
+ * the thread that writes the outputs, so state can be kept in `ctx` from one
+ * to the next. returning false stops the batch, like `BatchEvalFn`.
+ */
+typedef bool (*BatchFragmentFn)(const char *fragment, size_t len, bool first,
+                                bool last, struct AppendBuffer *out,
+                                void *ctx);
+
+struct BatchOptions {
+  size_t num_workers;   // 0 for one per CPU
+  size_t chunk_size;    // bytes of input per chunk, 0 for the default
+  size_t max_in_flight; // chunks read but not written yet, 0 for the default
+
+  // evaluates lines longer than a chunk, or NULL to read them whole & pass
+  // them to `BatchEvalFn` like the rest
+  BatchFragmentFn eval_fragment;
+
+  // where the outputs of lines are cached, so a line that comes up again
+  // isn't evaluated again, or NULL. only for an evaluator that's pure.
+  struct MemoCache *memo;
+};
+
+#define BATCH_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define BATCH_DEFAULT_IN_FLIGHT_PER_WORKER 4
+
+enum BatchResult {
+  BATCH_DONE,    // all of the input was evaluated
+  BATCH_STOPPED, // the evaluator asked to stop
+  BATCH_ERROR,   // reading, writing or starting threads failed
+};
+
+enum BatchResult batch_run(int in_fd, int out_fd, BatchEvalFn eval, void *ctx,
+                           const struct BatchOptions *options);
+
+#endif
@@ -0,0 +1,449 @@
+#include <errno.h>
+#include <poll.h>   // for poll()
+#include <signal.h> // for sigaction()
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>  // for ioctl(), struct winsize
+#include <sys/socket.h> // for socket(), connect()
+#include <sys/un.h>     // for struct sockaddr_un
+#include <termios.h>    // for struct termios, tcgetattr(), tcsetattr()
+#include <unistd.h>     // for read(), write(), isatty()
+
+#include "abuf.h"
+#include "predict.h"
+#include "remote.h"
+
+/*
+ * A client for bin/repl-server: it sends the keys typed into the terminal to
+ * the server as they are, & draws the line the server sends back, wrapping
+ * it at the terminal's width. Since the server may be a long way off, keys
+ * whose effect is obvious are echoed right away, underlined until the
+ * server's line confirms them (see src/predict.c). REPL_PREDICT=0 turns that
+ * off, so every key waits for the round trip.
+ *
+ * The server sends the whole line only when it starts, & then what changed
+ * in it (see src/remote.h). All of what came in at once is taken in before
+ * the line is drawn, so after a burst it's drawn once, as it ended up.
+ *
+ *   bin/repl-client /tmp/repl.sock
+ */
+
+#define READ_SIZE 4096
+#define DEFAULT_COLS 80
+
+struct Client {
+  int sock;
+  struct Predictor *predictor;
+  bool predict;
+
+  struct AppendBuffer received; // what's left of what the server sent
+
+  // the line being read, as the server has it
+  struct AppendBuffer prompt;
+  size_t prompt_width;
+  struct AppendBuffer text;
+  size_t pos;
+
+  // whether there's a line to draw, which there isn't between a line being
+  // done & the next one starting, so the output comes out in between
+  bool drawing;
+
+  // the terminal's width, & which of the rows the line was drawn on the
+  // cursor was left on
+  size_t cols;
+  size_t cursor_row;
+
+  struct AppendBuffer frame;
+};
+
+static struct termios original_state;
+static bool raw = false;
+
+static volatile sig_atomic_t resized = false;
+
+static bool handle_keys(struct Client *c);
+static bool handle_messages(struct Client *c, bool *closed);
+static bool handle_line(struct Client *c, uint64_t handled, bool done);
+static bool draw(struct Client *c);
+static bool draw_line(struct Client *c, const char *text,
+                      const char *tentative, size_t len, size_t pos,
+                      bool done);
+static bool append_move(struct AppendBuffer *ab, char dir, size_t n);
+static size_t text_width(const char *s, size_t len);
+static void update_cols(struct Client *c);
+static void on_resize(int sig);
+static bool write_all(int fd, const char *buf, size_t len);
+static void enable_raw_mode(void);
+static void disable_raw_mode(void);
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <socket path>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path too long: %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  strcpy(addr.sun_path, argv[1]);
+
+  struct Client c = {
+      .received = ABUF_INIT,
+      .prompt = ABUF_INIT,
+      .text = ABUF_INIT,
+      .frame = ABUF_INIT,
+  };
+
+  const char *predict = getenv("REPL_PREDICT");
+  c.predict = predict == NULL || strcmp(predict, "0") != 0;
+
+  c.sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (c.sock == -1 ||
+      connect(c.sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    perror("failed to connect to server");
+    return EXIT_FAILURE;
+  }
+
+  c.predictor = predictor_init();
+  if (c.predictor == NULL) {
+    fputs("failed to allocate predictor\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  // no SA_RESTART, so it interrupts poll()
+  struct sigaction action = {.sa_handler = on_resize};
+  sigaction(SIGWINCH, &action, NULL);
+  update_cols(&c);
+
+  enable_raw_mode();
+
+  bool ok = true, closed = false;
+  while (ok && !closed) {
+    if (resized) {
+      resized = false;
+      update_cols(&c);
+      ok = !c.drawing || draw(&c);
+      continue;
+    }
+
+    struct pollfd fds[2] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = c.sock, .events = POLLIN},
+    };
+    if (poll(fds, 2, -1) == -1) {
+      ok = errno == EINTR;
+      continue;
+    }
+
+    if (fds[0].revents != 0) {
+      ok = handle_keys(&c);
+    }
+    if (ok && fds[1].revents != 0) {
+      ok = handle_messages(&c, &closed);
+    }
+  }
+
+  disable_raw_mode();
+
+  predictor_free(c.predictor);
+  abuf_free(&c.received);
+  abuf_free(&c.prompt);
+  abuf_free(&c.text);
+  abuf_free(&c.frame);
+  close(c.sock);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * sends the keys that were typed to the server, & echoes them if they can be
+ * guessed.
+ */
+static bool handle_keys(struct Client *c) {
+  char keys[READ_SIZE];
+  ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+  if (n <= 0) {
+    // the terminal went away, so there's no one left to type
+    return n == 0 || errno == EINTR;
+  }
+
+  if (!write_all(c->sock, keys, n)) {
+    perror("failed to send keys");
+    return false;
+  }
+
+  if (!c->predict) {
+    return true;
+  }
+
+  if (!predictor_send(c->predictor, keys, n)) {
+    fputs("failed to allocate guesses\n", stderr);
+    return false;
+  }
+
+  return !c->drawing || draw(c);
+}
+
+/*
+ * takes in what the server sent, & draws the line once for all of it, so a
+ * burst of changes doesn't draw every one of them.
+ */
+static bool handle_messages(struct Client *c, bool *closed) {
+  if (!abuf_reserve(&c->received, READ_SIZE)) {
+    fputs("failed to allocate receive buffer\n", stderr);
+    return false;
+  }
+
+  ssize_t n = read(c->sock, c->received.data + c->received.len, READ_SIZE);
+  if (n <= 0) {
+    *closed = true;
+    return n == 0;
+  }
+  c->received.len += n;
+
+  bool redraw = false;
+  size_t offset = 0;
+  for (;;) {
+    struct RemoteMessage msg;
+    bool malformed;
+    size_t size = remote_parse(c->received.data + offset,
+                               c->received.len - offset, &msg, &malformed);
+    if (malformed) {
+      fputs("malformed message from server\n", stderr);
+      return false;
+    }
+    if (size == 0) {
+      break;
+    }
+    offset += size;
+
+    bool ok = true;
+    switch (msg.type) {
+    case REMOTE_OUTPUT:
+      ok = write_all(STDOUT_FILENO, msg.output, msg.output_len);
+      break;
+
+    case REMOTE_LINE:
+      abuf_clear(&c->prompt);
+      abuf_clear(&c->text);
+      ok = abuf_append(&c->prompt, msg.line.prompt, msg.line.prompt_len) &&
+           abuf_append(&c->text, msg.line.text, msg.line.len);
+      if (!ok) {
+        fputs("failed to allocate line\n", stderr);
+        break;
+      }
+      c->prompt_width = msg.line.prompt_width;
+      c->pos = msg.line.pos;
+
+      ok = handle_line(c, msg.line.handled, msg.line.done);
+      break;
+
+    case REMOTE_EDIT:
+      ok = remote_apply_edit(&c->text, &c->pos, &msg.edit);
+      if (!ok) {
+        fputs("failed to apply the server's change to the line\n", stderr);
+        break;
+      }
+
+      ok = handle_line(c, msg.edit.handled, msg.edit.done);
+      break;
+    }
+    if (!ok) {
+      return false;
+    }
+
+    redraw = c->drawing;
+  }
+
+  // keep what's left of a message that's still coming in
+  memmove(c->received.data, c->received.data + offset,
+          c->received.len - offset);
+  c->received.len -= offset;
+
+  return !redraw || draw(c);
+}
+
+/*
+ * settles the guesses for the line the server sent, & if it's done, draws
+ * it as the server finished it, once, & moves on.
+ */
+static bool handle_line(struct Client *c, uint64_t handled, bool done) {
+  struct RemoteLine line = {
+      .handled = handled,
+      .prompt = c->prompt.data,
+      .prompt_len = c->prompt.len,
+      .prompt_width = c->prompt_width,
+      .text = c->text.data,
+      .len = c->text.len,
+      .pos = c->pos,
+      .done = done,
+  };
+  if (!predictor_confirm(c->predictor, &line)) {
+    fputs("failed to allocate line\n", stderr);
+    return false;
+  }
+
+  if (!done) {
+    c->drawing = true;
+    return true;
+  }
+
+  bool ok = !c->drawing ||
+            draw_line(c, c->text.data, NULL, c->text.len, c->text.len, true);
+  c->drawing = false;
+
+  return ok;
+}
+
+/*
+ * draws the line as it's predicted to be.
+ */
+static bool draw(struct Client *c) {
+  struct PredictedLine line;
+  if (!predictor_line(c->predictor, &line)) {
+    fputs("failed to allocate line\n", stderr);
+    return false;
+  }
+
+  return draw_line(c, line.text, line.tentative, line.len, line.pos, false);
+}
+
+/*
+ * draws the prompt & a line over the one that's there, with the guesses
+ * (where `tentative` is set, if it's not NULL) underlined. a line that's
+ * done is left with the cursor on the row after it.
+ */
+static bool draw_line(struct Client *c, const char *text,
+                      const char *tentative, size_t len, size_t pos,
+                      bool done) {
+  struct AppendBuffer *f = &c->frame;
+  abuf_clear(f);
+
+  // back to where the line starts
+  bool ok = append_move(f, 'A', c->cursor_row) && abuf_append(f, "\r", 1) &&
+            abuf_append(f, c->prompt.data, c->prompt.len);
+
+  // the runs of guessed & confirmed characters
+  for (size_t i = 0; ok && i < len;) {
+    bool guessed = tentative != NULL && tentative[i];
+    size_t end = i + 1;
+    while (end < len && (tentative != NULL && tentative[end]) == guessed) {
+      ++end;
+    }
+
+    ok = guessed ? abuf_append(f, "\x1b[4m", 4) &&
+                       abuf_append(f, &text[i], end - i) &&
+                       abuf_append(f, "\x1b[24m", 5)
+                 : abuf_append(f, &text[i], end - i);
+    i = end;
+  }
+
+  // the terminal holds off wrapping after the last column until there's more
+  // to write, so the cursor is moved onto the next row by hand, where
+  // clearing the rest of the screen starts
+  size_t end_col = c->prompt_width + text_width(text, len);
+  size_t end_row = end_col / c->cols;
+  bool wrapped = end_col > 0 && end_col % c->cols == 0;
+  if (wrapped) {
+    ok = ok && abuf_append(f, "\r\n", 2);
+  }
+  ok = ok && abuf_append(f, "\x1b[J", 3);
+
+  if (done) {
+    ok = ok && (wrapped || abuf_append(f, "\r\n", 2));
+    c->cursor_row = 0;
+  } else {
+    size_t cursor = c->prompt_width + text_width(text, pos);
+    c->cursor_row = cursor / c->cols;
+    ok = ok && append_move(f, 'A', end_row - c->cursor_row) &&
+         abuf_append(f, "\r", 1) && append_move(f, 'C', cursor % c->cols);
+  }
+
+  if (!ok) {
+    fputs("failed to allocate frame\n", stderr);
+    return false;
+  }
+
+  return write_all(STDOUT_FILENO, f->data, f->len);
+}
+
+// appends the escape sequence that moves the cursor `n` cells towards `dir`
+static bool append_move(struct AppendBuffer *ab, char dir, size_t n) {
+  if (n == 0) {
+    return true;
+  }
+
+  char seq[32];
+  int len = snprintf(seq, sizeof(seq), "\x1b[%zu%c", n, dir);
+  return abuf_append(ab, seq, len);
+}
+
+// the number of columns text takes up: 1 per UTF-8 character
+static size_t text_width(const char *s, size_t len) {
+  size_t width = 0;
+  for (size_t i = 0; i < len; ++i) {
+    width += ((unsigned char)s[i] & 0xc0) != 0x80;
+  }
+  return width;
+}
+
+static void update_cols(struct Client *c) {
+  struct winsize size;
+  c->cols = ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != -1 && size.ws_col > 0
+                ? size.ws_col
+                : DEFAULT_COLS;
+}
+
+static void on_resize(int sig) {
+  (void)sig;
+  resized = true;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+/*
+ * like the editor's raw mode, except the output is still processed, so the
+ * server's output can use plain "\n"s.
+ */
+static void enable_raw_mode(void) {
+  if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &original_state) == -1) {
+    return;
+  }
+
+  struct termios term = original_state;
+  term.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+  term.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  term.c_cflag &= ~(CSIZE | PARENB);
+  term.c_cflag |= CS8;
+  term.c_cc[VMIN] = 1;
+  term.c_cc[VTIME] = 0;
+
+  raw = tcsetattr(STDIN_FILENO, TCSAFLUSH, &term) != -1;
+}
+
+static void disable_raw_mode(void) {
+  if (raw) {
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_state);
+    raw = false;
+  }
+}
@@ -0,0 +1,80 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "./command.h"
+
+/*
+ * The commands are found with a perfect hash of a command name's second &
+ * last characters, laid out at compile time: every name has a slot of its
+ * own, so a line that might be a command is compared with one name at most,
+ * & the rest of the lines, which don't start with ':' or 'e', with none.
+ *
+ * The slots are computed by the compiler too, & two names hashing to the same
+ * slot fail the build (see the pragmas around `commands`), so a new name that
+ * collides needs another multiplier, or more slots.
+ */
+
+struct CommandName {
+  const char *name;
+  size_t len;
+  enum Command command;
+  bool takes_args;
+};
+
+#define NUM_SLOTS 16
+
+#define SLOT(second, last)                                                     \
+  (((unsigned char)(second) * 5 + (unsigned char)(last)) & (NUM_SLOTS - 1))
+
+// the shortest & the longest names
+#define MIN_NAME_LEN 4
+#define MAX_NAME_LEN 8
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+static const struct CommandName commands[NUM_SLOTS] = {
+    [SLOT('x', 't')] = {"exit", 4, COMMAND_EXIT, false},
+    [SLOT('h', 'p')] = {":help", 5, COMMAND_HELP, false},
+    [SLOT('h', 'y')] = {":history", 8, COMMAND_HISTORY, true},
+    [SLOT('s', 's')] = {":stats", 6, COMMAND_STATS, false},
+    [SLOT('l', 'y')] = {":latency", 8, COMMAND_LATENCY, false},
+    [SLOT('s', 'h')] = {":search", 7, COMMAND_SEARCH, true},
+    [SLOT('s', 'e')] = {":save", 5, COMMAND_SAVE, true},
+    [SLOT('r', 't')] = {":repeat", 7, COMMAND_REPEAT, true},
+};
+#pragma GCC diagnostic pop
+
+/**
+ * finds out which command a line is, if any.
+ *
+ * @param line the line, which doesn't have to be null-terminated
+ * @param len its length
+ * @param args where to store the index of the command's arguments in the
+ * line: past the name & the space after it, or `len` if there are none
+ *
+ * @return the command, or `COMMAND_NONE` if the line isn't one
+ */
+enum Command command_find(const char *line, size_t len, size_t *args) {
+  if (len < MIN_NAME_LEN || (line[0] != ':' && line[0] != 'e')) {
+    return COMMAND_NONE;
+  }
+
+  // a name is never longer, so neither is the search for its end
+  size_t scan_len = len < MAX_NAME_LEN + 1 ? len : MAX_NAME_LEN + 1;
+  const char *space = memchr(line, ' ', scan_len);
+  size_t name_len = space != NULL ? (size_t)(space - line) : len;
+  if (name_len < MIN_NAME_LEN || name_len > MAX_NAME_LEN) {
+    return COMMAND_NONE;
+  }
+
+  const struct CommandName *c = &commands[SLOT(line[1], line[name_len - 1])];
+  if (c->len != name_len || memcmp(line, c->name, name_len) != 0 ||
+      (!c->takes_args && name_len != len)) {
+    return COMMAND_NONE;
+  }
+
+  *args = name_len < len ? name_len + 1 : len;
+
+  return c->command;
+}
@@ -0,0 +1,24 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+
+/*
+ * the REPL's own commands. a line is one if its first word is a command's
+ * name, & it either takes arguments or there's nothing after the name.
+ */
+enum Command {
+  COMMAND_NONE, // not a command: the line is evaluated as it is
+  COMMAND_EXIT,
+  COMMAND_HELP,
+  COMMAND_HISTORY, // [<count>]
+  COMMAND_STATS,
+  COMMAND_LATENCY,
+  COMMAND_SEARCH, // <text>
+  COMMAND_SAVE,   // <path>
+  COMMAND_REPEAT, // <count> <text>
+};
+
+enum Command command_find(const char *line, size_t len, size_t *args);
+
+#endif
@@ -0,0 +1,628 @@
+#include <assert.h>
+#include <ctype.h>  // for isspace()
+#include <errno.h>  // for errno
+#include <fcntl.h>  // for open(), O_RDONLY
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>  // for fprintf(), snprintf(), rename()
+#include <stdlib.h> // for malloc(), free()
+#include <string.h> // for memcmp(), strncmp(), strcmp()
+#include <sys/mman.h> // for mmap(), munmap()
+#include <sys/stat.h> // for fstat(), struct stat
+#include <unistd.h>   // for read(), write(), close(), unlink()
+
+#include "./config.h"
+#include "./vector.h"
+
+// macOS calls it differently
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+/*
+ * Parsing a config file isn't expensive, but it isn't free either, & it
+ * happens on every start. So the parsed config is saved in a binary cache: a
+ * header followed by the `struct ConfigOp` array, exactly as it's laid out in
+ * memory. On the next start, if the header says the cache was made from the
+ * same source, the cache is memory mapped & its operations are used where they
+ * are, without parsing anything.
+ *
+ * The cache is valid if the source's mtime & size are what the header says
+ * (no need to even read the source), or, if only the mtime changed (the file
+ * was touched, or checked out again), if the hash of its contents is the same.
+ */
+
+#define CACHE_MAGIC "REPLRC\0"
+#define CACHE_VERSION 1
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_ops;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t size;
+  uint64_t hash; // FNV-1a of the source
+};
+
+struct Config {
+  const struct ConfigOp *ops;
+  size_t num_ops;
+
+  // if the config came from the cache, the mapping to unmap when done
+  void *mapping;
+  size_t mapping_size;
+
+  // if it was parsed, the operations are in here instead
+  struct Vector *parsed;
+};
+
+static char *read_file(int fd, size_t size);
+static uint64_t hash_bytes(const char *data, size_t len);
+static struct Config *load_cache(const char *cache_path, const struct stat *st,
+                                 const char *source, size_t source_len);
+static void save_cache(const char *cache_path, const struct stat *st,
+                       uint64_t hash, const struct ConfigOp *ops,
+                       size_t num_ops);
+static bool parse_config(const char *path, char *source, size_t len,
+                         struct Vector *ops);
+static bool parse_line(char *line, enum KeymapId *keymap,
+                       struct ConfigOp *op, const char **error);
+static size_t parse_keyname(const char *name, int *keys);
+
+/**
+ * loads a config file, from its cache if the cache is up to date. if the cache
+ * isn't, the file is parsed & a new cache is saved (unless the file has
+ * errors, so that they keep being reported until fixed). problems in the file
+ * are reported on stderr, with line numbers.
+ *
+ * @param path the config file
+ * @param cache_path where the binary cache of the config file is kept. if
+ * NULL, no cache is used.
+ *
+ * @return the loaded config, or NULL if the file can't be read
+ */
+struct Config *config_load(const char *path, const char *cache_path) {
+  assert(path != NULL);
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  // the fast path: mtime & size match, the source isn't even read
+  if (cache_path != NULL) {
+    struct Config *config = load_cache(cache_path, &st, NULL, 0);
+    if (config != NULL) {
+      close(fd);
+      return config;
+    }
+  }
+
+  char *source = read_file(fd, st.st_size);
+  close(fd);
+  if (source == NULL) {
+    return NULL;
+  }
+
+  // the file was touched but may not have changed
+  if (cache_path != NULL) {
+    struct Config *config = load_cache(cache_path, &st, source, st.st_size);
+    if (config != NULL) {
+      // save it again with the new mtime, for the fast path next time
+      save_cache(cache_path, &st, hash_bytes(source, st.st_size), config->ops,
+                 config->num_ops);
+
+      free(source);
+      return config;
+    }
+  }
+
+  struct Config *config = malloc(sizeof(struct Config));
+  if (config == NULL) {
+    free(source);
+    return NULL;
+  }
+
+  config->mapping = NULL;
+  config->mapping_size = 0;
+  config->parsed = vector_init(sizeof(struct ConfigOp), 0);
+  if (config->parsed == NULL) {
+    free(config);
+    free(source);
+    return NULL;
+  }
+
+  uint64_t hash = hash_bytes(source, st.st_size);
+  bool ok = parse_config(path, source, st.st_size, config->parsed);
+  free(source);
+
+  config->ops = vector_data(config->parsed);
+  config->num_ops = vector_length(config->parsed);
+
+  if (ok && cache_path != NULL) {
+    save_cache(cache_path, &st, hash, config->ops, config->num_ops);
+  }
+
+  return config;
+}
+
+/**
+ * builds the path of the cache for a config file: a file named after the hash
+ * of the config's path, in $XDG_CACHE_HOME (or ~/.cache). the directory is
+ * created if it doesn't exist.
+ *
+ * @param path the config file
+ * @param cache_path where to store the path of the cache
+ * @param size the size of `cache_path`
+ *
+ * @return `true` if the path was built, `false` if there's no cache directory
+ * or the path doesn't fit
+ */
+bool config_cache_path(const char *path, char *cache_path, size_t size) {
+  assert(path != NULL);
+  assert(cache_path != NULL);
+
+  char dir[4096];
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+
+  int n;
+  if (xdg != NULL && xdg[0] != '\0') {
+    n = snprintf(dir, sizeof(dir), "%s", xdg);
+  } else if (home != NULL && home[0] != '\0') {
+    n = snprintf(dir, sizeof(dir), "%s/.cache", home);
+  } else {
+    return false;
+  }
+
+  if (n < 0 || (size_t)n >= sizeof(dir)) {
+    return false;
+  }
+
+  if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+    return false;
+  }
+
+  n = snprintf(cache_path, size, "%s/repl-inputrc-%016llx.bin", dir,
+               (unsigned long long)hash_bytes(path, strlen(path)));
+
+  return n >= 0 && (size_t)n < size;
+}
+
+/**
+ * frees the config (& unmaps its cache)
+ *
+ * @param config the config to free
+ */
+void config_free(struct Config *config) {
+  assert(config != NULL);
+
+  if (config->mapping != NULL) {
+    munmap(config->mapping, config->mapping_size);
+  }
+
+  if (config->parsed != NULL) {
+    vector_free(config->parsed);
+  }
+
+  free(config);
+}
+
+/**
+ * gets the operations of the config, to apply in order.
+ *
+ * @param config the config
+ * @param count pointer to store the number of operations
+ */
+const struct ConfigOp *config_ops(const struct Config *config, size_t *count) {
+  assert(config != NULL);
+  assert(count != NULL);
+
+  *count = config->num_ops;
+  return config->ops;
+}
+
+/**
+ * whether the config was loaded from its cache rather than parsed
+ */
+bool config_from_cache(const struct Config *config) {
+  assert(config != NULL);
+
+  return config->mapping != NULL;
+}
+
+static char *read_file(int fd, size_t size) {
+  char *data = malloc(size + 1);
+  if (data == NULL) {
+    return NULL;
+  }
+
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = read(fd, &data[total], size - total);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (n <= 0) {
+      break;
+    }
+
+    total += n;
+  }
+
+  if (total != size) {
+    free(data);
+    return NULL;
+  }
+
+  data[size] = '\0';
+  return data;
+}
+
+/*
+ * 64-bit FNV-1a
+ */
+static uint64_t hash_bytes(const char *data, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= (unsigned char)data[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+/*
+ * maps the cache & checks that it was made from the source described by `st`.
+ * if `source` is NULL, only the mtime & size are compared. otherwise the hash
+ * of `source` is compared instead of the mtime. returns NULL if the cache is
+ * missing or stale.
+ */
+static struct Config *load_cache(const char *cache_path, const struct stat *st,
+                                 const char *source, size_t source_len) {
+  int fd = open(cache_path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat cache_st;
+  if (fstat(fd, &cache_st) == -1 ||
+      (size_t)cache_st.st_size < sizeof(struct CacheHeader)) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = cache_st.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  const struct CacheHeader *header = mapping;
+
+  bool valid =
+      memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+      header->version == CACHE_VERSION &&
+      size == sizeof(struct CacheHeader) +
+                  header->num_ops * sizeof(struct ConfigOp) &&
+      header->size == (uint64_t)st->st_size;
+
+  if (valid && source == NULL) {
+    valid = header->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+            header->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+  } else if (valid) {
+    valid = header->hash == hash_bytes(source, source_len);
+  }
+
+  struct Config *config = valid ? malloc(sizeof(struct Config)) : NULL;
+  if (config == NULL) {
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  config->ops = (const struct ConfigOp *)(header + 1);
+  config->num_ops = header->num_ops;
+  config->mapping = mapping;
+  config->mapping_size = size;
+  config->parsed = NULL;
+
+  return config;
+}
+
+/*
+ * writes the cache to a temporary file & renames it into place, so that a
+ * REPL starting at the same time never sees half a cache. failing to save the
+ * cache isn't an error, the config just gets parsed again next time.
+ */
+static void save_cache(const char *cache_path, const struct stat *st,
+                       uint64_t hash, const struct ConfigOp *ops,
+                       size_t num_ops) {
+  struct CacheHeader header = {
+      .magic = CACHE_MAGIC,
+      .version = CACHE_VERSION,
+      .num_ops = num_ops,
+      .mtime_sec = st->st_mtim.tv_sec,
+      .mtime_nsec = st->st_mtim.tv_nsec,
+      .size = st->st_size,
+      .hash = hash,
+  };
+
+  char tmp_path[4096];
+  int n = snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", cache_path,
+                   (int)getpid());
+  if (n < 0 || (size_t)n >= sizeof(tmp_path)) {
+    return;
+  }
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return;
+  }
+
+  size_t ops_size = header.num_ops * sizeof(struct ConfigOp);
+  bool ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+            write(fd, ops, ops_size) == (ssize_t)ops_size;
+
+  if (close(fd) == -1 || !ok || rename(tmp_path, cache_path) == -1) {
+    unlink(tmp_path);
+  }
+}
+
+/*
+ * parses the whole file, line by line. returns false if any line had an
+ * error (the other lines are still used).
+ */
+static bool parse_config(const char *path, char *source, size_t len,
+                         struct Vector *ops) {
+  bool ok = true;
+  enum KeymapId keymap = KEYMAP_EMACS;
+
+  char *line = source;
+  size_t line_number = 0;
+  while (line < source + len) {
+    char *end = memchr(line, '\n', source + len - line);
+    if (end == NULL) {
+      end = source + len;
+    }
+    *end = '\0';
+    ++line_number;
+
+    struct ConfigOp op;
+    const char *error = NULL;
+    if (parse_line(line, &keymap, &op, &error)) {
+      if (!vector_push(ops, &op)) {
+        error = "out of memory";
+      }
+    }
+
+    if (error != NULL) {
+      fprintf(stderr, "%s: line %zu: %s\n", path, line_number, error);
+      ok = false;
+    }
+
+    line = end + 1;
+  }
+
+  return ok;
+}
+
+static char *skip_spaces(char *s) {
+  while (isspace((unsigned char)*s)) {
+    ++s;
+  }
+
+  return s;
+}
+
+/*
+ * parses one line. returns true if it produced an operation. `keymap` is the
+ * keymap that bindings go to, which `set keymap` & `set editing-mode` change.
+ * `error` is set if the line is invalid.
+ */
+static bool parse_line(char *line, enum KeymapId *keymap,
+                       struct ConfigOp *op, const char **error) {
+  line = skip_spaces(line);
+
+  // blank lines & comments. conditionals ($if, $else, $endif, $include)
+  // aren't supported, so they're skipped as well.
+  if (*line == '\0' || *line == '#' || *line == '$') {
+    return false;
+  }
+
+  // strip trailing whitespace (including the \r of CRLF files)
+  char *end = line + strlen(line);
+  while (end > line && isspace((unsigned char)end[-1])) {
+    *--end = '\0';
+  }
+
+  memset(op, 0, sizeof(*op));
+
+  // set <variable> <value>
+  if (strncmp(line, "set", 3) == 0 && isspace((unsigned char)line[3])) {
+    char *name = skip_spaces(line + 3);
+    char *value = name;
+    while (*value != '\0' && !isspace((unsigned char)*value)) {
+      ++value;
+    }
+    if (*value != '\0') {
+      *value = '\0';
+      value = skip_spaces(value + 1);
+    }
+
+    if (strcmp(name, "editing-mode") == 0) {
+      if (strcmp(value, "vi") == 0) {
+        *keymap = KEYMAP_VI_INSERT;
+      } else if (strcmp(value, "emacs") == 0) {
+        *keymap = KEYMAP_EMACS;
+      } else {
+        *error = "editing-mode must be 'vi' or 'emacs'";
+        return false;
+      }
+
+      op->type = CONFIG_OP_EDITING_MODE;
+      op->value = *keymap;
+      return true;
+    }
+
+    if (strcmp(name, "keymap") == 0) {
+      if (!keymap_id_from_name(value, keymap)) {
+        *error = "unknown keymap";
+      }
+
+      return false;
+    }
+
+    if (strcmp(name, "clipboard-export") == 0) {
+      if (strcmp(value, "on") != 0 && strcmp(value, "off") != 0) {
+        *error = "clipboard-export must be 'on' or 'off'";
+        return false;
+      }
+
+      op->type = CONFIG_OP_CLIPBOARD_EXPORT;
+      op->value = strcmp(value, "on") == 0;
+      return true;
+    }
+
+    *error = "unknown variable";
+    return false;
+  }
+
+  // "<keyseq>": <command>  or  <keyname>: <command>
+  char *colon;
+  int keys[MAX_KEYSEQ_LEN];
+  size_t num_keys;
+
+  if (*line == '"') {
+    // find the closing quote, skipping escaped characters
+    char *close = line + 1;
+    while (*close != '\0' && *close != '"') {
+      close += close[0] == '\\' && close[1] != '\0' ? 2 : 1;
+    }
+
+    if (*close != '"') {
+      *error = "missing closing quote";
+      return false;
+    }
+
+    *close = '\0';
+    num_keys = keymap_parse_keyseq(line + 1, keys, MAX_KEYSEQ_LEN);
+
+    colon = skip_spaces(close + 1);
+    if (*colon != ':') {
+      *error = "missing ':'";
+      return false;
+    }
+  } else {
+    colon = strchr(line, ':');
+    if (colon == NULL) {
+      *error = "missing ':'";
+      return false;
+    }
+
+    *colon = '\0';
+    num_keys = parse_keyname(line, keys);
+  }
+
+  if (num_keys == 0) {
+    *error = "invalid key";
+    return false;
+  }
+
+  char *command = skip_spaces(colon + 1);
+  if (*command == '"' || *command == '\'') {
+    *error = "macros are not supported";
+    return false;
+  }
+
+  enum EditCommand cmd = command_from_name(command);
+  if (cmd == CMD_NONE) {
+    *error = "unknown command";
+    return false;
+  }
+
+  op->type = CONFIG_OP_BIND;
+  op->keymap = *keymap;
+  op->num_keys = num_keys;
+  op->command = cmd;
+  for (size_t i = 0; i < num_keys; ++i) {
+    op->keys[i] = keys[i];
+  }
+
+  return true;
+}
+
+/*
+ * parses a key written the inputrc way, like "Control-a", "C-a", "Meta-f",
+ * "M-Rubout" or "Up". returns the number of keys (always 1), or 0 if the name
+ * is invalid.
+ */
+static size_t parse_keyname(const char *name, int *keys) {
+  static const struct {
+    const char *name;
+    int key;
+  } names[] = {
+      {"Rubout", KEY_BACKSPACE}, {"DEL", KEY_BACKSPACE},
+      {"Escape", KEY_ESC},       {"ESC", KEY_ESC},
+      {"Return", KEY_ENTER},     {"RET", KEY_ENTER},
+      {"Newline", '\n'},         {"LFD", '\n'},
+      {"Space", ' '},            {"SPC", ' '},
+      {"Tab", '\t'},             {"Up", KEY_ARROW_UP},
+      {"Down", KEY_ARROW_DOWN},  {"Left", KEY_ARROW_LEFT},
+      {"Right", KEY_ARROW_RIGHT}, {"Home", KEY_HOME},
+      {"End", KEY_END},          {"Delete", KEY_DELETE},
+      {"PageUp", KEY_PAGE_UP},   {"PageDown", KEY_PAGE_DOWN},
+  };
+
+  bool ctrl = false;
+  bool meta = false;
+
+  while (true) {
+    if (strncmp(name, "Control-", 8) == 0) {
+      ctrl = true;
+      name += 8;
+    } else if (strncmp(name, "C-", 2) == 0) {
+      ctrl = true;
+      name += 2;
+    } else if (strncmp(name, "Meta-", 5) == 0) {
+      meta = true;
+      name += 5;
+    } else if (strncmp(name, "M-", 2) == 0) {
+      meta = true;
+      name += 2;
+    } else {
+      break;
+    }
+  }
+
+  int key = -1;
+  if (name[0] != '\0' && name[1] == '\0') {
+    key = (unsigned char)name[0];
+  } else {
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+      if (strcmp(name, names[i].name) == 0) {
+        key = names[i].key;
+        break;
+      }
+    }
+  }
+
+  if (key == -1) {
+    return 0;
+  }
+
+  if (ctrl) {
+    key = key == '?' ? KEY_BACKSPACE : CTRL_KEY(key);
+  }
+
+  keys[0] = meta ? ALT_KEY(key) : key;
+  return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "keymap.h"
+
+/*
+ * A config file is compiled into a list of operations that `rl_load_config`
+ * applies in order. This is also exactly what's stored in the binary cache,
+ * so a cached config is used straight from the memory mapped file.
+ */
+enum ConfigOpType {
+  CONFIG_OP_BIND,
+  CONFIG_OP_EDITING_MODE,
+  CONFIG_OP_CLIPBOARD_EXPORT,
+};
+
+struct ConfigOp {
+  uint8_t type;     // enum ConfigOpType
+  uint8_t keymap;   // CONFIG_OP_BIND: enum KeymapId
+  uint8_t num_keys; // CONFIG_OP_BIND: number of keys in `keys`
+  uint8_t value;    // the editing mode (enum KeymapId), or 0 / 1 for off / on
+  uint16_t command; // CONFIG_OP_BIND: enum EditCommand
+  uint16_t reserved;
+  int32_t keys[MAX_KEYSEQ_LEN];
+};
+
+struct Config;
+
+struct Config *config_load(const char *path, const char *cache_path);
+bool config_cache_path(const char *path, char *cache_path, size_t size);
+void config_free(struct Config *config);
+
+const struct ConfigOp *config_ops(const struct Config *config, size_t *count);
+bool config_from_cache(const struct Config *config);
+
+#endif
@@ -0,0 +1,725 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>   // for epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/eventfd.h> // for eventfd()
+#include <unistd.h>      // for close(), read(), write()
+
+#include "readline.hpp"
+#include "timer.h"
+
+/*
+ * Runs many sessions on one thread as coroutines (C++20). Each session is
+ * written as straight-line code, & `co_await` suspends it until its line is
+ * complete, while the executor waits on all of their inputs with epoll:
+ *
+ *   rl::Task serve(rl::Executor &executor, int fd) {
+ *     rl::AsyncSession session(executor, fd, fd);
+ *     while (auto result = co_await session.read_line("> ")) {
+ *       handle(result.line);
+ *     }
+ *     close(fd);
+ *   }
+ *
+ *   rl::Executor executor;
+ *   for (int fd : clients) {
+ *     executor.spawn(serve(executor, fd));
+ *   }
+ *   executor.run();
+ *
+ * inputs MUST be something epoll can wait on (a pipe, a socket, a terminal),
+ * not a regular file.
+ */
+
+namespace rl {
+
+class Executor;
+
+/*
+ * a coroutine the executor runs. it doesn't start until it's spawned, & its
+ * frame is freed as soon as it finishes.
+ */
+class Task {
+public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(Handle handle) noexcept;
+    void await_resume() const noexcept {}
+  };
+
+  struct promise_type {
+    Executor *executor = nullptr;
+
+    Task get_return_object() { return Task(Handle::from_promise(*this)); }
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void return_void() const noexcept {}
+    void unhandled_exception() noexcept;
+  };
+
+  Task(Task &&other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  Task &operator=(Task &&) = delete;
+
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+private:
+  friend class Executor;
+
+  explicit Task(Handle handle) : handle_(handle) {}
+
+  Handle handle_;
+};
+
+/*
+ * something the executor waits on: `on_ready` is called once the fd it's
+ * watched for is readable (or at EOF, or closed by the other end).
+ */
+class Watcher {
+public:
+  virtual void on_ready() = 0;
+
+protected:
+  ~Watcher() = default;
+
+private:
+  friend class Executor;
+
+  bool added_ = false; // whether the fd is in the epoll set
+  bool armed_ = false; // whether it's waiting for the fd
+};
+
+/*
+ * something the executor times: `on_timeout` is called once the time it was
+ * started for has passed, unless it's cancelled (or started again) first.
+ * starting & cancelling it are O(1) (see src/timer.c), so it can be pushed
+ * back on every key press.
+ */
+class Timeout {
+public:
+  virtual void on_timeout() = 0;
+
+  bool pending() const { return timer_pending(&timer_); }
+
+protected:
+  Timeout() { timer_init(&timer_, &expired, this); }
+  ~Timeout() { timer_cancel(&timer_); }
+
+  Timeout(const Timeout &) = delete;
+  Timeout &operator=(const Timeout &) = delete;
+
+private:
+  friend class Executor;
+
+  static void expired(::Timer *, void *arg) {
+    static_cast<Timeout *>(arg)->on_timeout();
+  }
+
+  ::Timer timer_;
+};
+
+/*
+ * a single-threaded event loop: runs the tasks that are ready, & when none
+ * are, waits for the fds they're waiting on.
+ */
+class Executor {
+public:
+  /**
+   * @throws std::system_error if the epoll instance can't be made
+   */
+  Executor() : epfd_(epoll_create1(EPOLL_CLOEXEC)) {
+    if (epfd_ == -1) {
+      throw std::system_error(errno, std::generic_category(), "epoll_create1");
+    }
+
+    // `post` wakes up `epoll_wait` through this. it's the only fd in the set
+    // without a watcher.
+    wakefd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (wakefd_ == -1 ||
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, wakefd_, &event) == -1) {
+      int error = errno;
+      if (wakefd_ != -1) {
+        close(wakefd_);
+      }
+      close(epfd_);
+      throw std::system_error(error, std::generic_category(), "eventfd");
+    }
+
+    wheel_ = timer_wheel_init(timer_now());
+    if (wheel_ == nullptr) {
+      close(wakefd_);
+      close(epfd_);
+      throw std::bad_alloc();
+    }
+  }
+
+  // tasks that haven't finished are destroyed along with it
+  ~Executor() {
+    for (void *address : tasks_) {
+      Task::Handle::from_address(address).destroy();
+    }
+    timer_wheel_free(wheel_);
+    close(wakefd_);
+    close(epfd_);
+  }
+
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  /**
+   * hands a task to the executor. it starts running in `run`.
+   *
+   * @param task the task to run
+   */
+  void spawn(Task task) {
+    Task::Handle handle = std::exchange(task.handle_, nullptr);
+    handle.promise().executor = this;
+    tasks_.insert(handle.address());
+    ready_.push_back(handle);
+  }
+
+  /**
+   * runs tasks until all of them have finished.
+   *
+   * @throws whatever a task threw, leaving the rest of them as they were
+   * @throws std::logic_error if tasks are left that nothing will wake up
+   */
+  void run() {
+    epoll_event events[64];
+
+    while (!tasks_.empty()) {
+      // tasks that become ready while these run (e.g. by yielding) wait for
+      // the next round, so everyone waiting on an fd gets a turn in between
+      for (std::size_t n = ready_.size(); n > 0; --n) {
+        std::coroutine_handle<> handle = ready_.front();
+        ready_.pop_front();
+        handle.resume();
+
+        if (error_) {
+          std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+      }
+
+      if (tasks_.empty()) {
+        break;
+      }
+
+      if (ready_.empty() && num_armed_ == 0 && num_expected_ == 0 &&
+          timer_wheel_size(wheel_) == 0) {
+        throw std::logic_error("rl::Executor: tasks are stuck, nothing will "
+                               "wake them up");
+      }
+
+      int timeout =
+          ready_.empty() ? timer_wheel_timeout(wheel_, timer_now()) : 0;
+      int n = epoll_wait(epfd_, events, sizeof(events) / sizeof(events[0]),
+                         timeout);
+      if (n == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(), "epoll_wait");
+      }
+
+      for (int i = 0; i < n; ++i) {
+        if (events[i].data.ptr == nullptr) {
+          take_posted();
+          continue;
+        }
+
+        auto *watcher = static_cast<Watcher *>(events[i].data.ptr);
+        watcher->armed_ = false;
+        --num_armed_;
+        watcher->on_ready();
+      }
+
+      // after the fds, so a timeout that input came in for is cancelled
+      // before it's due
+      timer_wheel_advance(wheel_, timer_now());
+    }
+  }
+
+  // the number of tasks that haven't finished
+  std::size_t num_tasks() const { return tasks_.size(); }
+
+  /**
+   * makes a suspended coroutine run again, in the next round of `run`.
+   */
+  void schedule(std::coroutine_handle<> handle) { ready_.push_back(handle); }
+
+  /**
+   * tells `run` that a coroutine is suspended until another thread `post`s
+   * it, so it doesn't count as stuck in the meantime.
+   */
+  void expect_post() { ++num_expected_; }
+
+  /**
+   * like `schedule`, but from any thread, waking up `run` if it's waiting.
+   * `expect_post` MUST have been called for it first, from the executor's
+   * thread.
+   */
+  void post(std::coroutine_handle<> handle) {
+    {
+      std::lock_guard<std::mutex> lock(posted_lock_);
+      posted_.push_back(handle);
+    }
+
+    std::uint64_t one = 1;
+    // it only fails if the counter would overflow, & then it's readable
+    // anyway
+    [[maybe_unused]] ssize_t n = write(wakefd_, &one, sizeof(one));
+  }
+
+  /**
+   * for `co_await executor.yield()`: lets every other task that's ready (or
+   * whose fd is) run before this one carries on.
+   */
+  auto yield() {
+    struct Awaiter {
+      Executor &executor;
+
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        executor.schedule(handle);
+      }
+      void await_resume() const noexcept {}
+    };
+
+    return Awaiter{*this};
+  }
+
+  /**
+   * for `co_await executor.readable(fd)`: lets the other tasks run until `fd`
+   * is readable (or at EOF, or closed by the other end).
+   */
+  auto readable(int fd) {
+    struct Awaiter : Watcher {
+      Executor &executor;
+      int fd;
+      std::coroutine_handle<> waiting;
+
+      Awaiter(Executor &executor, int fd) : executor(executor), fd(fd) {}
+      ~Awaiter() { executor.unwatch(*this, fd); }
+
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        waiting = handle;
+        executor.watch(*this, fd);
+      }
+      void await_resume() const noexcept {}
+
+      void on_ready() override { executor.schedule(waiting); }
+    };
+
+    return Awaiter(*this, fd);
+  }
+
+  /**
+   * calls `timeout.on_timeout()` once `after` has passed, in `run`. if it's
+   * pending already, it's pushed back (or forward) instead.
+   */
+  void start_timeout(Timeout &timeout, std::chrono::milliseconds after) {
+    timer_start(wheel_, &timeout.timer_, timer_now() + after.count());
+  }
+
+  void cancel_timeout(Timeout &timeout) { timer_cancel(&timeout.timer_); }
+
+  /**
+   * for `co_await executor.sleep(duration)`: lets the other tasks run until
+   * `duration` has passed.
+   */
+  auto sleep(std::chrono::milliseconds duration) {
+    struct Awaiter : Timeout {
+      Executor &executor;
+      std::chrono::milliseconds duration;
+      std::coroutine_handle<> waiting;
+
+      Awaiter(Executor &executor, std::chrono::milliseconds duration)
+          : executor(executor), duration(duration) {}
+
+      bool await_ready() const noexcept { return duration.count() <= 0; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        waiting = handle;
+        executor.start_timeout(*this, duration);
+      }
+      void await_resume() const noexcept {}
+
+      void on_timeout() override { executor.schedule(waiting); }
+    };
+
+    return Awaiter(*this, duration);
+  }
+
+  /**
+   * calls `watcher.on_ready()` once `fd` is readable. it's a one-off: the
+   * watcher has to watch again for the next time.
+   *
+   * @throws std::system_error if epoll can't watch `fd`
+   */
+  void watch(Watcher &watcher, int fd) {
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = &watcher;
+
+    int op = watcher.added_ ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epfd_, op, fd, &event) == -1) {
+      throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+    }
+
+    watcher.added_ = true;
+    if (!watcher.armed_) {
+      watcher.armed_ = true;
+      ++num_armed_;
+    }
+  }
+
+  /**
+   * stops watching `fd`. it MUST be called before the watcher or the fd go
+   * away.
+   */
+  void unwatch(Watcher &watcher, int fd) {
+    if (!watcher.added_) {
+      return;
+    }
+
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+    watcher.added_ = false;
+
+    if (watcher.armed_) {
+      watcher.armed_ = false;
+      --num_armed_;
+    }
+  }
+
+private:
+  friend class Task;
+
+  void finished(Task::Handle handle) {
+    tasks_.erase(handle.address());
+    handle.destroy();
+  }
+
+  void failed(std::exception_ptr error) {
+    if (!error_) {
+      error_ = error;
+    }
+  }
+
+  // moves what other threads posted to the ready queue
+  void take_posted() {
+    std::uint64_t count;
+    [[maybe_unused]] ssize_t n = read(wakefd_, &count, sizeof(count));
+
+    std::lock_guard<std::mutex> lock(posted_lock_);
+    for (std::coroutine_handle<> handle : posted_) {
+      ready_.push_back(handle);
+    }
+    num_expected_ -= posted_.size();
+    posted_.clear();
+  }
+
+  int epfd_;
+  int wakefd_;
+  TimerWheel *wheel_;
+
+  std::unordered_set<void *> tasks_; // the tasks that haven't finished
+  std::deque<std::coroutine_handle<>> ready_;
+  std::size_t num_armed_ = 0; // watchers waiting for their fd
+
+  std::mutex posted_lock_;
+  std::vector<std::coroutine_handle<>> posted_; // by other threads
+  std::size_t num_expected_ = 0; // coroutines waiting to be posted
+
+  std::exception_ptr error_; // what a task threw, for `run` to rethrow
+};
+
+inline void Task::FinalAwaiter::await_suspend(Handle handle) noexcept {
+  handle.promise().executor->finished(handle);
+}
+
+inline void Task::promise_type::unhandled_exception() noexcept {
+  executor->failed(std::current_exception());
+}
+
+/*
+ * a session whose lines are read with `co_await`. the executor keeps a
+ * pointer to it, so it can't be moved.
+ *
+ * while it waits for input, it times what a terminal would: the rest of an
+ * escape sequence is waited for for `RL_KEY_TIMEOUT_MS` (so a lone ESC is
+ * still ESC), & optionally, the line is dropped after a while without input
+ * (`set_idle_timeout`), & the prompt is redrawn when its segments change
+ * (`set_prompt_refresh`). a session nobody types in can also give back the
+ * memory it only needs while keys come in (`set_compact_after`).
+ */
+class AsyncSession : private Watcher {
+public:
+  /**
+   * makes a new session, like `rl::Session` does. `in_fd` is read without
+   * ever waiting on it.
+   *
+   * @throws std::bad_alloc if the session can't be allocated
+   */
+  AsyncSession(
+      Executor &executor, int in_fd, int out_fd,
+      std::size_t max_line_len = RL_DEFAULT_MAX_LINE_LEN,
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : executor_(executor), in_fd_(in_fd),
+        session_(in_fd, out_fd, max_line_len, resource) {}
+
+  ~AsyncSession() { executor_.unwatch(*this, in_fd_); }
+
+  AsyncSession(const AsyncSession &) = delete;
+  AsyncSession &operator=(const AsyncSession &) = delete;
+
+  /**
+   * for `co_await session.read_line(prompt)`: suspends the coroutine until
+   * the line is complete. whatever input is there already is handled right
+   * away, without suspending.
+   *
+   * @param prompt the prompt to display before reading the line. it MUST stay
+   * valid until the line is complete.
+   *
+   * @return an awaitable that results in a `Session::Result`, which is never
+   * pending. it's `timed_out` if the idle timeout passed.
+   */
+  auto read_line(const char *prompt) {
+    struct Awaiter {
+      AsyncSession &s;
+      const char *prompt;
+
+      bool await_ready() {
+        s.result_ = s.session_.try_read_line(prompt);
+        return s.result_.status != Session::Status::pending;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+        s.wait(handle, prompt, false);
+      }
+
+      Session::Result await_resume() const { return s.result_; }
+    };
+
+    return Awaiter{*this, prompt};
+  }
+
+  /**
+   * for `co_await session.read_keys(prompt)`: like `read_line`, but it also
+   * resumes the coroutine when the line is begun, & whenever keys were
+   * handled without completing it, e.g. to send the line somewhere as it's
+   * typed (see `Session::pending_line`). awaiting it again carries on with
+   * the same line.
+   *
+   * @return an awaitable that results in a `Session::Result`, which is
+   * pending if the line isn't complete yet
+   */
+  auto read_keys(const char *prompt) {
+    struct Awaiter {
+      AsyncSession &s;
+      const char *prompt;
+
+      bool await_ready() {
+        RLLineView view;
+        bool begun = s.session_.pending_line(view);
+        std::uint64_t handled = s.session_.input_handled();
+
+        s.result_ = s.session_.try_read_line(prompt);
+        return s.result_.status != Session::Status::pending || !begun ||
+               s.session_.input_handled() != handled;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+        s.wait(handle, prompt, true);
+      }
+
+      Session::Result await_resume() const { return s.result_; }
+    };
+
+    return Awaiter{*this, prompt};
+  }
+
+  /**
+   * drops the line being read once `timeout` passes without any input, &
+   * `read_line` results in `Session::Status::timed_out`. 0 (the default)
+   * never does.
+   */
+  void set_idle_timeout(std::chrono::milliseconds timeout) {
+    idle_after_ = timeout;
+  }
+
+  /**
+   * checks whether the prompt's segments changed every `interval` while
+   * waiting for input, & redraws it if they did. 0 (the default) never does.
+   */
+  void set_prompt_refresh(std::chrono::milliseconds interval) {
+    refresh_every_ = interval;
+  }
+
+  /**
+   * compacts the session (see `Session::compact`) once `idle` passes without
+   * any input while it waits for a line, so thousands of idle sessions take
+   * up as little as they can. 0 (the default) never does.
+   */
+  void set_compact_after(std::chrono::milliseconds idle) {
+    compact_after_ = idle;
+  }
+
+  Session &session() { return session_; }
+
+private:
+  // calls one of the session's handlers when it expires
+  struct SessionTimeout final : Timeout {
+    SessionTimeout(AsyncSession &s, void (AsyncSession::*handler)())
+        : s(s), handler(handler) {}
+
+    void on_timeout() override { (s.*handler)(); }
+
+    AsyncSession &s;
+    void (AsyncSession::*handler)();
+  };
+
+  void wait(std::coroutine_handle<> handle, const char *prompt,
+            bool each_key) {
+    waiting_ = handle;
+    prompt_ = prompt;
+    each_key_ = each_key;
+    executor_.watch(*this, in_fd_);
+    start_timeouts();
+  }
+
+  void on_ready() override {
+    std::uint64_t handled = session_.input_handled();
+    result_ = session_.try_read_line(prompt_);
+    if (result_.status == Session::Status::pending &&
+        (!each_key_ || session_.input_handled() == handled)) {
+      executor_.watch(*this, in_fd_);
+      start_timeouts();
+      return;
+    }
+
+    complete();
+  }
+
+  // the rest of the escape sequence didn't come in time
+  void on_key_timeout() {
+    result_ = session_.expire_key();
+    if (result_.status == Session::Status::pending && !each_key_) {
+      start_timeouts();
+      return;
+    }
+
+    executor_.unwatch(*this, in_fd_);
+    complete();
+  }
+
+  void on_idle_timeout() {
+    session_.cancel_line();
+    result_ = {Session::Status::timed_out, {}};
+
+    executor_.unwatch(*this, in_fd_);
+    complete();
+  }
+
+  void on_refresh_timeout() {
+    if (session_.prompt_outdated()) {
+      // redraws it, & handles the input that's there already, if any
+      result_ = session_.try_read_line(prompt_);
+      if (result_.status != Session::Status::pending || each_key_) {
+        executor_.unwatch(*this, in_fd_);
+        complete();
+        return;
+      }
+    }
+
+    executor_.start_timeout(refresh_timeout_, refresh_every_);
+  }
+
+  void on_compact_timeout() { session_.compact(); }
+
+  /*
+   * (re)starts the timeouts after some input was handled: the idle timeout
+   * starts over, & the key timeout only runs while a key is cut off.
+   */
+  void start_timeouts() {
+    if (session_.key_incomplete()) {
+      executor_.start_timeout(key_timeout_,
+                              std::chrono::milliseconds(RL_KEY_TIMEOUT_MS));
+    } else {
+      executor_.cancel_timeout(key_timeout_);
+    }
+
+    if (idle_after_.count() > 0) {
+      executor_.start_timeout(idle_timeout_, idle_after_);
+    }
+
+    if (refresh_every_.count() > 0 && !refresh_timeout_.pending()) {
+      executor_.start_timeout(refresh_timeout_, refresh_every_);
+    }
+
+    if (compact_after_.count() > 0) {
+      executor_.start_timeout(compact_timeout_, compact_after_);
+    }
+  }
+
+  void complete() {
+    executor_.cancel_timeout(key_timeout_);
+    executor_.cancel_timeout(idle_timeout_);
+    executor_.cancel_timeout(refresh_timeout_);
+    executor_.cancel_timeout(compact_timeout_);
+
+    executor_.schedule(std::exchange(waiting_, nullptr));
+  }
+
+  Executor &executor_;
+  int in_fd_;
+  Session session_;
+
+  // the coroutine waiting for a line, the prompt it's waiting with, & whether
+  // it's waiting for any keys at all (`read_keys`)
+  std::coroutine_handle<> waiting_;
+  const char *prompt_ = nullptr;
+  bool each_key_ = false;
+
+  Session::Result result_ = {Session::Status::pending, {}};
+
+  std::chrono::milliseconds idle_after_{0};
+  std::chrono::milliseconds refresh_every_{0};
+  std::chrono::milliseconds compact_after_{0};
+
+  SessionTimeout key_timeout_{*this, &AsyncSession::on_key_timeout};
+  SessionTimeout idle_timeout_{*this, &AsyncSession::on_idle_timeout};
+  SessionTimeout refresh_timeout_{*this, &AsyncSession::on_refresh_timeout};
+  SessionTimeout compact_timeout_{*this, &AsyncSession::on_compact_timeout};
+};
+
+} // namespace rl
+
+#endif
@@ -0,0 +1,709 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h> // for strcmp()
+
+#include "./keymap.h"
+#include "./vector.h"
+
+/*
+ * A keymap is compiled into a flat table with one slot per key, so looking up
+ * the command for a key is a single array access. The slots are the 256 byte
+ * values, then the special keys (arrows, HOME, etc.), and then all of them
+ * again with Alt held down.
+ *
+ * Bindings of more than one key (like Ctrl+X e, or dd in vi) can't fit in the
+ * table. The slot of their first key is marked as a prefix & points to a node
+ * of a small trie that holds the rest of the keys. The trie nodes of a keymap
+ * all live in one array, & the children of a node are linked through
+ * `next_sibling`, since a node rarely has more than a few of them.
+ */
+
+#define NUM_SPECIAL_KEYS (KEY_PAGE_DOWN - KEY_ARROW_UP + 1)
+#define SLOTS_PER_MODIFIER (256 + NUM_SPECIAL_KEYS)
+#define KEYMAP_SIZE (2 * SLOTS_PER_MODIFIER)
+
+struct KeyBinding {
+  uint16_t command; // enum EditCommand
+  uint16_t node;    // if `command` is CMD_PREFIX, the trie node for the rest
+};
+
+struct TrieNode {
+  int key;
+  uint16_t command; // enum EditCommand
+  uint16_t first_child;
+  uint16_t next_sibling;
+};
+
+struct Keymap {
+  enum KeymapId id;
+  struct KeyBinding table[KEYMAP_SIZE];
+
+  // the trie for multi-key bindings (each element is a `struct TrieNode`).
+  // node 0 is never used, so that 0 can mean "no node".
+  struct Vector *nodes;
+};
+
+/*
+ * the built-in bindings, compiled into each keymap when it's created.
+ */
+struct DefaultBinding {
+  int keys[3]; // unused keys are 0
+  enum EditCommand cmd;
+};
+
+static const struct DefaultBinding emacs_bindings[] = {
+    {{KEY_ENTER}, CMD_ACCEPT_LINE},
+    {{CTRL_KEY('c')}, CMD_INTERRUPT},
+    {{CTRL_KEY('d')}, CMD_END_OF_FILE},
+    {{KEY_BACKSPACE}, CMD_BACKWARD_DELETE_CHAR},
+    {{KEY_DELETE}, CMD_DELETE_CHAR},
+    {{KEY_ARROW_UP}, CMD_PREVIOUS_HISTORY},
+    {{KEY_ARROW_DOWN}, CMD_NEXT_HISTORY},
+    {{CTRL_KEY('b')}, CMD_BACKWARD_CHAR},
+    {{KEY_ARROW_LEFT}, CMD_BACKWARD_CHAR},
+    {{CTRL_KEY('f')}, CMD_FORWARD_CHAR},
+    {{KEY_ARROW_RIGHT}, CMD_FORWARD_CHAR},
+    {{CTRL_KEY('a')}, CMD_BEGINNING_OF_LINE},
+    {{KEY_HOME}, CMD_BEGINNING_OF_LINE},
+    {{CTRL_KEY('e')}, CMD_END_OF_LINE},
+    {{KEY_END}, CMD_END_OF_LINE},
+    {{ALT_KEY('b')}, CMD_BACKWARD_WORD},
+    {{ALT_KEY('f')}, CMD_FORWARD_WORD},
+    {{CTRL_KEY('k')}, CMD_KILL_LINE},
+    {{CTRL_KEY('u')}, CMD_UNIX_LINE_DISCARD},
+    {{CTRL_KEY('w')}, CMD_UNIX_WORD_RUBOUT},
+    {{ALT_KEY('d')}, CMD_KILL_WORD},
+    {{ALT_KEY(KEY_BACKSPACE)}, CMD_BACKWARD_KILL_WORD},
+    {{CTRL_KEY('y')}, CMD_YANK},
+    {{ALT_KEY('y')}, CMD_YANK_POP},
+    {{ALT_KEY('0')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('1')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('2')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('3')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('4')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('5')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('6')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('7')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('8')}, CMD_DIGIT_ARGUMENT},
+    {{ALT_KEY('9')}, CMD_DIGIT_ARGUMENT},
+    {{CTRL_KEY('x'), '('}, CMD_START_KBD_MACRO},
+    {{CTRL_KEY('x'), ')'}, CMD_END_KBD_MACRO},
+    {{CTRL_KEY('x'), 'e'}, CMD_CALL_LAST_KBD_MACRO},
+    {{ALT_KEY(CTRL_KEY('j'))}, CMD_VI_EDITING_MODE},
+};
+
+static const struct DefaultBinding vi_insert_bindings[] = {
+    {{KEY_ENTER}, CMD_ACCEPT_LINE},
+    {{CTRL_KEY('c')}, CMD_INTERRUPT},
+    {{CTRL_KEY('d')}, CMD_END_OF_FILE},
+    {{KEY_BACKSPACE}, CMD_BACKWARD_DELETE_CHAR},
+    {{KEY_DELETE}, CMD_DELETE_CHAR},
+    {{KEY_ARROW_UP}, CMD_PREVIOUS_HISTORY},
+    {{KEY_ARROW_DOWN}, CMD_NEXT_HISTORY},
+    {{KEY_ARROW_LEFT}, CMD_BACKWARD_CHAR},
+    {{KEY_ARROW_RIGHT}, CMD_FORWARD_CHAR},
+    {{KEY_HOME}, CMD_BEGINNING_OF_LINE},
+    {{KEY_END}, CMD_END_OF_LINE},
+    {{CTRL_KEY('u')}, CMD_UNIX_LINE_DISCARD},
+    {{CTRL_KEY('w')}, CMD_UNIX_WORD_RUBOUT},
+    {{CTRL_KEY('y')}, CMD_YANK},
+    {{KEY_ESC}, CMD_VI_MOVEMENT_MODE},
+    {{ALT_KEY(CTRL_KEY('j'))}, CMD_EMACS_EDITING_MODE},
+};
+
+static const struct DefaultBinding vi_command_bindings[] = {
+    {{KEY_ENTER}, CMD_ACCEPT_LINE},
+    {{CTRL_KEY('c')}, CMD_INTERRUPT},
+    {{CTRL_KEY('d')}, CMD_END_OF_FILE},
+    {{KEY_BACKSPACE}, CMD_BACKWARD_CHAR},
+    {{KEY_DELETE}, CMD_DELETE_CHAR},
+    {{KEY_ARROW_UP}, CMD_PREVIOUS_HISTORY},
+    {{'k'}, CMD_PREVIOUS_HISTORY},
+    {{KEY_ARROW_DOWN}, CMD_NEXT_HISTORY},
+    {{'j'}, CMD_NEXT_HISTORY},
+    {{KEY_ARROW_LEFT}, CMD_BACKWARD_CHAR},
+    {{'h'}, CMD_BACKWARD_CHAR},
+    {{KEY_ARROW_RIGHT}, CMD_FORWARD_CHAR},
+    {{'l'}, CMD_FORWARD_CHAR},
+    {{' '}, CMD_FORWARD_CHAR},
+    {{KEY_HOME}, CMD_BEGINNING_OF_LINE},
+    {{'0'}, CMD_BEGINNING_OF_LINE},
+    {{'^'}, CMD_BEGINNING_OF_LINE},
+    {{KEY_END}, CMD_END_OF_LINE},
+    {{'$'}, CMD_END_OF_LINE},
+    {{'w'}, CMD_VI_NEXT_WORD},
+    {{'b'}, CMD_BACKWARD_WORD},
+    {{'e'}, CMD_VI_END_WORD},
+    {{'x'}, CMD_DELETE_CHAR},
+    {{'X'}, CMD_BACKWARD_DELETE_CHAR},
+    {{'D'}, CMD_KILL_LINE},
+    {{'d', 'd'}, CMD_KILL_WHOLE_LINE},
+    {{'d', 'w'}, CMD_KILL_WORD},
+    {{'d', 'b'}, CMD_BACKWARD_KILL_WORD},
+    {{'d', '$'}, CMD_KILL_LINE},
+    {{'d', '0'}, CMD_UNIX_LINE_DISCARD},
+    {{'p'}, CMD_VI_PUT},
+    {{'P'}, CMD_YANK},
+    {{'i'}, CMD_VI_INSERTION_MODE},
+    {{'I'}, CMD_VI_INSERT_BEG},
+    {{'a'}, CMD_VI_APPEND_MODE},
+    {{'A'}, CMD_VI_APPEND_EOL},
+    {{ALT_KEY(CTRL_KEY('j'))}, CMD_EMACS_EDITING_MODE},
+};
+
+static const char *const command_names[NUM_COMMANDS] = {
+    [CMD_NONE] = "",
+    [CMD_PREFIX] = "",
+    [CMD_SELF_INSERT] = "self-insert",
+    [CMD_ACCEPT_LINE] = "accept-line",
+    [CMD_INTERRUPT] = "interrupt",
+    [CMD_END_OF_FILE] = "end-of-file",
+    [CMD_BACKWARD_CHAR] = "backward-char",
+    [CMD_FORWARD_CHAR] = "forward-char",
+    [CMD_BACKWARD_WORD] = "backward-word",
+    [CMD_FORWARD_WORD] = "forward-word",
+    [CMD_BEGINNING_OF_LINE] = "beginning-of-line",
+    [CMD_END_OF_LINE] = "end-of-line",
+    [CMD_PREVIOUS_HISTORY] = "previous-history",
+    [CMD_NEXT_HISTORY] = "next-history",
+    [CMD_BACKWARD_DELETE_CHAR] = "backward-delete-char",
+    [CMD_DELETE_CHAR] = "delete-char",
+    [CMD_KILL_LINE] = "kill-line",
+    [CMD_UNIX_LINE_DISCARD] = "unix-line-discard",
+    [CMD_KILL_WHOLE_LINE] = "kill-whole-line",
+    [CMD_UNIX_WORD_RUBOUT] = "unix-word-rubout",
+    [CMD_KILL_WORD] = "kill-word",
+    [CMD_BACKWARD_KILL_WORD] = "backward-kill-word",
+    [CMD_YANK] = "yank",
+    [CMD_YANK_POP] = "yank-pop",
+    [CMD_DIGIT_ARGUMENT] = "digit-argument",
+    [CMD_START_KBD_MACRO] = "start-kbd-macro",
+    [CMD_END_KBD_MACRO] = "end-kbd-macro",
+    [CMD_CALL_LAST_KBD_MACRO] = "call-last-kbd-macro",
+    [CMD_EMACS_EDITING_MODE] = "emacs-editing-mode",
+    [CMD_VI_EDITING_MODE] = "vi-editing-mode",
+    [CMD_VI_MOVEMENT_MODE] = "vi-movement-mode",
+    [CMD_VI_INSERTION_MODE] = "vi-insertion-mode",
+    [CMD_VI_INSERT_BEG] = "vi-insert-beg",
+    [CMD_VI_APPEND_MODE] = "vi-append-mode",
+    [CMD_VI_APPEND_EOL] = "vi-append-eol",
+    [CMD_VI_NEXT_WORD] = "vi-next-word",
+    [CMD_VI_END_WORD] = "vi-end-word",
+    [CMD_VI_PUT] = "vi-put",
+};
+
+static int key_slot(int key);
+static const char *parse_key(const char *seq, int *key);
+static size_t fold_escapes(int *keys, size_t len);
+static bool load_defaults(struct Keymap *keymap,
+                          const struct DefaultBinding *bindings, size_t count);
+static uint16_t new_node(struct Keymap *keymap, int key);
+static struct TrieNode *get_node(const struct Keymap *keymap, uint16_t index);
+
+/**
+ * the name of a command, as used in config files.
+ */
+const char *command_name(enum EditCommand cmd) {
+  assert(cmd < NUM_COMMANDS);
+
+  return command_names[cmd];
+}
+
+/**
+ * finds a command by its name. returns `CMD_NONE` if there's no such command.
+ *
+ * @param name the name of the command, e.g. "beginning-of-line"
+ */
+enum EditCommand command_from_name(const char *name) {
+  assert(name != NULL);
+
+  for (int cmd = CMD_SELF_INSERT; cmd < NUM_COMMANDS; ++cmd) {
+    if (strcmp(command_names[cmd], name) == 0) {
+      return cmd;
+    }
+  }
+
+  return CMD_NONE;
+}
+
+/**
+ * creates a keymap with the default bindings of the given mode. returns NULL
+ * if memory allocation fails.
+ *
+ * @param id which mode's default bindings to compile into the keymap
+ */
+struct Keymap *keymap_init(enum KeymapId id) {
+  assert(id < NUM_KEYMAPS);
+
+  struct Keymap *keymap = malloc(sizeof(struct Keymap));
+  if (keymap == NULL) {
+    return NULL;
+  }
+
+  keymap->id = id;
+  memset(keymap->table, 0, sizeof(keymap->table));
+
+  keymap->nodes = vector_init(sizeof(struct TrieNode), 0);
+  if (keymap->nodes == NULL) {
+    free(keymap);
+    return NULL;
+  }
+
+  // the unused node 0
+  struct TrieNode nil = {0};
+  vector_push(keymap->nodes, &nil);
+
+  // every printable key types itself, except in vi command mode
+  if (id != KEYMAP_VI_COMMAND) {
+    for (int key = ' '; key <= '~'; ++key) {
+      keymap->table[key_slot(key)].command = CMD_SELF_INSERT;
+    }
+  }
+
+  bool ok = false;
+  switch (id) {
+  case KEYMAP_EMACS:
+    ok = load_defaults(keymap, emacs_bindings,
+                       sizeof(emacs_bindings) / sizeof(emacs_bindings[0]));
+    break;
+
+  case KEYMAP_VI_INSERT:
+    ok = load_defaults(keymap, vi_insert_bindings,
+                       sizeof(vi_insert_bindings) /
+                           sizeof(vi_insert_bindings[0]));
+    break;
+
+  case KEYMAP_VI_COMMAND:
+    ok = load_defaults(keymap, vi_command_bindings,
+                       sizeof(vi_command_bindings) /
+                           sizeof(vi_command_bindings[0]));
+    break;
+
+  case NUM_KEYMAPS:
+    break;
+  }
+
+  if (!ok) {
+    keymap_free(keymap);
+    return NULL;
+  }
+
+  return keymap;
+}
+
+/**
+ * frees the keymap
+ *
+ * @param keymap the keymap to free
+ */
+void keymap_free(struct Keymap *keymap) {
+  assert(keymap != NULL);
+
+  vector_free(keymap->nodes);
+  free(keymap);
+}
+
+/**
+ * which mode the keymap is for
+ */
+enum KeymapId keymap_id(const struct Keymap *keymap) {
+  assert(keymap != NULL);
+
+  return keymap->id;
+}
+
+/**
+ * finds a keymap by the name readline uses for it ("emacs", "vi-insert",
+ * "vi-command", or "vi-move" / "vi" for vi command mode). returns false if
+ * there's no such keymap.
+ *
+ * @param name the name of the keymap
+ * @param id pointer to store the keymap found
+ */
+bool keymap_id_from_name(const char *name, enum KeymapId *id) {
+  assert(name != NULL);
+  assert(id != NULL);
+
+  if (strcmp(name, "emacs") == 0 || strcmp(name, "emacs-standard") == 0) {
+    *id = KEYMAP_EMACS;
+  } else if (strcmp(name, "vi-insert") == 0) {
+    *id = KEYMAP_VI_INSERT;
+  } else if (strcmp(name, "vi-command") == 0 || strcmp(name, "vi-move") == 0 ||
+             strcmp(name, "vi") == 0) {
+    *id = KEYMAP_VI_COMMAND;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * parses a key sequence written the way readline's inputrc writes them, like
+ * "\C-x\C-e", "\M-f" or "\e[A", into keys as `read_key` would return them.
+ *
+ * supported escapes are \C-<key> (Ctrl), \M-<key> (Alt), \e (ESC), \t,
+ * \n, \r, \\, \" and \'. the escape sequences of special keys, like
+ * "\e[A" for ARROW UP, & ESC followed by a key (Alt+<key>) are turned into
+ * single keys, just like `read_key` does.
+ *
+ * @param seq the key sequence
+ * @param keys where to store the keys
+ * @param max_keys the max number of keys that fit in `keys`
+ *
+ * @return the number of keys, or 0 if the sequence is empty, malformed or too
+ * long
+ */
+size_t keymap_parse_keyseq(const char *seq, int *keys, size_t max_keys) {
+  assert(seq != NULL);
+  assert(keys != NULL);
+
+  // escape sequences are folded later, so give them some room
+  int raw[MAX_KEYSEQ_LEN * 4];
+  size_t len = 0;
+
+  while (*seq != '\0') {
+    if (len == sizeof(raw) / sizeof(raw[0])) {
+      return 0;
+    }
+
+    seq = parse_key(seq, &raw[len]);
+    if (seq == NULL) {
+      return 0;
+    }
+
+    ++len;
+  }
+
+  len = fold_escapes(raw, len);
+  if (len == 0 || len > max_keys) {
+    return 0;
+  }
+
+  memcpy(keys, raw, len * sizeof(int));
+
+  return len;
+}
+
+/**
+ * binds a sequence of keys to a command, replacing any binding it had. binding
+ * a sequence also replaces the bindings of any longer sequence it's a prefix
+ * of. returns false if the sequence can't be bound (too long, or has a key
+ * that doesn't fit in the table) or memory allocation fails.
+ *
+ * @param keymap the keymap to add the binding to
+ * @param keys the keys, as returned by `read_key`
+ * @param num_keys the number of keys
+ * @param cmd the command to bind the keys to. `CMD_NONE` unbinds them.
+ */
+bool keymap_bind(struct Keymap *keymap, const int *keys, size_t num_keys,
+                 enum EditCommand cmd) {
+  assert(keymap != NULL);
+  assert(keys != NULL);
+  assert(cmd != CMD_PREFIX && cmd < NUM_COMMANDS);
+
+  if (num_keys == 0 || num_keys > MAX_KEYSEQ_LEN) {
+    return false;
+  }
+
+  int slot = key_slot(keys[0]);
+  if (slot < 0) {
+    return false;
+  }
+
+  struct KeyBinding *binding = &keymap->table[slot];
+  if (num_keys == 1) {
+    binding->command = cmd;
+    binding->node = 0;
+    return true;
+  }
+
+  // the first key becomes a prefix, with its own (empty) trie node
+  if (binding->command != CMD_PREFIX) {
+    uint16_t node = new_node(keymap, keys[0]);
+    if (node == 0) {
+      return false;
+    }
+
+    binding->command = CMD_PREFIX;
+    binding->node = node;
+  }
+
+  // walk down the trie, adding the missing nodes
+  uint16_t parent = binding->node;
+  for (size_t i = 1; i < num_keys; ++i) {
+    uint16_t child = get_node(keymap, parent)->first_child;
+    while (child != 0 && get_node(keymap, child)->key != keys[i]) {
+      child = get_node(keymap, child)->next_sibling;
+    }
+
+    if (child == 0) {
+      child = new_node(keymap, keys[i]);
+      if (child == 0) {
+        return false;
+      }
+
+      // `new_node` may have moved the nodes, so look the parent up again
+      get_node(keymap, child)->next_sibling =
+          get_node(keymap, parent)->first_child;
+      get_node(keymap, parent)->first_child = child;
+    }
+
+    struct TrieNode *node = get_node(keymap, child);
+    if (i == num_keys - 1) {
+      node->command = cmd;
+      node->first_child = 0;
+    } else {
+      node->command = CMD_PREFIX;
+    }
+
+    parent = child;
+  }
+
+  return true;
+}
+
+/**
+ * finds the command bound to a key.
+ *
+ * `node` carries the state of multi-key bindings between calls. it must be 0
+ * before the first key of a sequence. if the key is the start (or the middle)
+ * of a multi-key binding, `CMD_PREFIX` is returned and `node` is set, so that
+ * the next call continues from there. otherwise `node` is reset to 0.
+ *
+ * @param keymap the keymap to look in
+ * @param key the key, as returned by `read_key`
+ * @param node where the lookup is in the trie
+ *
+ * @return the command bound to the key (or the sequence ending with it), or
+ * `CMD_NONE` if there isn't one
+ */
+enum EditCommand keymap_lookup(const struct Keymap *keymap, int key,
+                               uint16_t *node) {
+  assert(keymap != NULL);
+  assert(node != NULL);
+
+  // the common case: the first key of a sequence is a single table access
+  if (*node == 0) {
+    int slot = key_slot(key);
+    if (slot < 0) {
+      return CMD_NONE;
+    }
+
+    struct KeyBinding binding = keymap->table[slot];
+    if (binding.command == CMD_PREFIX) {
+      *node = binding.node;
+    }
+
+    return binding.command;
+  }
+
+  uint16_t child = get_node(keymap, *node)->first_child;
+  *node = 0;
+
+  for (; child != 0; child = get_node(keymap, child)->next_sibling) {
+    struct TrieNode *n = get_node(keymap, child);
+    if (n->key == key) {
+      if (n->command == CMD_PREFIX) {
+        *node = child;
+      }
+
+      return n->command;
+    }
+  }
+
+  return CMD_NONE;
+}
+
+/*
+ * where a key lives in the flat table, or -1 if it has no slot.
+ */
+static int key_slot(int key) {
+  int offset = key & ALT_BIT ? SLOTS_PER_MODIFIER : 0;
+  key &= ~ALT_BIT;
+
+  if (key >= 0 && key < 256) {
+    return offset + key;
+  }
+
+  if (key >= KEY_ARROW_UP && key <= KEY_PAGE_DOWN) {
+    return offset + 256 + (key - KEY_ARROW_UP);
+  }
+
+  return -1;
+}
+
+/*
+ * parses one key of a key sequence & returns what's after it, or NULL if the
+ * key is malformed.
+ */
+static const char *parse_key(const char *seq, int *key) {
+  if (seq[0] != '\\') {
+    *key = (unsigned char)seq[0];
+    return seq + 1;
+  }
+
+  switch (seq[1]) {
+  case 'C':
+    if (seq[2] != '-' || seq[3] == '\0') {
+      return NULL;
+    }
+
+    // \C-? is how readline writes DEL (BACKSPACE)
+    *key = seq[3] == '?' ? KEY_BACKSPACE : CTRL_KEY(seq[3]);
+    return seq + 4;
+
+  case 'M':
+    if (seq[2] != '-' || seq[3] == '\0') {
+      return NULL;
+    }
+
+    seq = parse_key(seq + 3, key);
+    *key = ALT_KEY(*key);
+    return seq;
+
+  case 'e':
+    *key = KEY_ESC;
+    return seq + 2;
+
+  case 't':
+    *key = '\t';
+    return seq + 2;
+
+  case 'n':
+    *key = '\n';
+    return seq + 2;
+
+  case 'r':
+    *key = '\r';
+    return seq + 2;
+
+  case '\\':
+  case '"':
+  case '\'':
+    *key = seq[1];
+    return seq + 2;
+  }
+
+  return NULL;
+}
+
+/*
+ * turns the escape sequences in `keys` into the keys `read_key` would have
+ * returned for them, in place. returns the new number of keys.
+ */
+static size_t fold_escapes(int *keys, size_t len) {
+  size_t out = 0;
+
+  for (size_t i = 0; i < len; ++i) {
+    if (keys[i] != KEY_ESC || i + 1 == len) {
+      keys[out++] = keys[i];
+      continue;
+    }
+
+    int next = keys[i + 1];
+    if ((next == '[' || next == 'O') && i + 2 < len) {
+      int key = 0;
+      size_t used = 3;
+
+      switch (keys[i + 2]) {
+      case 'A':
+        key = KEY_ARROW_UP;
+        break;
+      case 'B':
+        key = KEY_ARROW_DOWN;
+        break;
+      case 'C':
+        key = KEY_ARROW_RIGHT;
+        break;
+      case 'D':
+        key = KEY_ARROW_LEFT;
+        break;
+      case 'F':
+        key = KEY_END;
+        break;
+      case 'H':
+        key = KEY_HOME;
+        break;
+      }
+
+      // ESC [ <digit> ~
+      if (next == '[' && i + 3 < len && keys[i + 3] == '~') {
+        used = 4;
+
+        switch (keys[i + 2]) {
+        case '1':
+        case '7':
+          key = KEY_HOME;
+          break;
+        case '3':
+          key = KEY_DELETE;
+          break;
+        case '4':
+        case '8':
+          key = KEY_END;
+          break;
+        case '5':
+          key = KEY_PAGE_UP;
+          break;
+        case '6':
+          key = KEY_PAGE_DOWN;
+          break;
+        }
+      }
+
+      if (key != 0) {
+        keys[out++] = key;
+        i += used - 1;
+        continue;
+      }
+    }
+
+    // ESC followed by a key is Alt+<key>
+    keys[out++] = ALT_KEY(next);
+    ++i;
+  }
+
+  return out;
+}
+
+static bool load_defaults(struct Keymap *keymap,
+                          const struct DefaultBinding *bindings,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    size_t num_keys = 1;
+    while (num_keys < 3 && bindings[i].keys[num_keys] != 0) {
+      ++num_keys;
+    }
+
+    if (!keymap_bind(keymap, bindings[i].keys, num_keys, bindings[i].cmd)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * adds a trie node & returns its index, or 0 if it can't.
+ */
+static uint16_t new_node(struct Keymap *keymap, int key) {
+  size_t index = vector_length(keymap->nodes);
+  if (index > UINT16_MAX) {
+    return 0;
+  }
+
+  struct TrieNode node = {.key = key, .command = CMD_NONE};
+  if (!vector_push(keymap->nodes, &node)) {
+    return 0;
+  }
+
+  return index;
+}
+
+static struct TrieNode *get_node(const struct Keymap *keymap, uint16_t index) {
+  return vector_get(keymap->nodes, index);
+}
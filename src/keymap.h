@@ -0,0 +1,148 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// the longest key sequence that can be bound
+#define MAX_KEYSEQ_LEN 8
+
+/*
+ * This macro is used to check if the key pressed is Ctrl+<alphabet>
+ *
+ * Ctrl key combined with the alphabetic keys maps to 1–26.
+ *
+ * ASCII of 'b' is 98, which is 01100010 in binary.
+ * 0x1f is 00011111 in binary.
+ * 00011111 & 01100010 = 00000010 = 2, which is Ctrl+b.
+ *
+ * ASCII of 'B' is 66, which is 01000010 in binary.
+ * 00011111 & 01000010 = 00000010 = 2,  which is Ctrl+B.
+ *
+ * So it works regardless of the case.
+ *
+ * This mirrors what the Ctrl key does in the terminal: it strips bits 5 and 6
+ * from whatever key you press in combination with Ctrl, and sends that.
+ * (By convention, bit numbering starts from 0.) The ASCII character set seems
+ * to be designed this way on purpose. (It is also similarly designed so that
+ * you can set and clear bit 5 to switch between lowercase and uppercase.)
+ */
+#define CTRL_KEY(k) (k & 0x1f)
+
+/*
+ * Alt+<key> is sent by terminals as ESC followed by the key, so `read_key`
+ * reports it as the key with this bit set. It's above every `enum TermKey`
+ * value so it can't be confused with one.
+ */
+#define ALT_BIT 0x4000
+#define ALT_KEY(k) ((k) | ALT_BIT)
+
+enum TermKey {
+  KEY_ENTER = 13, // '\r',
+  KEY_ESC = 27,   // '\x1b',
+  KEY_BACKSPACE = 127,
+  KEY_ARROW_UP = 1000,
+  KEY_ARROW_DOWN,
+  KEY_ARROW_RIGHT,
+  KEY_ARROW_LEFT,
+  KEY_DELETE,
+  KEY_HOME,
+  KEY_END,
+  KEY_PAGE_UP,
+  KEY_PAGE_DOWN,
+
+  // not keys: a prompt segment changed, so the prompt should be redrawn,
+  // there's no more input at all (only when headless, see `rl_set_headless`),
+  // or there's no input yet & waiting for it isn't allowed (see
+  // `rl_session_try_read_line`)
+  KEY_PROMPT_CHANGED,
+  KEY_INPUT_END,
+  KEY_INPUT_PENDING,
+};
+
+/*
+ * everything a key can be bound to. the names (see `command_name`) are the
+ * ones readline uses, where readline has the same command.
+ */
+enum EditCommand {
+  CMD_NONE, // unbound key
+  CMD_PREFIX, // first keys of a multi-key binding (internal to the keymap)
+
+  CMD_SELF_INSERT,
+  CMD_ACCEPT_LINE,
+  CMD_INTERRUPT,
+  CMD_END_OF_FILE,
+
+  CMD_BACKWARD_CHAR,
+  CMD_FORWARD_CHAR,
+  CMD_BACKWARD_WORD,
+  CMD_FORWARD_WORD,
+  CMD_BEGINNING_OF_LINE,
+  CMD_END_OF_LINE,
+
+  CMD_PREVIOUS_HISTORY,
+  CMD_NEXT_HISTORY,
+
+  CMD_BACKWARD_DELETE_CHAR,
+  CMD_DELETE_CHAR,
+  CMD_KILL_LINE,
+  CMD_UNIX_LINE_DISCARD,
+  CMD_KILL_WHOLE_LINE,
+  CMD_UNIX_WORD_RUBOUT,
+  CMD_KILL_WORD,
+  CMD_BACKWARD_KILL_WORD,
+  CMD_YANK,
+  CMD_YANK_POP,
+
+  CMD_DIGIT_ARGUMENT,
+  CMD_START_KBD_MACRO,
+  CMD_END_KBD_MACRO,
+  CMD_CALL_LAST_KBD_MACRO,
+
+  CMD_EMACS_EDITING_MODE,
+  CMD_VI_EDITING_MODE,
+  CMD_VI_MOVEMENT_MODE,
+  CMD_VI_INSERTION_MODE,
+  CMD_VI_INSERT_BEG,
+  CMD_VI_APPEND_MODE,
+  CMD_VI_APPEND_EOL,
+  CMD_VI_NEXT_WORD,
+  CMD_VI_END_WORD,
+  CMD_VI_PUT,
+
+  NUM_COMMANDS,
+};
+
+const char *command_name(enum EditCommand cmd);
+enum EditCommand command_from_name(const char *name);
+
+/*
+ * the keymaps that exist. emacs & vi insert mode bind the printable keys to
+ * `self-insert`, vi command (movement) mode binds them to commands.
+ */
+enum KeymapId {
+  KEYMAP_EMACS,
+  KEYMAP_VI_INSERT,
+  KEYMAP_VI_COMMAND,
+
+  NUM_KEYMAPS,
+};
+
+struct Keymap;
+
+struct Keymap *keymap_init(enum KeymapId id);
+void keymap_free(struct Keymap *keymap);
+
+enum KeymapId keymap_id(const struct Keymap *keymap);
+bool keymap_id_from_name(const char *name, enum KeymapId *id);
+
+size_t keymap_parse_keyseq(const char *seq, int *keys, size_t max_keys);
+
+bool keymap_bind(struct Keymap *keymap, const int *keys, size_t num_keys,
+                 enum EditCommand cmd);
+
+enum EditCommand keymap_lookup(const struct Keymap *keymap, int key,
+                               uint16_t *node);
+
+#endif
@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h> // for memcpy(), memmove()
+
+#include "./alloc.h"
+#include "./killring.h"
+
+struct KillEntry {
+  char *text;
+  size_t len;
+};
+
+/*
+ * a fixed size ring of killed texts. once it's full, every new kill replaces
+ * the oldest one.
+ */
+struct KillRing {
+  struct KillEntry *entries;
+  size_t capacity;
+  size_t length; // number of entries in use
+  size_t head;   // index of the most recent kill
+  size_t yank;   // how far back the last yank / yank-pop went
+
+  const struct Allocator *allocator; // NULL for malloc()
+};
+
+/**
+ * initializes a new kill ring. returns NULL if memory allocation fails.
+ *
+ * @param capacity the max number of kills to remember. if 0, it will be set to
+ * `KILLRING_INIT_CAPACITY`
+ */
+struct KillRing *killring_init(size_t capacity) {
+  return killring_init_with(capacity, NULL);
+}
+
+/**
+ * like `killring_init`, but the ring & the texts in it are allocated with
+ * `allocator`, which MUST outlive the ring.
+ *
+ * @param capacity the max number of kills to remember. if 0, it will be set to
+ * `KILLRING_INIT_CAPACITY`
+ * @param allocator the allocator to use, or NULL for malloc()
+ */
+struct KillRing *killring_init_with(size_t capacity,
+                                    const struct Allocator *allocator) {
+  struct KillRing *ring = mem_alloc(allocator, sizeof(struct KillRing));
+  if (ring == NULL) {
+    return NULL;
+  }
+
+  if (capacity == 0) {
+    capacity = KILLRING_INIT_CAPACITY;
+  }
+
+  ring->entries = mem_calloc(allocator, capacity, sizeof(struct KillEntry));
+  if (ring->entries == NULL) {
+    mem_free(allocator, ring, sizeof(struct KillRing));
+    return NULL;
+  }
+
+  ring->allocator = allocator;
+
+  ring->capacity = capacity;
+  ring->length = 0;
+  ring->head = 0;
+  ring->yank = 0;
+
+  return ring;
+}
+
+/**
+ * frees the kill ring and all the texts in it
+ *
+ * @param ring the kill ring to free
+ */
+void killring_free(struct KillRing *ring) {
+  assert(ring != NULL);
+
+  const struct Allocator *allocator = ring->allocator;
+
+  for (size_t i = 0; i < ring->capacity; ++i) {
+    struct KillEntry *entry = &ring->entries[i];
+    mem_free(allocator, entry->text, entry->len + 1);
+  }
+
+  mem_free(allocator, ring->entries, ring->capacity * sizeof(struct KillEntry));
+  mem_free(allocator, ring, sizeof(struct KillRing));
+}
+
+/**
+ * adds a copy of the killed text as the most recent kill. returns false if
+ * memory allocation fails.
+ *
+ * @param ring the kill ring to add the text to
+ * @param text the killed text. it doesn't need to be null-terminated.
+ * @param len the length of the killed text
+ */
+bool killring_push(struct KillRing *ring, const char *text, size_t len) {
+  assert(ring != NULL);
+  assert(text != NULL || len == 0);
+
+  char *copy = mem_alloc(ring->allocator, len + 1);
+  if (copy == NULL) {
+    return false;
+  }
+
+  memcpy(copy, text, len);
+  copy[len] = '\0';
+
+  if (ring->length > 0) {
+    ring->head = (ring->head + 1) % ring->capacity;
+  }
+
+  if (ring->length < ring->capacity) {
+    ++ring->length;
+  }
+
+  // when the ring is full this is the oldest kill
+  struct KillEntry *entry = &ring->entries[ring->head];
+  mem_free(ring->allocator, entry->text, entry->len + 1);
+  entry->text = copy;
+  entry->len = len;
+
+  ring->yank = 0;
+
+  return true;
+}
+
+/**
+ * grows the most recent kill with more killed text, so that consecutive kills
+ * can be yanked back as one piece. if the ring is empty, it behaves like
+ * `killring_push`. returns false if memory allocation fails.
+ *
+ * @param ring the kill ring
+ * @param text the killed text. it doesn't need to be null-terminated.
+ * @param len the length of the killed text
+ * @param prepend whether to put the text before the most recent kill (when
+ * killing backward) instead of after it
+ */
+bool killring_extend(struct KillRing *ring, const char *text, size_t len,
+                     bool prepend) {
+  assert(ring != NULL);
+  assert(text != NULL || len == 0);
+
+  if (ring->length == 0) {
+    return killring_push(ring, text, len);
+  }
+
+  struct KillEntry *entry = &ring->entries[ring->head];
+
+  char *grown = mem_realloc(ring->allocator, entry->text, entry->len + 1,
+                            entry->len + len + 1);
+  if (grown == NULL) {
+    return false;
+  }
+
+  if (prepend) {
+    memmove(&grown[len], grown, entry->len);
+    memcpy(grown, text, len);
+  } else {
+    memcpy(&grown[entry->len], text, len);
+  }
+
+  entry->text = grown;
+  entry->len += len;
+  entry->text[entry->len] = '\0';
+
+  ring->yank = 0;
+
+  return true;
+}
+
+/**
+ * gets the most recent kill. returns NULL if the ring is empty.
+ *
+ * @param ring the kill ring
+ * @param len pointer to store the length of the text
+ */
+const char *killring_yank(struct KillRing *ring, size_t *len) {
+  assert(ring != NULL);
+  assert(len != NULL);
+
+  if (ring->length == 0) {
+    return NULL;
+  }
+
+  ring->yank = 0;
+
+  *len = ring->entries[ring->head].len;
+  return ring->entries[ring->head].text;
+}
+
+/**
+ * gets the kill before the one returned by the last `killring_yank` or
+ * `killring_yank_pop`, wrapping around to the most recent one after the
+ * oldest. returns NULL if the ring is empty.
+ *
+ * @param ring the kill ring
+ * @param len pointer to store the length of the text
+ */
+const char *killring_yank_pop(struct KillRing *ring, size_t *len) {
+  assert(ring != NULL);
+  assert(len != NULL);
+
+  if (ring->length == 0) {
+    return NULL;
+  }
+
+  ring->yank = (ring->yank + 1) % ring->length;
+
+  size_t index = (ring->head + ring->capacity - ring->yank) % ring->capacity;
+
+  *len = ring->entries[index].len;
+  return ring->entries[index].text;
+}
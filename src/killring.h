@@ -0,0 +1,25 @@
+#ifndef KILLRING_H
+#define KILLRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "alloc.h"
+
+struct KillRing;
+
+#define KILLRING_INIT_CAPACITY 16
+
+struct KillRing *killring_init(size_t capacity);
+struct KillRing *killring_init_with(size_t capacity,
+                                    const struct Allocator *allocator);
+void killring_free(struct KillRing *ring);
+
+bool killring_push(struct KillRing *ring, const char *text, size_t len);
+bool killring_extend(struct KillRing *ring, const char *text, size_t len,
+                     bool prepend);
+
+const char *killring_yank(struct KillRing *ring, size_t *len);
+const char *killring_yank_pop(struct KillRing *ring, size_t *len);
+
+#endif
@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h> // for uint32_t
+#include <string.h> // for memcpy(), memset()
+
+#include "lz.h"
+
+/*
+ * A small LZ77 compressor, using the same block format as LZ4. It's nowhere
+ * near as good as zlib at squeezing bytes, but it's very fast both ways, which
+ * is what matters for text that's compressed once & mostly never read again.
+ *
+ * The compressed data is a series of sequences. Each one is a token byte, the
+ * literal length if it doesn't fit in the token, the literals, a 2 byte
+ * offset back to where the match starts & the match length if it doesn't fit
+ * in the token:
+ *
+ *   token: high 4 bits = number of literals, low 4 bits = match length - 4.
+ *          15 means "more follows": extra bytes are added to it until one
+ *          that isn't 255.
+ *
+ * The last sequence has only literals.
+ */
+
+#define MIN_MATCH 4
+#define HASH_BITS 12
+#define MAX_OFFSET 65535
+
+static inline uint32_t read32(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+  return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/*
+ * writes a length that didn't fit in the token
+ */
+static char *write_length(char *dst, size_t len) {
+  while (len >= 255) {
+    *dst++ = (char)255;
+    len -= 255;
+  }
+
+  *dst++ = (char)len;
+  return dst;
+}
+
+static char *write_sequence(char *dst, const char *literals, size_t num_literals,
+                            size_t offset, size_t match_len) {
+  char *token = dst++;
+
+  size_t lit_nibble = num_literals < 15 ? num_literals : 15;
+  *token = (char)(lit_nibble << 4);
+  if (num_literals >= 15) {
+    dst = write_length(dst, num_literals - 15);
+  }
+
+  memcpy(dst, literals, num_literals);
+  dst += num_literals;
+
+  // the last sequence has no match
+  if (match_len == 0) {
+    return dst;
+  }
+
+  *dst++ = (char)(offset & 0xff);
+  *dst++ = (char)(offset >> 8);
+
+  size_t extra = match_len - MIN_MATCH;
+  *token |= (char)(extra < 15 ? extra : 15);
+  if (extra >= 15) {
+    dst = write_length(dst, extra - 15);
+  }
+
+  return dst;
+}
+
+/**
+ * the most `lz_compress` can write for `len` bytes of input (if the input
+ * doesn't compress at all).
+ */
+size_t lz_compress_bound(size_t len) { return len + len / 255 + 16; }
+
+/**
+ * compresses `len` bytes of `src` into `dst`.
+ *
+ * @param src the bytes to compress
+ * @param len the number of bytes to compress
+ * @param dst where to write the compressed bytes. it must have room for
+ * `lz_compress_bound(len)` bytes.
+ *
+ * @return the size of the compressed data
+ */
+size_t lz_compress(const char *src, size_t len, char *dst) {
+  assert(src != NULL || len == 0);
+  assert(dst != NULL);
+
+  // where each 4 byte sequence was last seen, plus one (0 means never)
+  uint32_t table[1 << HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  char *out = dst;
+  size_t anchor = 0; // start of the literals not written yet
+  size_t pos = 0;
+
+  while (len >= MIN_MATCH && pos <= len - MIN_MATCH) {
+    uint32_t seq = read32(&src[pos]);
+    uint32_t h = hash32(seq);
+    size_t candidate = table[h];
+    table[h] = pos + 1;
+
+    if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET ||
+        read32(&src[candidate - 1]) != seq) {
+      ++pos;
+      continue;
+    }
+
+    size_t ref = candidate - 1;
+    size_t match_len = MIN_MATCH;
+    while (pos + match_len < len && src[ref + match_len] == src[pos + match_len]) {
+      ++match_len;
+    }
+
+    out = write_sequence(out, &src[anchor], pos - anchor, pos - ref, match_len);
+
+    pos += match_len;
+    anchor = pos;
+  }
+
+  out = write_sequence(out, &src[anchor], len - anchor, 0, 0);
+
+  return out - dst;
+}
+
+/*
+ * reads a length that didn't fit in the token. returns false if the input
+ * ends before it does.
+ */
+static bool read_length(const unsigned char **src, const unsigned char *end,
+                        size_t *len) {
+  unsigned char b;
+  do {
+    if (*src == end) {
+      return false;
+    }
+
+    b = *(*src)++;
+    *len += b;
+  } while (b == 255);
+
+  return true;
+}
+
+/**
+ * decompresses what `lz_compress` compressed. every length & offset is
+ * checked, so corrupt input can't make it write outside of `dst`.
+ *
+ * @param src the compressed bytes
+ * @param len the number of compressed bytes
+ * @param dst where to write the decompressed bytes
+ * @param raw_len the size of the decompressed data
+ *
+ * @return `true` if exactly `raw_len` bytes were decompressed, else `false`
+ */
+bool lz_decompress(const char *src, size_t len, char *dst, size_t raw_len) {
+  assert(src != NULL || len == 0);
+  assert(dst != NULL || raw_len == 0);
+
+  const unsigned char *in = (const unsigned char *)src;
+  const unsigned char *in_end = in + len;
+  size_t out = 0;
+
+  while (in < in_end) {
+    unsigned char token = *in++;
+
+    size_t num_literals = token >> 4;
+    if (num_literals == 15 && !read_length(&in, in_end, &num_literals)) {
+      return false;
+    }
+
+    if (num_literals > (size_t)(in_end - in) || num_literals > raw_len - out) {
+      return false;
+    }
+
+    memcpy(&dst[out], in, num_literals);
+    in += num_literals;
+    out += num_literals;
+
+    // the last sequence has no match
+    if (in == in_end) {
+      break;
+    }
+
+    if (in_end - in < 2) {
+      return false;
+    }
+
+    size_t offset = in[0] | (size_t)in[1] << 8;
+    in += 2;
+
+    size_t match_len = token & 0x0f;
+    if (match_len == 15 && !read_length(&in, in_end, &match_len)) {
+      return false;
+    }
+    match_len += MIN_MATCH;
+
+    if (offset == 0 || offset > out || match_len > raw_len - out) {
+      return false;
+    }
+
+    // the match can overlap with what it's writing, so copy byte by byte
+    const char *ref = &dst[out - offset];
+    for (size_t i = 0; i < match_len; ++i) {
+      dst[out + i] = ref[i];
+    }
+    out += match_len;
+  }
+
+  return out == raw_len;
+}
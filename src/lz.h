@@ -0,0 +1,11 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+size_t lz_compress_bound(size_t len);
+size_t lz_compress(const char *src, size_t len, char *dst);
+bool lz_decompress(const char *src, size_t len, char *dst, size_t raw_len);
+
+#endif
@@ -1,23 +1,738 @@
+#define _GNU_SOURCE // for memmem()
+
+#include <ctype.h> // for isdigit()
+#include <errno.h>
+#include <limits.h> // for ULONG_MAX
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>   // for clock_gettime()
+#include <unistd.h> // for getcwd(), isatty()
 
+#include "abuf.h"
+#include "batch.h"
+#include "command.h"
+#include "memo.h"
+#include "pager.h"
 #include "readline.h"
+#include "scrollback.h"
 
 #define REPL_INPUT_BUFFER_SIZE 1024
+#define REPL_OUTPUT_BUFFER_SIZE (REPL_INPUT_BUFFER_SIZE + 16)
+
+#define ECHO_CHUNK_SIZE (64 * 1024)
+
+// the most output a :repeat typed in the editor may make
+#define REPEAT_MAX_OUTPUT (256 * 1024 * 1024)
+
+// how much the outputs of lines evaluated in batch mode are cached in, by
+// default
+#define MEMO_DEFAULT_MB 64
+
+#define PROMPT "{cwd}{git}{took}> "
+
+#define WELCOME                                                                \
+  "welcome to Biraj's echo repl\n"                                             \
+  "- press arrow UP/DOWN to navigate in history\n"                             \
+  "- type ':search <text>' to search past output\n"                            \
+  "- type ':repeat <count> <text>' to echo something many times\n"             \
+  "- type ':help' for the rest of the commands\n"                              \
+  "- type 'exit' or press Ctrl+C to exit\n\n"
+
+// how many of the last lines' durations :latency looks at
+#define LATENCY_SAMPLES 1024
+
+#define HELP                                                                   \
+  ":help                   lists these commands\n"                             \
+  ":history [<count>]      shows the last lines entered, or all of them\n"     \
+  ":stats                  shows what the history & the scrollback take\n"     \
+  ":latency                shows how long the last lines took to evaluate\n"   \
+  ":search <text>          searches past output\n"                             \
+  ":save <path>            saves the history to a file\n"                      \
+  ":repeat <count> <text>  echoes something many times\n"                      \
+  "exit                    exits\n"
+
+// how long the last command took, for the "took" prompt segment
+static _Atomic uint64_t last_duration_ns = 0;
+
+struct Echo {
+  const char *text;
+  unsigned long count;
+};
+
+struct SearchQuery {
+  const char *needle;
+  size_t needle_len;
+};
+
+// how long the lines evaluated last took, for :latency
+struct Latencies {
+  uint64_t ns[LATENCY_SAMPLES]; // a ring, oldest first from `count`
+  size_t count;                 // lines evaluated in all
+};
+
+// what the first fragment of a line that's too long to hold whole said
+struct LongLine {
+  bool echo; // whether the fragments are echoed, rather than ignored
+};
+
+// what the batch evaluators share
+struct BatchState {
+  struct LongLine long_line;
+
+  // an output couldn't be allocated, so the batch stopped short of the end,
+  // rather than at an "exit"
+  atomic_bool out_of_memory;
+};
+
+/*
+ * prints a matching input line and the lines of its output that contain the
+ * search text
+ */
+static bool print_match(void *ctx, uint64_t id, const char *input,
+                        size_t input_len, const char *output,
+                        size_t output_len) {
+  struct SearchQuery *query = ctx;
+
+  printf("[%llu] > %.*s\n", (unsigned long long)id, (int)input_len, input);
+
+  const char *end = output + output_len;
+  while (output < end) {
+    const char *newline = memchr(output, '\n', end - output);
+    const char *line_end = newline != NULL ? newline : end;
+
+    if (memmem(output, line_end - output, query->needle, query->needle_len) !=
+        NULL) {
+      printf("  %.*s\n", (int)(line_end - output), output);
+    }
+
+    output = newline != NULL ? newline + 1 : end;
+  }
+
+  return true;
+}
+
+/*
+ * produces the output for an input line, `count` times over. it's written to
+ * the pager in big chunks, so a huge output doesn't take the lock per line.
+ */
+static void echo_output(struct Pager *pager, void *ctx) {
+  struct Echo *echo = ctx;
+
+  char line[REPL_OUTPUT_BUFFER_SIZE];
+  int line_len = snprintf(line, sizeof(line), "you said: %s\n", echo->text);
+  if (line_len >= (int)sizeof(line)) {
+    line_len = sizeof(line) - 1;
+  }
+
+  char chunk[ECHO_CHUNK_SIZE];
+  size_t len = 0;
+  for (unsigned long i = 0; i < echo->count; ++i) {
+    if (len + line_len > sizeof(chunk)) {
+      if (!pager_write(pager, chunk, len)) {
+        return;
+      }
+      len = 0;
+    }
+
+    memcpy(&chunk[len], line, line_len);
+    len += line_len;
+  }
+
+  pager_write(pager, chunk, len);
+}
+
+/*
+ * the current directory, with $HOME shortened to ~
+ */
+static bool segment_cwd(char *buf, size_t size, void *ctx) {
+  char cwd[4096];
+  if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    return false;
+  }
+
+  const char *home = getenv("HOME");
+  size_t home_len = home != NULL ? strlen(home) : 0;
+  if (home_len > 1 && strncmp(cwd, home, home_len) == 0 &&
+      (cwd[home_len] == '/' || cwd[home_len] == '\0')) {
+    snprintf(buf, size, "~%s ", &cwd[home_len]);
+  } else {
+    snprintf(buf, size, "%s ", cwd);
+  }
+
+  return true;
+}
+
+/*
+ * the git branch (or commit, if detached) of the current directory, found by
+ * reading .git/HEAD in it or the closest directory above it that has one
+ */
+static bool segment_git(char *buf, size_t size, void *ctx) {
+  char dir[4096];
+  if (getcwd(dir, sizeof(dir)) == NULL) {
+    return false;
+  }
+
+  buf[0] = '\0';
+
+  while (true) {
+    char path[4096 + 16];
+    snprintf(path, sizeof(path), "%s/.git/HEAD", dir);
+
+    FILE *f = fopen(path, "r");
+    if (f != NULL) {
+      char head[256];
+      if (fgets(head, sizeof(head), f) != NULL) {
+        head[strcspn(head, "\n")] = '\0';
+
+        const char *ref = "ref: refs/heads/";
+        if (strncmp(head, ref, strlen(ref)) == 0) {
+          snprintf(buf, size, "(%s) ", head + strlen(ref));
+        } else {
+          snprintf(buf, size, "(%.7s) ", head);
+        }
+      }
+
+      fclose(f);
+      return true;
+    }
+
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL || slash == dir) {
+      return true; // not in a repo
+    }
+    *slash = '\0';
+  }
+}
+
+/*
+ * writes a duration in the unit that suits it, e.g. "12ms"
+ */
+static void format_duration(char *buf, size_t size, uint64_t ns) {
+  if (ns < 1000000) {
+    snprintf(buf, size, "%lluus", (unsigned long long)(ns / 1000));
+  } else if (ns < 1000000000) {
+    snprintf(buf, size, "%llums", (unsigned long long)(ns / 1000000));
+  } else {
+    snprintf(buf, size, "%.1fs", ns / 1e9);
+  }
+}
+
+/*
+ * how long the last command took
+ */
+static bool segment_took(char *buf, size_t size, void *ctx) {
+  uint64_t ns = atomic_load(&last_duration_ns);
+
+  if (ns == 0) {
+    buf[0] = '\0';
+    return true;
+  }
+
+  char duration[32];
+  format_duration(duration, sizeof(duration), ns);
+  snprintf(buf, size, "[%s] ", duration);
+
+  return true;
+}
+
+/*
+ * prints the last `args` lines of the history (a number), or all of them
+ */
+static void print_history(const char *args) {
+  struct RLSessionStats stats;
+  rl_stats(&stats);
+
+  size_t first = 0;
+  if (*args != '\0') {
+    size_t count = strtoul(args, NULL, 10);
+    first = count < stats.history_len ? stats.history_len - count : 0;
+  }
+
+  for (size_t i = first; i < stats.history_len; ++i) {
+    size_t len;
+    const char *line = rl_history_line(i, &len);
+    printf("%5zu  %.*s\n", i + 1, (int)len, line);
+  }
+}
+
+/*
+ * writes every line of the history to the file at `path`, one per line
+ */
+static void save_history(const char *path) {
+  if (*path == '\0') {
+    puts("usage: :save <path>");
+    return;
+  }
+
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    printf("failed to open %s: %s\n", path, strerror(errno));
+    return;
+  }
+
+  struct RLSessionStats stats;
+  rl_stats(&stats);
+
+  for (size_t i = 0; i < stats.history_len; ++i) {
+    size_t len;
+    const char *line = rl_history_line(i, &len);
+    fwrite(line, 1, len, file);
+    fputc('\n', file);
+  }
+
+  bool failed = ferror(file);
+  if (fclose(file) != 0 || failed) {
+    printf("failed to write %s\n", path);
+    return;
+  }
+
+  printf("saved %zu lines to %s\n", stats.history_len, path);
+}
+
+/*
+ * prints how much the history & the scrollback take
+ */
+static void print_stats(const struct Scrollback *scrollback) {
+  struct RLSessionStats session;
+  rl_stats(&session);
+
+  printf("history: %zu lines, %zu evicted, %zu rejected, %zu KB of memory\n",
+         session.history_len, session.history_evicted, session.lines_rejected,
+         session.memory_used / 1024);
+
+  struct ScrollbackStats sb;
+  scrollback_stats(scrollback, &sb);
+
+  printf("scrollback: %llu outputs, %llu evicted, %llu KB logged in %llu KB\n",
+         (unsigned long long)sb.entries, (unsigned long long)sb.evicted_entries,
+         (unsigned long long)(sb.raw_bytes / 1024),
+         (unsigned long long)(sb.compressed_bytes / 1024));
+}
+
+static void add_latency(struct Latencies *latencies, uint64_t ns) {
+  latencies->ns[latencies->count++ % LATENCY_SAMPLES] = ns;
+}
+
+static int compare_ns(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * prints the percentiles of how long the last lines took to evaluate
+ */
+static void print_latency(const struct Latencies *latencies) {
+  size_t n = latencies->count < LATENCY_SAMPLES ? latencies->count
+                                                : LATENCY_SAMPLES;
+  if (n == 0) {
+    puts("no lines evaluated yet");
+    return;
+  }
+
+  uint64_t sorted[LATENCY_SAMPLES];
+  memcpy(sorted, latencies->ns, n * sizeof(*sorted));
+  qsort(sorted, n, sizeof(*sorted), compare_ns);
+
+  static const struct {
+    const char *name;
+    unsigned percent;
+  } percentiles[] = {{"p50", 50}, {"p90", 90}, {"p99", 99}, {"max", 100}};
+
+  printf("last %zu lines:", n);
+  for (size_t i = 0; i < sizeof(percentiles) / sizeof(*percentiles); ++i) {
+    char duration[32];
+    format_duration(duration, sizeof(duration),
+                    sorted[(n - 1) * percentiles[i].percent / 100]);
+    printf(" %s %s", percentiles[i].name, duration);
+  }
+  putchar('\n');
+}
+
+/*
+ * runs one of the REPL's own commands that doesn't evaluate anything, with
+ * its arguments
+ */
+static void run_command(enum Command command, const char *args,
+                        struct Scrollback *scrollback,
+                        const struct Latencies *latencies) {
+  switch (command) {
+  case COMMAND_HELP:
+    fputs(HELP, stdout);
+    break;
+  case COMMAND_HISTORY:
+    print_history(args);
+    break;
+  case COMMAND_STATS:
+    print_stats(scrollback);
+    break;
+  case COMMAND_LATENCY:
+    print_latency(latencies);
+    break;
+  case COMMAND_SEARCH: {
+    struct SearchQuery query = {.needle = args, .needle_len = strlen(args)};
+    if (scrollback_search(scrollback, query.needle, query.needle_len,
+                          print_match, &query) == 0) {
+      puts("no matches");
+    }
+    break;
+  }
+  case COMMAND_SAVE:
+    save_history(args);
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * what batch mode says to a command that needs the editor, or NULL if the
+ * command runs without it
+ */
+static const char *needs_terminal(enum Command command) {
+  switch (command) {
+  case COMMAND_SEARCH:
+    return "searching past output needs a terminal\n";
+  case COMMAND_HISTORY:
+  case COMMAND_SAVE:
+    return "there's no history without a terminal\n";
+  case COMMAND_STATS:
+  case COMMAND_LATENCY:
+    return "there are no stats without a terminal\n";
+  default:
+    return NULL;
+  }
+}
+
+/*
+ * writes the output of a line read from a pipe or a file, other than "exit".
+ * there's no past output to search & nobody to page to, so lines are just
+ * echoed. returns false if the output can't be allocated.
+ */
+static bool echo_batch_line(const char *line, size_t len, enum Command command,
+                            size_t args, struct AppendBuffer *out) {
+  if (command == COMMAND_HELP) {
+    return abuf_append(out, HELP, strlen(HELP));
+  }
+
+  const char *msg = needs_terminal(command);
+  if (msg != NULL) {
+    return abuf_append(out, msg, strlen(msg));
+  }
+
+  const char *text = line;
+  size_t text_len = len;
+  unsigned long count = 1;
+
+  // the line isn't null-terminated, so the count is parsed by hand
+  if (command == COMMAND_REPEAT) {
+    size_t i = args;
+    bool overflow = false;
+    count = 0;
+    while (i < len && isdigit((unsigned char)line[i])) {
+      unsigned long digit = line[i++] - '0';
+      overflow = overflow || count > (ULONG_MAX - digit) / 10;
+      count = count * 10 + digit;
+    }
+    if (i < len && line[i] == ' ') {
+      ++i;
+    }
+
+    text = &line[i];
+    text_len = len - i;
+
+    // like a line too long to hold, an output bigger than a chunk is refused,
+    // so a line's output stays bounded by the chunk size
+    size_t line_len = strlen("you said: ") + text_len + 1;
+    if (overflow || count > BATCH_DEFAULT_CHUNK_SIZE / line_len) {
+      const char *msg = "the output of :repeat would be too long\n";
+      return abuf_append(out, msg, strlen(msg));
+    }
+  }
+
+  for (unsigned long i = 0; i < count; ++i) {
+    if (!abuf_append(out, "you said: ", strlen("you said: ")) ||
+        !abuf_append(out, text, text_len) || !abuf_append(out, "\n", 1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * evaluates a line read from a pipe or a file. it runs on the batch's worker
+ * threads, and stops the batch at "exit", or when an output can't be
+ * allocated, which is noted in the `struct BatchState` so it isn't taken for
+ * an "exit".
+ */
+static bool eval_batch_line(const char *line, size_t len,
+                            struct AppendBuffer *out, void *ctx) {
+  struct BatchState *state = ctx;
+
+  size_t args;
+  enum Command command = command_find(line, len, &args);
+  if (command == COMMAND_EXIT) {
+    return false;
+  }
+
+  if (!echo_batch_line(line, len, command, args, out)) {
+    atomic_store(&state->out_of_memory, true);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * writes the output of a fragment of a line that's longer than a batch chunk,
+ * so even a line of hundreds of MB is echoed in a chunk's worth of memory. no
+ * command is that long, but a huge :search or :repeat can't be held to be
+ * searched for or repeated, so they're refused. returns false if the output
+ * can't be allocated.
+ */
+static bool echo_batch_fragment(const char *fragment, size_t len, bool first,
+                                bool last, struct AppendBuffer *out,
+                                struct LongLine *line) {
+  if (first) {
+    size_t args;
+    enum Command command = command_find(fragment, len, &args);
+
+    const char *msg = needs_terminal(command);
+    if (command == COMMAND_REPEAT) {
+      msg = "the text to repeat is too long\n";
+    }
+
+    line->echo = msg == NULL;
+    if (!line->echo) {
+      return abuf_append(out, msg, strlen(msg));
+    }
+
+    if (!abuf_append(out, "you said: ", strlen("you said: "))) {
+      return false;
+    }
+  }
+
+  if (!line->echo) {
+    return true;
+  }
+
+  return abuf_append(out, fragment, len) &&
+         (!last || abuf_append(out, "\n", 1));
+}
+
+/*
+ * evaluates a line read from a pipe or a file that's longer than a batch
+ * chunk, a fragment at a time. like `eval_batch_line`, running out of memory
+ * is noted in the `struct BatchState`.
+ */
+static bool eval_batch_fragment(const char *fragment, size_t len, bool first,
+                                bool last, struct AppendBuffer *out,
+                                void *ctx) {
+  struct BatchState *state = ctx;
+
+  if (!echo_batch_fragment(fragment, len, first, last, out,
+                           &state->long_line)) {
+    atomic_store(&state->out_of_memory, true);
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * evaluates lines from stdin in parallel, without the editor, writing their
+ * outputs in order. $REPL_JOBS sets how many threads evaluate them (one per
+ * CPU by default).
+ *
+ * a line's output only depends on the line, so the outputs of lines that come
+ * up again are cached, in $REPL_MEMO_MB MB (0 for no cache). with
+ * $REPL_MEMO_STATS set, how well that went is written to stderr at the end.
+ */
+static int run_batch(void) {
+  struct BatchState state = {0};
+  struct BatchOptions options = {.eval_fragment = eval_batch_fragment};
+
+  const char *jobs = getenv("REPL_JOBS");
+  if (jobs != NULL) {
+    options.num_workers = strtoul(jobs, NULL, 10);
+  }
+
+  size_t memo_mb = MEMO_DEFAULT_MB;
+  const char *memo_env = getenv("REPL_MEMO_MB");
+  if (memo_env != NULL) {
+    memo_mb = strtoul(memo_env, NULL, 10);
+  }
+  if (memo_mb > 0) {
+    // without it, lines are just evaluated every time
+    options.memo = memo_init(memo_mb * 1024 * 1024);
+  }
+
+  enum BatchResult result = batch_run(STDIN_FILENO, STDOUT_FILENO,
+                                      eval_batch_line, &state, &options);
+
+  if (options.memo != NULL && getenv("REPL_MEMO_STATS") != NULL) {
+    struct MemoStats stats;
+    memo_stats(options.memo, &stats);
+
+    uint64_t lookups = stats.hits + stats.misses;
+    fprintf(stderr,
+            "memo: %llu of %llu lines cached (%.1f%%), saved %.3f ms, "
+            "%zu outputs in %zu KB\n",
+            (unsigned long long)stats.hits, (unsigned long long)lookups,
+            lookups > 0 ? 100.0 * stats.hits / lookups : 0.0,
+            stats.saved_ns / 1e6, stats.entries, stats.bytes / 1024);
+  }
+  memo_free(options.memo);
+
+  if (result == BATCH_ERROR) {
+    fputs("failed to evaluate the input\n", stderr);
+    return 1;
+  }
+
+  if (result == BATCH_STOPPED && atomic_load(&state.out_of_memory)) {
+    fputs("ran out of memory, so the output was cut short\n", stderr);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * loads key bindings & settings from $REPL_INPUTRC, or ~/.replrc
+ */
+static void load_config(void *ctx) {
+  (void)ctx;
+
+  const char *config_path = getenv("REPL_INPUTRC");
+  char default_config_path[4096];
+  if (config_path == NULL && getenv("HOME") != NULL) {
+    snprintf(default_config_path, sizeof(default_config_path), "%s/.replrc",
+             getenv("HOME"));
+    config_path = default_config_path;
+  }
+
+  if (config_path != NULL) {
+    rl_load_config(config_path);
+  }
+
+  // copy killed text to the system clipboard if asked to
+  if (getenv("REPL_OSC52") != NULL) {
+    rl_set_clipboard_export(true);
+  }
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * evaluates a line that was typed: runs it if it's a command, else echoes
+ * it. returns false if it was `exit`.
+ */
+static bool eval_line(const char *line, size_t len, bool use_pager,
+                      struct Scrollback *scrollback,
+                      struct Latencies *latencies) {
+  size_t args;
+  enum Command command = command_find(line, len, &args);
+
+  if (command == COMMAND_EXIT) {
+    return false;
+  }
+
+  if (command != COMMAND_NONE && command != COMMAND_REPEAT) {
+    run_command(command, line + args, scrollback, latencies);
+    return true;
+  }
+
+  struct Echo echo = {.text = line, .count = 1};
+  if (command == COMMAND_REPEAT) {
+    char *text;
+    errno = 0;
+    echo.count = strtoul(line + args, &text, 10);
+    echo.text = *text == ' ' ? text + 1 : text;
+
+    // it's all kept in the scrollback, so it can't be just any size
+    size_t line_len = strlen("you said: ") + strlen(echo.text) + 1;
+    if (errno == ERANGE || echo.count > REPEAT_MAX_OUTPUT / line_len) {
+      printf("the output would be over %d MB\n",
+             REPEAT_MAX_OUTPUT / (1024 * 1024));
+      return true;
+    }
+  }
+
+  // the output is produced in the background while it's paged or streamed
+  struct Pager *pager = pager_init();
+  if (pager == NULL) {
+    fputs("failed to allocate the pager\n", stderr);
+    return true;
+  }
+
+  uint64_t start = now_ns();
+  if (use_pager) {
+    pager_run(pager, echo_output, &echo);
+  } else {
+    pager_stream(pager, echo_output, &echo);
+  }
+  uint64_t took = now_ns() - start;
+  atomic_store(&last_duration_ns, took);
+  add_latency(latencies, took);
+
+  size_t output_len;
+  const char *output = pager_output(pager, &output_len);
+  scrollback_append(scrollback, line, len, output, output_len);
+
+  pager_free(pager);
+
+  return true;
+}
 
 int main(void) {
-  puts("welcome to Biraj's echo repl\n"
-       "- press arrow UP/DOWN to navigate in history\n"
-       "- type 'exit' or press Ctrl+C to exit\n");
+  // lines piped in (or read from a file) don't need the editor
+  if (!isatty(STDIN_FILENO)) {
+    return run_batch();
+  }
+
+  // in one write, rather than one per line as stdout would
+  if (write(STDOUT_FILENO, WELCOME, sizeof(WELCOME) - 1) == -1) {
+    return 1;
+  }
 
   atexit(rl_cleanup);
 
-  char input_line[REPL_INPUT_BUFFER_SIZE];
+  // the config isn't needed until the first key, so the prompt doesn't wait
+  // for it
+  rl_at_first_prompt(load_config, NULL);
+
+  // show big outputs in a pager, unless $REPL_PAGER is 0
+  const char *pager_env = getenv("REPL_PAGER");
+  bool use_pager = pager_env == NULL || strcmp(pager_env, "0") != 0;
+
+  // dynamic parts of the prompt, computed in the background
+  rl_add_prompt_segment("cwd", segment_cwd, NULL, 1000);
+  rl_add_prompt_segment("git", segment_git, NULL, 2000);
+  rl_add_prompt_segment("took", segment_took, NULL, 0);
+
+  // keep every output, so it can still be searched once it scrolls away
+  struct Scrollback *scrollback = scrollback_init(0);
+  if (scrollback == NULL) {
+    fputs("failed to allocate the scrollback log\n", stderr);
+    return 1;
+  }
+
+  struct Latencies latencies = {0};
+
   while (true) {
+    const struct RLLine *lines;
+    size_t count;
     enum ReadLineResult r =
-        rl_read_line(input_line, REPL_INPUT_BUFFER_SIZE, "> ");
+        rl_read_lines(REPL_INPUT_BUFFER_SIZE - 1, PROMPT, &lines, &count);
 
     if (r == RL_SIGINT) {
       puts("\npressed Ctrl+C (SIGINT), exiting...");
@@ -29,12 +744,18 @@ int main(void) {
       break;
     }
 
-    if (strcmp(input_line, "exit") == 0) {
-      break;
+    // a paste comes back as all of its lines, which are evaluated in order
+    bool exiting = false;
+    for (size_t i = 0; i < count && !exiting; ++i) {
+      exiting = !eval_line(lines[i].line, lines[i].len, use_pager, scrollback,
+                           &latencies);
     }
 
-    printf("you said: %s\n", input_line);
+    if (exiting) {
+      break;
+    }
   }
 
+  scrollback_free(scrollback);
   return 0;
 }
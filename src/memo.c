@@ -0,0 +1,554 @@
+#include <pthread.h> // for pthread_mutex_lock() & related functions
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./memo.h"
+
+/*
+ * A cache of evaluated lines, keyed by a 64-bit hash of the line (& compared
+ * in full on a hit), bounded in bytes & run by W-TinyLFU:
+ *
+ *   - how often each line was looked up lately is kept, approximately, in a
+ *     count-min sketch of 4-bit counters, which are all halved every so often
+ *     so lines that stopped coming up are forgotten
+ *   - a new output goes into a small LRU window first, so a line that comes
+ *     up a few times in a burst gets its hits
+ *   - what falls out of the window only makes it into the main cache if its
+ *     line came up more often than that of the output it would push out, so
+ *     a flood of lines seen once never flushes the ones seen all the time
+ *   - the main cache is a segmented LRU: an output hit while on probation is
+ *     protected, & the protected outputs used least go back on probation
+ *
+ * There's a single lock: what it covers takes far less time than the
+ * evaluations it saves, & the order of the lists is global anyway.
+ */
+
+enum Region {
+  REGION_WINDOW,
+  REGION_PROBATION,
+  REGION_PROTECTED,
+  NUM_REGIONS,
+};
+
+struct Entry {
+  uint64_t hash;
+  struct Entry *next_in_bucket;
+
+  // in its region's list, from the most to the least recently used
+  struct Entry *prev;
+  struct Entry *next;
+  enum Region region;
+
+  size_t len;
+  size_t output_len;
+  uint64_t cost_ns;
+
+  char data[]; // the line, then its output
+};
+
+struct List {
+  struct Entry *head; // most recently used
+  struct Entry *tail; // least recently used
+  size_t bytes;
+};
+
+struct Sketch {
+  uint64_t *table; // 16 counters of 4 bits in each word
+  size_t mask;
+  size_t additions;
+  size_t sample_size; // the counters are halved after this many additions
+};
+
+#define SKETCH_DEPTH 4
+
+// how big an entry is assumed to be, to size the sketch & the hash table
+#define AVERAGE_ENTRY_SIZE 128
+
+struct MemoCache {
+  pthread_mutex_t lock;
+
+  struct Entry **buckets;
+  size_t num_buckets; // a power of 2
+  size_t num_entries;
+
+  struct List regions[NUM_REGIONS];
+  size_t max_bytes[NUM_REGIONS];
+  size_t max_entry_bytes;
+
+  struct Sketch sketch;
+
+  struct MemoStats stats;
+};
+
+static uint64_t hash_line(const char *line, size_t len);
+static uint64_t mix(uint64_t k);
+static bool sketch_init(struct Sketch *sketch, size_t num_entries);
+static void sketch_add(struct Sketch *sketch, uint64_t hash);
+static unsigned sketch_frequency(const struct Sketch *sketch, uint64_t hash);
+static void sketch_slot(const struct Sketch *sketch, uint64_t hash, int row,
+                        size_t *word, unsigned *shift);
+static struct Entry *find(struct MemoCache *memo, uint64_t hash,
+                          const char *line, size_t len);
+static void insert(struct MemoCache *memo, struct Entry *entry);
+static void evict(struct MemoCache *memo, struct Entry *entry);
+static void drop(struct MemoCache *memo, struct Entry *entry);
+static struct Entry **bucket_of(struct MemoCache *memo, uint64_t hash);
+static void grow_buckets(struct MemoCache *memo);
+static void touch(struct MemoCache *memo, struct Entry *entry);
+static void shrink_window(struct MemoCache *memo);
+static bool admit(struct MemoCache *memo, struct Entry *candidate);
+static void list_push(struct MemoCache *memo, struct Entry *entry,
+                      enum Region region);
+static void list_remove(struct MemoCache *memo, struct Entry *entry);
+static size_t entry_size(const struct Entry *entry);
+
+/**
+ * @param max_bytes how much the lines & outputs it holds may take in all
+ * @return the cache, or NULL if it can't be allocated
+ */
+struct MemoCache *memo_init(size_t max_bytes) {
+  struct MemoCache *memo = calloc(1, sizeof(*memo));
+  if (memo == NULL) {
+    return NULL;
+  }
+
+  // 1% for the window, & of the rest, 80% for the protected outputs
+  memo->max_bytes[REGION_WINDOW] = max_bytes / 100;
+  size_t main_bytes = max_bytes - memo->max_bytes[REGION_WINDOW];
+  memo->max_bytes[REGION_PROTECTED] = main_bytes / 5 * 4;
+  memo->max_bytes[REGION_PROBATION] =
+      main_bytes - memo->max_bytes[REGION_PROTECTED];
+
+  // a huge output would push out many small ones for a single hit
+  memo->max_entry_bytes = main_bytes / 16;
+
+  size_t num_entries = max_bytes / AVERAGE_ENTRY_SIZE;
+  memo->num_buckets = 64;
+  while (memo->num_buckets < num_entries) {
+    memo->num_buckets *= 2;
+  }
+
+  memo->buckets = calloc(memo->num_buckets, sizeof(*memo->buckets));
+  if (memo->buckets == NULL || !sketch_init(&memo->sketch, num_entries)) {
+    free(memo->buckets);
+    free(memo);
+    return NULL;
+  }
+
+  pthread_mutex_init(&memo->lock, NULL);
+
+  return memo;
+}
+
+void memo_free(struct MemoCache *memo) {
+  if (memo == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < memo->num_buckets; ++i) {
+    struct Entry *entry = memo->buckets[i];
+    while (entry != NULL) {
+      struct Entry *next = entry->next_in_bucket;
+      free(entry);
+      entry = next;
+    }
+  }
+
+  pthread_mutex_destroy(&memo->lock);
+  free(memo->sketch.table);
+  free(memo->buckets);
+  free(memo);
+}
+
+/**
+ * appends the output of `line` to `out`, if it's cached.
+ *
+ * @param line the line, which doesn't have to be null-terminated
+ * @param len its length
+ * @param out where its output is appended
+ * @return whether it was cached (& appended)
+ */
+bool memo_lookup(struct MemoCache *memo, const char *line, size_t len,
+                 struct AppendBuffer *out) {
+  uint64_t hash = hash_line(line, len);
+
+  pthread_mutex_lock(&memo->lock);
+
+  sketch_add(&memo->sketch, hash);
+
+  struct Entry *entry = find(memo, hash, line, len);
+  bool hit = entry != NULL &&
+             (entry->output_len == 0 ||
+              abuf_append(out, entry->data + len, entry->output_len));
+  if (hit) {
+    ++memo->stats.hits;
+    memo->stats.saved_ns += entry->cost_ns;
+    touch(memo, entry);
+  } else {
+    ++memo->stats.misses;
+  }
+
+  pthread_mutex_unlock(&memo->lock);
+
+  return hit;
+}
+
+/**
+ * caches the output of a line that was just evaluated, unless it's cheaper to
+ * evaluate again than to keep, or too big.
+ *
+ * @param line the line
+ * @param len its length
+ * @param output its output
+ * @param output_len the output's length
+ * @param cost_ns how long evaluating it took
+ */
+void memo_store(struct MemoCache *memo, const char *line, size_t len,
+                const char *output, size_t output_len, uint64_t cost_ns) {
+  if (cost_ns < MEMO_MIN_COST_NS ||
+      sizeof(struct Entry) + len + output_len > memo->max_entry_bytes) {
+    return;
+  }
+
+  uint64_t hash = hash_line(line, len);
+
+  // copied outside of the lock, as it may be big
+  struct Entry *entry = malloc(sizeof(*entry) + len + output_len);
+  if (entry == NULL) {
+    return;
+  }
+  entry->hash = hash;
+  entry->len = len;
+  entry->output_len = output_len;
+  entry->cost_ns = cost_ns;
+  memcpy(entry->data, line, len);
+  if (output_len > 0) {
+    memcpy(entry->data + len, output, output_len);
+  }
+
+  pthread_mutex_lock(&memo->lock);
+
+  // another thread may have evaluated the same line at the same time
+  if (find(memo, hash, line, len) != NULL) {
+    pthread_mutex_unlock(&memo->lock);
+    free(entry);
+    return;
+  }
+
+  insert(memo, entry);
+  list_push(memo, entry, REGION_WINDOW);
+  shrink_window(memo);
+
+  pthread_mutex_unlock(&memo->lock);
+}
+
+void memo_stats(struct MemoCache *memo, struct MemoStats *stats) {
+  pthread_mutex_lock(&memo->lock);
+
+  *stats = memo->stats;
+  stats->entries = memo->num_entries;
+  stats->bytes = 0;
+  for (int region = 0; region < NUM_REGIONS; ++region) {
+    stats->bytes += memo->regions[region].bytes;
+  }
+
+  pthread_mutex_unlock(&memo->lock);
+}
+
+static uint64_t mix(uint64_t k) {
+  k *= 0x87c37b91114253d5ULL;
+  k = (k << 31) | (k >> 33);
+  return k * 0x4cf5ad432745937fULL;
+}
+
+/*
+ * a MurmurHash3-style hash, 8 bytes at a time.
+ */
+static uint64_t hash_line(const char *line, size_t len) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t k;
+    memcpy(&k, &line[i], 8);
+    h ^= mix(k);
+    h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+  }
+
+  if (i < len) {
+    uint64_t k = 0;
+    memcpy(&k, &line[i], len - i);
+    h ^= mix(k);
+  }
+
+  // fmix64
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+static bool sketch_init(struct Sketch *sketch, size_t num_entries) {
+  size_t words = 64;
+  while (words < num_entries) {
+    words *= 2;
+  }
+
+  sketch->table = calloc(words, sizeof(*sketch->table));
+  sketch->mask = words - 1;
+  sketch->additions = 0;
+  sketch->sample_size = words * 10;
+
+  return sketch->table != NULL;
+}
+
+// the word & the counter in it that hold `hash` in row `row` of the sketch
+static void sketch_slot(const struct Sketch *sketch, uint64_t hash, int row,
+                        size_t *word, unsigned *shift) {
+  static const uint64_t seeds[SKETCH_DEPTH] = {
+      0xc3a5c85c97cb3127ULL,
+      0xb492b66fbe98f273ULL,
+      0x9ae16a3b2f90404fULL,
+      0xcbf29ce484222325ULL,
+  };
+
+  uint64_t h = (hash + seeds[row]) * seeds[row];
+  h ^= h >> 32;
+
+  *word = h & sketch->mask;
+  *shift = ((h >> 40) & 15) * 4;
+}
+
+static void sketch_add(struct Sketch *sketch, uint64_t hash) {
+  bool added = false;
+  for (int row = 0; row < SKETCH_DEPTH; ++row) {
+    size_t word;
+    unsigned shift;
+    sketch_slot(sketch, hash, row, &word, &shift);
+
+    if (((sketch->table[word] >> shift) & 15) < 15) {
+      sketch->table[word] += 1ULL << shift;
+      added = true;
+    }
+  }
+
+  // lines that stopped coming up are forgotten by halving every counter
+  if (added && ++sketch->additions >= sketch->sample_size) {
+    for (size_t i = 0; i <= sketch->mask; ++i) {
+      sketch->table[i] = (sketch->table[i] >> 1) & 0x7777777777777777ULL;
+    }
+    sketch->additions /= 2;
+  }
+}
+
+static unsigned sketch_frequency(const struct Sketch *sketch, uint64_t hash) {
+  unsigned frequency = 15;
+  for (int row = 0; row < SKETCH_DEPTH; ++row) {
+    size_t word;
+    unsigned shift;
+    sketch_slot(sketch, hash, row, &word, &shift);
+
+    unsigned count = (sketch->table[word] >> shift) & 15;
+    if (count < frequency) {
+      frequency = count;
+    }
+  }
+
+  return frequency;
+}
+
+static struct Entry *find(struct MemoCache *memo, uint64_t hash,
+                          const char *line, size_t len) {
+  struct Entry *entry = *bucket_of(memo, hash);
+  while (entry != NULL) {
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(entry->data, line, len) == 0) {
+      return entry;
+    }
+    entry = entry->next_in_bucket;
+  }
+
+  return NULL;
+}
+
+static void insert(struct MemoCache *memo, struct Entry *entry) {
+  if (memo->num_entries >= memo->num_buckets) {
+    grow_buckets(memo);
+  }
+
+  struct Entry **bucket = bucket_of(memo, entry->hash);
+  entry->next_in_bucket = *bucket;
+  *bucket = entry;
+  ++memo->num_entries;
+}
+
+/*
+ * takes an entry out of its list & out of the cache, & frees it.
+ */
+static void evict(struct MemoCache *memo, struct Entry *entry) {
+  list_remove(memo, entry);
+  drop(memo, entry);
+}
+
+/*
+ * takes an entry that's in no list out of the cache & frees it.
+ */
+static void drop(struct MemoCache *memo, struct Entry *entry) {
+  struct Entry **link = bucket_of(memo, entry->hash);
+  while (*link != entry) {
+    link = &(*link)->next_in_bucket;
+  }
+  *link = entry->next_in_bucket;
+  --memo->num_entries;
+
+  free(entry);
+}
+
+static struct Entry **bucket_of(struct MemoCache *memo, uint64_t hash) {
+  return &memo->buckets[hash & (memo->num_buckets - 1)];
+}
+
+/*
+ * doubles the number of buckets, if they can be allocated. otherwise the
+ * chains just get longer.
+ */
+static void grow_buckets(struct MemoCache *memo) {
+  size_t num_buckets = memo->num_buckets * 2;
+  struct Entry **buckets = calloc(num_buckets, sizeof(*buckets));
+  if (buckets == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < memo->num_buckets; ++i) {
+    struct Entry *entry = memo->buckets[i];
+    while (entry != NULL) {
+      struct Entry *next = entry->next_in_bucket;
+      struct Entry **bucket = &buckets[entry->hash & (num_buckets - 1)];
+      entry->next_in_bucket = *bucket;
+      *bucket = entry;
+      entry = next;
+    }
+  }
+
+  free(memo->buckets);
+  memo->buckets = buckets;
+  memo->num_buckets = num_buckets;
+}
+
+/*
+ * marks an entry as just used: an entry on probation is protected, which may
+ * put the protected entry used least back on probation.
+ */
+static void touch(struct MemoCache *memo, struct Entry *entry) {
+  enum Region region = entry->region;
+  list_remove(memo, entry);
+
+  if (region != REGION_PROBATION) {
+    list_push(memo, entry, region);
+    return;
+  }
+
+  list_push(memo, entry, REGION_PROTECTED);
+
+  struct List *protected = &memo->regions[REGION_PROTECTED];
+  while (protected->bytes > memo->max_bytes[REGION_PROTECTED] &&
+         protected->tail != entry) {
+    struct Entry *demoted = protected->tail;
+    list_remove(memo, demoted);
+    list_push(memo, demoted, REGION_PROBATION);
+  }
+}
+
+/*
+ * moves the entries used least out of the window, once it's full, into the
+ * main cache if they're admitted, or out of the cache if they're not.
+ */
+static void shrink_window(struct MemoCache *memo) {
+  struct List *window = &memo->regions[REGION_WINDOW];
+
+  while (window->bytes > memo->max_bytes[REGION_WINDOW]) {
+    struct Entry *candidate = window->tail;
+    list_remove(memo, candidate);
+
+    if (admit(memo, candidate)) {
+      list_push(memo, candidate, REGION_PROBATION);
+      ++memo->stats.admitted;
+    } else {
+      ++memo->stats.rejected;
+      drop(memo, candidate);
+    }
+  }
+}
+
+/*
+ * makes room in the main cache for an entry leaving the window, by evicting
+ * the entries used least, as long as its line came up more often than theirs.
+ */
+static bool admit(struct MemoCache *memo, struct Entry *candidate) {
+  size_t max_main =
+      memo->max_bytes[REGION_PROBATION] + memo->max_bytes[REGION_PROTECTED];
+  size_t size = entry_size(candidate);
+  unsigned frequency = sketch_frequency(&memo->sketch, candidate->hash);
+
+  for (;;) {
+    size_t main_bytes = memo->regions[REGION_PROBATION].bytes +
+                        memo->regions[REGION_PROTECTED].bytes;
+    if (main_bytes + size <= max_main) {
+      return true;
+    }
+
+    struct Entry *victim = memo->regions[REGION_PROBATION].tail;
+    if (victim == NULL) {
+      victim = memo->regions[REGION_PROTECTED].tail;
+    }
+
+    if (sketch_frequency(&memo->sketch, victim->hash) >= frequency) {
+      return false;
+    }
+
+    evict(memo, victim);
+    ++memo->stats.evicted;
+  }
+}
+
+static void list_push(struct MemoCache *memo, struct Entry *entry,
+                      enum Region region) {
+  struct List *list = &memo->regions[region];
+
+  entry->region = region;
+  entry->prev = NULL;
+  entry->next = list->head;
+  if (list->head != NULL) {
+    list->head->prev = entry;
+  } else {
+    list->tail = entry;
+  }
+  list->head = entry;
+  list->bytes += entry_size(entry);
+}
+
+static void list_remove(struct MemoCache *memo, struct Entry *entry) {
+  struct List *list = &memo->regions[entry->region];
+
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    list->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  } else {
+    list->tail = entry->prev;
+  }
+  list->bytes -= entry_size(entry);
+}
+
+static size_t entry_size(const struct Entry *entry) {
+  return sizeof(*entry) + entry->len + entry->output_len;
+}
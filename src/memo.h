@@ -0,0 +1,53 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "abuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * the outputs of lines that were evaluated already, for evaluators that are
+ * pure (a line always has the same output, & evaluating it changes nothing
+ * else), so a line that comes up again isn't evaluated again. it's safe to
+ * share between threads.
+ */
+struct MemoCache;
+
+/*
+ * what `memo_stats` reports.
+ */
+struct MemoStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t admitted; // outputs that made it past the window into the cache
+  uint64_t rejected; // outputs dropped, since what they'd push out is used more
+  uint64_t evicted;  // outputs pushed out by ones used more
+  uint64_t saved_ns; // how long evaluating the hits took the first time
+  size_t entries;
+  size_t bytes;
+};
+
+// outputs that took less than this to evaluate are quicker to evaluate again
+#define MEMO_MIN_COST_NS 1000
+
+struct MemoCache *memo_init(size_t max_bytes);
+void memo_free(struct MemoCache *memo);
+
+bool memo_lookup(struct MemoCache *memo, const char *line, size_t len,
+                 struct AppendBuffer *out);
+void memo_store(struct MemoCache *memo, const char *line, size_t len,
+                const char *output, size_t output_len, uint64_t cost_ns);
+
+void memo_stats(struct MemoCache *memo, struct MemoStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
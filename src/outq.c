@@ -0,0 +1,487 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>   // for fcntl(), O_NONBLOCK
+#include <poll.h>    // for poll()
+#include <pthread.h> // for pthread_mutex_t & related functions
+#include <signal.h>  // for sigaction(), sig_atomic_t
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>   // for snprintf()
+#include <stdlib.h>
+#include <string.h>  // for memcpy(), memchr()
+#include <termios.h> // for struct termios, tcgetattr(), tcsetattr()
+#include <unistd.h>  // for read(), write(), pipe()
+
+#include "./outq.h"
+
+/*
+ * A ring buffer between a producer thread & the terminal. Writing to it
+ * doesn't wait for the terminal: once it's full, whole lines are dropped &
+ * counted instead, and a "... N lines elided" line takes their place once
+ * there's room again. A line too long for the room left while the queue is
+ * at most half full goes through in pieces instead, as the terminal takes
+ * them.
+ *
+ * The main thread drains it with `poll()`. Ctrl+C is left to the terminal,
+ * which sends SIGINT, so a flood of output can always be interrupted without
+ * reading (& losing) whatever else is typed in the meantime.
+ */
+struct OutputQueue {
+  pthread_mutex_t lock;
+
+  char *data;
+  size_t capacity;
+  size_t head; // index of the oldest byte
+  size_t len;  // number of bytes queued
+
+  bool closed;    // the producer is done
+  bool cancelled; // the user interrupted the output
+  bool eliding;   // dropping lines until there's room again
+  bool mid_line;  // the last byte queued wasn't a newline
+  bool passing;   // letting a line longer than the queue through in pieces
+  uint64_t elided_lines;
+
+  // the producer writes a byte to this pipe when the queue stops being empty
+  // or is closed, so `outq_drain` can wait on it along with the terminal
+  int notify[2];
+
+  // signalled whenever the drain makes room, or the output is cancelled
+  pthread_cond_t drained;
+};
+
+// room always kept free for the summary line
+#define OUTQ_SUMMARY_RESERVE 64
+// how much is written to the terminal at a time, so Ctrl+C is seen quickly
+#define OUTQ_WRITE_CHUNK 4096
+
+#define KEY_CTRL_C 0x03
+
+// set by `on_interrupt` while `outq_drain` runs, which it wakes up through
+// `interrupt_fd`
+static volatile sig_atomic_t interrupted = 0;
+static int interrupt_fd = -1;
+
+static void on_interrupt(int sig);
+static void push(struct OutputQueue *q, const char *data, size_t len);
+static void push_summary(struct OutputQueue *q);
+static size_t free_space(struct OutputQueue *q);
+static uint64_t count_lines(const char *data, size_t len);
+static const char *find_last_newline(const char *data, size_t len);
+static void notify(struct OutputQueue *q);
+
+/**
+ * initializes a new output queue. returns NULL if memory allocation fails.
+ *
+ * @param capacity the size of the queue in bytes. if 0, it will be set to
+ * `OUTQ_DEFAULT_CAPACITY`
+ */
+struct OutputQueue *outq_init(size_t capacity) {
+  if (capacity == 0) {
+    capacity = OUTQ_DEFAULT_CAPACITY;
+  }
+  assert(capacity > 2 * OUTQ_SUMMARY_RESERVE);
+
+  struct OutputQueue *q = calloc(1, sizeof(struct OutputQueue));
+  if (q == NULL) {
+    return NULL;
+  }
+
+  q->data = malloc(capacity);
+  if (q->data == NULL) {
+    free(q);
+    return NULL;
+  }
+
+  if (pipe(q->notify) == -1) {
+    free(q->data);
+    free(q);
+    return NULL;
+  }
+
+  // neither side may ever block on the pipe
+  fcntl(q->notify[0], F_SETFL, fcntl(q->notify[0], F_GETFL) | O_NONBLOCK);
+  fcntl(q->notify[1], F_SETFL, fcntl(q->notify[1], F_GETFL) | O_NONBLOCK);
+
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->drained, NULL);
+  q->capacity = capacity;
+
+  return q;
+}
+
+/**
+ * frees the output queue. the producer MUST be done with it.
+ *
+ * @param q the output queue to free
+ */
+void outq_free(struct OutputQueue *q) {
+  assert(q != NULL);
+
+  close(q->notify[0]);
+  close(q->notify[1]);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->drained);
+  free(q->data);
+  free(q);
+}
+
+/**
+ * queues output to be written to the terminal. if the queue is full, the
+ * lines that don't fit are dropped & summarized, rather than waited for. a
+ * line that doesn't fit while the queue is at most half full is the
+ * exception: it's queued in pieces, waiting for the terminal to take each, so
+ * `outq_drain` MUST be running. returns false once the user has interrupted
+ * the output, so the producer can stop.
+ *
+ * @param q the output queue
+ * @param data the output. it doesn't need to be null-terminated.
+ * @param len the length of the output
+ */
+bool outq_write(struct OutputQueue *q, const char *data, size_t len) {
+  assert(q != NULL);
+
+  pthread_mutex_lock(&q->lock);
+
+  if (q->cancelled) {
+    pthread_mutex_unlock(&q->lock);
+    return false;
+  }
+
+  bool was_empty = q->len == 0;
+
+  while (len > 0 && !q->cancelled) {
+    if (q->passing) {
+      const char *newline = memchr(data, '\n', len);
+      size_t line_len = newline != NULL ? (size_t)(newline + 1 - data) : len;
+
+      // let the drain know about the pieces queued so far, & wait for it
+      while (free_space(q) <= OUTQ_SUMMARY_RESERVE && !q->cancelled) {
+        notify(q);
+        pthread_cond_wait(&q->drained, &q->lock);
+      }
+      if (q->cancelled) {
+        break;
+      }
+
+      size_t n = free_space(q) - OUTQ_SUMMARY_RESERVE;
+      if (n > line_len) {
+        n = line_len;
+      }
+      push(q, data, n);
+      data += n;
+      len -= n;
+
+      q->passing = n < line_len || newline == NULL;
+      continue;
+    }
+
+    if (q->eliding) {
+      // keep dropping until the queue is half empty, so it doesn't flip
+      // between eliding & not on every line
+      if (free_space(q) < q->capacity / 2) {
+        q->elided_lines += count_lines(data, len);
+        break;
+      }
+
+      // the rest of the line being dropped goes too
+      const char *newline = memchr(data, '\n', len);
+      if (newline == NULL) {
+        break;
+      }
+
+      q->elided_lines += 1;
+      len -= newline + 1 - data;
+      data = newline + 1;
+
+      push_summary(q);
+      continue;
+    }
+
+    size_t space = free_space(q);
+    size_t room = space > OUTQ_SUMMARY_RESERVE ? space - OUTQ_SUMMARY_RESERVE : 0;
+    if (len <= room) {
+      push(q, data, len);
+      break;
+    }
+
+    // only whole lines go in, so the summary can start on a line of its own
+    const char *newline = find_last_newline(data, room);
+    if (newline != NULL) {
+      size_t n = newline + 1 - data;
+      push(q, data, n);
+      data += n;
+      len -= n;
+      continue;
+    }
+
+    // a line that doesn't fit is only dropped if the queue is backed up, the
+    // same way lines are dropped until it's half empty again
+    if (free_space(q) >= q->capacity / 2) {
+      q->passing = true;
+      continue;
+    }
+
+    q->eliding = true;
+  }
+
+  if (was_empty && q->len > 0) {
+    notify(q);
+  }
+
+  pthread_mutex_unlock(&q->lock);
+
+  return true;
+}
+
+/**
+ * marks the end of the output, so `outq_drain` returns once it's all written.
+ *
+ * @param q the output queue
+ */
+void outq_close(struct OutputQueue *q) {
+  assert(q != NULL);
+
+  pthread_mutex_lock(&q->lock);
+
+  if (q->eliding && !q->cancelled) {
+    // a last line with no newline was dropped
+    if (q->elided_lines == 0) {
+      q->elided_lines = 1;
+    }
+    push_summary(q);
+  }
+
+  q->closed = true;
+  notify(q);
+
+  pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * writes the queued output to the terminal until the producer closes the queue
+ * and it's empty, or until the user presses Ctrl+C. the terminal's input is
+ * neither echoed nor read while it runs, so whatever else is typed in the
+ * meantime is still there to be read afterwards. Ctrl+C makes the terminal
+ * send SIGINT, which is caught until it returns.
+ *
+ * @param q the output queue
+ * @param in_fd the terminal Ctrl+C is typed on
+ * @param out_fd where to write the output
+ * @param tee if not NULL, called with everything written to `out_fd`
+ * @param ctx passed to `tee` as is
+ */
+enum OutqResult outq_drain(struct OutputQueue *q, int in_fd, int out_fd,
+                           OutqTeeFn tee, void *ctx) {
+  assert(q != NULL);
+
+  // the handler is in place before the terminal can send SIGINT
+  interrupted = 0;
+  interrupt_fd = q->notify[1];
+  struct sigaction action = {.sa_handler = on_interrupt};
+  struct sigaction original_action;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, &original_action);
+
+  struct termios original_state;
+  bool is_tty = tcgetattr(in_fd, &original_state) != -1;
+  if (is_tty) {
+    // only the input side changes, so output still gets "\r\n" for "\n"
+    struct termios term = original_state;
+    // NOFLSH, or the interrupt would throw away what's typed ahead of it
+    term.c_lflag &= ~(ICANON | ECHO);
+    term.c_lflag |= ISIG | NOFLSH;
+    term.c_cc[VINTR] = KEY_CTRL_C;
+    tcsetattr(in_fd, TCSANOW, &term);
+  }
+
+  enum OutqResult result = OUTQ_DONE;
+  struct pollfd fds[2] = {
+      {.fd = q->notify[0], .events = POLLIN},
+      {.fd = out_fd, .events = POLLOUT},
+  };
+
+  while (true) {
+    pthread_mutex_lock(&q->lock);
+    size_t head = q->head;
+    size_t len = q->len;
+    bool closed = q->closed;
+    pthread_mutex_unlock(&q->lock);
+
+    if (interrupted) {
+      pthread_mutex_lock(&q->lock);
+      q->cancelled = true;
+      q->len = 0;
+      pthread_cond_signal(&q->drained);
+      pthread_mutex_unlock(&q->lock);
+
+      result = OUTQ_INTERRUPTED;
+      break;
+    }
+
+    if (len == 0 && closed) {
+      break;
+    }
+
+    // only wait for the terminal to be writable when there's something to
+    // write, else it'd spin
+    if (poll(fds, len > 0 ? 2 : 1, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      result = OUTQ_ERROR;
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char buf[64];
+      while (read(q->notify[0], buf, sizeof(buf)) > 0) {
+      }
+    }
+
+    if (len > 0 && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP))) {
+      // only the drain moves `head`, & the producer never writes over queued
+      // bytes, so they can be written without holding the lock
+      size_t n = q->capacity - head;
+      if (n > len) {
+        n = len;
+      }
+      if (n > OUTQ_WRITE_CHUNK) {
+        n = OUTQ_WRITE_CHUNK;
+      }
+
+      ssize_t written = write(out_fd, &q->data[head], n);
+      if (written == -1) {
+        if (errno == EINTR || errno == EAGAIN) {
+          continue;
+        }
+
+        result = OUTQ_ERROR;
+        break;
+      }
+
+      if (tee != NULL) {
+        tee(ctx, &q->data[head], written);
+      }
+
+      pthread_mutex_lock(&q->lock);
+      q->head = (q->head + written) % q->capacity;
+      q->len -= written;
+      pthread_cond_signal(&q->drained);
+      pthread_mutex_unlock(&q->lock);
+    }
+  }
+
+  if (result != OUTQ_DONE) {
+    // make sure the producer stops
+    pthread_mutex_lock(&q->lock);
+    q->cancelled = true;
+    pthread_cond_signal(&q->drained);
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  if (is_tty) {
+    tcsetattr(in_fd, TCSANOW, &original_state);
+  }
+
+  sigaction(SIGINT, &original_action, NULL);
+  interrupt_fd = -1;
+
+  return result;
+}
+
+/*
+ * the SIGINT handler while `outq_drain` runs: it only notes the interrupt &
+ * wakes the drain up.
+ */
+static void on_interrupt(int sig) {
+  (void)sig;
+
+  int saved_errno = errno;
+  interrupted = 1;
+
+  char c = 0;
+  ssize_t n = write(interrupt_fd, &c, 1);
+  (void)n;
+
+  errno = saved_errno;
+}
+
+/*
+ * copies into the ring buffer. `lock` MUST be held, and there MUST be room.
+ */
+static void push(struct OutputQueue *q, const char *data, size_t len) {
+  assert(len <= free_space(q));
+
+  if (len == 0) {
+    return;
+  }
+
+  size_t tail = (q->head + q->len) % q->capacity;
+  size_t n = q->capacity - tail;
+  if (n > len) {
+    n = len;
+  }
+
+  memcpy(&q->data[tail], data, n);
+  memcpy(q->data, &data[n], len - n);
+  q->len += len;
+
+  q->mid_line = data[len - 1] != '\n';
+}
+
+/*
+ * queues the "... N lines elided" line & stops eliding. `lock` MUST be held.
+ */
+static void push_summary(struct OutputQueue *q) {
+  char count[32];
+  if (q->elided_lines < 1000) {
+    snprintf(count, sizeof(count), "%llu", (unsigned long long)q->elided_lines);
+  } else if (q->elided_lines < 1000000) {
+    snprintf(count, sizeof(count), "%.1fK", q->elided_lines / 1e3);
+  } else {
+    snprintf(count, sizeof(count), "%.1fM", q->elided_lines / 1e6);
+  }
+
+  char summary[OUTQ_SUMMARY_RESERVE];
+  int len = snprintf(summary, sizeof(summary), "%s... %s line%s elided\n",
+                     q->mid_line ? "\n" : "", count,
+                     q->elided_lines == 1 ? "" : "s");
+
+  push(q, summary, len);
+
+  q->eliding = false;
+  q->elided_lines = 0;
+}
+
+static size_t free_space(struct OutputQueue *q) { return q->capacity - q->len; }
+
+static uint64_t count_lines(const char *data, size_t len) {
+  uint64_t lines = 0;
+  const char *end = data + len;
+
+  while ((data = memchr(data, '\n', end - data)) != NULL) {
+    ++lines;
+    ++data;
+  }
+
+  return lines;
+}
+
+static const char *find_last_newline(const char *data, size_t len) {
+  while (len > 0) {
+    if (data[--len] == '\n') {
+      return &data[len];
+    }
+  }
+
+  return NULL;
+}
+
+static void notify(struct OutputQueue *q) {
+  // if the pipe's full, the drain is going to wake up anyway
+  char c = 0;
+  ssize_t n = write(q->notify[1], &c, 1);
+  (void)n;
+}
@@ -0,0 +1,31 @@
+#ifndef OUTQ_H
+#define OUTQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct OutputQueue;
+
+#define OUTQ_DEFAULT_CAPACITY (1024 * 1024)
+
+enum OutqResult {
+  OUTQ_DONE,        // everything written
+  OUTQ_INTERRUPTED, // the user pressed Ctrl+C
+  OUTQ_ERROR,       // writing to the terminal failed
+};
+
+/*
+ * called with every chunk `outq_drain` writes to the terminal
+ */
+typedef void (*OutqTeeFn)(void *ctx, const char *data, size_t len);
+
+struct OutputQueue *outq_init(size_t capacity);
+void outq_free(struct OutputQueue *q);
+
+bool outq_write(struct OutputQueue *q, const char *data, size_t len);
+void outq_close(struct OutputQueue *q);
+
+enum OutqResult outq_drain(struct OutputQueue *q, int in_fd, int out_fd,
+                           OutqTeeFn tee, void *ctx);
+
+#endif
@@ -0,0 +1,735 @@
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>    // for poll()
+#include <pthread.h> // for pthread_create(), pthread_mutex_t, etc.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h> // for SIZE_MAX
+#include <stdio.h>     // for snprintf()
+#include <stdlib.h>
+#include <string.h>    // for memchr()
+#include <sys/ioctl.h> // for ioctl(), struct winsize
+#include <termios.h>   // for struct termios, tcgetattr(), tcsetattr()
+#include <unistd.h>    // for read(), write(), isatty()
+
+#include "./abuf.h"
+#include "./outq.h"
+#include "./pager.h"
+#include "./vector.h"
+
+/*
+ * The producer appends to `output` from a background thread while the reader
+ * pages through it on the main thread, so everything shared between them is
+ * only touched with `lock` held.
+ *
+ * Line starts are only found as far as the reader has scrolled, so paging
+ * through the first screen of a 50 MB output doesn't have to scan all of it,
+ * and only the visible lines are ever rendered. The producer is only let that
+ * far ahead of them (see `PAGER_MAX_AHEAD`), so output nobody scrolls to
+ * isn't produced & kept all the same.
+ */
+struct Pager {
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // signalled whenever the producer writes or ends
+  pthread_cond_t room;    // signalled whenever lines are found, or on quit
+
+  struct AppendBuffer output;
+  bool done;      // the producer has returned
+  bool cancelled; // the reader quit, so the producer should stop
+  bool failed;    // the output couldn't grow, so the rest of it was dropped
+  bool throttled; // the reader pages on another thread, so the producer waits
+
+  struct Vector *line_starts; // offset of each line found so far
+  size_t indexed;             // bytes of `output` searched for line starts
+
+  PagerProducer producer;
+  void *producer_ctx;
+
+  // when streaming, the producer writes here instead, & only what's actually
+  // written to the terminal ends up in `output`
+  struct OutputQueue *queue;
+
+  // only used by the main thread
+  size_t top; // the first visible line
+  size_t rows;
+  size_t cols;
+  struct AppendBuffer frame;
+  struct termios original_state;
+};
+
+#define PAGER_POLL_MS 100
+
+// how far past the last line found the producer may get before it waits for
+// the reader to scroll
+#define PAGER_MAX_AHEAD (4 * 1024 * 1024)
+#define PAGER_TAB_WIDTH 8
+
+enum PagerKey {
+  PAGER_KEY_NONE,
+  PAGER_KEY_QUIT,
+  PAGER_KEY_DOWN,
+  PAGER_KEY_UP,
+  PAGER_KEY_PAGE_DOWN,
+  PAGER_KEY_PAGE_UP,
+  PAGER_KEY_TOP,
+  PAGER_KEY_BOTTOM,
+};
+
+static void *run_producer(void *arg);
+static void tee_output(void *ctx, const char *data, size_t len);
+static bool page(struct Pager *pager);
+static bool render(struct Pager *pager);
+static void render_line(struct Pager *pager, size_t line);
+static void index_lines(struct Pager *pager, size_t line);
+static size_t num_lines(struct Pager *pager);
+static size_t page_rows(struct Pager *pager);
+static void scroll(struct Pager *pager, enum PagerKey key);
+static size_t parse_key(const char *buf, size_t len, enum PagerKey *key);
+static void get_window_size(struct Pager *pager);
+static bool enable_raw_mode(struct Pager *pager);
+static void disable_raw_mode(struct Pager *pager);
+static bool write_all(int fd, const char *data, size_t len);
+
+/**
+ * initializes a new pager. returns NULL if memory allocation fails.
+ */
+struct Pager *pager_init(void) {
+  struct Pager *pager = calloc(1, sizeof(struct Pager));
+  if (pager == NULL) {
+    return NULL;
+  }
+
+  pager->line_starts = vector_init(sizeof(size_t), 0);
+  if (pager->line_starts == NULL) {
+    free(pager);
+    return NULL;
+  }
+
+  // the first line always starts at the beginning
+  size_t start = 0;
+  vector_push(pager->line_starts, &start);
+
+  pthread_mutex_init(&pager->lock, NULL);
+  pthread_cond_init(&pager->changed, NULL);
+  pthread_cond_init(&pager->room, NULL);
+
+  pager->output = (struct AppendBuffer)ABUF_INIT;
+  pager->frame = (struct AppendBuffer)ABUF_INIT;
+
+  return pager;
+}
+
+/**
+ * frees the pager and the output in it. the producer MUST have returned.
+ *
+ * @param pager the pager to free
+ */
+void pager_free(struct Pager *pager) {
+  assert(pager != NULL);
+
+  pthread_mutex_destroy(&pager->lock);
+  pthread_cond_destroy(&pager->changed);
+  pthread_cond_destroy(&pager->room);
+
+  vector_free(pager->line_starts);
+  abuf_free(&pager->output);
+  abuf_free(&pager->frame);
+  free(pager);
+}
+
+/**
+ * appends to the output. this is meant to be called by the producer, and is
+ * safe to call while the output is being paged through, in which case it
+ * waits while the output is too far ahead of what the reader has scrolled
+ * to. returns false once the reader has quit, or if memory allocation fails.
+ *
+ * @param pager the pager to append to
+ * @param data the bytes to append
+ * @param len the number of bytes to append
+ */
+bool pager_write(struct Pager *pager, const char *data, size_t len) {
+  assert(pager != NULL);
+
+  if (pager->queue != NULL) {
+    return outq_write(pager->queue, data, len);
+  }
+
+  pthread_mutex_lock(&pager->lock);
+
+  while (pager->throttled && !pager->cancelled &&
+         pager->output.len - pager->indexed >= PAGER_MAX_AHEAD) {
+    pthread_cond_wait(&pager->room, &pager->lock);
+  }
+
+  bool ok = !pager->cancelled && !pager->failed;
+  if (ok && !abuf_append(&pager->output, data, len)) {
+    pager->failed = true;
+    ok = false;
+  }
+
+  pthread_cond_signal(&pager->changed);
+  pthread_mutex_unlock(&pager->lock);
+
+  return ok;
+}
+
+/**
+ * runs `producer` on a background thread and shows its output. if the output
+ * fits on the screen, or stdin / stdout isn't a terminal, it's just printed.
+ * otherwise the user pages through it while it's still being produced, until
+ * they quit, which also stops the producer.
+ *
+ * @param pager the pager to collect the output in
+ * @param producer generates the output
+ * @param ctx passed to `producer` as is
+ *
+ * @return `false` if writing to the terminal fails, else `true`
+ */
+bool pager_run(struct Pager *pager, PagerProducer producer, void *ctx) {
+  assert(pager != NULL);
+  assert(producer != NULL);
+
+  // anything printed with stdio has to come out before the output
+  fflush(stdout);
+
+  if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+    producer(pager, ctx);
+    pager->done = true;
+    return write_all(STDOUT_FILENO, pager->output.data, pager->output.len);
+  }
+
+  pager->producer = producer;
+  pager->producer_ctx = ctx;
+
+  pthread_t thread;
+  pager->throttled = true;
+  bool threaded = pthread_create(&thread, NULL, run_producer, pager) == 0;
+  if (!threaded) {
+    // no thread, so page through it once it's all there
+    pager->throttled = false;
+    run_producer(pager);
+  }
+
+  get_window_size(pager);
+
+  // wait until it's clear whether the output fits on the screen, keeping a
+  // row for the prompt
+  pthread_mutex_lock(&pager->lock);
+  while (true) {
+    index_lines(pager, pager->rows - 1);
+    if (pager->done || num_lines(pager) >= pager->rows - 1) {
+      break;
+    }
+
+    pthread_cond_wait(&pager->changed, &pager->lock);
+  }
+  bool fits = pager->done && num_lines(pager) < pager->rows - 1;
+  pthread_mutex_unlock(&pager->lock);
+
+  bool ok;
+  if (fits) {
+    ok = write_all(STDOUT_FILENO, pager->output.data, pager->output.len);
+  } else {
+    ok = page(pager);
+  }
+
+  pthread_mutex_lock(&pager->lock);
+  pager->cancelled = true;
+  pthread_cond_signal(&pager->room);
+  pthread_mutex_unlock(&pager->lock);
+
+  if (threaded) {
+    pthread_join(thread, NULL);
+  }
+
+  return ok;
+}
+
+/**
+ * runs `producer` on a background thread and streams its output straight to
+ * the terminal, without paging it. the output goes through a bounded queue,
+ * so if it comes faster than the terminal can show it, lines are dropped &
+ * summarized instead. pressing Ctrl+C stops it right away. if stdin / stdout
+ * isn't a terminal, it's the same as `pager_run`.
+ *
+ * @param pager the pager to collect the output in
+ * @param producer generates the output
+ * @param ctx passed to `producer` as is
+ *
+ * @return `false` if writing to the terminal fails, else `true`
+ */
+bool pager_stream(struct Pager *pager, PagerProducer producer, void *ctx) {
+  assert(pager != NULL);
+  assert(producer != NULL);
+
+  if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+    return pager_run(pager, producer, ctx);
+  }
+
+  pager->queue = outq_init(0);
+  if (pager->queue == NULL) {
+    return pager_run(pager, producer, ctx);
+  }
+
+  fflush(stdout);
+
+  pager->producer = producer;
+  pager->producer_ctx = ctx;
+
+  // a line too long for the queue waits for the drain, so the producer can't
+  // run on this thread
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, run_producer, pager) != 0) {
+    outq_free(pager->queue);
+    pager->queue = NULL;
+    return pager_run(pager, producer, ctx);
+  }
+
+  enum OutqResult result = outq_drain(pager->queue, STDIN_FILENO,
+                                      STDOUT_FILENO, tee_output, pager);
+  if (result == OUTQ_INTERRUPTED) {
+    const char *msg = "^C\n";
+    if (write_all(STDOUT_FILENO, msg, strlen(msg))) {
+      tee_output(pager, msg, strlen(msg));
+    }
+  }
+
+  pthread_join(thread, NULL);
+
+  outq_free(pager->queue);
+  pager->queue = NULL;
+
+  return result != OUTQ_ERROR;
+}
+
+/**
+ * gets the output produced so far. the producer MUST have returned.
+ *
+ * @param pager the pager to get the output of
+ * @param len where to write the length of the output
+ */
+const char *pager_output(struct Pager *pager, size_t *len) {
+  assert(pager != NULL);
+  assert(len != NULL);
+
+  *len = pager->output.len;
+  return pager->output.data;
+}
+
+static void *run_producer(void *arg) {
+  struct Pager *pager = arg;
+
+  pager->producer(pager, pager->producer_ctx);
+
+  if (pager->queue != NULL) {
+    outq_close(pager->queue);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&pager->lock);
+  pager->done = true;
+  pthread_cond_signal(&pager->changed);
+  pthread_mutex_unlock(&pager->lock);
+
+  return NULL;
+}
+
+/*
+ * keeps what was streamed to the terminal, for `pager_output`
+ */
+static void tee_output(void *ctx, const char *data, size_t len) {
+  struct Pager *pager = ctx;
+
+  if (!pager->failed && !abuf_append(&pager->output, data, len)) {
+    pager->failed = true;
+  }
+}
+
+/*
+ * the interactive part. it draws on the alternate screen, so the terminal
+ * looks just like it did before once the user quits.
+ */
+static bool page(struct Pager *pager) {
+  if (!enable_raw_mode(pager)) {
+    return false;
+  }
+
+  // switch to the alternate screen & hide the cursor
+  bool ok = write_all(STDOUT_FILENO, "\x1b[?1049h\x1b[?25l", 14);
+
+  size_t rendered_len = 0;
+  bool rendered_done = false;
+  bool dirty = true;
+
+  while (ok) {
+    if (dirty) {
+      get_window_size(pager);
+
+      pthread_mutex_lock(&pager->lock);
+      ok = render(pager);
+      rendered_len = pager->output.len;
+      rendered_done = pager->done;
+      pthread_mutex_unlock(&pager->lock);
+
+      dirty = false;
+    }
+
+    struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+    int r = poll(&pfd, 1, PAGER_POLL_MS);
+    if (r == -1 && errno != EINTR) {
+      ok = false;
+      break;
+    }
+
+    if (r <= 0) {
+      // nothing typed, but the output may have grown, or the window resized
+      pthread_mutex_lock(&pager->lock);
+      dirty = pager->output.len != rendered_len || pager->done != rendered_done;
+      pthread_mutex_unlock(&pager->lock);
+
+      size_t rows = pager->rows, cols = pager->cols;
+      get_window_size(pager);
+      dirty = dirty || rows != pager->rows || cols != pager->cols;
+      continue;
+    }
+
+    char buf[32];
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n <= 0) {
+      continue;
+    }
+
+    bool quit = false;
+    for (size_t i = 0; i < (size_t)n && !quit;) {
+      enum PagerKey key;
+      i += parse_key(&buf[i], n - i, &key);
+
+      if (key == PAGER_KEY_QUIT) {
+        quit = true;
+      } else if (key != PAGER_KEY_NONE) {
+        pthread_mutex_lock(&pager->lock);
+        scroll(pager, key);
+        pthread_mutex_unlock(&pager->lock);
+        dirty = true;
+      }
+    }
+
+    if (quit) {
+      break;
+    }
+  }
+
+  // show the cursor & switch back to the normal screen
+  ok = write_all(STDOUT_FILENO, "\x1b[?25h\x1b[?1049l", 14) && ok;
+  disable_raw_mode(pager);
+
+  return ok;
+}
+
+/*
+ * draws the visible lines and a status line. `lock` MUST be held.
+ */
+static bool render(struct Pager *pager) {
+  size_t rows = page_rows(pager);
+  index_lines(pager, pager->top + rows);
+
+  struct AppendBuffer *ab = &pager->frame;
+  abuf_append(ab, "\x1b[H", 3);
+
+  size_t lines = num_lines(pager);
+  for (size_t r = 0; r < rows; ++r) {
+    if (pager->top + r < lines) {
+      render_line(pager, pager->top + r);
+    } else {
+      abuf_append(ab, "~", 1);
+    }
+
+    abuf_append(ab, "\x1b[K\r\n", 5);
+  }
+
+  // the total is only known once every line has been found
+  bool all_indexed = pager->done && pager->indexed == pager->output.len;
+  size_t last = pager->top + rows < lines ? pager->top + rows : lines;
+
+  char status[128];
+  int len = snprintf(status, sizeof(status),
+                     "lines %zu-%zu of %zu%s%s (q: quit, j/k, space/b, g/G)",
+                     lines == 0 ? 0 : pager->top + 1, last, lines,
+                     all_indexed ? "" : "+",
+                     pager->done ? "" : ", loading...");
+  if (len > (int)sizeof(status) - 1) {
+    len = sizeof(status) - 1;
+  }
+  if (len > (int)pager->cols) {
+    len = pager->cols;
+  }
+
+  abuf_append(ab, "\x1b[7m", 4);
+  abuf_append(ab, status, len);
+  abuf_append(ab, "\x1b[0m\x1b[K", 7);
+
+  return abuf_flush(ab, STDOUT_FILENO);
+}
+
+/*
+ * appends as much of a line as fits on the screen to the frame. control
+ * characters are replaced so they can't mess up the screen. `lock` MUST be
+ * held.
+ */
+static void render_line(struct Pager *pager, size_t line) {
+  const char *data = pager->output.data;
+  size_t start = *(size_t *)vector_get(pager->line_starts, line);
+  size_t end = line + 1 < vector_length(pager->line_starts)
+                   ? *(size_t *)vector_get(pager->line_starts, line + 1) - 1
+                   : pager->output.len;
+
+  struct AppendBuffer *ab = &pager->frame;
+  size_t col = 0;
+
+  for (size_t i = start; i < end; ++i) {
+    unsigned char c = data[i];
+
+    // UTF-8 continuation bytes don't take up a column of their own
+    if ((c & 0xc0) == 0x80) {
+      abuf_append(ab, &data[i], 1);
+      continue;
+    }
+
+    if (col >= pager->cols) {
+      break;
+    }
+
+    if (c == '\t') {
+      size_t spaces = PAGER_TAB_WIDTH - col % PAGER_TAB_WIDTH;
+      for (; spaces > 0 && col < pager->cols; --spaces, ++col) {
+        abuf_append(ab, " ", 1);
+      }
+    } else if (c < 0x20 || c == 0x7f) {
+      abuf_append(ab, "?", 1);
+      ++col;
+    } else {
+      abuf_append(ab, &data[i], 1);
+      ++col;
+    }
+  }
+}
+
+/*
+ * finds line starts until `line` is found, or the end of the output so far.
+ * `lock` MUST be held.
+ */
+static void index_lines(struct Pager *pager, size_t line) {
+  const char *data = pager->output.data;
+  size_t len = pager->output.len;
+  size_t indexed = pager->indexed;
+
+  while (vector_length(pager->line_starts) <= line && pager->indexed < len) {
+    const char *newline =
+        memchr(&data[pager->indexed], '\n', len - pager->indexed);
+    if (newline == NULL) {
+      pager->indexed = len;
+      break;
+    }
+
+    size_t start = newline - data + 1;
+    if (!vector_push(pager->line_starts, &start)) {
+      break;
+    }
+
+    pager->indexed = start;
+  }
+
+  // the producer may be waiting for the reader to get this far
+  if (pager->indexed != indexed) {
+    pthread_cond_signal(&pager->room);
+  }
+}
+
+/*
+ * the number of lines found so far. `lock` MUST be held.
+ */
+static size_t num_lines(struct Pager *pager) {
+  size_t n = vector_length(pager->line_starts);
+  size_t last = *(size_t *)vector_get(pager->line_starts, n - 1);
+
+  // nothing after the last newline (yet), so it's not a line
+  return last == pager->output.len ? n - 1 : n;
+}
+
+/*
+ * the number of rows for the output, keeping one for the status line
+ */
+static size_t page_rows(struct Pager *pager) {
+  return pager->rows > 1 ? pager->rows - 1 : 1;
+}
+
+/*
+ * moves the visible part of the output. `lock` MUST be held.
+ */
+static void scroll(struct Pager *pager, enum PagerKey key) {
+  size_t rows = page_rows(pager);
+
+  switch (key) {
+  case PAGER_KEY_DOWN:
+    pager->top += 1;
+    break;
+  case PAGER_KEY_UP:
+    pager->top = pager->top > 0 ? pager->top - 1 : 0;
+    break;
+  case PAGER_KEY_PAGE_DOWN:
+    pager->top += rows;
+    break;
+  case PAGER_KEY_PAGE_UP:
+    pager->top = pager->top > rows ? pager->top - rows : 0;
+    break;
+  case PAGER_KEY_TOP:
+    pager->top = 0;
+    break;
+  case PAGER_KEY_BOTTOM:
+    pager->top = SIZE_MAX - rows;
+    break;
+  default:
+    return;
+  }
+
+  // find enough lines to fill the screen, but don't scroll past the end
+  index_lines(pager, pager->top + rows);
+  size_t lines = num_lines(pager);
+  size_t max_top = lines > rows ? lines - rows : 0;
+  if (pager->top > max_top) {
+    pager->top = max_top;
+  }
+}
+
+/*
+ * parses one key press from `buf`. returns the number of bytes it took up.
+ */
+static size_t parse_key(const char *buf, size_t len, enum PagerKey *key) {
+  *key = PAGER_KEY_NONE;
+
+  switch (buf[0]) {
+  case 'q':
+  case 'Q':
+  case 0x03: // Ctrl+C
+    *key = PAGER_KEY_QUIT;
+    return 1;
+  case 'j':
+  case '\r':
+  case '\n':
+    *key = PAGER_KEY_DOWN;
+    return 1;
+  case 'k':
+    *key = PAGER_KEY_UP;
+    return 1;
+  case ' ':
+  case 'f':
+    *key = PAGER_KEY_PAGE_DOWN;
+    return 1;
+  case 'b':
+    *key = PAGER_KEY_PAGE_UP;
+    return 1;
+  case 'g':
+    *key = PAGER_KEY_TOP;
+    return 1;
+  case 'G':
+    *key = PAGER_KEY_BOTTOM;
+    return 1;
+  case '\x1b':
+    break;
+  default:
+    return 1;
+  }
+
+  // escape sequences for arrow keys, PAGE UP / DOWN, HOME & END
+  if (len < 3 || buf[1] != '[') {
+    return 1;
+  }
+
+  switch (buf[2]) {
+  case 'A':
+    *key = PAGER_KEY_UP;
+    return 3;
+  case 'B':
+    *key = PAGER_KEY_DOWN;
+    return 3;
+  case 'H':
+    *key = PAGER_KEY_TOP;
+    return 3;
+  case 'F':
+    *key = PAGER_KEY_BOTTOM;
+    return 3;
+  }
+
+  if (len < 4 || buf[3] != '~') {
+    return 3;
+  }
+
+  switch (buf[2]) {
+  case '1':
+    *key = PAGER_KEY_TOP;
+    break;
+  case '4':
+    *key = PAGER_KEY_BOTTOM;
+    break;
+  case '5':
+    *key = PAGER_KEY_PAGE_UP;
+    break;
+  case '6':
+    *key = PAGER_KEY_PAGE_DOWN;
+    break;
+  }
+
+  return 4;
+}
+
+static void get_window_size(struct Pager *pager) {
+  struct winsize ws;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_row == 0 ||
+      ws.ws_col == 0) {
+    pager->rows = 24;
+    pager->cols = 80;
+    return;
+  }
+
+  pager->rows = ws.ws_row;
+  pager->cols = ws.ws_col;
+}
+
+static bool enable_raw_mode(struct Pager *pager) {
+  if (tcgetattr(STDIN_FILENO, &pager->original_state) == -1) {
+    return false;
+  }
+
+  // same as readline's raw mode, read /notes/raw-mode.md
+  struct termios term = pager->original_state;
+  term.c_iflag &=
+      ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+  term.c_oflag &= ~OPOST;
+  term.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  term.c_cflag &= ~(CSIZE | PARENB);
+  term.c_cflag |= CS8;
+
+  return tcsetattr(STDIN_FILENO, TCSAFLUSH, &term) != -1;
+}
+
+static void disable_raw_mode(struct Pager *pager) {
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &pager->original_state);
+}
+
+static bool write_all(int fd, const char *data, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    ssize_t n = write(fd, &data[written], len - written);
+    if (n == -1) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+
+      return false;
+    }
+
+    written += n;
+  }
+
+  return true;
+}
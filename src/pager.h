@@ -0,0 +1,25 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct Pager;
+
+/*
+ * generates the output to page through, by calling `pager_write` as many
+ * times as needed. it runs on a background thread, so it must stop once
+ * `pager_write` returns false.
+ */
+typedef void (*PagerProducer)(struct Pager *pager, void *ctx);
+
+struct Pager *pager_init(void);
+void pager_free(struct Pager *pager);
+
+bool pager_write(struct Pager *pager, const char *data, size_t len);
+bool pager_run(struct Pager *pager, PagerProducer producer, void *ctx);
+bool pager_stream(struct Pager *pager, PagerProducer producer, void *ctx);
+
+const char *pager_output(struct Pager *pager, size_t *len);
+
+#endif
@@ -0,0 +1,601 @@
+#include <assert.h>
+#include <pthread.h> // for pthread_create() & related functions
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h> // for sysconf()
+
+#include "./pool.h"
+
+/*
+ * A work-stealing thread pool for evaluating lines, shared by all sessions.
+ *
+ * Every worker has a deque of tasks: it takes tasks from the front of its own,
+ * & once that's empty, steals from the back of another worker's, so no core
+ * sits idle while there's work queued anywhere.
+ *
+ * Tasks are evaluated in the order they were submitted within a session, so
+ * each session only ever has one task in the deques (or running) at a time:
+ * the rest wait in the session's own queue, & the next one is released to
+ * the back of the deque of the worker that ran the previous one, once it's
+ * done. That also makes the pool fair: a session that submits a thousand
+ * tasks takes one turn at a time like everyone else, instead of filling up
+ * the deques. (the usual LIFO order for the owner would hand the session that
+ * just ran the next turn right away, so the owner goes first in, first out.)
+ */
+
+struct PoolTask {
+  struct PoolSession *session;
+
+  PoolTaskFn fn;
+  PoolDoneFn done;
+  void *arg;
+
+  // the session's generation when the task was submitted. the task is
+  // cancelled once they differ (see `pool_cancel`).
+  uint64_t generation;
+
+  struct PoolTask *next; // in the session's queue
+};
+
+struct PoolSession {
+  struct WorkPool *pool;
+
+  pthread_mutex_t lock;
+
+  // tasks waiting for the session's turn
+  struct PoolTask *head;
+  struct PoolTask *tail;
+
+  bool busy;  // one of its tasks is in a deque or running
+  bool freed; // `pool_session_free` was called while it was busy
+
+  _Atomic uint64_t generation;
+};
+
+/*
+ * a ring of tasks. the owner pushes at the back & pops at the front, thieves
+ * take from the back, so they only contend with the owner over the last task.
+ */
+struct Deque {
+  pthread_mutex_t lock;
+
+  struct PoolTask **tasks;
+  size_t capacity;
+  size_t head;
+  size_t len;
+};
+
+#define DEQUE_INIT_CAPACITY 64
+
+struct Worker {
+  struct WorkPool *pool;
+  size_t index;
+  pthread_t thread;
+
+  struct Deque deque;
+
+  _Atomic uint64_t executed;
+  _Atomic uint64_t stolen;
+  _Atomic uint64_t failed_steals;
+
+  uint32_t rng; // for picking whom to steal from
+};
+
+struct WorkPool {
+  struct Worker *workers;
+  size_t num_workers;
+
+  // idle workers sleep on this until a task is queued anywhere
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_cond;
+  bool stopping;
+
+  _Atomic size_t queued;  // tasks in the deques
+  _Atomic size_t waiting; // tasks in sessions' queues
+  _Atomic size_t next_worker;
+};
+
+static void stop_workers(struct WorkPool *pool, size_t num_started);
+static void *worker_main(void *arg);
+static void run_task(struct Worker *w, struct PoolTask *task);
+static void release(struct WorkPool *pool, struct PoolTask *task,
+                    size_t worker);
+static struct PoolTask *steal(struct Worker *w);
+static bool deque_push(struct Deque *d, struct PoolTask *task);
+static struct PoolTask *deque_pop_back(struct Deque *d);
+static struct PoolTask *deque_pop_front(struct Deque *d);
+static size_t cancel_waiting(struct PoolSession *session);
+static void session_destroy(struct PoolSession *session);
+
+/**
+ * starts a pool of worker threads. returns NULL if memory allocation or
+ * starting the threads fails.
+ *
+ * @param num_workers the number of worker threads. if 0, one per CPU.
+ */
+struct WorkPool *pool_init(size_t num_workers) {
+  if (num_workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = cpus > 0 ? cpus : 1;
+  }
+
+  struct WorkPool *pool = calloc(1, sizeof(struct WorkPool));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  pool->workers = calloc(num_workers, sizeof(struct Worker));
+  if (pool->workers == NULL) {
+    free(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->idle_lock, NULL);
+  pthread_cond_init(&pool->idle_cond, NULL);
+
+  for (size_t i = 0; i < num_workers; ++i) {
+    struct Worker *w = &pool->workers[i];
+    w->pool = pool;
+    w->index = i;
+    w->rng = 2654435761u * (i + 1);
+
+    pthread_mutex_init(&w->deque.lock, NULL);
+    w->deque.tasks = malloc(DEQUE_INIT_CAPACITY * sizeof(struct PoolTask *));
+    w->deque.capacity = DEQUE_INIT_CAPACITY;
+    if (w->deque.tasks == NULL) {
+      pool->num_workers = i + 1;
+      stop_workers(pool, 0);
+      return NULL;
+    }
+  }
+
+  // set before any worker starts, since they read it to find one another
+  pool->num_workers = num_workers;
+
+  for (size_t i = 0; i < num_workers; ++i) {
+    if (pthread_create(&pool->workers[i].thread, NULL, worker_main,
+                       &pool->workers[i]) != 0) {
+      stop_workers(pool, i);
+      return NULL;
+    }
+  }
+
+  return pool;
+}
+
+/**
+ * stops the workers & frees the pool. every session MUST be freed first.
+ * tasks already handed to the workers are finished (or skipped, if they were
+ * cancelled) before it returns.
+ *
+ * @param pool the pool to free
+ */
+void pool_free(struct WorkPool *pool) {
+  assert(pool != NULL);
+
+  stop_workers(pool, pool->num_workers);
+}
+
+/**
+ * makes a session to submit tasks in. its tasks run one at a time, in the
+ * order they were submitted. returns NULL if memory allocation fails.
+ *
+ * @param pool the pool that runs the session's tasks
+ */
+struct PoolSession *pool_session_init(struct WorkPool *pool) {
+  assert(pool != NULL);
+
+  struct PoolSession *session = calloc(1, sizeof(struct PoolSession));
+  if (session == NULL) {
+    return NULL;
+  }
+
+  session->pool = pool;
+  pthread_mutex_init(&session->lock, NULL);
+
+  return session;
+}
+
+/**
+ * cancels every task of the session (see `pool_cancel`) & frees it. if one
+ * of its tasks is running, the session is freed once that finishes.
+ *
+ * @param session the session to free
+ */
+void pool_session_free(struct PoolSession *session) {
+  assert(session != NULL);
+
+  pool_cancel(session);
+
+  pthread_mutex_lock(&session->lock);
+  bool busy = session->busy;
+  session->freed = true;
+  pthread_mutex_unlock(&session->lock);
+
+  if (!busy) {
+    session_destroy(session);
+  }
+}
+
+/**
+ * submits a task, to run after the session's other tasks. it's thread-safe.
+ *
+ * @param session the session the task belongs to
+ * @param fn evaluates the task, on a worker thread
+ * @param done called once the task ran or was cancelled. can be NULL.
+ * @param arg passed to `fn` & `done` as is
+ *
+ * @return `false` if memory allocation fails, else `true`
+ */
+bool pool_submit(struct PoolSession *session, PoolTaskFn fn, PoolDoneFn done,
+                 void *arg) {
+  assert(session != NULL);
+  assert(fn != NULL);
+
+  struct PoolTask *task = malloc(sizeof(struct PoolTask));
+  if (task == NULL) {
+    return false;
+  }
+
+  *task = (struct PoolTask){
+      .session = session,
+      .fn = fn,
+      .done = done,
+      .arg = arg,
+      .generation = atomic_load(&session->generation),
+  };
+
+  struct WorkPool *pool = session->pool;
+
+  pthread_mutex_lock(&session->lock);
+
+  // it's the session's turn right away, so it goes to a worker's deque
+  if (!session->busy) {
+    session->busy = true;
+    pthread_mutex_unlock(&session->lock);
+
+    size_t worker = atomic_fetch_add(&pool->next_worker, 1);
+    release(pool, task, worker % pool->num_workers);
+    return true;
+  }
+
+  if (session->tail != NULL) {
+    session->tail->next = task;
+  } else {
+    session->head = task;
+  }
+  session->tail = task;
+  atomic_fetch_add(&pool->waiting, 1);
+
+  pthread_mutex_unlock(&session->lock);
+
+  return true;
+}
+
+/**
+ * cancels the session's tasks: those that haven't started are dropped (their
+ * `done` is called from here), & the one that's running, if any, sees
+ * `pool_task_cancelled` become true. tasks submitted later aren't affected.
+ *
+ * @param session the session whose tasks to cancel
+ *
+ * @return the number of tasks dropped before they started
+ */
+size_t pool_cancel(struct PoolSession *session) {
+  assert(session != NULL);
+
+  atomic_fetch_add(&session->generation, 1);
+
+  return cancel_waiting(session);
+}
+
+/**
+ * whether the task was cancelled, so a long task can stop early.
+ *
+ * @param task the task being run
+ */
+bool pool_task_cancelled(const struct PoolTask *task) {
+  assert(task != NULL);
+
+  return task->generation != atomic_load(&task->session->generation);
+}
+
+size_t pool_num_workers(struct WorkPool *pool) {
+  assert(pool != NULL);
+
+  return pool->num_workers;
+}
+
+/**
+ * reports how busy each worker is. the numbers are read without stopping the
+ * workers, so they're only a snapshot.
+ *
+ * @param pool the pool
+ * @param stats where to store the stats of each worker
+ * @param max how many workers' stats fit in `stats`
+ * @param waiting where to store the number of tasks waiting for their
+ * session's turn. can be NULL.
+ *
+ * @return the number of workers whose stats were stored
+ */
+size_t pool_stats(struct WorkPool *pool, struct PoolWorkerStats *stats,
+                  size_t max, size_t *waiting) {
+  assert(pool != NULL);
+  assert(stats != NULL || max == 0);
+
+  size_t n = max < pool->num_workers ? max : pool->num_workers;
+
+  for (size_t i = 0; i < n; ++i) {
+    struct Worker *w = &pool->workers[i];
+
+    pthread_mutex_lock(&w->deque.lock);
+    stats[i].queue_depth = w->deque.len;
+    pthread_mutex_unlock(&w->deque.lock);
+
+    stats[i].executed = atomic_load(&w->executed);
+    stats[i].stolen = atomic_load(&w->stolen);
+    stats[i].failed_steals = atomic_load(&w->failed_steals);
+  }
+
+  if (waiting != NULL) {
+    *waiting = atomic_load(&pool->waiting);
+  }
+
+  return n;
+}
+
+/*
+ * stops & joins the workers that started, then frees the pool.
+ */
+static void stop_workers(struct WorkPool *pool, size_t num_started) {
+  pthread_mutex_lock(&pool->idle_lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->idle_cond);
+  pthread_mutex_unlock(&pool->idle_lock);
+
+  for (size_t i = 0; i < num_started; ++i) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+
+  for (size_t i = 0; i < pool->num_workers; ++i) {
+    struct Worker *w = &pool->workers[i];
+    pthread_mutex_destroy(&w->deque.lock);
+    free(w->deque.tasks);
+  }
+
+  pthread_cond_destroy(&pool->idle_cond);
+  pthread_mutex_destroy(&pool->idle_lock);
+  free(pool->workers);
+  free(pool);
+}
+
+/*
+ * runs tasks from its own deque, or stolen ones, sleeping while there are
+ * none anywhere.
+ */
+static void *worker_main(void *arg) {
+  struct Worker *w = arg;
+  struct WorkPool *pool = w->pool;
+
+  while (true) {
+    struct PoolTask *task = deque_pop_front(&w->deque);
+    if (task == NULL) {
+      task = steal(w);
+    }
+
+    if (task != NULL) {
+      atomic_fetch_sub(&pool->queued, 1);
+      run_task(w, task);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->idle_lock);
+    while (atomic_load(&pool->queued) == 0 && !pool->stopping) {
+      pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+    }
+    bool stop = pool->stopping && atomic_load(&pool->queued) == 0;
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    if (stop) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * runs a task (unless it was cancelled), then hands the session's turn to
+ * its next task, on this worker.
+ */
+static void run_task(struct Worker *w, struct PoolTask *task) {
+  struct PoolSession *session = task->session;
+
+  bool ran = !pool_task_cancelled(task);
+  if (ran) {
+    task->fn(task, task->arg);
+    atomic_fetch_add(&w->executed, 1);
+  }
+
+  if (task->done != NULL) {
+    task->done(task->arg, ran);
+  }
+  free(task);
+
+  pthread_mutex_lock(&session->lock);
+
+  struct PoolTask *next = session->head;
+  if (next != NULL) {
+    session->head = next->next;
+    if (session->head == NULL) {
+      session->tail = NULL;
+    }
+    next->next = NULL;
+    atomic_fetch_sub(&w->pool->waiting, 1);
+  } else {
+    session->busy = false;
+  }
+
+  bool destroy = !session->busy && session->freed;
+
+  pthread_mutex_unlock(&session->lock);
+
+  if (next != NULL) {
+    release(w->pool, next, w->index);
+  } else if (destroy) {
+    session_destroy(session);
+  }
+}
+
+/*
+ * hands a task whose session's turn it is to a worker, waking one up if
+ * they're all asleep.
+ */
+static void release(struct WorkPool *pool, struct PoolTask *task,
+                    size_t worker) {
+  if (!deque_push(&pool->workers[worker].deque, task)) {
+    // the deque couldn't grow, so the task is dropped like a cancelled one.
+    // `run_task` still hands the turn to the session's next task.
+    task->generation = atomic_load(&task->session->generation) - 1;
+    run_task(&pool->workers[worker], task);
+    return;
+  }
+
+  // counted before the workers are woken up, so that a worker going to
+  // sleep either sees it or gets the signal
+  atomic_fetch_add(&pool->queued, 1);
+
+  pthread_mutex_lock(&pool->idle_lock);
+  pthread_cond_signal(&pool->idle_cond);
+  pthread_mutex_unlock(&pool->idle_lock);
+}
+
+/*
+ * takes the newest task of another worker, trying each of them once,
+ * starting from a random one.
+ */
+static struct PoolTask *steal(struct Worker *w) {
+  struct WorkPool *pool = w->pool;
+  if (pool->num_workers < 2 || atomic_load(&pool->queued) == 0) {
+    return NULL;
+  }
+
+  // xorshift32
+  w->rng ^= w->rng << 13;
+  w->rng ^= w->rng >> 17;
+  w->rng ^= w->rng << 5;
+
+  size_t start = w->rng % pool->num_workers;
+  for (size_t i = 0; i < pool->num_workers; ++i) {
+    size_t victim = (start + i) % pool->num_workers;
+    if (victim == w->index) {
+      continue;
+    }
+
+    struct PoolTask *task = deque_pop_back(&pool->workers[victim].deque);
+    if (task != NULL) {
+      atomic_fetch_add(&w->stolen, 1);
+      return task;
+    }
+  }
+
+  atomic_fetch_add(&w->failed_steals, 1);
+  return NULL;
+}
+
+static bool deque_push(struct Deque *d, struct PoolTask *task) {
+  pthread_mutex_lock(&d->lock);
+
+  if (d->len == d->capacity) {
+    size_t capacity = d->capacity * 2;
+    struct PoolTask **tasks = malloc(capacity * sizeof(struct PoolTask *));
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&d->lock);
+      return false;
+    }
+
+    // unwrap the ring into the new array
+    for (size_t i = 0; i < d->len; ++i) {
+      tasks[i] = d->tasks[(d->head + i) % d->capacity];
+    }
+
+    free(d->tasks);
+    d->tasks = tasks;
+    d->capacity = capacity;
+    d->head = 0;
+  }
+
+  d->tasks[(d->head + d->len) % d->capacity] = task;
+  ++d->len;
+
+  pthread_mutex_unlock(&d->lock);
+
+  return true;
+}
+
+static struct PoolTask *deque_pop_back(struct Deque *d) {
+  pthread_mutex_lock(&d->lock);
+
+  struct PoolTask *task = NULL;
+  if (d->len > 0) {
+    --d->len;
+    task = d->tasks[(d->head + d->len) % d->capacity];
+  }
+
+  pthread_mutex_unlock(&d->lock);
+
+  return task;
+}
+
+static struct PoolTask *deque_pop_front(struct Deque *d) {
+  pthread_mutex_lock(&d->lock);
+
+  struct PoolTask *task = NULL;
+  if (d->len > 0) {
+    task = d->tasks[d->head];
+    d->head = (d->head + 1) % d->capacity;
+    --d->len;
+  }
+
+  pthread_mutex_unlock(&d->lock);
+
+  return task;
+}
+
+/*
+ * drops the tasks waiting for the session's turn, calling their `done`.
+ */
+static size_t cancel_waiting(struct PoolSession *session) {
+  pthread_mutex_lock(&session->lock);
+
+  struct PoolTask *task = session->head;
+  session->head = NULL;
+  session->tail = NULL;
+
+  pthread_mutex_unlock(&session->lock);
+
+  size_t count = 0;
+  while (task != NULL) {
+    struct PoolTask *next = task->next;
+
+    if (task->done != NULL) {
+      task->done(task->arg, false);
+    }
+    free(task);
+
+    ++count;
+    task = next;
+  }
+
+  atomic_fetch_sub(&session->pool->waiting, count);
+
+  return count;
+}
+
+static void session_destroy(struct PoolSession *session) {
+  pthread_mutex_destroy(&session->lock);
+  free(session);
+}
@@ -0,0 +1,58 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct WorkPool;
+struct PoolSession;
+struct PoolTask;
+
+/*
+ * evaluates something on a worker thread. a long task should check
+ * `pool_task_cancelled` now & then, & return early once it's true.
+ */
+typedef void (*PoolTaskFn)(struct PoolTask *task, void *arg);
+
+/*
+ * called exactly once for every task that was submitted: on the worker that
+ * ran it, or, if it was cancelled before it started, on the thread that
+ * cancelled it. `ran` says which.
+ */
+typedef void (*PoolDoneFn)(void *arg, bool ran);
+
+/*
+ * what `pool_stats` reports for each worker.
+ */
+struct PoolWorkerStats {
+  size_t queue_depth; // tasks in its deque right now
+  uint64_t executed;  // tasks it ran
+  uint64_t stolen;    // tasks it took from other workers' deques
+  uint64_t failed_steals;
+};
+
+struct WorkPool *pool_init(size_t num_workers);
+void pool_free(struct WorkPool *pool);
+
+struct PoolSession *pool_session_init(struct WorkPool *pool);
+void pool_session_free(struct PoolSession *session);
+
+bool pool_submit(struct PoolSession *session, PoolTaskFn fn, PoolDoneFn done,
+                 void *arg);
+size_t pool_cancel(struct PoolSession *session);
+bool pool_task_cancelled(const struct PoolTask *task);
+
+size_t pool_num_workers(struct WorkPool *pool);
+size_t pool_stats(struct WorkPool *pool, struct PoolWorkerStats *stats,
+                  size_t max, size_t *waiting);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
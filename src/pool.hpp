@@ -0,0 +1,187 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "executor.hpp"
+#include "pool.h"
+
+/*
+ * Evaluates lines on a work-stealing thread pool (see src/pool.c) from
+ * coroutines on an `rl::Executor`, so an expensive line doesn't hold up every
+ * other session on the executor's thread:
+ *
+ *   rl::Task serve(rl::Executor &executor, rl::EvalPool &pool, int fd) {
+ *     rl::AsyncSession session(executor, fd, fd);
+ *     rl::EvalQueue queue(executor, pool);
+ *
+ *     while (auto result = co_await session.read_line("> ")) {
+ *       std::string output;
+ *       co_await queue.eval([&](rl::CancelToken) {
+ *         output = eval(result.line);
+ *       });
+ *       write(fd, output.data(), output.size());
+ *     }
+ *   }
+ *
+ * the pool is shared by all sessions (& executors): each session's lines are
+ * evaluated one at a time, in order, taking turns with the other sessions.
+ */
+
+namespace rl {
+
+// lets an evaluation check whether it was cancelled, to stop early
+class CancelToken {
+public:
+  explicit CancelToken(const PoolTask *task) : task_(task) {}
+
+  bool cancelled() const { return pool_task_cancelled(task_); }
+
+private:
+  const PoolTask *task_;
+};
+
+/*
+ * a pool of worker threads, stopped & joined when it goes out of scope. every
+ * queue MUST be destroyed first.
+ */
+class EvalPool {
+public:
+  /**
+   * @param num_workers the number of worker threads. if 0, one per CPU.
+   *
+   * @throws std::bad_alloc if the pool can't be started
+   */
+  explicit EvalPool(std::size_t num_workers = 0)
+      : pool_(pool_init(num_workers)) {
+    if (pool_ == nullptr) {
+      throw std::bad_alloc();
+    }
+  }
+
+  ~EvalPool() { pool_free(pool_); }
+
+  EvalPool(const EvalPool &) = delete;
+  EvalPool &operator=(const EvalPool &) = delete;
+
+  struct Stats {
+    std::vector<PoolWorkerStats> workers;
+
+    // tasks waiting for their session's turn
+    std::size_t waiting;
+  };
+
+  Stats stats() const {
+    Stats stats;
+    stats.workers.resize(pool_num_workers(pool_));
+    pool_stats(pool_, stats.workers.data(), stats.workers.size(),
+               &stats.waiting);
+    return stats;
+  }
+
+  std::size_t num_workers() const { return pool_num_workers(pool_); }
+
+  WorkPool *get() { return pool_; }
+
+private:
+  WorkPool *pool_;
+};
+
+/*
+ * a session's evaluations. they run one at a time, in the order they were
+ * awaited.
+ */
+class EvalQueue {
+public:
+  /**
+   * @throws std::bad_alloc if the session can't be allocated
+   */
+  EvalQueue(Executor &executor, EvalPool &pool)
+      : executor_(executor), session_(pool_session_init(pool.get())) {
+    if (session_ == nullptr) {
+      throw std::bad_alloc();
+    }
+  }
+
+  // a coroutine can't be waiting on it by then, since it'd have to be
+  // suspended in its frame
+  ~EvalQueue() { pool_session_free(session_); }
+
+  EvalQueue(const EvalQueue &) = delete;
+  EvalQueue &operator=(const EvalQueue &) = delete;
+
+  /**
+   * for `co_await queue.eval(fn)`: runs `fn(rl::CancelToken)` on a worker
+   * thread, & resumes the coroutine on the executor's thread once it's done.
+   * whatever `fn` throws is rethrown from the `co_await`.
+   *
+   * @return an awaitable that results in `false` if the evaluation was
+   * cancelled before it started, else `true`
+   *
+   * @throws std::bad_alloc if the task can't be submitted
+   */
+  template <typename Fn> auto eval(Fn fn) {
+    struct Awaiter {
+      EvalQueue &queue;
+      Fn fn;
+
+      std::coroutine_handle<> waiting;
+      bool ran = false;
+      std::exception_ptr error;
+
+      bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+        waiting = handle;
+        if (!pool_submit(queue.session_, &run, &done, this)) {
+          throw std::bad_alloc();
+        }
+        queue.executor_.expect_post();
+      }
+
+      bool await_resume() {
+        if (error) {
+          std::rethrow_exception(error);
+        }
+        return ran;
+      }
+
+      static void run(PoolTask *task, void *arg) {
+        auto *self = static_cast<Awaiter *>(arg);
+        try {
+          self->fn(CancelToken(task));
+        } catch (...) {
+          self->error = std::current_exception();
+        }
+      }
+
+      static void done(void *arg, bool ran) {
+        auto *self = static_cast<Awaiter *>(arg);
+        self->ran = ran;
+        self->queue.executor_.post(self->waiting);
+      }
+    };
+
+    return Awaiter{*this, std::move(fn)};
+  }
+
+  /**
+   * cancels the evaluations that are waiting, & flags the running one.
+   *
+   * @return the number of evaluations dropped before they started
+   */
+  std::size_t cancel() { return pool_cancel(session_); }
+
+private:
+  Executor &executor_;
+  PoolSession *session_;
+};
+
+} // namespace rl
+
+#endif
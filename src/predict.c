@@ -0,0 +1,361 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h> // for memcmp(), memcpy(), memmove(), memset()
+
+#include "./predict.h"
+#include "abuf.h"
+#include "keymap.h" // for CTRL_KEY(), KEY_ESC
+#include "vector.h"
+
+/*
+ * Guesses what the keys typed into a remote session do to its line before
+ * the server has even seen them, the way mosh does, so that a client can echo
+ * them right away instead of a round trip later.
+ *
+ * Only the keys whose effect is obvious are guessed: printable keys insert
+ * themselves at the cursor, & the arrow keys (or Ctrl+B & Ctrl+F) move it.
+ * Any other key could do anything, so nothing after it is guessed until the
+ * server has handled it.
+ *
+ * The server's line says how many bytes of the keys it has handled (see
+ * src/remote.h), which settles the guesses for those keys: the line the
+ * guesses led to is compared with the server's, & the guesses are dropped,
+ * since the server's line shows their effect now. If the line didn't come
+ * out as guessed (say the editor is in vi mode, where keys are commands),
+ * the guesses after them are rolled back as well, & nothing is guessed until
+ * the server has caught up with every key sent so far.
+ */
+
+enum GuessKind {
+  GUESS_INSERT,
+  GUESS_LEFT,
+  GUESS_RIGHT,
+  GUESS_NONE, // a key that could do anything
+};
+
+struct Guess {
+  uint64_t end; // how many bytes were sent up to the end of the key
+  enum GuessKind kind;
+  char c; // the character inserted, for GUESS_INSERT
+};
+
+// where the key being sent is in an escape sequence
+enum SeqState {
+  SEQ_NONE,
+  SEQ_ESC,  // after ESC
+  SEQ_CSI,  // after ESC [ (or ESC O)
+  SEQ_ARGS, // after a parameter of one, like the 1 in ESC [ 1 ; 5 C
+};
+
+struct Predictor {
+  // the line as the server last had it, & how many bytes of the keys it had
+  // handled by then
+  struct AppendBuffer confirmed;
+  size_t confirmed_pos;
+  uint64_t handled;
+
+  // how many bytes of keys were sent so far, & the guesses for the keys the
+  // server hasn't handled yet, oldest first (each is a `struct Guess`)
+  uint64_t sent;
+  struct Vector *guesses;
+  enum SeqState seq;
+
+  // after a misprediction, nothing is guessed until the server has handled
+  // this many bytes
+  uint64_t suspended_until;
+
+  // the line the guesses lead to, with a mark for every guessed character
+  struct AppendBuffer text;
+  struct AppendBuffer marks;
+  size_t pos;
+
+  struct PredictorStats stats;
+};
+
+static bool add_guess(struct Predictor *p, enum GuessKind kind, char c);
+static bool guess_line(struct Predictor *p, size_t count, size_t *applied);
+static bool insert_char(struct AppendBuffer *ab, size_t pos, char c);
+
+/**
+ * makes a predictor for a session's line, before anything was sent.
+ *
+ * @return the predictor, or NULL if memory allocation fails
+ */
+struct Predictor *predictor_init(void) {
+  struct Predictor *p = calloc(1, sizeof(struct Predictor));
+  if (p == NULL) {
+    return NULL;
+  }
+
+  p->guesses = vector_init(sizeof(struct Guess), 0);
+  if (p->guesses == NULL) {
+    free(p);
+    return NULL;
+  }
+
+  p->confirmed = (struct AppendBuffer)ABUF_INIT;
+  p->text = (struct AppendBuffer)ABUF_INIT;
+  p->marks = (struct AppendBuffer)ABUF_INIT;
+
+  return p;
+}
+
+void predictor_free(struct Predictor *p) {
+  if (p == NULL) {
+    return;
+  }
+
+  vector_free(p->guesses);
+  abuf_free(&p->confirmed);
+  abuf_free(&p->text);
+  abuf_free(&p->marks);
+  free(p);
+}
+
+/**
+ * guesses what keys do, as they're sent to the server. they MUST be passed
+ * in the order they're sent, & exactly as they're sent, since the server
+ * counts their bytes.
+ *
+ * @param p the predictor
+ * @param keys the keys, as read from the terminal
+ * @param len the length of `keys`
+ *
+ * @return `true` if the guesses were made, `false` if memory allocation fails
+ */
+bool predictor_send(struct Predictor *p, const char *keys, size_t len) {
+  assert(p != NULL);
+
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char c = keys[i];
+    ++p->sent;
+
+    switch (p->seq) {
+    case SEQ_NONE:
+      if (c == KEY_ESC) {
+        p->seq = SEQ_ESC;
+        continue;
+      }
+
+      enum GuessKind kind = c >= ' ' && c <= '~'   ? GUESS_INSERT
+                            : c == CTRL_KEY('b') ? GUESS_LEFT
+                            : c == CTRL_KEY('f') ? GUESS_RIGHT
+                                                 : GUESS_NONE;
+      if (!add_guess(p, kind, c)) {
+        return false;
+      }
+      continue;
+
+    case SEQ_ESC:
+      if (c == '[' || c == 'O') {
+        p->seq = SEQ_CSI;
+        continue;
+      }
+
+      // Alt+<key>
+      p->seq = SEQ_NONE;
+      if (!add_guess(p, GUESS_NONE, 0)) {
+        return false;
+      }
+      continue;
+
+    case SEQ_CSI:
+    case SEQ_ARGS:
+      // parameters & intermediate bytes, up to the final byte
+      if (c < '@' || c > '~') {
+        p->seq = SEQ_ARGS;
+        continue;
+      }
+
+      // only the plain arrow keys, not Ctrl+<arrow> & the like
+      enum GuessKind arrow = p->seq == SEQ_ARGS ? GUESS_NONE
+                             : c == 'D'         ? GUESS_LEFT
+                             : c == 'C'         ? GUESS_RIGHT
+                                                : GUESS_NONE;
+      p->seq = SEQ_NONE;
+      if (!add_guess(p, arrow, 0)) {
+        return false;
+      }
+      continue;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * settles the guesses for the keys the server's line reflects, & makes it the
+ * line further guesses start from (or an empty one, if it's done).
+ *
+ * @param p the predictor
+ * @param line the line, as the server sent it
+ *
+ * @return `true` if it was taken in, `false` if memory allocation fails
+ */
+bool predictor_confirm(struct Predictor *p, const struct RemoteLine *line) {
+  assert(p != NULL);
+  assert(line != NULL);
+
+  size_t num_guesses = vector_length(p->guesses);
+  size_t settled = 0;
+  while (settled < num_guesses &&
+         ((struct Guess *)vector_get(p->guesses, settled))->end <=
+             line->handled) {
+    ++settled;
+  }
+
+  // check the line the guesses led to against the server's, unless they
+  // weren't all guesses (then they weren't shown either)
+  size_t applied = 0;
+  if (settled > 0 && p->suspended_until <= p->handled) {
+    if (!guess_line(p, settled, &applied)) {
+      return false;
+    }
+
+    if (applied == settled) {
+      if (p->pos == line->pos && p->text.len == line->len &&
+          memcmp(p->text.data, line->text, line->len) == 0) {
+        p->stats.confirmed += settled;
+      } else {
+        ++p->stats.mispredicted;
+        p->suspended_until = p->sent;
+      }
+    }
+  }
+
+  vector_remove(p->guesses, 0, settled);
+
+  // once a line is done, the keys after it go to the next one, which starts
+  // out empty
+  abuf_clear(&p->confirmed);
+  if (!line->done && !abuf_append(&p->confirmed, line->text, line->len)) {
+    return false;
+  }
+  p->confirmed_pos = line->done ? 0 : line->pos;
+  p->handled = line->handled;
+
+  return true;
+}
+
+/**
+ * gets the line the server's last line & the guesses since then lead to.
+ *
+ * @param p the predictor
+ * @param line where to store the line. it points into the predictor, & is
+ * valid until its next call.
+ *
+ * @return `true` if the line was made, `false` if memory allocation fails
+ */
+bool predictor_line(struct Predictor *p, struct PredictedLine *line) {
+  assert(p != NULL);
+  assert(line != NULL);
+
+  size_t count =
+      p->suspended_until <= p->handled ? vector_length(p->guesses) : 0;
+
+  size_t applied;
+  if (!guess_line(p, count, &applied)) {
+    return false;
+  }
+
+  *line = (struct PredictedLine){
+      .text = p->text.data,
+      .tentative = p->marks.data,
+      .len = p->text.len,
+      .pos = p->pos,
+  };
+
+  return true;
+}
+
+void predictor_stats(const struct Predictor *p, struct PredictorStats *stats) {
+  assert(p != NULL);
+  assert(stats != NULL);
+
+  *stats = p->stats;
+}
+
+static bool add_guess(struct Predictor *p, enum GuessKind kind, char c) {
+  struct Guess guess = {.end = p->sent, .kind = kind, .c = c};
+  if (!vector_push(p->guesses, &guess)) {
+    return false;
+  }
+
+  if (kind != GUESS_NONE) {
+    ++p->stats.guessed;
+  }
+
+  return true;
+}
+
+/**
+ * makes `text`, `marks` & `pos` the line that the first `count` guesses lead
+ * to from the confirmed line, stopping at a key that wasn't guessed.
+ *
+ * @param applied set to the number of guesses that were applied
+ *
+ * @return `true` if the line was made, `false` if memory allocation fails
+ */
+static bool guess_line(struct Predictor *p, size_t count, size_t *applied) {
+  abuf_clear(&p->text);
+  abuf_clear(&p->marks);
+  p->pos = p->confirmed_pos;
+
+  // the marks are kept as long as the line, even if there's nothing guessed,
+  // so they can be indexed like it
+  size_t len = p->confirmed.len;
+  if (!abuf_reserve(&p->text, len + 1) || !abuf_reserve(&p->marks, len + 1)) {
+    return false;
+  }
+  if (len > 0) {
+    memcpy(p->text.data, p->confirmed.data, len);
+  }
+  memset(p->marks.data, 0, len);
+  p->text.len = len;
+  p->marks.len = len;
+
+  *applied = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const struct Guess *guess = vector_get(p->guesses, i);
+
+    switch (guess->kind) {
+    case GUESS_INSERT:
+      if (!insert_char(&p->text, p->pos, guess->c) ||
+          !insert_char(&p->marks, p->pos, 1)) {
+        return false;
+      }
+      ++p->pos;
+      break;
+
+    case GUESS_LEFT:
+      p->pos -= p->pos > 0 ? 1 : 0;
+      break;
+
+    case GUESS_RIGHT:
+      p->pos += p->pos < p->text.len ? 1 : 0;
+      break;
+
+    case GUESS_NONE:
+      return true;
+    }
+
+    ++*applied;
+  }
+
+  return true;
+}
+
+static bool insert_char(struct AppendBuffer *ab, size_t pos, char c) {
+  if (!abuf_reserve(ab, 1)) {
+    return false;
+  }
+
+  memmove(&ab->data[pos + 1], &ab->data[pos], ab->len - pos);
+  ab->data[pos] = c;
+  ++ab->len;
+
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef PREDICT_H
+#define PREDICT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "remote.h"
+
+struct Predictor;
+
+/*
+ * the line as it's predicted to be. `tentative[i]` is nonzero if the
+ * character at `i` is only a guess, that the server hasn't confirmed yet.
+ */
+struct PredictedLine {
+  const char *text;
+  const char *tentative;
+  size_t len;
+  size_t pos;
+};
+
+/*
+ * what `predictor_stats` reports.
+ */
+struct PredictorStats {
+  size_t guessed;      // keys whose effect was guessed
+  size_t confirmed;    // guesses the server's line turned out to agree with
+  size_t mispredicted; // times it didn't, & the guesses were rolled back
+};
+
+struct Predictor *predictor_init(void);
+void predictor_free(struct Predictor *p);
+
+bool predictor_send(struct Predictor *p, const char *keys, size_t len);
+bool predictor_confirm(struct Predictor *p, const struct RemoteLine *line);
+bool predictor_line(struct Predictor *p, struct PredictedLine *line);
+void predictor_stats(const struct Predictor *p, struct PredictorStats *stats);
+
+#endif
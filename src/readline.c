@@ -1,491 +1,1757 @@
 #include <assert.h>  // for assert()
-#include <ctype.h>   // for isprint()
+#include <ctype.h>   // for isprint(), isdigit()
 #include <errno.h>   // for errno
+#include <poll.h>    // for poll()
 #include <stdbool.h> // for bool, duh
+#include <stdint.h>  // for uint16_t, SIZE_MAX
 #include <stdio.h>   // for fputs(), putchar(), perror()
 #include <stdlib.h>  // for exit(), EXIT_FAILURE
 #include <string.h>  // for strlen(), memmove()
 #include <termios.h> // for struct termios, tcgetattr(), tcsetattr()
 #include <unistd.h>  // for STDIN_FILENO, STDOUT_FILENO, read(), write()
 
+#include "abuf.h"     // for struct AppendBuffer & related functions
+#include "alloc.h"    // for struct Allocator & related functions
+#include "base64.h"   // for base64_encode_append()
+#include "config.h"   // for struct Config & related functions
+#include "keymap.h"   // for struct Keymap, CTRL_KEY(), ALT_KEY(), etc.
+#include "killring.h" // for struct KillRing & related functions
 #include "readline.h" // for enum ReadLineResult
+#include "segment.h"  // for struct SegmentSet & related functions
 #include "vector.h"   // for struct Vector & related functions
-
-/*
- * This macro is used to check if the key pressed is Ctrl+<alphabet>
- *
- * Ctrl key combined with the alphabetic keys maps to 1–26.
- *
- * ASCII of 'b' is 98, which is 01100010 in binary.
- * 0x1f is 00011111 in binary.
- * 00011111 & 01100010 = 00000010 = 2, which is Ctrl+b.
- *
- * ASCII of 'B' is 66, which is 01000010 in binary.
- * 00011111 & 01000010 = 00000010 = 2,  which is Ctrl+B.
- *
- * So it works regardless of the case.
- *
- * This mirrors what the Ctrl key does in the terminal: it strips bits 5 and 6
- * from whatever key you press in combination with Ctrl, and sends that.
- * (By convention, bit numbering starts from 0.) The ASCII character set seems
- * to be designed this way on purpose. (It is also similarly designed so that
- * you can set and clear bit 5 to switch between lowercase and uppercase.)
- */
-#define CTRL_KEY(k) (k & 0x1f)
-
-enum TermKey {
-  KEY_ENTER = 13, // '\r',
-  KEY_ESC = 27,   // '\x1b',
-  KEY_BACKSPACE = 127,
-  KEY_ARROW_UP = 1000,
-  KEY_ARROW_DOWN,
-  KEY_ARROW_RIGHT,
-  KEY_ARROW_LEFT,
-  KEY_DELETE,
-  KEY_HOME,
-  KEY_END,
-  KEY_PAGE_UP,
-  KEY_PAGE_DOWN,
-};
-
-static void enable_raw_mode(void);
+#include "word.h"     // for word_forward(), word_backward(), etc.
+
+// the largest count that can be given with Alt+<digits>
+#define MAX_NUMERIC_ARG 1000000
+
+static enum ReadLineResult read_line(struct RLSession *s, const char *prompt,
+                                     size_t buf_size);
+static void begin_line(struct RLSession *s, const char *prompt,
+                       size_t buf_size);
+static enum KeyAction edit_line(struct RLSession *s);
+static enum ReadLineResult end_line(struct RLSession *s, enum KeyAction action);
+static enum ReadLineResult continue_line(struct RLSession *s,
+                                         const char **line, size_t *len);
+static enum ReadLineResult read_lines(struct RLSession *s, const char *prompt,
+                                      size_t buf_size);
+static size_t take_pasted_lines(struct RLSession *s, size_t buf_size);
+static bool add_pasted_lines(struct RLSession *s, size_t count);
+
+static void enable_raw_mode(struct RLSession *s);
 static void disable_raw_mode(void);
 
-static bool add_to_history(const char *line, size_t line_len);
-static int read_key(void);
+static bool add_to_history(struct RLSession *s);
+static int read_key(struct RLSession *s);
+static bool read_byte(struct RLSession *s, char *c);
+static bool read_more_input(struct RLSession *s);
+static bool fill_input(struct RLSession *s);
+static bool fill_input_now(struct RLSession *s);
+static int incomplete_key(struct RLSession *s);
+static bool flush_output(struct RLSession *s);
+
+static bool request_cursor_position(struct RLSession *s);
+static bool read_cursor_position(struct RLSession *s, unsigned short *row,
+                                 unsigned short *col);
+static size_t cursor_report_len(const char *data, size_t len);
+static void finish_startup(void);
+static bool move_cursor_left(struct RLSession *s);
+static bool move_cursor_right(struct RLSession *s);
+static bool move_cursor_to(struct RLSession *s, unsigned short row,
+                           unsigned short col);
 
-static bool get_cursor_position(unsigned short *row, unsigned short *col);
-static bool move_cursor_left(void);
-static bool move_cursor_right(void);
-static bool move_cursor_to(unsigned short row, unsigned short col);
+/*
+ * commands that behave differently depending on the command before them.
+ */
+enum LastCommand {
+  LAST_OTHER,
+  LAST_KILL, // consecutive kills are merged into one kill ring entry
+  LAST_YANK, // Alt+Y only works right after Ctrl+Y or Alt+Y
+};
 
-static bool repaint_line(unsigned short orig_cy, unsigned short orig_cx,
-                         const char *line, size_t len);
+/*
+ * what `rl_read_line` should do after a key is processed.
+ */
+enum KeyAction {
+  ACTION_CONTINUE, // keep reading keys
+  ACTION_ACCEPT,   // the line is complete
+  ACTION_EOF,      // Ctrl+D on an empty line
+  ACTION_SIGINT,   // Ctrl+C
+  ACTION_PENDING,  // the input ran dry before the line was complete
+  ACTION_REJECT,   // the line didn't fit in the session's memory budget
+};
 
-static void die(const char *msg);
+/*
+ * state of the line that's being edited by `rl_read_line`.
+ */
+struct LineState {
+  struct RLSession *s; // the session the line is edited in
 
-// original settings of the terminal
-static struct termios original_state;
+  char *buf;       // the line being edited (lives in the history)
+  size_t buf_size; // size of `buf`, including the null terminator
+  size_t len;      // number of characters in the line
+  size_t pos;      // offset of the cursor in the line
 
-// whether raw mode is enabled or not
-static bool raw_mode_enabled = false;
+  // where the line starts on the screen
+  unsigned short cy;
+  unsigned short cx;
 
-// to store the history of inputs (each element is a `char *`)
-static struct Vector *history = NULL;
-static size_t history_index = 0;
+  // the prompt as it was given, & the column it starts at, so it can be
+  // redrawn when one of its segments changes
+  const char *prompt;
+  unsigned short prompt_col;
 
-enum ReadLineResult rl_read_line(char *buf, size_t buf_size, char *prompt) {
-  assert(buf != NULL);
-  assert(buf_size > 0);
+  enum LastCommand last_cmd;
 
-  // print the prompt if provided
-  if (prompt != NULL) {
-    size_t prompt_len = strlen(prompt);
-    if (write(STDOUT_FILENO, prompt, prompt_len) != prompt_len) {
-      die("failed to write to terminal (prompt)");
-    }
-  }
+  // where the last yanked text is in the line, so that Alt+Y can replace it
+  size_t yank_start;
+  size_t yank_end;
 
-  // add the current buffer as a node in the history
-  if (!add_to_history(buf, buf_size)) {
-    die("failed to add line to history");
-  }
+  size_t arg; // count given with Alt+<digits>, 0 if none
 
-  size_t history_len = vector_length(history);
+  // where we are in a multi-key binding (see `keymap_lookup`) & how many keys
+  // of it were pressed so far
+  uint16_t keymap_node;
+  size_t seq_len;
 
-  // set the history index to the latest element
-  history_index = history_len - 1;
+  // while a macro is replayed nothing is drawn, the line is repainted once at
+  // the end
+  bool suppress_render;
 
-  // get the current buffer from the history
-  char *current_buf = *((char **)vector_get(history, history_index));
+  // set once the line outgrew the session's memory budget. it's emptied, & the
+  // rest of it is skipped (see `reject_line`).
+  bool rejected;
+};
 
-  // clear the buffer
-  current_buf[0] = '\0';
+/*
+ * what a command gets to know about the key press that triggered it.
+ */
+struct KeyEvent {
+  int key;                   // the last key of the binding
+  size_t seq_len;            // number of keys in the binding
+  size_t arg;                // count given with Alt+<digits>, 0 if none
+  enum LastCommand prev_cmd; // what the previous command was
+};
 
-  // enable raw mode for the terminal
-  enable_raw_mode();
+static bool init_keymaps(void);
+static struct RLSession *session_init(int in_fd, int out_fd, bool headless,
+                                      const struct Allocator *allocator);
+static void session_free(struct RLSession *s);
+static struct RLSession *get_default_session(void);
+static void *default_alloc(void *ctx, void *ptr, size_t old_size,
+                           size_t new_size);
+static void *count_alloc(void *ctx, void *ptr, size_t old_size,
+                         size_t new_size);
+static enum KeyAction process_key(struct LineState *l, int key);
+static enum KeyAction dispatch_key(struct LineState *l, int key);
+static enum KeyAction replay_macro(struct LineState *l, size_t count);
+
+static bool reserve_line(struct LineState *l, size_t extra);
+static bool fit_in_budget(struct LineState *l, size_t extra);
+static enum KeyAction reject_line(struct LineState *l, enum KeyAction action);
+static void trim_to_budget(struct RLSession *s);
+static void evict_history(struct RLSession *s, size_t bytes, size_t end);
+static void leave_history_entry(struct LineState *l);
+
+static bool refresh_line(struct LineState *l);
+static bool refresh_tail(struct LineState *l, size_t from);
+static bool redraw_prompt(struct LineState *l);
+static size_t display_width(const char *s, size_t len);
+static void delete_range(struct LineState *l, size_t from, size_t to);
+static void insert_text(struct LineState *l, const char *text, size_t len);
+static void kill_range(struct LineState *l, size_t from, size_t to,
+                       enum LastCommand prev_cmd);
+static void yank(struct LineState *l, const char *text, size_t len);
 
-  // get current cursor position
-  unsigned short cx, cy;
-  if (!get_cursor_position(&cy, &cx)) {
-    die("failed to get cursor position");
-  }
+static void die(const char *msg);
 
-  int cursor_pos = 0; // the x offset of the cursor from the original position
+// original settings of the terminal that's in raw mode
+static struct termios original_state;
+static int raw_fd = -1;
 
-  // handle each key press
-  size_t num_chars = 0;
-  while (num_chars < buf_size - 1) {
-    int key = read_key();
+// whether raw mode is enabled or not
+static bool raw_mode_enabled = false;
 
-    // handle printable characters, i.e., the actual characters that user types
-    if (isprint(key)) {
-      // write the typed character to the terminal (won't happen automatically
-      // in raw mode)
-      if (write(STDOUT_FILENO, &key, 1) != 1) {
-        die("failed to write to terminal (key press)");
-      }
+/*
+ * a line in the history. only the line being edited has room to grow (see
+ * `reserve_line`), the rest take up just what they need.
+ */
+struct HistoryEntry {
+  char *line; // null-terminated
+  size_t len;
+  size_t capacity;
+};
 
-      // move characters after the cursor to the right by one if required
-      if (cursor_pos < num_chars) {
-        memmove(&current_buf[cursor_pos + 1], &current_buf[cursor_pos],
-                num_chars - cursor_pos + 1);
+// keys are read in chunks of this size, so that a paste doesn't take a read()
+// per byte
+#define INPUT_CHUNK_SIZE 4096
 
-        // repaint the line after the cursor
-        size_t len = num_chars - cursor_pos;
-        if (write(STDOUT_FILENO, &current_buf[cursor_pos + 1], len) != len) {
-          die("failed to write to terminal (key press, repaint)");
-        }
+// how long the terminal gets to answer where the cursor is, like a read
+// waits in raw mode, & what `cursor_report_len` says about input that isn't
+// the answer
+#define CURSOR_REPORT_TIMEOUT_MS 100
+#define NOT_A_CURSOR_REPORT SIZE_MAX
 
-        // move the cursor back to the original position plus one because
-        // cursor will be moved because of the write() above
-        if (!move_cursor_to(cy, cx + cursor_pos + 1)) {
-          die("failed to move cursor (key press)");
-        }
-      }
+// the smallest room a line that's being typed into gets
+#define LINE_MIN_CAPACITY 64
 
-      // insert the character at the cursor position
-      current_buf[cursor_pos] = key;
+/*
+ * everything that belongs to one editor. each has its own terminal, history,
+ * kill ring, macro & editing mode, and allocates all of its memory with its
+ * own allocator. the keymaps, the prompt segments & the clipboard setting are
+ * shared by all of them.
+ */
+struct RLSession {
+  // what the session's memory is allocated with: `count_alloc`, which hands
+  // it to `backing` (the session's own allocator), counting it in
+  // `memory_used` on the way
+  struct Allocator allocator;
+  struct Allocator backing;
+  size_t memory_used;
+
+  // how much memory the session may take, 0 if there's no limit (see
+  // `rl_session_set_memory_budget`), & what staying within it took
+  size_t memory_budget;
+  size_t history_evicted;
+  size_t lines_rejected;
+
+  // where keys are read from & the line is drawn to, & whether that's a
+  // terminal at all (see `rl_set_headless`)
+  int in_fd;
+  int out_fd;
+  bool headless;
+
+  // the last chunk of input read (INPUT_CHUNK_SIZE bytes, allocated on the
+  // first read)
+  char *input;
+  size_t input_len;
+  size_t input_pos;
+  size_t key_start; // where the key `read_key` is reading starts in `input`
+  uint64_t input_read; // bytes read from `in_fd` so far, all chunks together
+
+  // when set, keys are only read if they're there already, & `read_key`
+  // returns KEY_INPUT_PENDING instead of waiting (see
+  // `rl_session_try_read_line`). `input_ended` is set once `in_fd` is at EOF.
+  // `key_expired` is set while a key that was cut off is taken as it is (see
+  // `rl_session_expire_key`).
+  bool nonblocking;
+  bool input_ended;
+  bool key_expired;
+
+  // the line being read, between `begin_line` & `end_line`. it lives here so
+  // that reading it can stop when the input runs dry & pick up again later.
+  struct LineState line;
+  bool reading;
+
+  // a burst of printable keys, inserted all at once (see `cmd_self_insert`)
+  struct AppendBuffer burst;
+
+  // the lines of a paste that are read all at once by `rl_session_read_lines`,
+  // one per '\n' until they're added to the history (see
+  // `take_pasted_lines`), & the lines it returns (each a `struct RLLine`)
+  struct AppendBuffer pasted;
+  struct Vector *batch;
+
+  // the frame being built by `refresh_line`. kept around so that repainting
+  // doesn't allocate on every key press.
+  struct AppendBuffer frame;
+
+  // the prompt with the values of its segments filled in, & the generation
+  // of the values it was drawn with
+  struct AppendBuffer prompt_buf;
+  uint64_t prompt_generation;
+
+  // to store the history of inputs (each element is a `struct HistoryEntry`)
+  struct Vector *history;
+  size_t history_index;
+
+  // killed text, for yanking back with Ctrl+Y & Alt+Y
+  struct KillRing *kill_ring;
+
+  // the keys of the last recorded macro (each element is an `int`)
+  struct Vector *macro;
+  bool macro_recording;
+
+  // the keymap of the mode the editor is in
+  struct Keymap *keymap;
+
+  // the longest line `rl_session_read_line` reads
+  size_t max_line_len;
+};
 
-      // move the cursor to the right
-      ++cursor_pos;
+// the session `rl_read_line` uses, on stdin & stdout
+static struct RLSession *default_session = NULL;
 
-      // move to the next character
-      ++num_chars;
+// whether killed text is also copied to the system clipboard (OSC 52)
+static bool clipboard_export = false;
 
-      // null-terminate the buffer
-      current_buf[num_chars] = '\0';
+// the keymaps of every mode, compiled once, & the one new sessions start in
+static struct Keymap *keymaps[NUM_KEYMAPS] = {NULL};
+static struct Keymap *default_keymap = NULL;
 
-      continue;
-    }
+// segments the prompt can include as "{name}"
+static struct SegmentSet *segments = NULL;
 
-    // handle other keys
-    switch (key) {
-    case KEY_ENTER:
-      // if hit enter, then get out of the loop
-      if (write(STDOUT_FILENO, "\r\n", 2) != 2) {
-        die("failed to write to terminal (key press, enter)");
-      }
+// whether the first prompt was drawn, & what was left to do until then (see
+// `finish_startup`)
+static bool started_up = false;
+static RLStartupFn startup_fn = NULL;
+static void *startup_ctx = NULL;
 
-      goto end_of_loop;
-      break;
+/**
+ * reads a line in a session. the line is left in the last entry of the
+ * history, where the caller can read it from.
+ *
+ * @param s the session
+ * @param prompt the prompt to display before reading the line
+ * @param buf_size the longest line to read, including the null terminator
+ *
+ * @return what `rl_read_line` returns
+ */
+static enum ReadLineResult read_line(struct RLSession *s, const char *prompt,
+                                     size_t buf_size) {
+  // a line `rl_session_try_read_line` started is finished instead
+  if (!s->reading) {
+    begin_line(s, prompt, buf_size);
+  }
 
-    // handle Ctrl+C (SIGINT)
-    case CTRL_KEY('c'):
-      disable_raw_mode();
-      return RL_SIGINT;
-      break;
+  return end_line(s, edit_line(s));
+}
 
-    // handle Ctrl+D (EOF)
-    case CTRL_KEY('d'):
-      // if the buffer is empty, then return EOF
-      if (num_chars == 0) {
-        disable_raw_mode();
-        return RL_EOF;
-      }
+/**
+ * starts reading a line: draws the prompt & adds the line to the history.
+ *
+ * @param s the session
+ * @param prompt the prompt to display before reading the line
+ * @param buf_size the longest line to read, including the null terminator
+ */
+static void begin_line(struct RLSession *s, const char *prompt,
+                       size_t buf_size) {
+  assert(!s->reading);
+
+  // print the prompt if provided, filling in its segments with whatever
+  // values they have now. they're redrawn as fresh values come in.
+  abuf_clear(&s->prompt_buf);
+  if (prompt != NULL && segments != NULL) {
+    s->prompt_generation = segments_generation(segments);
+    if (!segments_render(segments, prompt, &s->prompt_buf)) {
+      die("failed to render prompt");
+    }
+  } else if (prompt != NULL) {
+    abuf_append(&s->prompt_buf, prompt, strlen(prompt));
+  }
 
-      goto end_of_loop;
-      break;
+  if (!abuf_append(&s->frame, s->prompt_buf.data, s->prompt_buf.len)) {
+    die("failed to write to terminal (prompt)");
+  }
 
-    // handle BACKSPACE key
-    case KEY_BACKSPACE:
-      // if the cursor is at the beginning of the line, do nothing
-      if (cursor_pos == 0) {
-        continue;
-      }
+  // add a new, empty line to the history. that's the one being edited.
+  if (!add_to_history(s)) {
+    die("failed to add line to history");
+  }
 
-      // move the cursor to the left
-      --cursor_pos;
+  // set the history index to the latest element
+  s->history_index = vector_length(s->history) - 1;
 
-      // move characters after the cursor to the left by one, essentially
-      // deleting the character
-      memmove(&current_buf[cursor_pos], &current_buf[cursor_pos + 1],
-              num_chars - cursor_pos);
+  // enable raw mode for the terminal
+  enable_raw_mode(s);
+
+  s->line = (struct LineState){
+      .s = s,
+      .buf = ((struct HistoryEntry *)vector_get(s->history, s->history_index))
+                 ->line,
+      .buf_size = buf_size,
+      .len = 0,
+      .pos = 0,
+      .last_cmd = LAST_OTHER,
+      .keymap_node = 0,
+      .seq_len = 0,
+      .prompt = prompt,
+  };
+  s->reading = true;
+
+  struct LineState *l = &s->line;
+
+  size_t prompt_width = display_width(s->prompt_buf.data, s->prompt_buf.len);
+
+  // ask the terminal where the cursor is, along with the prompt, & finish
+  // starting up while it answers
+  if (!s->headless && !request_cursor_position(s)) {
+    die("failed to get cursor position");
+  }
 
-      // reduce the length of current buffer
-      --num_chars;
+  if (!started_up) {
+    finish_startup();
+  }
+  if (s->keymap == NULL) {
+    s->keymap = default_keymap;
+  }
 
-      // null-terminate the buffer
-      current_buf[num_chars] = '\0';
+  // without a terminal to ask, assume the prompt starts the line
+  if (s->headless) {
+    l->cy = 1;
+    l->cx = prompt_width + 1;
+  } else if (!read_cursor_position(s, &l->cy, &l->cx)) {
+    die("failed to get cursor position");
+  }
 
-      // repaint the line
-      if (!repaint_line(cy, cx, current_buf, num_chars)) {
-        die("failed to repaint line (BACKSPACE)");
-      }
-      break;
+  l->prompt_col = l->cx > prompt_width ? l->cx - prompt_width : 1;
+}
 
-    // handle arrow up & down to navigate through history
-    case KEY_ARROW_UP:
-    case KEY_ARROW_DOWN:
-      // validate the history index before moving
-      if ((key == KEY_ARROW_UP && history_index == 0) ||
-          (key == KEY_ARROW_DOWN && history_index == history_len - 1)) {
-        continue;
+/**
+ * handles key presses until the line is complete, or, when the session isn't
+ * allowed to wait, until the input runs dry.
+ *
+ * @param s the session, with a line begun
+ *
+ * @return why it stopped: ACTION_PENDING if it ran out of input, else what
+ * ended the line
+ */
+static enum KeyAction edit_line(struct RLSession *s) {
+  struct LineState *l = &s->line;
+
+  enum KeyAction action = ACTION_CONTINUE;
+  while (action == ACTION_CONTINUE && l->len < l->buf_size - 1) {
+    int key = read_key(s);
+    if (key == KEY_PROMPT_CHANGED) {
+      if (!redraw_prompt(l)) {
+        die("failed to redraw prompt");
       }
+      continue;
+    }
 
-      // go backward if arrow up, else go forward
-      history_index += key == KEY_ARROW_UP ? -1 : 1;
-
-      // go forward in history get the data
-      current_buf = *((char **)vector_get(history, history_index));
-
-      size_t current_buf_len = strlen(current_buf);
+    if (key == KEY_INPUT_PENDING) {
+      return ACTION_PENDING;
+    }
 
-      // move cursor back to the original position
-      if (!repaint_line(cy, cx, current_buf, current_buf_len)) {
-        die("failed to repaint line (ARROW_UP/DOWN)");
+    // the input ended: whatever was typed is the last line
+    if (key == KEY_INPUT_END) {
+      if (l->len == 0 && !l->rejected) {
+        action = ACTION_EOF;
+      } else if (abuf_append(&s->frame, "\r\n", 2)) {
+        action = l->rejected ? ACTION_REJECT : ACTION_ACCEPT;
+      } else {
+        die("failed to write to terminal (end of input)");
       }
-
-      // cursor position is at the end of the line now
-      cursor_pos = current_buf_len;
-      num_chars = current_buf_len;
       break;
+    }
 
-    // backward / arrow left
-    case CTRL_KEY('b'):
-    case KEY_ARROW_LEFT:
-      // if the cursor is at the beginning of the line, do nothing
-      if (cursor_pos == 0) {
+    // the rest of a line that was rejected is skipped, up to the ENTER that
+    // ends it, so a paste too big for the session ends up as a single line
+    if (l->rejected) {
+      if (key != KEY_ENTER) {
         continue;
       }
 
-      // move the cursor to the left
-      move_cursor_left();
-      --cursor_pos;
-      break;
-
-    // forward / arrow right
-    case CTRL_KEY('f'):
-    case KEY_ARROW_RIGHT:
-      // if the cursor is at the end of the line, do nothing
-      if (cursor_pos == num_chars) {
-        continue;
+      if (!abuf_append(&s->frame, "\r\n", 2)) {
+        die("failed to write to terminal (key press, enter)");
       }
-
-      // move the cursor to the right
-      move_cursor_right();
-      ++cursor_pos;
+      action = ACTION_REJECT;
       break;
+    }
 
-    default:
-      // just ignore other keys
-      break;
+    action = process_key(l, key);
+    if (l->rejected) {
+      action = reject_line(l, action);
     }
   }
 
-end_of_loop:
-  current_buf[num_chars] = '\0';
-
-  // remember that i is the length of current buffer
-  size_t num_chars_to_copy = num_chars < buf_size ? num_chars + 1 : buf_size;
+  return action;
+}
 
-  // copy the current buffer to the buffer arg
-  memcpy(buf, current_buf, num_chars_to_copy);
+/**
+ * finishes the line `edit_line` stopped at, handing the terminal back.
+ *
+ * @param s the session, with a line begun
+ * @param action what ended the line
+ *
+ * @return what `rl_read_line` returns
+ */
+static enum ReadLineResult end_line(struct RLSession *s,
+                                   enum KeyAction action) {
+  struct LineState *l = &s->line;
 
-  // if we're not at the end of the history, then copy the current buffer to
-  // the history
-  if (history_index < history_len - 1) {
-    char *last_node = *((char **)vector_get(history, history_len - 1));
-    memcpy(last_node, current_buf, num_chars_to_copy);
+  // whatever is left of the line is drawn before handing back to the caller
+  if (!flush_output(s)) {
+    die("failed to write to terminal");
   }
 
+  leave_history_entry(l);
+  s->reading = false;
+
   // disable the raw mode so that the terminal behaves normally again
   disable_raw_mode();
 
-  return RL_SUCCESS;
-}
+  enum ReadLineResult result = RL_SUCCESS;
+  if (action == ACTION_SIGINT) {
+    result = RL_SIGINT;
+  } else if (action == ACTION_EOF) {
+    result = RL_EOF;
+  } else if (action == ACTION_REJECT) {
+    result = RL_OVER_BUDGET;
+  } else if (s->history_index < vector_length(s->history) - 1) {
+    // if we're not at the end of the history, then copy the current line to
+    // the end of the history
+    struct HistoryEntry *last =
+        vector_get(s->history, vector_length(s->history) - 1);
+    char *line = mem_realloc(&s->allocator, last->line, last->capacity,
+                             l->len + 1);
+    if (line == NULL) {
+      die("failed to add line to history");
+    }
 
-/**
- * enables raw mode for the terminal.
- * for more information on raw mode, read /notes/raw-mode.md
- *
- * it will exit the program using `die` function if it fails to enable raw mode.
- */
-static void enable_raw_mode(void) {
-  // save original terminal settings
-  if (tcgetattr(STDIN_FILENO, &original_state) == -1) {
-    die("failed to enable raw mode (tcgetattr)");
+    memcpy(line, l->buf, l->len + 1);
+    last->line = line;
+    last->len = l->len;
+    last->capacity = l->len + 1;
   }
 
-  struct termios term = original_state;
+  trim_to_budget(s);
 
-  // from linux man pages (man cfmakeraw -> Raw Mode -> cfmakeraw())
-  // read /notes/raw-mode.md
-  term.c_iflag &=
-      ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
-  term.c_oflag &= ~OPOST;
-  term.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-  term.c_cflag &= ~(CSIZE | PARENB);
-  term.c_cflag |= CS8;
+  return result;
+}
 
-  // to read within 100ms
-  term.c_cc[VMIN] = 0;
-  term.c_cc[VTIME] = 1; // 1 * 1/10th seconds = 100ms timeout
+/**
+ * handles whatever keys are there already in a line that's begun, for
+ * `rl_session_try_read_line` & `rl_session_expire_key`.
+ */
+static enum ReadLineResult continue_line(struct RLSession *s,
+                                         const char **line, size_t *len) {
+  s->nonblocking = true;
+  enum KeyAction action = edit_line(s);
+  s->nonblocking = false;
+
+  // show what the keys read so far did, then wait for more
+  if (action == ACTION_PENDING) {
+    if (!flush_output(s)) {
+      die("failed to write to terminal");
+    }
+    return RL_PENDING;
+  }
 
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &term) == -1) {
-    die("failed to enable raw mode (tcsetattr)");
+  enum ReadLineResult result = end_line(s, action);
+  if (result != RL_SUCCESS) {
+    return result;
   }
 
-  raw_mode_enabled = true;
-}
+  // the line is the last one in the history
+  struct HistoryEntry *last =
+      vector_get(s->history, vector_length(s->history) - 1);
+  *line = last->line;
+  *len = last->len;
 
-static void disable_raw_mode(void) {
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_state) == -1) {
-    die("failed to disable raw mode (tcsetattr)");
-  }
+  return RL_SUCCESS;
 }
 
 /**
- * raw mode MUST be enabled before calling this function!!!
+ * reads a line in a session like `read_line`, along with the complete lines
+ * of a paste that follow it. they're all listed in `batch`.
  *
- * reads a key from the terminal. it handles escape sequences for arrow keys,
- * HOME, END, etc.
+ * @param s the session
+ * @param prompt the prompt to display before reading the line
+ * @param buf_size the longest line to read, including the null terminator
+ *
+ * @return what `rl_read_line` returns
  */
-static int read_key(void) {
-  assert(raw_mode_enabled);
-
-  ssize_t bytes_read;
-  char c;
-  do {
-    bytes_read = read(STDIN_FILENO, &c, 1);
-    // in Cygwin, when read() times out it returns -1 and sets errno
-    // to EAGAIN, instead of just returning 0
-    if (bytes_read == -1 && errno != EAGAIN) {
-      die("failed to read input");
-    }
-  } while (bytes_read != 1);
-
-  if (c != KEY_ESC) {
-    return c;
+static enum ReadLineResult read_lines(struct RLSession *s, const char *prompt,
+                                      size_t buf_size) {
+  if (!s->reading) {
+    begin_line(s, prompt, buf_size);
   }
 
-  // for reading escape sequences to check if the user pressed arrow keys,
-  // function keys, HOME, END, etc.
-  char seq[5];
+  enum KeyAction action = edit_line(s);
 
-read_esc_seq:
-  // 2nd byte
-  if (read(STDIN_FILENO, &seq[0], 1) != 1) {
-    return KEY_ESC;
-  }
+  // the rest of the paste is taken before the terminal is handed back, since
+  // that drops whatever input wasn't read yet
+  size_t pasted = action == ACTION_ACCEPT ? take_pasted_lines(s, buf_size) : 0;
 
-  /*
-   * It is possible to get a combination like ESC + Arrow Up, in which case
-   * the sequence will be ESC, ESC, [, A. In such cases, I want to ignore the
-   * first ESC and just return Arrow Up.
-   */
+  enum ReadLineResult result = end_line(s, action);
+  if (result != RL_SUCCESS) {
+    return result;
+  }
 
-  if (seq[0] == KEY_ESC) {
-    goto read_esc_seq;
+  if (!add_pasted_lines(s, pasted)) {
+    die("failed to add lines to history");
   }
 
-  if (seq[0] == '[') {
-    // 3rd byte
-    if (read(STDIN_FILENO, &seq[1], 1) != 1) {
-      return KEY_ESC;
-    }
+  return RL_SUCCESS;
+}
 
-    if (seq[1] >= '0' && seq[1] <= '9') {
-      // 4th byte
-      if (read(STDIN_FILENO, &seq[2], 1) != 1) {
-        return KEY_ESC;
-      }
+/**
+ * takes the lines a paste left in the input after the line that was just
+ * accepted: every complete line that's there already, or that comes in
+ * without waiting, up to the first one that needs the editor, for a key that
+ * isn't just inserted or for being too long. each is drawn after the prompt
+ * as if it was typed, into the frame `end_line` draws the accepted line with,
+ * & staged in `pasted` for `add_pasted_lines`.
+ *
+ * @param s the session, with the accepted line still begun
+ * @param buf_size the longest line to read, including the null terminator
+ *
+ * @return the number of lines taken
+ */
+static size_t take_pasted_lines(struct RLSession *s, size_t buf_size) {
+  abuf_clear(&s->pasted);
 
-      if (seq[2] != '~') {
-        // 5th byte
-        if (read(STDIN_FILENO, &seq[3], 1) == 1) {
-          read(STDIN_FILENO, &seq[4], 1); // 6th byte
-        }
+  // with a memory budget, every line is checked against it as it's typed. a
+  // macro being recorded needs the keys of every line.
+  if (s->memory_budget != 0 || s->macro_recording || buf_size < 2) {
+    return 0;
+  }
 
-        return KEY_ESC;
+  // a line that fills the buffer is accepted without its ENTER
+  size_t max_len = buf_size - 2;
+
+  size_t count = 0;
+  size_t start = s->input_pos;
+  while (true) {
+    if (s->input_pos == s->input_len) {
+      // the line read so far is kept at the front of the next chunk. one
+      // that takes up a whole chunk is left to the editor.
+      s->key_start = start;
+      if (s->input_len - start == INPUT_CHUNK_SIZE || !fill_input_now(s)) {
+        start = s->key_start;
+        break;
       }
+      start = s->key_start;
+    }
 
-      switch (seq[1]) {
-      case '1':
-      case '7':
-        return KEY_HOME;
-      case '3':
-        return KEY_DELETE;
-      case '4':
-      case '8':
-        return KEY_END;
-      case '5':
-        return KEY_PAGE_UP;
-      case '6':
-        return KEY_PAGE_DOWN;
-      }
-    } else {
-      switch (seq[1]) {
-      case 'A':
-        return KEY_ARROW_UP;
-      case 'B':
-        return KEY_ARROW_DOWN;
-      case 'C':
-        return KEY_ARROW_RIGHT;
-      case 'D':
-        return KEY_ARROW_LEFT;
-      case 'F':
-        return KEY_END;
-      case 'H':
-        return KEY_HOME;
+    unsigned char c = s->input[s->input_pos];
+    uint16_t node = 0;
+    enum EditCommand cmd = keymap_lookup(s->keymap, c, &node);
+
+    if (cmd == CMD_ACCEPT_LINE) {
+      const char *line = &s->input[start];
+      size_t len = s->input_pos - start;
+      if (!abuf_append(&s->pasted, line, len) ||
+          !abuf_append(&s->pasted, "\n", 1) ||
+          !abuf_append(&s->frame, s->prompt_buf.data, s->prompt_buf.len) ||
+          !abuf_append(&s->frame, line, len) ||
+          !abuf_append(&s->frame, "\r\n", 2)) {
+        die("failed to take pasted lines");
       }
-    }
-  } else if (seq[0] == 'O') {
-    // 3rd byte
-    if (read(STDIN_FILENO, &seq[1], 1) != 1) {
-      return KEY_ESC;
+
+      ++count;
+      start = ++s->input_pos;
+      continue;
     }
 
-    switch (seq[1]) {
-    case 'A':
-      return KEY_ARROW_UP;
-    case 'B':
-      return KEY_ARROW_DOWN;
-    case 'C':
-      return KEY_ARROW_RIGHT;
-    case 'D':
-      return KEY_ARROW_LEFT;
-    case 'F':
-      return KEY_END;
-    case 'H':
-      return KEY_HOME;
+    if (!isprint(c) || cmd != CMD_SELF_INSERT ||
+        s->input_pos - start >= max_len) {
+      break;
     }
+
+    ++s->input_pos;
   }
 
-  return KEY_ESC;
+  // the line it stopped at is read by the editor, from its start
+  s->input_pos = start;
+  s->key_start = start;
+
+  return count;
 }
 
 /**
- * to print an error message and exit the program with `EXIT_FAILURE`.
- * it tries to disable raw mode if it was enabled.
+ * adds the lines `take_pasted_lines` staged to the history, growing it once
+ * for all of them, & lists them in `batch` after the line that was read with
+ * them.
  *
- * if `errno` is set, it prints the error message using `perror()`.
- * otherwise, it prints the message directly using `fputs()`.
+ * @param s the session, with the line that was read last in the history
+ * @param count the number of lines staged
  *
- * @param msg the error message to print
+ * @return `true` if the lines were added, `false` if memory allocation fails
  */
-static void die(const char *msg) {
-  if (raw_mode_enabled) {
-    // to prevent infinite recursion in case die() is called from
-    // disable_raw_mode() function
-    raw_mode_enabled = false;
+static bool add_pasted_lines(struct RLSession *s, size_t count) {
+  if (s->batch == NULL) {
+    s->batch = vector_init_with(sizeof(struct RLLine), 0, &s->allocator);
+    if (s->batch == NULL) {
+      return false;
+    }
+  }
 
-    disable_raw_mode();
+  vector_clear(s->batch);
+  if (!vector_reserve(s->history, count) ||
+      !vector_reserve(s->batch, count + 1)) {
+    return false;
   }
 
-  if (errno == 0) {
-    fputs(msg, stderr);
-    putchar('\n');
-  } else {
-    perror(msg);
+  struct HistoryEntry *last =
+      vector_get(s->history, vector_length(s->history) - 1);
+  struct RLLine line = {.line = last->line, .len = last->len};
+  vector_push(s->batch, &line);
+
+  const char *text = s->pasted.data;
+  const char *end = s->pasted.data + s->pasted.len;
+  for (size_t i = 0; i < count; ++i) {
+    const char *newline = memchr(text, '\n', end - text);
+    size_t len = newline - text;
+
+    struct HistoryEntry entry = {
+        .line = mem_alloc(&s->allocator, len + 1),
+        .len = len,
+        .capacity = len + 1,
+    };
+    if (entry.line == NULL) {
+      return false;
+    }
+
+    memcpy(entry.line, text, len);
+    entry.line[len] = '\0';
+
+    // there's room for both already
+    vector_push(s->history, &entry);
+    line = (struct RLLine){.line = entry.line, .len = len};
+    vector_push(s->batch, &line);
+
+    text = newline + 1;
   }
 
-  exit(EXIT_FAILURE);
+  abuf_clear(&s->pasted);
+  s->history_index = vector_length(s->history) - 1;
+
+  return true;
 }
 
-/**
- * uses the CPR (cursor position report) escape sequence to get the cursor
- * position.
+/*
+ * Every command gets the line being edited & the key event that triggered it,
+ * and returns what `rl_read_line` should do next. They repaint whatever they
+ * changed themselves (`refresh_line` does nothing while a macro is replayed).
+ */
+
+static enum KeyAction cmd_self_insert(struct LineState *l,
+                                      const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  int key = ev->key;
+  if (!isprint(key)) {
+    return ACTION_CONTINUE;
+  }
+
+  char c = key;
+  abuf_clear(&s->burst);
+  if (!abuf_append(&s->burst, &c, 1)) {
+    die("failed to insert character");
+  }
+
+  // a paste arrives as a burst of printable keys that are all waiting to be
+  // read already. they're inserted together, so the text after the cursor is
+  // moved & repainted once per burst instead of once per key. (a macro is
+  // replayed from its recorded keys, so it's left alone.) with a memory
+  // budget, a burst is a chunk of the input at most, so a paste that's too
+  // big for it is rejected before it's all copied.
+  size_t max_burst = s->memory_budget != 0 ? INPUT_CHUNK_SIZE : SIZE_MAX;
+  while (!l->suppress_render && l->len + s->burst.len < l->buf_size - 1 &&
+         s->burst.len < max_burst) {
+    if (s->input_pos == s->input_len && !read_more_input(s)) {
+      break;
+    }
+
+    unsigned char next = s->input[s->input_pos];
+    uint16_t node = 0;
+    if (!isprint(next) ||
+        keymap_lookup(s->keymap, next, &node) != CMD_SELF_INSERT) {
+      break;
+    }
+
+    ++s->input_pos;
+
+    int next_key = next;
+    if (s->macro_recording && !vector_push(s->macro, &next_key)) {
+      die("failed to record macro");
+    }
+
+    if (!abuf_append(&s->burst, (char *)&next, 1)) {
+      die("failed to insert character");
+    }
+  }
+
+  size_t from = l->pos;
+  insert_text(l, s->burst.data, s->burst.len);
+
+  if (!refresh_tail(l, from)) {
+    die("failed to write to terminal (key press)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_accept_line(struct LineState *l,
+                                      const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  // if hit enter, then the line is complete
+  if (!l->suppress_render && !abuf_append(&s->frame, "\r\n", 2)) {
+    die("failed to write to terminal (key press, enter)");
+  }
+
+  return ACTION_ACCEPT;
+}
+
+static enum KeyAction cmd_interrupt(struct LineState *l,
+                                    const struct KeyEvent *ev) {
+  return ACTION_SIGINT;
+}
+
+static enum KeyAction cmd_end_of_file(struct LineState *l,
+                                      const struct KeyEvent *ev) {
+  // if the buffer is empty, then return EOF
+  if (l->len == 0) {
+    return ACTION_EOF;
+  }
+
+  return ACTION_ACCEPT;
+}
+
+static enum KeyAction cmd_backward_char(struct LineState *l,
+                                        const struct KeyEvent *ev) {
+  // if the cursor is at the beginning of the line, do nothing
+  if (l->pos == 0) {
+    return ACTION_CONTINUE;
+  }
+
+  // move the cursor to the left
+  if (!l->suppress_render) {
+    move_cursor_left(l->s);
+  }
+  --l->pos;
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_forward_char(struct LineState *l,
+                                       const struct KeyEvent *ev) {
+  // if the cursor is at the end of the line, do nothing
+  if (l->pos == l->len) {
+    return ACTION_CONTINUE;
+  }
+
+  // move the cursor to the right
+  if (!l->suppress_render) {
+    move_cursor_right(l->s);
+  }
+  ++l->pos;
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_backward_word(struct LineState *l,
+                                        const struct KeyEvent *ev) {
+  l->pos = word_backward(l->buf, l->pos);
+  if (!refresh_line(l)) {
+    die("failed to repaint line (backward-word)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_forward_word(struct LineState *l,
+                                       const struct KeyEvent *ev) {
+  l->pos = word_forward(l->buf, l->len, l->pos);
+  if (!refresh_line(l)) {
+    die("failed to repaint line (forward-word)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_beginning_of_line(struct LineState *l,
+                                            const struct KeyEvent *ev) {
+  l->pos = 0;
+  if (!refresh_line(l)) {
+    die("failed to repaint line (beginning-of-line)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_end_of_line(struct LineState *l,
+                                      const struct KeyEvent *ev) {
+  l->pos = l->len;
+  if (!refresh_line(l)) {
+    die("failed to repaint line (end-of-line)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+/*
+ * previous-history & next-history
+ */
+static enum KeyAction move_in_history(struct LineState *l, bool backward) {
+  struct RLSession *s = l->s;
+
+  // validate the history index before moving
+  if ((backward && s->history_index == 0) ||
+      (!backward && s->history_index == vector_length(s->history) - 1)) {
+    return ACTION_CONTINUE;
+  }
+
+  // whatever was edited in this line stays in the history
+  leave_history_entry(l);
+
+  // go backward if arrow up, else go forward
+  s->history_index += backward ? -1 : 1;
+
+  // go forward in history get the data
+  struct HistoryEntry *entry = vector_get(s->history, s->history_index);
+  l->buf = entry->line;
+
+  // cursor position is at the end of the line now
+  l->len = entry->len;
+  l->pos = l->len;
+
+  if (!refresh_line(l)) {
+    die("failed to repaint line (history)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_previous_history(struct LineState *l,
+                                           const struct KeyEvent *ev) {
+  return move_in_history(l, true);
+}
+
+static enum KeyAction cmd_next_history(struct LineState *l,
+                                       const struct KeyEvent *ev) {
+  return move_in_history(l, false);
+}
+
+static enum KeyAction cmd_backward_delete_char(struct LineState *l,
+                                               const struct KeyEvent *ev) {
+  // if the cursor is at the beginning of the line, do nothing
+  if (l->pos == 0) {
+    return ACTION_CONTINUE;
+  }
+
+  // delete the character before the cursor & repaint what was after it
+  delete_range(l, l->pos - 1, l->pos);
+  if (!refresh_tail(l, l->pos)) {
+    die("failed to repaint line (backward-delete-char)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_delete_char(struct LineState *l,
+                                      const struct KeyEvent *ev) {
+  // if the cursor is at the end of the line, do nothing
+  if (l->pos == l->len) {
+    return ACTION_CONTINUE;
+  }
+
+  // delete the character under the cursor & repaint what was after it
+  delete_range(l, l->pos, l->pos + 1);
+  if (!refresh_tail(l, l->pos)) {
+    die("failed to repaint line (delete-char)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+/*
+ * the kill commands only differ in what they kill
+ */
+static enum KeyAction kill_and_refresh(struct LineState *l,
+                                       const struct KeyEvent *ev, size_t from,
+                                       size_t to) {
+  kill_range(l, from, to, ev->prev_cmd);
+  if (!refresh_line(l)) {
+    die("failed to repaint line (kill)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+// kill from the cursor to the end of the line
+static enum KeyAction cmd_kill_line(struct LineState *l,
+                                    const struct KeyEvent *ev) {
+  return kill_and_refresh(l, ev, l->pos, l->len);
+}
+
+// kill from the beginning of the line to the cursor
+static enum KeyAction cmd_unix_line_discard(struct LineState *l,
+                                            const struct KeyEvent *ev) {
+  return kill_and_refresh(l, ev, 0, l->pos);
+}
+
+static enum KeyAction cmd_kill_whole_line(struct LineState *l,
+                                          const struct KeyEvent *ev) {
+  l->pos = l->len;
+  return kill_and_refresh(l, ev, 0, l->len);
+}
+
+// kill the whitespace delimited word before the cursor
+static enum KeyAction cmd_unix_word_rubout(struct LineState *l,
+                                           const struct KeyEvent *ev) {
+  return kill_and_refresh(l, ev, word_backward_space(l->buf, l->pos), l->pos);
+}
+
+// kill up to the end of the next word
+static enum KeyAction cmd_kill_word(struct LineState *l,
+                                    const struct KeyEvent *ev) {
+  return kill_and_refresh(l, ev, l->pos, word_forward(l->buf, l->len, l->pos));
+}
+
+// kill back to the start of the previous word
+static enum KeyAction cmd_backward_kill_word(struct LineState *l,
+                                             const struct KeyEvent *ev) {
+  return kill_and_refresh(l, ev, word_backward(l->buf, l->pos), l->pos);
+}
+
+// yank the most recent kill
+static enum KeyAction cmd_yank(struct LineState *l,
+                               const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  // nothing has been killed yet
+  if (s->kill_ring == NULL) {
+    return ACTION_CONTINUE;
+  }
+
+  size_t len;
+  const char *text = killring_yank(s->kill_ring, &len);
+  if (text == NULL) {
+    return ACTION_CONTINUE;
+  }
+
+  yank(l, text, len);
+  if (!refresh_line(l)) {
+    die("failed to repaint line (yank)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+// replace the text that was just yanked with the kill before it
+static enum KeyAction cmd_yank_pop(struct LineState *l,
+                                   const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  if (ev->prev_cmd != LAST_YANK) {
+    return ACTION_CONTINUE;
+  }
+
+  size_t len;
+  const char *text = killring_yank_pop(s->kill_ring, &len);
+  if (text == NULL) {
+    return ACTION_CONTINUE;
+  }
+
+  delete_range(l, l->yank_start, l->yank_end);
+  yank(l, text, len);
+  if (!refresh_line(l)) {
+    die("failed to repaint line (yank-pop)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+// Alt+<digits> give a count to the next command
+static enum KeyAction cmd_digit_argument(struct LineState *l,
+                                         const struct KeyEvent *ev) {
+  int digit = (ev->key & ~ALT_BIT) - '0';
+  if (digit < 0 || digit > 9) {
+    return ACTION_CONTINUE;
+  }
+
+  l->arg = ev->arg < MAX_NUMERIC_ARG ? ev->arg * 10 + digit : ev->arg;
+  l->last_cmd = ev->prev_cmd;
+
+  return ACTION_CONTINUE;
+}
+
+/*
+ * the keys that run a macro command are never part of a macro
+ */
+static void unrecord_keys(struct RLSession *s, size_t count) {
+  while (s->macro_recording && count > 0 && vector_length(s->macro) > 0) {
+    vector_pop(s->macro);
+    --count;
+  }
+}
+
+static enum KeyAction cmd_start_kbd_macro(struct LineState *l,
+                                          const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  if (s->macro_recording) {
+    unrecord_keys(s, ev->seq_len);
+    return ACTION_CONTINUE;
+  }
+
+  if (s->macro == NULL) {
+    s->macro = vector_init_with(sizeof(int), 0, &s->allocator);
+    if (s->macro == NULL) {
+      die("failed to allocate macro");
+    }
+  }
+
+  vector_clear(s->macro);
+  s->macro_recording = true;
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_end_kbd_macro(struct LineState *l,
+                                        const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  unrecord_keys(s, ev->seq_len);
+  s->macro_recording = false;
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_call_last_kbd_macro(struct LineState *l,
+                                              const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  // a macro can't replay itself
+  if (s->macro_recording) {
+    unrecord_keys(s, ev->seq_len);
+    return ACTION_CONTINUE;
+  }
+
+  return replay_macro(l, ev->arg == 0 ? 1 : ev->arg);
+}
+
+/*
+ * switching modes is just pointing `keymap` at another keymap
+ */
+static enum KeyAction set_keymap(struct LineState *l, enum KeymapId id) {
+  struct RLSession *s = l->s;
+
+  s->keymap = keymaps[id];
+  l->keymap_node = 0;
+
+  return ACTION_CONTINUE;
+}
+
+static enum KeyAction cmd_emacs_editing_mode(struct LineState *l,
+                                             const struct KeyEvent *ev) {
+  return set_keymap(l, KEYMAP_EMACS);
+}
+
+static enum KeyAction cmd_vi_editing_mode(struct LineState *l,
+                                          const struct KeyEvent *ev) {
+  return set_keymap(l, KEYMAP_VI_INSERT);
+}
+
+static enum KeyAction cmd_vi_movement_mode(struct LineState *l,
+                                           const struct KeyEvent *ev) {
+  struct RLSession *s = l->s;
+
+  // like vi, leaving insert mode puts the cursor on the last character typed
+  if (keymap_id(s->keymap) == KEYMAP_VI_INSERT) {
+    cmd_backward_char(l, ev);
+  }
+
+  return set_keymap(l, KEYMAP_VI_COMMAND);
+}
+
+static enum KeyAction cmd_vi_insertion_mode(struct LineState *l,
+                                            const struct KeyEvent *ev) {
+  return set_keymap(l, KEYMAP_VI_INSERT);
+}
+
+static enum KeyAction cmd_vi_insert_beg(struct LineState *l,
+                                        const struct KeyEvent *ev) {
+  cmd_beginning_of_line(l, ev);
+  return set_keymap(l, KEYMAP_VI_INSERT);
+}
+
+static enum KeyAction cmd_vi_append_mode(struct LineState *l,
+                                         const struct KeyEvent *ev) {
+  cmd_forward_char(l, ev);
+  return set_keymap(l, KEYMAP_VI_INSERT);
+}
+
+static enum KeyAction cmd_vi_append_eol(struct LineState *l,
+                                        const struct KeyEvent *ev) {
+  cmd_end_of_line(l, ev);
+  return set_keymap(l, KEYMAP_VI_INSERT);
+}
+
+// to the start of the next word
+static enum KeyAction cmd_vi_next_word(struct LineState *l,
+                                       const struct KeyEvent *ev) {
+  size_t pos = word_scan_forward(l->buf, l->len, l->pos, CC_WORD, false);
+  l->pos = word_scan_forward(l->buf, l->len, pos, CC_WORD, true);
+  if (!refresh_line(l)) {
+    die("failed to repaint line (vi-next-word)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+// to the last character of the current / next word
+static enum KeyAction cmd_vi_end_word(struct LineState *l,
+                                      const struct KeyEvent *ev) {
+  size_t from = l->pos < l->len ? l->pos + 1 : l->pos;
+  size_t end = word_forward(l->buf, l->len, from);
+  l->pos = end > 0 ? end - 1 : 0;
+  if (!refresh_line(l)) {
+    die("failed to repaint line (vi-end-word)");
+  }
+
+  return ACTION_CONTINUE;
+}
+
+// yank after the cursor
+static enum KeyAction cmd_vi_put(struct LineState *l,
+                                 const struct KeyEvent *ev) {
+  if (l->pos < l->len) {
+    ++l->pos;
+  }
+
+  return cmd_yank(l, ev);
+}
+
+static enum KeyAction (*const command_fns[NUM_COMMANDS])(
+    struct LineState *, const struct KeyEvent *) = {
+    [CMD_SELF_INSERT] = cmd_self_insert,
+    [CMD_ACCEPT_LINE] = cmd_accept_line,
+    [CMD_INTERRUPT] = cmd_interrupt,
+    [CMD_END_OF_FILE] = cmd_end_of_file,
+    [CMD_BACKWARD_CHAR] = cmd_backward_char,
+    [CMD_FORWARD_CHAR] = cmd_forward_char,
+    [CMD_BACKWARD_WORD] = cmd_backward_word,
+    [CMD_FORWARD_WORD] = cmd_forward_word,
+    [CMD_BEGINNING_OF_LINE] = cmd_beginning_of_line,
+    [CMD_END_OF_LINE] = cmd_end_of_line,
+    [CMD_PREVIOUS_HISTORY] = cmd_previous_history,
+    [CMD_NEXT_HISTORY] = cmd_next_history,
+    [CMD_BACKWARD_DELETE_CHAR] = cmd_backward_delete_char,
+    [CMD_DELETE_CHAR] = cmd_delete_char,
+    [CMD_KILL_LINE] = cmd_kill_line,
+    [CMD_UNIX_LINE_DISCARD] = cmd_unix_line_discard,
+    [CMD_KILL_WHOLE_LINE] = cmd_kill_whole_line,
+    [CMD_UNIX_WORD_RUBOUT] = cmd_unix_word_rubout,
+    [CMD_KILL_WORD] = cmd_kill_word,
+    [CMD_BACKWARD_KILL_WORD] = cmd_backward_kill_word,
+    [CMD_YANK] = cmd_yank,
+    [CMD_YANK_POP] = cmd_yank_pop,
+    [CMD_DIGIT_ARGUMENT] = cmd_digit_argument,
+    [CMD_START_KBD_MACRO] = cmd_start_kbd_macro,
+    [CMD_END_KBD_MACRO] = cmd_end_kbd_macro,
+    [CMD_CALL_LAST_KBD_MACRO] = cmd_call_last_kbd_macro,
+    [CMD_EMACS_EDITING_MODE] = cmd_emacs_editing_mode,
+    [CMD_VI_EDITING_MODE] = cmd_vi_editing_mode,
+    [CMD_VI_MOVEMENT_MODE] = cmd_vi_movement_mode,
+    [CMD_VI_INSERTION_MODE] = cmd_vi_insertion_mode,
+    [CMD_VI_INSERT_BEG] = cmd_vi_insert_beg,
+    [CMD_VI_APPEND_MODE] = cmd_vi_append_mode,
+    [CMD_VI_APPEND_EOL] = cmd_vi_append_eol,
+    [CMD_VI_NEXT_WORD] = cmd_vi_next_word,
+    [CMD_VI_END_WORD] = cmd_vi_end_word,
+    [CMD_VI_PUT] = cmd_vi_put,
+};
+
+/**
+ * handles a single key press: finds the command bound to it in the active
+ * keymap & runs it. keys come from `read_key`, or from a macro when it's
+ * replayed.
+ *
+ * @param l the line being edited
+ * @param key the key that was pressed
+ *
+ * @return what `rl_read_line` should do next
+ */
+static enum KeyAction process_key(struct LineState *l, int key) {
+  struct RLSession *s = l->s;
+
+  // every key goes into the macro while one is being recorded (the keys that
+  // start / stop / replay a macro are taken out again by those commands)
+  if (s->macro_recording && !vector_push(s->macro, &key)) {
+    die("failed to record macro");
+  }
+
+  return dispatch_key(l, key);
+}
+
+/**
+ * looks up a key in the active keymap & runs the command bound to it. keys
+ * that are only the start of a multi-key binding are remembered until the
+ * binding is complete.
+ *
+ * @param l the line being edited
+ * @param key the key that was pressed
+ *
+ * @return what `rl_read_line` should do next
+ */
+static enum KeyAction dispatch_key(struct LineState *l, int key) {
+  struct RLSession *s = l->s;
+
+  bool in_sequence = l->keymap_node != 0;
+
+  enum EditCommand cmd = keymap_lookup(s->keymap, key, &l->keymap_node);
+  ++l->seq_len;
+
+  if (cmd == CMD_PREFIX) {
+    return ACTION_CONTINUE;
+  }
+
+  size_t seq_len = l->seq_len;
+  l->seq_len = 0;
+
+  // an unbound Alt+<key> is handled as ESC followed by the key, which is what
+  // the terminal actually sent. in vi mode that's what ESC typed quickly
+  // followed by a command looks like.
+  if (cmd == CMD_NONE && !in_sequence && (key & ALT_BIT)) {
+    enum KeyAction action = dispatch_key(l, KEY_ESC);
+    if (action != ACTION_CONTINUE) {
+      return action;
+    }
+
+    return dispatch_key(l, key & ~ALT_BIT);
+  }
+
+  struct KeyEvent ev = {
+      .key = key,
+      .seq_len = seq_len,
+      .arg = l->arg,
+      .prev_cmd = l->last_cmd,
+  };
+
+  // the count only applies to the command right after it, & only kills &
+  // yanks care about the previous command, so they set it again themselves
+  l->arg = 0;
+  l->last_cmd = LAST_OTHER;
+
+  if (cmd == CMD_NONE) {
+    return ACTION_CONTINUE;
+  }
+
+  return command_fns[cmd](l, &ev);
+}
+
+/**
+ * feeds the keys of the recorded macro to `process_key`, `count` times. the
+ * screen isn't touched until all of them are processed, then the line is
+ * repainted once.
+ *
+ * replaying stops early if a key completes the line (like ENTER) or the line
+ * gets full.
+ *
+ * @param l the line being edited
+ * @param count how many times to replay the macro
+ *
+ * @return what `rl_read_line` should do next
+ */
+static enum KeyAction replay_macro(struct LineState *l, size_t count) {
+  struct RLSession *s = l->s;
+
+  if (s->macro == NULL || vector_length(s->macro) == 0) {
+    return ACTION_CONTINUE;
+  }
+
+  const int *keys = vector_data(s->macro);
+  size_t num_keys = vector_length(s->macro);
+
+  enum KeyAction action = ACTION_CONTINUE;
+
+  l->suppress_render = true;
+  for (size_t i = 0; i < count && action == ACTION_CONTINUE; ++i) {
+    for (size_t j = 0; j < num_keys && action == ACTION_CONTINUE; ++j) {
+      if (l->len >= l->buf_size - 1) {
+        break;
+      }
+
+      action = process_key(l, keys[j]);
+    }
+  }
+  l->suppress_render = false;
+
+  // nothing to paint, the line was thrown away
+  if (action == ACTION_EOF || action == ACTION_SIGINT) {
+    return action;
+  }
+
+  if (!refresh_line(l)) {
+    die("failed to repaint line (macro)");
+  }
+
+  if (action == ACTION_ACCEPT && !abuf_append(&s->frame, "\r\n", 2)) {
+    die("failed to write to terminal (macro, enter)");
+  }
+
+  return action;
+}
+
+/**
+ * enables raw mode for the terminal.
+ * for more information on raw mode, read /notes/raw-mode.md
+ *
+ * it will exit the program using `die` function if it fails to enable raw mode.
+ */
+static void enable_raw_mode(struct RLSession *s) {
+  if (s->headless) {
+    return;
+  }
+
+  // save original terminal settings
+  if (tcgetattr(s->in_fd, &original_state) == -1) {
+    die("failed to enable raw mode (tcgetattr)");
+  }
+
+  struct termios term = original_state;
+
+  // from linux man pages (man cfmakeraw -> Raw Mode -> cfmakeraw())
+  // read /notes/raw-mode.md
+  term.c_iflag &=
+      ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+  term.c_oflag &= ~OPOST;
+  term.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  term.c_cflag &= ~(CSIZE | PARENB);
+  term.c_cflag |= CS8;
+
+  // to read within 100ms
+  term.c_cc[VMIN] = 0;
+  term.c_cc[VTIME] = 1; // 1 * 1/10th seconds = 100ms timeout
+
+  // TCSADRAIN, not TCSAFLUSH, so what's typed ahead of the prompt is kept
+  if (tcsetattr(s->in_fd, TCSADRAIN, &term) == -1) {
+    die("failed to enable raw mode (tcsetattr)");
+  }
+
+  raw_fd = s->in_fd;
+  raw_mode_enabled = true;
+}
+
+static void disable_raw_mode(void) {
+  if (!raw_mode_enabled) {
+    return;
+  }
+
+  // to prevent infinite recursion in case die() is called from here
+  raw_mode_enabled = false;
+
+  if (tcsetattr(raw_fd, TCSADRAIN, &original_state) == -1) {
+    die("failed to disable raw mode (tcsetattr)");
+  }
+}
+
+/**
+ * raw mode MUST be enabled before calling this function!!!
+ *
+ * reads a key from the terminal. it handles escape sequences for arrow keys,
+ * HOME, END, etc.
+ */
+static int read_key(struct RLSession *s) {
+  assert(raw_mode_enabled || s->headless);
+
+  // all the keys read so far are processed, so show the result before
+  // waiting for more
+  if (s->input_pos == s->input_len && !flush_output(s)) {
+    die("failed to write to terminal");
+  }
+
+  s->key_start = s->input_pos;
+
+  char c;
+  while (!read_byte(s, &c)) {
+    // a terminal never runs out of input, it just times out. without waiting
+    // for input, running dry doesn't mean it ended either.
+    if ((s->headless && !s->nonblocking) || s->input_ended) {
+      return KEY_INPUT_END;
+    }
+
+    // nothing was typed in a while, a good time to check whether the prompt
+    // is out of date
+    if (segments != NULL &&
+        segments_generation(segments) != s->prompt_generation) {
+      return KEY_PROMPT_CHANGED;
+    }
+
+    if (s->nonblocking) {
+      return KEY_INPUT_PENDING;
+    }
+  }
+
+  if (c != KEY_ESC) {
+    return (unsigned char)c;
+  }
+
+  // for reading escape sequences to check if the user pressed arrow keys,
+  // function keys, HOME, END, etc.
+  char seq[5];
+
+read_esc_seq:
+  // 2nd byte
+  if (!read_byte(s, &seq[0])) {
+    return incomplete_key(s);
+  }
+
+  /*
+   * It is possible to get a combination like ESC + Arrow Up, in which case
+   * the sequence will be ESC, ESC, [, A. In such cases, I want to ignore the
+   * first ESC and just return Arrow Up.
+   */
+
+  if (seq[0] == KEY_ESC) {
+    goto read_esc_seq;
+  }
+
+  if (seq[0] == '[') {
+    // 3rd byte
+    if (!read_byte(s, &seq[1])) {
+      return incomplete_key(s);
+    }
+
+    if (seq[1] >= '0' && seq[1] <= '9') {
+      // 4th byte
+      if (!read_byte(s, &seq[2])) {
+        return incomplete_key(s);
+      }
+
+      if (seq[2] != '~') {
+        // 5th byte
+        if (read_byte(s, &seq[3])) {
+          read_byte(s, &seq[4]); // 6th byte
+        }
+
+        return KEY_ESC;
+      }
+
+      switch (seq[1]) {
+      case '1':
+      case '7':
+        return KEY_HOME;
+      case '3':
+        return KEY_DELETE;
+      case '4':
+      case '8':
+        return KEY_END;
+      case '5':
+        return KEY_PAGE_UP;
+      case '6':
+        return KEY_PAGE_DOWN;
+      }
+    } else {
+      switch (seq[1]) {
+      case 'A':
+        return KEY_ARROW_UP;
+      case 'B':
+        return KEY_ARROW_DOWN;
+      case 'C':
+        return KEY_ARROW_RIGHT;
+      case 'D':
+        return KEY_ARROW_LEFT;
+      case 'F':
+        return KEY_END;
+      case 'H':
+        return KEY_HOME;
+      }
+    }
+  } else if (seq[0] == 'O') {
+    // 3rd byte
+    if (!read_byte(s, &seq[1])) {
+      return incomplete_key(s);
+    }
+
+    switch (seq[1]) {
+    case 'A':
+      return KEY_ARROW_UP;
+    case 'B':
+      return KEY_ARROW_DOWN;
+    case 'C':
+      return KEY_ARROW_RIGHT;
+    case 'D':
+      return KEY_ARROW_LEFT;
+    case 'F':
+      return KEY_END;
+    case 'H':
+      return KEY_HOME;
+    }
+  } else {
+    // ESC followed by a regular key is how terminals send Alt+<key>
+    return ALT_KEY((unsigned char)seq[0]);
+  }
+
+  return KEY_ESC;
+}
+
+/**
+ * reads the next byte of input, reading another chunk if all of the last one
+ * was used up.
+ *
+ * @param c where to store the byte
+ *
+ * @return `false` if there was nothing to read within 100ms (or ever, when
+ * headless, or right now, when the session can't wait), else `true`
+ */
+static bool read_byte(struct RLSession *s, char *c) {
+  if (s->input_pos == s->input_len &&
+      !(s->nonblocking ? fill_input_now(s) : fill_input(s))) {
+    return false;
+  }
+
+  *c = s->input[s->input_pos++];
+  return true;
+}
+
+/**
+ * reads another chunk of input, but only if it's there already, so it never
+ * waits. all of the previous chunk MUST be used up.
+ *
+ * @return `true` if more input was read, else `false`
+ */
+static bool read_more_input(struct RLSession *s) {
+  assert(s->input_pos == s->input_len);
+
+  struct pollfd pfd = {.fd = s->in_fd, .events = POLLIN};
+  if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLIN)) {
+    return false;
+  }
+
+  return fill_input(s);
+}
+
+/**
+ * reads the next chunk of input, replacing the last one.
+ *
+ * @return `false` if there was nothing to read within 100ms (or ever, when
+ * headless), else `true`
+ */
+static bool fill_input(struct RLSession *s) {
+  if (s->input == NULL) {
+    s->input = mem_alloc(&s->allocator, INPUT_CHUNK_SIZE);
+    if (s->input == NULL) {
+      die("failed to allocate input buffer");
+    }
+  }
+
+  ssize_t n = read(s->in_fd, s->input, INPUT_CHUNK_SIZE);
+  // a socket whose other end went away ends, like one that was closed
+  if (n == -1 && errno == ECONNRESET) {
+    n = 0;
+  }
+  // in Cygwin, when read() times out it returns -1 and sets errno
+  // to EAGAIN, instead of just returning 0
+  if (n == -1 && errno != EAGAIN && errno != EINTR) {
+    die("failed to read input");
+  }
+
+  if (n <= 0) {
+    return false;
+  }
+
+  s->input_len = n;
+  s->input_pos = 0;
+  s->key_start = 0;
+  s->input_read += n;
+
+  return true;
+}
+
+/**
+ * like `fill_input`, but it only reads if there's input already, so it never
+ * waits. the bytes of the key being read are kept at the front of the chunk,
+ * so a key that's split between two reads can be read again from its start
+ * (see `incomplete_key`).
+ *
+ * @return `true` if more input was read, else `false`. if `in_fd` is at EOF,
+ * `input_ended` is set too.
+ */
+static bool fill_input_now(struct RLSession *s) {
+  s->input_ended = false;
+
+  struct pollfd pfd = {.fd = s->in_fd, .events = POLLIN};
+  if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & (POLLIN | POLLHUP))) {
+    return false;
+  }
+
+  if (s->input == NULL) {
+    s->input = mem_alloc(&s->allocator, INPUT_CHUNK_SIZE);
+    if (s->input == NULL) {
+      die("failed to allocate input buffer");
+    }
+  }
+
+  size_t kept = s->input_len - s->key_start;
+  memmove(s->input, &s->input[s->key_start], kept);
+  s->key_start = 0;
+  s->input_len = kept;
+  s->input_pos = kept;
+
+  ssize_t n = read(s->in_fd, &s->input[kept], INPUT_CHUNK_SIZE - kept);
+  // a socket whose other end went away ends, like one that was closed
+  if (n == -1 && errno == ECONNRESET) {
+    n = 0;
+  }
+  if (n == -1 && errno != EAGAIN && errno != EINTR) {
+    die("failed to read input");
+  }
+
+  if (n <= 0) {
+    s->input_ended = n == 0;
+    return false;
+  }
+
+  s->input_len += n;
+  s->input_read += n;
+
+  return true;
+}
+
+/**
+ * what `read_key` returns when the input stops in the middle of an escape
+ * sequence: ESC, unless the rest of it can still come in without having been
+ * waited for, in which case the key is read again from its start next time.
+ */
+static int incomplete_key(struct RLSession *s) {
+  if (s->nonblocking && !s->input_ended && !s->key_expired) {
+    s->input_pos = s->key_start;
+    return KEY_INPUT_PENDING;
+  }
+
+  return KEY_ESC;
+}
+
+/**
+ * sends everything drawn so far to the terminal.
+ *
+ * @return `true` if it was written successfully, else `false`
+ */
+static bool flush_output(struct RLSession *s) {
+  return abuf_flush(&s->frame, s->out_fd);
+}
+
+/**
+ * to print an error message and exit the program with `EXIT_FAILURE`.
+ * it tries to disable raw mode if it was enabled.
+ *
+ * if `errno` is set, it prints the error message using `perror()`.
+ * otherwise, it prints the message directly using `fputs()`.
+ *
+ * @param msg the error message to print
+ */
+static void die(const char *msg) {
+  disable_raw_mode();
+
+  if (errno == 0) {
+    fputs(msg, stderr);
+    putchar('\n');
+  } else {
+    perror(msg);
+  }
+
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * uses the CPR (cursor position report) escape sequence to ask for the
+ * cursor position, which `read_cursor_position` reads the answer to.
+ *
+ * @return `true` if the question was sent, else `false`
+ */
+static bool request_cursor_position(struct RLSession *s) {
+  // along with whatever was drawn before it
+  return abuf_append(&s->frame, "\x1b[6n", 4) && flush_output(s);
+}
+
+/**
+ * reads the terminal's answer to `request_cursor_position`.
  *
  * @param row pointer to store the row where the cursor is
  * @param col pointer to store the column where the cursor is
@@ -493,134 +1759,1238 @@ static void die(const char *msg) {
  * @return `true` if the cursor position was successfully retrieved, else
  * `false`
  */
-static bool get_cursor_position(unsigned short *row, unsigned short *col) {
+static bool read_cursor_position(struct RLSession *s, unsigned short *row,
+                                 unsigned short *col) {
   assert(row != NULL);
   assert(col != NULL);
 
-  // write escape sequence to get the cursor position
-  if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4) {
-    return false;
+  // keys typed before the terminal answered, like the rest of a paste, come
+  // before the answer. they're left in the input for the editor, & only the
+  // answer is taken out of it.
+  size_t from = s->input_pos; // where the answer can start
+  while (true) {
+    for (; from < s->input_len; ++from) {
+      if (s->input[from] != KEY_ESC) {
+        continue;
+      }
+
+      size_t len = cursor_report_len(&s->input[from], s->input_len - from);
+      if (len == 0) {
+        break;
+      }
+      if (len == NOT_A_CURSOR_REPORT) {
+        continue;
+      }
+
+      if (sscanf(&s->input[from + 2], "%hu;%hu", row, col) != 2) {
+        return false;
+      }
+
+      memmove(&s->input[from], &s->input[from + len],
+              s->input_len - from - len);
+      s->input_len -= len;
+      s->input_read -= len;
+
+      return true;
+    }
+
+    // the rest of the answer is still to come. the keys before it are kept
+    // at the front of the chunk, unless they fill it up.
+    size_t kept_from = s->input_pos;
+    if (s->input_len - kept_from == INPUT_CHUNK_SIZE) {
+      return false;
+    }
+
+    s->key_start = kept_from;
+    struct pollfd pfd = {.fd = s->in_fd, .events = POLLIN};
+    if (poll(&pfd, 1, CURSOR_REPORT_TIMEOUT_MS) != 1 || !fill_input_now(s)) {
+      return false;
+    }
+
+    s->input_pos = 0;
+    from -= kept_from;
+  }
+}
+
+/**
+ * checks whether some input starts with a cursor position report, i.e.
+ * "ESC [ <row> ; <col> R".
+ *
+ * @param data the input, starting with ESC
+ * @param len its length
+ *
+ * @return the length of the report, 0 if the input could still turn out to
+ * be one, or `NOT_A_CURSOR_REPORT`
+ */
+static size_t cursor_report_len(const char *data, size_t len) {
+  // '0' stands for a number
+  const char *shape = "\x1b[0;0R";
+
+  size_t i = 0;
+  for (const char *c = shape; *c != '\0'; ++c) {
+    if (*c == '0') {
+      size_t digits_start = i;
+      while (i < len && isdigit((unsigned char)data[i])) {
+        ++i;
+      }
+      if (i == len) {
+        return 0;
+      }
+      if (i == digits_start) {
+        return NOT_A_CURSOR_REPORT;
+      }
+    } else if (i == len) {
+      return 0;
+    } else if (data[i++] != *c) {
+      return NOT_A_CURSOR_REPORT;
+    }
+  }
+
+  return i;
+}
+
+/**
+ * moves the cursor to the left by one character.
+ *
+ * @return `true` if the cursor was moved successfully, else `false`
+ */
+static bool move_cursor_left(struct RLSession *s) {
+  return abuf_append(&s->frame, "\x1b[D", 3);
+}
+
+/**
+ * moves the cursor to the right by one character.
+ *
+ * @return `true` if the cursor was moved successfully, else `false`
+ */
+static bool move_cursor_right(struct RLSession *s) {
+  return abuf_append(&s->frame, "\x1b[C", 3);
+}
+
+/**
+ * moves the cursor to the specified row and column.
+ *
+ * @param row the row to move the cursor to
+ * @param col the column to move the cursor to
+ *
+ * @return `true` if the cursor was moved successfully, else `false`
+ */
+static bool move_cursor_to(struct RLSession *s, unsigned short row,
+                           unsigned short col) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", row, col);
+  return abuf_append(&s->frame, buf, len);
+}
+
+/**
+ * repaints the whole line & puts the cursor where it belongs. it's only drawn
+ * into the frame, which is sent with a single `write()` once there are no more
+ * keys waiting to be processed, so the terminal never shows a half drawn line.
+ *
+ * @param l the line to repaint
+ *
+ * @return `true` if the line was repainted successfully, else `false`
+ */
+static bool refresh_line(struct LineState *l) {
+  struct RLSession *s = l->s;
+
+  if (l->suppress_render) {
+    return true;
+  }
+
+  char seq[32];
+  int seq_len;
+
+  // the frame isn't cleared here because something (like an OSC 52 sequence)
+  // may have been queued to go out along with the repaint
+
+  // move cursor back to the original position
+  seq_len = snprintf(seq, sizeof(seq), "\x1b[%d;%dH", l->cy, l->cx);
+  abuf_append(&s->frame, seq, seq_len);
+
+  // paint the line & clear whatever was left after it
+  abuf_append(&s->frame, l->buf, l->len);
+  abuf_append(&s->frame, "\x1b[K", 3);
+
+  // move the cursor to where it is in the line
+  seq_len = snprintf(seq, sizeof(seq), "\x1b[%d;%zuH", l->cy, l->cx + l->pos);
+  return abuf_append(&s->frame, seq, seq_len);
+}
+
+/**
+ * like `refresh_line`, but only repaints the line from `from` on. that's all
+ * an edit that leaves the text before `from` alone has to repaint, so typing
+ * or deleting at the end of a long line doesn't repaint all of it.
+ *
+ * @param l the line to repaint
+ * @param from index of the first character to repaint
+ *
+ * @return `true` if the line was repainted successfully, else `false`
+ */
+static bool refresh_tail(struct LineState *l, size_t from) {
+  struct RLSession *s = l->s;
+
+  if (l->suppress_render) {
+    return true;
+  }
+
+  if (!move_cursor_to(l->s, l->cy, l->cx + from) ||
+      !abuf_append(&s->frame, &l->buf[from], l->len - from) ||
+      !abuf_append(&s->frame, "\x1b[K", 3)) {
+    return false;
+  }
+
+  // the cursor is already at the end of the line
+  if (l->pos == l->len) {
+    return true;
+  }
+
+  return move_cursor_to(l->s, l->cy, l->cx + l->pos);
+}
+
+/**
+ * redraws the prompt with the latest values of its segments, then the line
+ * after it, since the prompt's width may have changed.
+ *
+ * @param l the line being edited
+ *
+ * @return `true` if the prompt was redrawn successfully, else `false`
+ */
+static bool redraw_prompt(struct LineState *l) {
+  struct RLSession *s = l->s;
+
+  s->prompt_generation = segments_generation(segments);
+
+  abuf_clear(&s->prompt_buf);
+  if (l->prompt == NULL ||
+      !segments_render(segments, l->prompt, &s->prompt_buf)) {
+    return false;
+  }
+
+  // move to where the prompt starts & draw it over the old one
+  char seq[32];
+  int seq_len = snprintf(seq, sizeof(seq), "\x1b[%d;%dH", l->cy, l->prompt_col);
+  abuf_append(&s->frame, seq, seq_len);
+  abuf_append(&s->frame, s->prompt_buf.data, s->prompt_buf.len);
+
+  // the line starts right after the prompt
+  l->cx = l->prompt_col + display_width(s->prompt_buf.data, s->prompt_buf.len);
+
+  return refresh_line(l);
+}
+
+/**
+ * the number of columns `s` takes up on the screen. escape sequences take up
+ * none, and neither do UTF-8 continuation bytes.
+ *
+ * @param s the text to measure
+ * @param len the length of the text
+ */
+static size_t display_width(const char *s, size_t len) {
+  size_t width = 0;
+
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char c = s[i];
+
+    if (c == KEY_ESC && i + 1 < len && s[i + 1] == '[') {
+      // skip to the final byte of the CSI sequence
+      for (i += 2; i < len && !(s[i] >= 0x40 && s[i] <= 0x7e); ++i) {
+      }
+      continue;
+    }
+
+    if ((c & 0xc0) != 0x80) {
+      ++width;
+    }
+  }
+
+  return width;
+}
+
+/**
+ * inserts `len` characters at the cursor & moves the cursor after them. if the
+ * line doesn't have room for all of them, the text is cut short. it doesn't
+ * repaint the line.
+ *
+ * @param l the line to insert into
+ * @param text the text to insert
+ * @param len the length of the text
+ */
+static void insert_text(struct LineState *l, const char *text, size_t len) {
+  size_t room = l->buf_size - 1 - l->len;
+  if (len > room) {
+    len = room;
+  }
+
+  // the line is thrown away once the command is done (see `edit_line`)
+  if (l->rejected || !fit_in_budget(l, len)) {
+    l->rejected = true;
+    return;
+  }
+
+  if (!reserve_line(l, len)) {
+    die("failed to make room in the line");
+  }
+
+  // move characters after the cursor (including the null terminator) out of
+  // the way
+  memmove(&l->buf[l->pos + len], &l->buf[l->pos], l->len - l->pos + 1);
+  memcpy(&l->buf[l->pos], text, len);
+
+  l->len += len;
+  l->pos += len;
+}
+
+/**
+ * like `delete_range`, but the deleted text is saved in the kill ring. if the
+ * previous command was a kill as well, the text is merged with that kill.
+ *
+ * if clipboard export is enabled, the kill is also queued as an OSC 52
+ * sequence, to go out with the next repaint.
+ *
+ * @param l the line to kill from
+ * @param from index of the first character to kill
+ * @param to index just after the last character to kill
+ * @param prev_cmd the command before this one
+ */
+static void kill_range(struct LineState *l, size_t from, size_t to,
+                       enum LastCommand prev_cmd) {
+  struct RLSession *s = l->s;
+
+  assert(from <= to);
+
+  l->last_cmd = LAST_KILL;
+
+  if (from == to) {
+    return;
+  }
+
+  if (s->kill_ring == NULL) {
+    s->kill_ring = killring_init_with(0, &s->allocator);
+    if (s->kill_ring == NULL) {
+      die("failed to allocate kill ring");
+    }
+  }
+
+  // killing text before the cursor goes in front of the previous kill
+  bool backward = from < l->pos;
+
+  bool saved = prev_cmd == LAST_KILL
+                   ? killring_extend(s->kill_ring, &l->buf[from], to - from,
+                                     backward)
+                   : killring_push(s->kill_ring, &l->buf[from], to - from);
+  if (!saved) {
+    die("failed to save killed text");
+  }
+
+  delete_range(l, from, to);
+
+  if (clipboard_export) {
+    size_t len;
+    const char *text = killring_yank(s->kill_ring, &len);
+
+    // ESC ] 52 ; c ; <base64 of the text> BEL
+    if (!abuf_append(&s->frame, "\x1b]52;c;", 7) ||
+        !base64_encode_append(&s->frame, text, len) ||
+        !abuf_append(&s->frame, "\a", 1)) {
+      die("failed to copy killed text to clipboard");
+    }
+  }
+}
+
+/**
+ * inserts yanked text at the cursor & remembers where it went, for Alt+Y.
+ *
+ * @param l the line to yank into
+ * @param text the text from the kill ring
+ * @param len the length of the text
+ */
+static void yank(struct LineState *l, const char *text, size_t len) {
+  l->yank_start = l->pos;
+  insert_text(l, text, len);
+  l->yank_end = l->pos;
+
+  l->last_cmd = LAST_YANK;
+}
+
+/**
+ * deletes the characters in [from, to) from the line & puts the cursor at
+ * `from`. it doesn't repaint the line.
+ *
+ * @param l the line to delete from
+ * @param from index of the first character to delete
+ * @param to index just after the last character to delete
+ */
+static void delete_range(struct LineState *l, size_t from, size_t to) {
+  assert(from <= to);
+  assert(to <= l->len);
+
+  // move characters after the range (including the null terminator) over it
+  memmove(&l->buf[from], &l->buf[to], l->len - to + 1);
+
+  l->len -= to - from;
+  l->pos = from;
+}
+
+/**
+ * adds a new, empty line to the end of the history.
+ *
+ * @param s the session
+ *
+ * @return `true` if the line was added to the history successfully, else
+ * `false`
+ */
+static bool add_to_history(struct RLSession *s) {
+  // initialize the history vector if it's not already initialized
+  if (s->history == NULL) {
+    s->history =
+        vector_init_with(sizeof(struct HistoryEntry), 0, &s->allocator);
+    if (s->history == NULL) {
+      return false;
+    }
+  }
+
+  struct HistoryEntry entry = {
+      .line = mem_alloc(&s->allocator, 1),
+      .len = 0,
+      .capacity = 1,
+  };
+  if (entry.line == NULL) {
+    return false;
+  }
+
+  entry.line[0] = '\0';
+
+  if (!vector_push(s->history, &entry)) {
+    mem_free(&s->allocator, entry.line, entry.capacity);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * makes sure the history entry being edited has room for `extra` more
+ * characters. it grows geometrically, up to the size of a full line, so
+ * typing a long line stays linear.
+ *
+ * @param l the line being edited
+ * @param extra the number of characters about to be inserted. the line MUST
+ * have room for them.
+ *
+ * @return `true` if there's room, `false` if memory allocation fails
+ */
+static bool reserve_line(struct LineState *l, size_t extra) {
+  struct RLSession *s = l->s;
+
+  struct HistoryEntry *entry = vector_get(s->history, s->history_index);
+  size_t needed = l->len + extra + 1;
+  if (entry->capacity >= needed) {
+    return true;
+  }
+
+  size_t capacity = entry->capacity * 2;
+  if (capacity < LINE_MIN_CAPACITY) {
+    capacity = LINE_MIN_CAPACITY;
+  }
+  if (capacity < needed) {
+    capacity = needed;
+  }
+  if (capacity > l->buf_size) {
+    capacity = l->buf_size;
+  }
+
+  // no more room than the memory budget has left (see `fit_in_budget`)
+  if (s->memory_budget != 0 && capacity > needed &&
+      s->memory_used + (capacity - entry->capacity) > s->memory_budget) {
+    capacity = needed;
+  }
+
+  char *line = mem_realloc(&s->allocator, entry->line, entry->capacity,
+                           capacity);
+  if (line == NULL) {
+    return false;
+  }
+
+  entry->line = line;
+  entry->capacity = capacity;
+  l->buf = line;
+
+  return true;
+}
+
+/**
+ * saves the line being edited in its history entry & shrinks the entry to fit
+ * the line, before moving to another one (or returning it).
+ *
+ * @param l the line being edited
+ */
+static void leave_history_entry(struct LineState *l) {
+  struct RLSession *s = l->s;
+
+  struct HistoryEntry *entry = vector_get(s->history, s->history_index);
+  entry->len = l->len;
+  entry->line[l->len] = '\0';
+
+  if (entry->capacity > l->len + 1) {
+    char *line = mem_realloc(&s->allocator, entry->line, entry->capacity,
+                             l->len + 1);
+    if (line != NULL) {
+      entry->line = line;
+      entry->capacity = l->len + 1;
+    }
+  }
+
+  l->buf = entry->line;
+}
+
+/**
+ * makes sure the line being edited can grow by `extra` characters within the
+ * session's memory budget, evicting the oldest lines of the history (the ones
+ * before the line) to make room if it has to.
+ *
+ * @param l the line being edited
+ * @param extra the number of characters about to be inserted
+ *
+ * @return `true` if the line fits, `false` if it doesn't even without them
+ */
+static bool fit_in_budget(struct LineState *l, size_t extra) {
+  struct RLSession *s = l->s;
+
+  // evicting moves the entry, so only its capacity is kept
+  struct HistoryEntry *entry = vector_get(s->history, s->history_index);
+  size_t capacity = entry->capacity;
+  size_t needed = l->len + extra + 1;
+  if (s->memory_budget == 0 || capacity >= needed) {
+    return true;
+  }
+
+  size_t wanted = s->memory_used + (needed - capacity);
+  if (wanted > s->memory_budget) {
+    evict_history(s, wanted - s->memory_budget, s->history_index);
+  }
+
+  return s->memory_used + (needed - capacity) <= s->memory_budget;
+}
+
+/**
+ * drops the line being edited once it outgrew the session's memory budget.
+ * it's emptied, freeing its memory, & the terminal's bell is rung. the rest of
+ * it is skipped by `edit_line`.
+ *
+ * @param l the line being edited, with `rejected` set
+ * @param action what the command that outgrew the budget returned
+ *
+ * @return what `rl_read_line` should do next
+ */
+static enum KeyAction reject_line(struct LineState *l, enum KeyAction action) {
+  struct RLSession *s = l->s;
+
+  ++s->lines_rejected;
+
+  l->len = 0;
+  l->pos = 0;
+  leave_history_entry(l);
+
+  // ENTER (from a macro) already moved past the line
+  if (action == ACTION_ACCEPT) {
+    return ACTION_REJECT;
   }
 
-  char res[16]; // stores response form CPR (cursor position report)
-  size_t i;
-  for (i = 0; i < sizeof(res) - 1; ++i) {
-    if (read(STDIN_FILENO, &res[i], 1) != 1 || res[i] == 'R') {
-      break;
-    }
+  if (!refresh_line(l) || !abuf_append(&s->frame, "\a", 1)) {
+    die("failed to repaint line (rejected)");
   }
 
-  res[i] = '\0';
+  return action;
+}
 
-  if (res[0] != '\x1b' || res[1] != '[') {
-    return false;
+/**
+ * brings a session that went over its memory budget back within it once a
+ * line is read: first by freeing what it can do without, then by evicting the
+ * oldest lines of its history. the line just read is kept.
+ *
+ * @param s the session, between lines
+ */
+static void trim_to_budget(struct RLSession *s) {
+  if (s->memory_budget == 0 || s->memory_used <= s->memory_budget) {
+    return;
   }
 
-  if (sscanf(&res[2], "%hu;%hu", row, col) != 2) {
-    return false;
+  rl_session_compact(s);
+  if (s->memory_used > s->memory_budget && s->history != NULL &&
+      vector_length(s->history) > 0) {
+    evict_history(s, s->memory_used - s->memory_budget,
+                  vector_length(s->history) - 1);
   }
-
-  return true;
 }
 
 /**
- * moves the cursor to the left by one character.
+ * evicts the oldest lines of the history until `bytes` bytes are freed, or
+ * it gets to the line at `end`.
  *
- * @return `true` if the cursor was moved successfully, else `false`
+ * @param s the session
+ * @param bytes how many bytes to free
+ * @param end the index of the first line to keep
  */
-static bool move_cursor_left(void) {
-  return write(STDOUT_FILENO, "\x1b[D", 3) == 3;
+static void evict_history(struct RLSession *s, size_t bytes, size_t end) {
+  size_t freed = 0;
+  size_t count = 0;
+
+  while (count < end && freed < bytes) {
+    struct HistoryEntry *entry = vector_get(s->history, count);
+    mem_free(&s->allocator, entry->line, entry->capacity);
+    freed += entry->capacity;
+    ++count;
+  }
+
+  // all at once, so evicting many lines moves the rest of them once
+  vector_remove(s->history, 0, count);
+  s->history_index -= count <= s->history_index ? count : s->history_index;
+  s->history_evicted += count;
 }
 
 /**
- * moves the cursor to the right by one character.
+ * compiles the keymap of every mode & makes emacs mode the default one.
  *
- * @return `true` if the cursor was moved successfully, else `false`
+ * @return `true` if the keymaps were compiled successfully, else `false`
  */
-static bool move_cursor_right(void) {
-  return write(STDOUT_FILENO, "\x1b[C", 3) == 3;
+static bool init_keymaps(void) {
+  for (int id = 0; id < NUM_KEYMAPS; ++id) {
+    keymaps[id] = keymap_init(id);
+    if (keymaps[id] == NULL) {
+      return false;
+    }
+  }
+
+  default_keymap = keymaps[KEYMAP_EMACS];
+
+  return true;
 }
 
 /**
- * moves the cursor to the specified row and column.
+ * does what starting up leaves until the first prompt is on the screen: runs
+ * the hook set with `rl_at_first_prompt`, starts updating the prompt's
+ * segments, & compiles the keymaps unless the config already needed them.
+ * it runs while the terminal answers the first cursor position query, so
+ * none of it delays the prompt, & all of it is done before the first key.
+ */
+static void finish_startup(void) {
+  started_up = true;
+
+  if (startup_fn != NULL) {
+    startup_fn(startup_ctx);
+  }
+
+  if (segments != NULL && !segments_start(segments)) {
+    die("failed to start prompt segments");
+  }
+
+  if (default_keymap == NULL && !init_keymaps()) {
+    die("failed to initialize keymaps");
+  }
+}
+
+/**
+ * makes a new session, in the default editing mode.
  *
- * @param row the row to move the cursor to
- * @param col the column to move the cursor to
+ * @param in_fd where keys are read from
+ * @param out_fd where the line is drawn to
+ * @param headless whether `in_fd` is read without treating it as a terminal
+ * @param allocator allocates all of the session's memory, or NULL for
+ * malloc(). it's copied.
  *
- * @return `true` if the cursor was moved successfully, else `false`
+ * @return the session, or NULL if memory allocation fails
  */
-static bool move_cursor_to(unsigned short row, unsigned short col) {
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", row, col);
-  return write(STDOUT_FILENO, buf, strlen(buf)) == strlen(buf);
+static struct RLSession *session_init(int in_fd, int out_fd, bool headless,
+                                      const struct Allocator *allocator) {
+  struct RLSession *s = mem_calloc(allocator, 1, sizeof(struct RLSession));
+  if (s == NULL) {
+    return NULL;
+  }
+
+  if (allocator != NULL) {
+    s->backing = *allocator;
+  } else {
+    s->backing = (struct Allocator){.fn = default_alloc, .ctx = NULL};
+  }
+
+  // everything else is counted as it's allocated
+  s->allocator = (struct Allocator){.fn = count_alloc, .ctx = s};
+  s->memory_used = sizeof(struct RLSession);
+
+  s->in_fd = in_fd;
+  s->out_fd = out_fd;
+  s->headless = headless;
+
+  s->burst = (struct AppendBuffer)ABUF_INIT;
+  s->burst.allocator = &s->allocator;
+  s->frame = (struct AppendBuffer)ABUF_INIT;
+  s->frame.allocator = &s->allocator;
+  s->prompt_buf = (struct AppendBuffer)ABUF_INIT;
+  s->prompt_buf.allocator = &s->allocator;
+  s->pasted = (struct AppendBuffer)ABUF_INIT;
+  s->pasted.allocator = &s->allocator;
+
+  // NULL until the keymaps are compiled, after the first prompt is drawn
+  s->keymap = default_keymap;
+  s->max_line_len = RL_DEFAULT_MAX_LINE_LEN;
+
+  return s;
 }
 
-static bool repaint_line(unsigned short orig_cy, unsigned short orig_cx,
-                         const char *line, size_t len) {
-  // move cursor back to the original position
-  if (!move_cursor_to(orig_cy, orig_cx)) {
-    die("repaint_line: failed to move cursor");
+/**
+ * frees a session & everything in it.
+ *
+ * @param s the session to free
+ */
+static void session_free(struct RLSession *s) {
+  // a line was left half read, with the terminal in raw mode
+  if (s->reading && raw_mode_enabled && raw_fd == s->in_fd) {
+    disable_raw_mode();
+  }
+
+  if (s->history != NULL) {
+    // free all the lines in the history
+    size_t history_len = vector_length(s->history);
+
+    for (size_t i = 0; i < history_len; ++i) {
+      struct HistoryEntry *entry = vector_get(s->history, i);
+      mem_free(&s->allocator, entry->line, entry->capacity);
+    }
+
+    vector_free(s->history);
+  }
+
+  if (s->kill_ring != NULL) {
+    killring_free(s->kill_ring);
+  }
+
+  if (s->macro != NULL) {
+    vector_free(s->macro);
   }
 
-  // clear the line
-  if (write(STDOUT_FILENO, "\x1b[K", 3) != 3) {
-    die("repaint_line: failed to clear line");
+  if (s->batch != NULL) {
+    vector_free(s->batch);
   }
 
-  // repaint the line
-  return write(STDOUT_FILENO, line, len) == len;
+  abuf_free(&s->frame);
+  abuf_free(&s->prompt_buf);
+  abuf_free(&s->burst);
+  abuf_free(&s->pasted);
+
+  mem_free(&s->allocator, s->input, INPUT_CHUNK_SIZE);
+
+  // the allocator is freed along with the session, so it's copied out first
+  struct Allocator allocator = s->backing;
+  mem_free(&allocator, s, sizeof(struct RLSession));
 }
 
 /**
- * adds the buffer to the history.
- *
- * @param buf the line to add to the history. must be null-terminated.
- * @param buf_size the size of the buffer. memory will be allocated based on
- * this size.
- *
- * @return `true` if the line was added to the history successfully, else
- * `false`
+ * gets the session `rl_read_line` uses, making it the first time around.
+ */
+static struct RLSession *get_default_session(void) {
+  if (default_session == NULL) {
+    default_session = session_init(STDIN_FILENO, STDOUT_FILENO, false, NULL);
+    if (default_session == NULL) {
+      die("failed to initialize the editor");
+    }
+  }
+
+  return default_session;
+}
+
+/*
+ * a session's allocator when it isn't given one
+ */
+static void *default_alloc(void *ctx, void *ptr, size_t old_size,
+                           size_t new_size) {
+  if (new_size == 0) {
+    free(ptr);
+    return NULL;
+  }
+
+  return realloc(ptr, new_size);
+}
+
+/*
+ * the allocator every session allocates with: the session's own, counting
+ * how much of it the session is using
  */
-static bool add_to_history(const char *buf, size_t buf_size) {
+static void *count_alloc(void *ctx, void *ptr, size_t old_size,
+                         size_t new_size) {
+  struct RLSession *s = ctx;
+
+  void *block = s->backing.fn(s->backing.ctx, ptr, old_size, new_size);
+  if (new_size == 0) {
+    s->memory_used -= ptr != NULL ? old_size : 0;
+  } else if (block != NULL) {
+    s->memory_used += new_size - (ptr != NULL ? old_size : 0);
+  }
+
+  return block;
+}
+
+enum ReadLineResult rl_read_line(char *buf, size_t buf_size, char *prompt) {
   assert(buf != NULL);
+  assert(buf_size > 0);
 
-  // initialize the history vector if it's not already initialized
-  if (history == NULL) {
-    history = vector_init(sizeof(char *), 0);
+  struct RLSession *s = get_default_session();
+
+  enum ReadLineResult result = read_line(s, prompt, buf_size);
+  if (result != RL_SUCCESS) {
+    return result;
+  }
+
+  // the line is the last one in the history
+  struct HistoryEntry *last =
+      vector_get(s->history, vector_length(s->history) - 1);
+  memcpy(buf, last->line, last->len + 1);
+
+  return RL_SUCCESS;
+}
+
+enum ReadLineResult rl_read_lines(size_t max_len, const char *prompt,
+                                  const struct RLLine **lines, size_t *count) {
+  assert(lines != NULL);
+  assert(count != NULL);
+
+  struct RLSession *s = get_default_session();
+
+  enum ReadLineResult result = read_lines(s, prompt, max_len + 1);
+  if (result != RL_SUCCESS) {
+    return result;
+  }
+
+  *lines = vector_data(s->batch);
+  *count = vector_length(s->batch);
+
+  return RL_SUCCESS;
+}
+
+struct RLSession *rl_session_init(int in_fd, int out_fd, size_t max_line_len,
+                                  RLAllocFn alloc, void *alloc_ctx) {
+  struct Allocator allocator = {.fn = alloc, .ctx = alloc_ctx};
+
+  struct RLSession *s = session_init(in_fd, out_fd, !isatty(in_fd),
+                                     alloc != NULL ? &allocator : NULL);
+  if (s == NULL) {
+    return NULL;
+  }
+
+  if (max_line_len > 0) {
+    s->max_line_len = max_line_len;
+  }
+
+  return s;
+}
+
+void rl_session_free(struct RLSession *session) {
+  assert(session != NULL);
+
+  session_free(session);
+}
+
+enum ReadLineResult rl_session_read_line(struct RLSession *session,
+                                         const char *prompt, const char **line,
+                                         size_t *len) {
+  assert(session != NULL);
+  assert(line != NULL);
+  assert(len != NULL);
+
+  enum ReadLineResult result =
+      read_line(session, prompt, session->max_line_len + 1);
+  if (result != RL_SUCCESS) {
+    return result;
+  }
+
+  // the line is the last one in the history
+  struct HistoryEntry *last =
+      vector_get(session->history, vector_length(session->history) - 1);
+  *line = last->line;
+  *len = last->len;
+
+  return RL_SUCCESS;
+}
+
+enum ReadLineResult rl_session_read_lines(struct RLSession *session,
+                                          const char *prompt,
+                                          const struct RLLine **lines,
+                                          size_t *count) {
+  assert(session != NULL);
+  assert(lines != NULL);
+  assert(count != NULL);
+
+  enum ReadLineResult result =
+      read_lines(session, prompt, session->max_line_len + 1);
+  if (result != RL_SUCCESS) {
+    return result;
+  }
+
+  *lines = vector_data(session->batch);
+  *count = vector_length(session->batch);
+
+  return RL_SUCCESS;
+}
+
+enum ReadLineResult rl_session_try_read_line(struct RLSession *session,
+                                             const char *prompt,
+                                             const char **line, size_t *len) {
+  assert(session != NULL);
+  assert(line != NULL);
+  assert(len != NULL);
+
+  if (!session->reading) {
+    begin_line(session, prompt, session->max_line_len + 1);
   }
 
-  // allocate memory for the line copy
-  char *line_copy = malloc(buf_size);
-  if (line_copy == NULL) {
+  return continue_line(session, line, len);
+}
+
+bool rl_session_key_incomplete(const struct RLSession *session) {
+  assert(session != NULL);
+
+  // `incomplete_key` leaves the input at the start of the key
+  return session->reading && session->input_pos < session->input_len;
+}
+
+enum ReadLineResult rl_session_expire_key(struct RLSession *session,
+                                          const char **line, size_t *len) {
+  assert(session != NULL);
+  assert(session->reading);
+  assert(line != NULL);
+  assert(len != NULL);
+
+  session->key_expired = true;
+  enum ReadLineResult result = continue_line(session, line, len);
+  session->key_expired = false;
+
+  return result;
+}
+
+bool rl_session_prompt_outdated(const struct RLSession *session) {
+  assert(session != NULL);
+
+  return session->reading && segments != NULL &&
+         segments_generation(segments) != session->prompt_generation;
+}
+
+void rl_session_cancel_line(struct RLSession *session) {
+  assert(session != NULL);
+
+  if (!session->reading) {
+    return;
+  }
+
+  // dropped like an empty line ended with Ctrl+D, on a line of its own
+  if (!abuf_append(&session->frame, "\r\n", 2)) {
+    die("failed to write to terminal (cancelling line)");
+  }
+  end_line(session, ACTION_EOF);
+}
+
+size_t rl_session_compact(struct RLSession *session) {
+  assert(session != NULL);
+
+  size_t freed = 0;
+
+  // unless it holds the start of a key that was cut off
+  if (session->input != NULL && session->input_pos == session->input_len) {
+    mem_free(&session->allocator, session->input, INPUT_CHUNK_SIZE);
+    session->input = NULL;
+    session->input_len = 0;
+    session->input_pos = 0;
+    session->key_start = 0;
+    freed += INPUT_CHUNK_SIZE;
+  }
+
+  // the render buffers are only used while keys are handled. the prompt is
+  // rendered again whenever it's redrawn.
+  struct AppendBuffer *buffers[] = {&session->burst, &session->frame,
+                                    &session->prompt_buf, &session->pasted};
+  for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i) {
+    if (buffers[i]->len == 0) {
+      freed += buffers[i]->capacity;
+      abuf_free(buffers[i]);
+    }
+  }
+
+  // the line being edited has room to grow, the rest of the history doesn't
+  if (session->reading) {
+    struct LineState *l = &session->line;
+    struct HistoryEntry *entry =
+        vector_get(session->history, session->history_index);
+
+    if (entry->capacity > l->len + 1) {
+      char *line = mem_realloc(&session->allocator, entry->line,
+                               entry->capacity, l->len + 1);
+      if (line != NULL) {
+        freed += entry->capacity - (l->len + 1);
+        entry->line = line;
+        entry->capacity = l->len + 1;
+        l->buf = line;
+      }
+    }
+  }
+
+  freed += vector_shrink(session->history);
+  if (session->macro != NULL) {
+    freed += vector_shrink(session->macro);
+  }
+  if (session->batch != NULL) {
+    freed += vector_shrink(session->batch);
+  }
+
+  return freed;
+}
+
+bool rl_session_pending_line(const struct RLSession *session,
+                             struct RLLineView *view) {
+  assert(session != NULL);
+  assert(view != NULL);
+
+  if (!session->reading) {
+    return false;
+  }
+
+  const struct LineState *l = &session->line;
+  *view = (struct RLLineView){
+      .prompt = session->prompt_buf.data != NULL ? session->prompt_buf.data
+                                                 : "",
+      .prompt_len = session->prompt_buf.len,
+      .prompt_width = l->cx - l->prompt_col,
+      .line = l->buf,
+      .len = l->len,
+      .pos = l->pos,
+  };
+
+  return true;
+}
+
+uint64_t rl_session_input_handled(const struct RLSession *session) {
+  assert(session != NULL);
+
+  // the rest of the chunk, including a key that was cut off, is still to come
+  return session->input_read - (session->input_len - session->input_pos);
+}
+
+void rl_session_set_memory_budget(struct RLSession *session, size_t budget) {
+  assert(session != NULL);
+
+  session->memory_budget = budget;
+
+  // a line that's being read is checked as it grows
+  if (!session->reading) {
+    trim_to_budget(session);
+  }
+}
+
+void rl_session_stats(const struct RLSession *session,
+                      struct RLSessionStats *stats) {
+  assert(session != NULL);
+  assert(stats != NULL);
+
+  *stats = (struct RLSessionStats){
+      .memory_used = session->memory_used,
+      .memory_budget = session->memory_budget,
+      .history_len =
+          session->history != NULL ? vector_length(session->history) : 0,
+      .history_evicted = session->history_evicted,
+      .lines_rejected = session->lines_rejected,
+  };
+}
+
+const char *rl_session_history_line(const struct RLSession *session,
+                                    size_t index, size_t *len) {
+  assert(session != NULL);
+  assert(len != NULL);
+
+  if (session->history == NULL || index >= vector_length(session->history)) {
+    return NULL;
+  }
+
+  const struct HistoryEntry *entry = vector_get(session->history, index);
+  *len = entry->len;
+
+  return entry->line;
+}
+
+void rl_stats(struct RLSessionStats *stats) {
+  rl_session_stats(get_default_session(), stats);
+}
+
+const char *rl_history_line(size_t index, size_t *len) {
+  return rl_session_history_line(get_default_session(), index, len);
+}
+
+void rl_set_clipboard_export(bool enabled) { clipboard_export = enabled; }
+
+bool rl_load_config(const char *path) {
+  assert(path != NULL);
+
+  if (default_keymap == NULL && !init_keymaps()) {
+    die("failed to initialize keymaps");
+  }
+
+  char cache_path[4096];
+  bool cached = config_cache_path(path, cache_path, sizeof(cache_path));
+
+  struct Config *config = config_load(path, cached ? cache_path : NULL);
+  if (config == NULL) {
     return false;
   }
 
-  // copy the line to the allocated memory
-  memcpy(line_copy, buf, buf_size);
+  size_t num_ops;
+  const struct ConfigOp *ops = config_ops(config, &num_ops);
+
+  for (size_t i = 0; i < num_ops; ++i) {
+    const struct ConfigOp *op = &ops[i];
+
+    switch (op->type) {
+    case CONFIG_OP_BIND: {
+      // the cache is trusted to be ours, but not to be intact
+      if (op->keymap >= NUM_KEYMAPS || op->command >= NUM_COMMANDS ||
+          op->command == CMD_PREFIX || op->num_keys > MAX_KEYSEQ_LEN) {
+        break;
+      }
+
+      int keys[MAX_KEYSEQ_LEN];
+      for (size_t k = 0; k < op->num_keys; ++k) {
+        keys[k] = op->keys[k];
+      }
+
+      keymap_bind(keymaps[op->keymap], keys, op->num_keys, op->command);
+      break;
+    }
+
+    case CONFIG_OP_EDITING_MODE:
+      if (op->value < NUM_KEYMAPS) {
+        rl_set_editing_mode(op->value == KEYMAP_EMACS ? RL_MODE_EMACS
+                                                      : RL_MODE_VI);
+      }
+      break;
+
+    case CONFIG_OP_CLIPBOARD_EXPORT:
+      clipboard_export = op->value != 0;
+      break;
+    }
+  }
 
-  // add the pointer to the line copy to the history vector
-  vector_push(history, &line_copy);
+  config_free(config);
 
   return true;
 }
 
-void rl_cleanup(void) {
-  if (history != NULL) {
-    // free all the lines in the history
-    size_t history_len = vector_length(history);
+void rl_set_editing_mode(enum ReadLineEditingMode mode) {
+  if (default_keymap == NULL && !init_keymaps()) {
+    die("failed to initialize keymaps");
+  }
 
-    for (size_t i = 0; i < history_len; ++i) {
-      char *alloced_str = *((char **)vector_get(history, i));
-      free(alloced_str);
+  default_keymap =
+      keymaps[mode == RL_MODE_VI ? KEYMAP_VI_INSERT : KEYMAP_EMACS];
+
+  // the editor `rl_read_line` uses switches right away
+  if (default_session != NULL) {
+    default_session->keymap = default_keymap;
+  }
+}
+
+bool rl_bind_key(const char *keymap_name, const char *keyseq,
+                 const char *command) {
+  assert(keyseq != NULL);
+  assert(command != NULL);
+
+  if (default_keymap == NULL && !init_keymaps()) {
+    die("failed to initialize keymaps");
+  }
+
+  enum KeymapId id = keymap_id(default_keymap);
+  if (keymap_name != NULL && !keymap_id_from_name(keymap_name, &id)) {
+    return false;
+  }
+
+  enum EditCommand cmd = command_from_name(command);
+  if (cmd == CMD_NONE) {
+    return false;
+  }
+
+  int keys[MAX_KEYSEQ_LEN];
+  size_t num_keys = keymap_parse_keyseq(keyseq, keys, MAX_KEYSEQ_LEN);
+  if (num_keys == 0) {
+    return false;
+  }
+
+  return keymap_bind(keymaps[id], keys, num_keys, cmd);
+}
+
+bool rl_add_prompt_segment(const char *name, RLPromptSegmentFn fn, void *ctx,
+                           unsigned int ttl_ms) {
+  assert(name != NULL);
+  assert(fn != NULL);
+
+  if (segments == NULL) {
+    segments = segments_init();
+    if (segments == NULL) {
+      return false;
     }
+  }
+
+  if (!segments_add(segments, name, fn, ctx, ttl_ms)) {
+    return false;
+  }
+
+  // added after the first prompt, so nothing else starts them
+  return !started_up || segments_start(segments);
+}
 
-    // free the history vector
-    vector_free(history);
+void rl_at_first_prompt(RLStartupFn fn, void *ctx) {
+  if (started_up) {
+    if (fn != NULL) {
+      fn(ctx);
+    }
+    return;
   }
 
+  startup_fn = fn;
+  startup_ctx = ctx;
+}
+
+void rl_set_headless(int in, int out) {
+  assert(!raw_mode_enabled);
+
+  struct RLSession *s = get_default_session();
+  s->in_fd = in;
+  s->out_fd = out;
+  s->headless = true;
+
+  // whatever was read from the previous input is dropped
+  s->input_len = 0;
+  s->input_pos = 0;
+}
+
+void rl_cleanup(void) {
   // in case the raw mode was left enabled, disable it
   // should not happen ideally, but just in case
-  if (raw_mode_enabled) {
-    disable_raw_mode();
+  disable_raw_mode();
+
+  if (default_session != NULL) {
+    session_free(default_session);
+    default_session = NULL;
+  }
+
+  if (segments != NULL) {
+    segments_free(segments);
+    segments = NULL;
   }
+
+  for (int id = 0; id < NUM_KEYMAPS; ++id) {
+    if (keymaps[id] != NULL) {
+      keymap_free(keymaps[id]);
+      keymaps[id] = NULL;
+    }
+  }
+  default_keymap = NULL;
+
+  started_up = false;
+  startup_fn = NULL;
+  startup_ctx = NULL;
 }
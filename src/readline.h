@@ -3,6 +3,11 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * the result of calling `rl_read_line` function.
@@ -16,6 +21,21 @@ enum ReadLineResult {
 
   // user pressed Ctrl+C (SIGINT)
   RL_SIGINT,
+
+  // the line isn't complete yet (only from `rl_session_try_read_line`)
+  RL_PENDING,
+
+  // the line didn't fit in the session's memory budget, so it was dropped
+  // (see `rl_session_set_memory_budget`)
+  RL_OVER_BUDGET,
+};
+
+/**
+ * the editing modes `rl_read_line` supports.
+ */
+enum ReadLineEditingMode {
+  RL_MODE_EMACS,
+  RL_MODE_VI,
 };
 
 /**
@@ -31,6 +51,146 @@ enum ReadLineResult {
  */
 enum ReadLineResult rl_read_line(char *buf, size_t buf_size, char *prompt);
 
+/**
+ * a line read by `rl_read_lines`. it points into the history.
+ */
+struct RLLine {
+  const char *line; // null-terminated
+  size_t len;
+};
+
+/**
+ * reads a line from the terminal like `rl_read_line`, along with every
+ * complete line of a paste that follows it, so a paste of many lines is read
+ * in one call: the raw mode is entered once, & the lines are drawn at once &
+ * added to the history at once. a pasted line that needs the editor (e.g.
+ * for a tab, or for being longer than `max_len`) ends the batch, & is read
+ * by the next call, as is a line that's only partly there. nothing is
+ * batched in vi's command mode, as its keys aren't inserted as they are.
+ *
+ * the lines aren't copied: they stay valid until the next line is read.
+ *
+ * @param max_len the longest line to read
+ * @param prompt the prompt to display before reading the lines. it's drawn
+ * before each of them.
+ * @param lines where to store a pointer to the lines, oldest first
+ * @param count where to store the number of lines, at least 1
+ *
+ * @return what `rl_read_line` returns. `lines` & `count` are only set on
+ * `RL_SUCCESS`.
+ */
+enum ReadLineResult rl_read_lines(size_t max_len, const char *prompt,
+                                  const struct RLLine **lines, size_t *count);
+
+/**
+ * sets whether killed text (Ctrl+K, Ctrl+U, Ctrl+W, Alt+D) is also copied to
+ * the system clipboard. it uses the OSC 52 escape sequence, so it works over
+ * SSH too, as long as the terminal supports it. it's disabled by default.
+ *
+ * @param enabled whether to copy killed text to the clipboard
+ */
+void rl_set_clipboard_export(bool enabled);
+
+/**
+ * switches the editing mode. emacs mode is the default. vi mode starts in
+ * insert mode, press ESC to get to command mode. (Alt+Ctrl+J switches modes
+ * from the keyboard.)
+ *
+ * @param mode the editing mode to switch to
+ */
+void rl_set_editing_mode(enum ReadLineEditingMode mode);
+
+/**
+ * binds a key sequence to a command in one of the keymaps.
+ *
+ * @param keymap the keymap to bind in: "emacs", "vi-insert" or "vi-command".
+ * if NULL, the keymap of the current mode is used.
+ * @param keyseq the key sequence, written the way readline's inputrc writes
+ * them, e.g. "\C-a", "\M-f", "\C-xe" or "\e[A"
+ * @param command the name of the command, e.g. "beginning-of-line"
+ *
+ * @return `true` if the key sequence was bound, `false` if the keymap, the key
+ * sequence or the command is invalid
+ */
+bool rl_bind_key(const char *keymap, const char *keyseq, const char *command);
+
+/**
+ * loads key bindings & settings from a config file written like readline's
+ * inputrc:
+ *
+ *   # comments start with '#'
+ *   set editing-mode vi           # or emacs
+ *   set keymap vi-command         # where the bindings below go
+ *   set clipboard-export on       # like `rl_set_clipboard_export(true)`
+ *   "\C-xk": kill-whole-line
+ *   Control-t: backward-kill-word
+ *
+ * the parsed file is cached (in $XDG_CACHE_HOME or ~/.cache), & as long as
+ * the file doesn't change, later calls use the cache without parsing it.
+ * errors in the file are reported on stderr, the rest of it still applies.
+ *
+ * @param path the config file
+ *
+ * @return `true` if the config was loaded, `false` if the file can't be read
+ */
+bool rl_load_config(const char *path);
+
+/**
+ * computes the text of a prompt segment into `buf` (null-terminated). return
+ * false to keep the previous value.
+ */
+typedef bool (*RLPromptSegmentFn)(char *buf, size_t size, void *ctx);
+
+/**
+ * adds a prompt segment: a piece of the prompt that takes a while to compute,
+ * like the git branch. a prompt includes it by containing "{name}".
+ *
+ * segments are computed on a background thread & cached, so the prompt is
+ * shown right away with the last values, and redrawn in place as fresh values
+ * come in. `fn` runs on that thread, so it MUST be thread-safe.
+ *
+ * @param name the name of the segment
+ * @param fn computes the segment's text
+ * @param ctx passed to `fn` as is
+ * @param ttl_ms how long a value is used for before it's recomputed. if 0,
+ * it's recomputed every time a prompt is shown.
+ *
+ * @return `true` if the segment was added, `false` if the name is taken or
+ * longer than 31 characters, or if memory allocation fails
+ */
+bool rl_add_prompt_segment(const char *name, RLPromptSegmentFn fn, void *ctx,
+                           unsigned int ttl_ms);
+
+/**
+ * work that can wait until the first prompt is on the screen.
+ */
+typedef void (*RLStartupFn)(void *ctx);
+
+/**
+ * defers part of starting up, like loading a config, until the first prompt
+ * is drawn: `fn` runs once, while the terminal answers the cursor position
+ * query that comes with the prompt, & before any key is handled, so what it
+ * sets up (e.g. key bindings) applies from the first key on. segments start
+ * being computed, & the keymaps compiled, at the same point. if the first
+ * prompt was drawn already, `fn` runs right away.
+ *
+ * @param fn what to run, replacing whatever was set before
+ * @param ctx passed to `fn` as is
+ */
+void rl_at_first_prompt(RLStartupFn fn, void *ctx);
+
+/**
+ * reads lines from `in` & draws them to `out` without a terminal: raw mode is
+ * never enabled, the cursor is assumed to start at the beginning of a line,
+ * and `rl_read_line` returns `RL_EOF` once `in` runs out (or accepts what was
+ * typed before that). it's meant for driving the editor from a file or a
+ * pipe, e.g. in tests.
+ *
+ * @param in where keys are read from
+ * @param out where the line is drawn to
+ */
+void rl_set_headless(int in, int out);
+
 /**
  * performs cleanup tasks. this function MUST be called if you've called the
  * `rl_read_line` function at least once. just register this function to be
@@ -38,4 +198,269 @@ enum ReadLineResult rl_read_line(char *buf, size_t buf_size, char *prompt);
  */
 void rl_cleanup(void);
 
+/**
+ * an editor of its own: its own input & output, history, kill ring, macro &
+ * editing mode. `rl_read_line` uses one on stdin & stdout; more can be made
+ * with `rl_session_init`, e.g. to host many editors in one process. key
+ * bindings, prompt segments & settings are shared by all of them.
+ */
+struct RLSession;
+
+/**
+ * allocates, resizes & frees a session's memory, like Lua's `lua_Alloc`:
+ * with `ptr` NULL it allocates `new_size` bytes, with `new_size` 0 it frees
+ * `ptr` (which is `old_size` bytes) & returns NULL, and otherwise it resizes
+ * `ptr` from `old_size` to `new_size` bytes, keeping its contents. it returns
+ * NULL if it can't allocate. the old size is always given, so allocators that
+ * free by size (like a C++ `memory_resource`) can be used.
+ */
+typedef void *(*RLAllocFn)(void *ctx, void *ptr, size_t old_size,
+                           size_t new_size);
+
+/**
+ * makes a new session. if `in_fd` is a terminal, it's put in raw mode while a
+ * line is read, like `rl_read_line` does with stdin; otherwise it's read
+ * like `rl_set_headless` does.
+ *
+ * @param in_fd where keys are read from
+ * @param out_fd where the line is drawn to
+ * @param max_line_len the longest line the session reads. if 0, it will be
+ * set to `RL_DEFAULT_MAX_LINE_LEN`
+ * @param alloc allocates all of the session's memory. if NULL, malloc() does.
+ * @param alloc_ctx passed to `alloc` as is
+ *
+ * @return the session, or NULL if memory allocation fails
+ */
+struct RLSession *rl_session_init(int in_fd, int out_fd, size_t max_line_len,
+                                  RLAllocFn alloc, void *alloc_ctx);
+
+#define RL_DEFAULT_MAX_LINE_LEN 4095
+
+/**
+ * frees a session & everything in it. all sessions MUST be freed before
+ * `rl_cleanup` is called.
+ *
+ * @param session the session to free
+ */
+void rl_session_free(struct RLSession *session);
+
+/**
+ * reads a line in a session, like `rl_read_line`, but without copying it: the
+ * line is left in the session's history, and `line` points at it. it stays
+ * valid until the next line is read in the session, or the session is freed.
+ *
+ * @param session the session to read in
+ * @param prompt the prompt to display before reading the line
+ * @param line where to store a pointer to the line (null-terminated)
+ * @param len where to store the length of the line
+ *
+ * @return what `rl_read_line` returns. `line` & `len` are only set on
+ * `RL_SUCCESS`.
+ */
+enum ReadLineResult rl_session_read_line(struct RLSession *session,
+                                         const char *prompt, const char **line,
+                                         size_t *len);
+
+/**
+ * reads a line in a session along with the complete lines of a paste that
+ * follow it, like `rl_read_lines`. with a memory budget, lines are read one
+ * at a time.
+ *
+ * @param session the session to read in
+ * @param prompt the prompt to display before reading the lines
+ * @param lines where to store a pointer to the lines (see `rl_read_lines`)
+ * @param count where to store the number of lines
+ *
+ * @return what `rl_session_read_line` returns
+ */
+enum ReadLineResult rl_session_read_lines(struct RLSession *session,
+                                          const char *prompt,
+                                          const struct RLLine **lines,
+                                          size_t *count);
+
+/**
+ * reads a line in a session without waiting for input, for driving many
+ * sessions from one event loop: it starts the line (drawing the prompt) if
+ * one isn't started yet, handles whatever keys are there already, and
+ * returns `RL_PENDING` if that didn't complete the line. call it again once
+ * the session's `in_fd` is readable to carry on where it left off.
+ *
+ * an escape sequence that's cut off is kept until the rest of it comes in,
+ * so a lone ESC waits for the next key, or for `rl_session_expire_key` to be
+ * called once `RL_KEY_TIMEOUT_MS` pass without it. when `in_fd` reaches EOF,
+ * the line is
+ * ended the way `rl_set_headless` ends it. a terminal is in raw mode from
+ * the start of a line to the end of it, so only one session on a terminal
+ * can read at a time.
+ *
+ * @param session the session to read in
+ * @param prompt the prompt to display before reading the line. it MUST stay
+ * valid until the line is complete, & it's ignored while a line is pending.
+ * @param line where to store a pointer to the line (see
+ * `rl_session_read_line`)
+ * @param len where to store the length of the line
+ *
+ * @return what `rl_session_read_line` returns, or `RL_PENDING`
+ */
+enum ReadLineResult rl_session_try_read_line(struct RLSession *session,
+                                             const char *prompt,
+                                             const char **line, size_t *len);
+
+// how long the rest of an escape sequence is waited for, like a terminal's
+// VTIME, before what came of it is taken as it is (e.g. a lone ESC)
+#define RL_KEY_TIMEOUT_MS 100
+
+/**
+ * whether the key `rl_session_try_read_line` stopped at was cut off, e.g.
+ * ESC with nothing after it (yet). if it is, call `rl_session_expire_key` if
+ * no more input comes within `RL_KEY_TIMEOUT_MS`.
+ *
+ * @param session the session, with a line pending
+ */
+bool rl_session_key_incomplete(const struct RLSession *session);
+
+/**
+ * takes the key that was cut off as it is, then carries on with the line
+ * like `rl_session_try_read_line` does. a line MUST be pending.
+ *
+ * @param session the session
+ * @param line where to store a pointer to the line
+ * @param len where to store the length of the line
+ *
+ * @return what `rl_session_try_read_line` returns
+ */
+enum ReadLineResult rl_session_expire_key(struct RLSession *session,
+                                          const char **line, size_t *len);
+
+/**
+ * whether one of the prompt's segments changed since the pending line's
+ * prompt was drawn. calling `rl_session_try_read_line` again redraws it.
+ *
+ * @param session the session
+ */
+bool rl_session_prompt_outdated(const struct RLSession *session);
+
+/**
+ * drops the pending line, if there is one, handing the terminal back, e.g.
+ * when a session is logged out for being idle. the next line is read from
+ * scratch.
+ *
+ * @param session the session
+ */
+void rl_session_cancel_line(struct RLSession *session);
+
+/**
+ * frees what an idle session can do without: the input & render buffers,
+ * which are made again on the next key, & the spare room of its history &
+ * macro. the line being read (if any) & the history are kept as they are.
+ * meant for sessions nobody typed in for a while, e.g. from a timer.
+ *
+ * @param session the session
+ *
+ * @return the number of bytes freed
+ */
+size_t rl_session_compact(struct RLSession *session);
+
+/**
+ * the line that's pending in a session, as `rl_session_pending_line` sees it.
+ * it points into the session, & is only valid until the session reads more
+ * keys.
+ */
+struct RLLineView {
+  const char *prompt; // as it's drawn, with its segments filled in
+  size_t prompt_len;
+  size_t prompt_width; // the number of columns it takes up
+  const char *line; // not null-terminated
+  size_t len;
+  size_t pos; // where the cursor is in the line
+};
+
+/**
+ * gets the line that's pending in a session, e.g. to draw it somewhere else
+ * than the session's `out_fd`, like a remote client (see src/server.cpp).
+ *
+ * @param session the session
+ * @param view where to store the line
+ *
+ * @return `true` if a line is pending, else `false`
+ */
+bool rl_session_pending_line(const struct RLSession *session,
+                             struct RLLineView *view);
+
+/**
+ * the number of bytes of input a session has handled so far, over all of its
+ * lines. bytes it read but didn't get to yet (like a key that was cut off)
+ * don't count, so whoever sends the keys can tell which of them the line
+ * reflects.
+ *
+ * @param session the session
+ */
+uint64_t rl_session_input_handled(const struct RLSession *session);
+
+/**
+ * limits how much memory a session takes, e.g. so that one user pasting
+ * gigabytes into a server can't take it down for everyone else. everything
+ * the session allocates counts. when it's over budget, the oldest lines of
+ * its history are evicted to make room, & a line that doesn't fit even then
+ * is dropped: the rest of it is skipped up to the next ENTER, & reading it
+ * returns `RL_OVER_BUDGET`.
+ *
+ * the session's own bookkeeping (a few KB) counts as well, so a budget that
+ * small leaves no room for lines at all.
+ *
+ * @param session the session
+ * @param budget the most bytes the session may take, 0 for no limit (the
+ * default)
+ */
+void rl_session_set_memory_budget(struct RLSession *session, size_t budget);
+
+/**
+ * what `rl_session_stats` reports.
+ */
+struct RLSessionStats {
+  size_t memory_used;     // bytes the session has allocated
+  size_t memory_budget;   // 0 if it has none
+  size_t history_len;     // lines in its history
+  size_t history_evicted; // lines evicted from the history to stay in budget
+  size_t lines_rejected;  // lines dropped for not fitting in the budget
+};
+
+/**
+ * reports how much memory a session is using, & what keeping it within its
+ * budget took so far.
+ *
+ * @param session the session
+ * @param stats where to store the stats
+ */
+void rl_session_stats(const struct RLSession *session,
+                      struct RLSessionStats *stats);
+
+/**
+ * gets a line from a session's history. the line `rl_session_read_line`
+ * returned last is the newest one.
+ *
+ * @param session the session
+ * @param index which line, 0 for the oldest
+ * @param len where to store the line's length
+ *
+ * @return the line, null-terminated, or NULL if there's no such line. it's
+ * valid until the session reads another line.
+ */
+const char *rl_session_history_line(const struct RLSession *session,
+                                    size_t index, size_t *len);
+
+/**
+ * `rl_session_stats` for the session `rl_read_line` uses.
+ */
+void rl_stats(struct RLSessionStats *stats);
+
+/**
+ * `rl_session_history_line` for the session `rl_read_line` uses.
+ */
+const char *rl_history_line(size_t index, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
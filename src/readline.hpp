@@ -0,0 +1,297 @@
+#ifndef READLINE_HPP
+#define READLINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include <unistd.h> // for STDIN_FILENO, STDOUT_FILENO
+
+#include "readline.h"
+
+/*
+ * A C++ wrapper around `RLSession`. A `rl::Session` owns an editor (its own
+ * history, kill ring & macro) & frees it when it goes out of scope. Lines are
+ * returned as `std::string_view`s into the session's history, so reading a
+ * line doesn't copy it, and all of the session's memory comes from the
+ * `std::pmr::memory_resource` it's given.
+ *
+ *   std::pmr::unsynchronized_pool_resource pool;
+ *   rl::Session session(STDIN_FILENO, STDOUT_FILENO, 4096, &pool);
+ *
+ *   while (auto result = session.read_line("> ")) {
+ *     handle(result.line);
+ *   }
+ *
+ * key bindings, the editing mode & prompt segments are still set with the
+ * `rl_*` functions, and `rl_cleanup` MUST be called after every session is
+ * gone.
+ */
+
+namespace rl {
+
+class Session {
+public:
+  enum class Status {
+    // a line was read
+    line,
+
+    // the user immediately pressed Ctrl+D (EOF), or the input ran out
+    eof,
+
+    // the user pressed Ctrl+C (SIGINT)
+    interrupted,
+
+    // the line isn't complete yet (only from `try_read_line`)
+    pending,
+
+    // nothing was typed for too long, so the line was dropped (only from
+    // `rl::AsyncSession`, see `set_idle_timeout`)
+    timed_out,
+
+    // the line didn't fit in the session's memory budget, so it was dropped
+    // (see `set_memory_budget`)
+    over_budget,
+  };
+
+  struct Result {
+    Status status;
+
+    // the line read. it points into the session, & stays valid until the
+    // next line is read or the session is destroyed.
+    std::string_view line;
+
+    explicit operator bool() const { return status == Status::line; }
+  };
+
+  struct Lines {
+    Status status;
+
+    // the lines read, oldest first. like `Result::line`, they point into the
+    // session.
+    std::span<const RLLine> lines;
+
+    explicit operator bool() const { return status == Status::line; }
+  };
+
+  /**
+   * makes a new session. it's read like `rl_session_init` reads, so raw mode
+   * is only used when `in_fd` is a terminal.
+   *
+   * @param in_fd where keys are read from
+   * @param out_fd where the line is drawn to
+   * @param max_line_len the longest line the session reads
+   * @param resource where all of the session's memory comes from. it MUST
+   * outlive the session.
+   *
+   * @throws std::bad_alloc if the session can't be allocated
+   */
+  explicit Session(
+      int in_fd = STDIN_FILENO, int out_fd = STDOUT_FILENO,
+      std::size_t max_line_len = RL_DEFAULT_MAX_LINE_LEN,
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : resource_(resource),
+        session_(rl_session_init(in_fd, out_fd, max_line_len, &allocate,
+                                 resource)) {
+    if (session_ == nullptr) {
+      throw std::bad_alloc();
+    }
+  }
+
+  ~Session() {
+    if (session_ != nullptr) {
+      rl_session_free(session_);
+    }
+  }
+
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  Session(Session &&other) noexcept
+      : resource_(other.resource_),
+        session_(std::exchange(other.session_, nullptr)) {}
+
+  Session &operator=(Session &&other) noexcept {
+    if (this != &other) {
+      if (session_ != nullptr) {
+        rl_session_free(session_);
+      }
+      resource_ = other.resource_;
+      session_ = std::exchange(other.session_, nullptr);
+    }
+    return *this;
+  }
+
+  /**
+   * reads a line, without copying it.
+   *
+   * @param prompt the prompt to display before reading the line
+   *
+   * @return the line, or why there isn't one. it's truthy if there's a line.
+   */
+  Result read_line(const char *prompt) {
+    const char *line;
+    std::size_t len;
+
+    ReadLineResult r = rl_session_read_line(session_, prompt, &line, &len);
+    return result(r, line, len);
+  }
+
+  /**
+   * reads a line along with the complete lines of a paste that follow it, like
+   * `rl_session_read_lines`.
+   *
+   * @param prompt the prompt to display before reading the lines
+   *
+   * @return the lines, or why there aren't any. it's truthy if there are.
+   */
+  Lines read_lines(const char *prompt) {
+    const RLLine *lines;
+    std::size_t count;
+
+    ReadLineResult r = rl_session_read_lines(session_, prompt, &lines, &count);
+    if (r != RL_SUCCESS) {
+      return {result(r, nullptr, 0).status, {}};
+    }
+    return {Status::line, std::span(lines, count)};
+  }
+
+  /**
+   * reads a line without waiting for input, like `rl_session_try_read_line`.
+   * call it again once the input is readable while it's pending.
+   *
+   * @param prompt the prompt to display before reading the line. it MUST stay
+   * valid until the line is complete.
+   *
+   * @return the line, or why there isn't one (yet)
+   */
+  Result try_read_line(const char *prompt) {
+    const char *line;
+    std::size_t len;
+
+    ReadLineResult r = rl_session_try_read_line(session_, prompt, &line, &len);
+    return result(r, line, len);
+  }
+
+  /**
+   * takes the key that was cut off as it is, like `rl_session_expire_key`,
+   * once `key_incomplete` was true for `RL_KEY_TIMEOUT_MS`.
+   *
+   * @return what `try_read_line` returns
+   */
+  Result expire_key() {
+    const char *line;
+    std::size_t len;
+
+    ReadLineResult r = rl_session_expire_key(session_, &line, &len);
+    return result(r, line, len);
+  }
+
+  bool key_incomplete() const { return rl_session_key_incomplete(session_); }
+  bool prompt_outdated() const { return rl_session_prompt_outdated(session_); }
+  void cancel_line() { rl_session_cancel_line(session_); }
+
+  // frees what the session can do without while it's idle, & returns how
+  // many bytes that was (see `rl_session_compact`)
+  std::size_t compact() { return rl_session_compact(session_); }
+
+  // limits how much memory the session takes, evicting its oldest history &
+  // dropping lines that don't fit (see `rl_session_set_memory_budget`). 0 is
+  // no limit.
+  void set_memory_budget(std::size_t budget) {
+    rl_session_set_memory_budget(session_, budget);
+  }
+
+  // the line that's pending, if there is one (see `rl_session_pending_line`)
+  bool pending_line(RLLineView &view) const {
+    return rl_session_pending_line(session_, &view);
+  }
+
+  std::uint64_t input_handled() const {
+    return rl_session_input_handled(session_);
+  }
+
+  RLSessionStats stats() const {
+    RLSessionStats stats;
+    rl_session_stats(session_, &stats);
+    return stats;
+  }
+
+  // a line of the history, 0 for the oldest, or nothing if there's no such
+  // line. like the lines read, it's a view into the history.
+  std::optional<std::string_view> history_line(std::size_t index) const {
+    std::size_t len;
+    const char *line = rl_session_history_line(session_, index, &len);
+    if (line == nullptr) {
+      return std::nullopt;
+    }
+    return std::string_view(line, len);
+  }
+
+  std::pmr::memory_resource *resource() const { return resource_; }
+
+  // for calling the `rl_session_*` functions directly
+  RLSession *native_handle() const { return session_; }
+
+private:
+  static Result result(ReadLineResult r, const char *line, std::size_t len) {
+    switch (r) {
+    case RL_SUCCESS:
+      return {Status::line, std::string_view(line, len)};
+    case RL_EOF:
+      return {Status::eof, {}};
+    case RL_PENDING:
+      return {Status::pending, {}};
+    case RL_OVER_BUDGET:
+      return {Status::over_budget, {}};
+    case RL_SIGINT:
+    default:
+      return {Status::interrupted, {}};
+    }
+  }
+
+  /*
+   * the session's `RLAllocFn`: hands the session's allocations to the memory
+   * resource. memory resources can't resize, so resizing allocates a new
+   * block & copies. exceptions can't go through C, so they become NULL.
+   */
+  static void *allocate(void *ctx, void *ptr, std::size_t old_size,
+                        std::size_t new_size) {
+    auto *resource = static_cast<std::pmr::memory_resource *>(ctx);
+    constexpr std::size_t align = alignof(std::max_align_t);
+
+    if (new_size == 0) {
+      if (ptr != nullptr) {
+        resource->deallocate(ptr, old_size, align);
+      }
+      return nullptr;
+    }
+
+    void *block;
+    try {
+      block = resource->allocate(new_size, align);
+    } catch (...) {
+      return nullptr;
+    }
+
+    if (ptr != nullptr) {
+      std::memcpy(block, ptr, old_size < new_size ? old_size : new_size);
+      resource->deallocate(ptr, old_size, align);
+    }
+
+    return block;
+  }
+
+  std::pmr::memory_resource *resource_;
+  RLSession *session_;
+};
+
+} // namespace rl
+
+#endif
@@ -0,0 +1,349 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h> // for memcpy(), memmove()
+
+#include "./remote.h"
+
+/*
+ * The messages a REPL server sends its clients. Each one is a header, the
+ * type (1 byte) & the length of what follows it (4 bytes), then:
+ *
+ * - REMOTE_LINE: the bytes handled (8), the cursor position (4), the width of
+ *   the prompt (4), flags (1, bit 0 is `done`), the length of the prompt (4),
+ *   the prompt, & the line itself (the rest)
+ * - REMOTE_OUTPUT: the output
+ * - REMOTE_EDIT: flags (1, like REMOTE_LINE's), then the bytes handled, the
+ *   cursor position, where the change starts & how many bytes it removed
+ *   (a varint each), & the bytes it inserted (the rest)
+ *
+ * All numbers are little endian. A varint is 7 bits per byte, lowest first,
+ * with the top bit set on every byte but the last, so an edit that types a
+ * key takes about a dozen bytes.
+ */
+
+#define HEADER_SIZE 5
+#define LINE_FIXED_SIZE (8 + 4 + 4 + 1 + 4)
+
+#define LINE_DONE 1
+
+#define MAX_VARINT_SIZE 10 // for 64 bits
+
+static bool append_header(struct AppendBuffer *ab, enum RemoteMessageType type,
+                          size_t len);
+static void put_u32(char *buf, uint32_t n);
+static void put_u64(char *buf, uint64_t n);
+static uint32_t get_u32(const char *buf);
+static uint64_t get_u64(const char *buf);
+static size_t put_varint(char *buf, uint64_t n);
+static bool get_varint(const char **buf, const char *end, uint64_t *n);
+
+/**
+ * appends a REMOTE_LINE message.
+ *
+ * @param ab the buffer to append to
+ * @param line the line
+ *
+ * @return `true` if it was appended, `false` if memory allocation fails
+ */
+bool remote_append_line(struct AppendBuffer *ab,
+                        const struct RemoteLine *line) {
+  assert(ab != NULL);
+  assert(line != NULL);
+
+  char fixed[LINE_FIXED_SIZE];
+  put_u64(&fixed[0], line->handled);
+  put_u32(&fixed[8], line->pos);
+  put_u32(&fixed[12], line->prompt_width);
+  fixed[16] = line->done ? LINE_DONE : 0;
+  put_u32(&fixed[17], line->prompt_len);
+
+  return append_header(ab, REMOTE_LINE,
+                       sizeof(fixed) + line->prompt_len + line->len) &&
+         abuf_append(ab, fixed, sizeof(fixed)) &&
+         abuf_append(ab, line->prompt, line->prompt_len) &&
+         abuf_append(ab, line->text, line->len);
+}
+
+/**
+ * appends a REMOTE_OUTPUT message.
+ *
+ * @param ab the buffer to append to
+ * @param output the output
+ * @param len the length of the output
+ *
+ * @return `true` if it was appended, `false` if memory allocation fails
+ */
+bool remote_append_output(struct AppendBuffer *ab, const char *output,
+                          size_t len) {
+  assert(ab != NULL);
+
+  return append_header(ab, REMOTE_OUTPUT, len) &&
+         abuf_append(ab, output, len);
+}
+
+/**
+ * appends a REMOTE_EDIT message.
+ *
+ * @param ab the buffer to append to
+ * @param edit the change
+ *
+ * @return `true` if it was appended, `false` if memory allocation fails
+ */
+bool remote_append_edit(struct AppendBuffer *ab,
+                        const struct RemoteEdit *edit) {
+  assert(ab != NULL);
+  assert(edit != NULL);
+
+  char fixed[1 + 4 * MAX_VARINT_SIZE];
+  size_t len = 0;
+  fixed[len++] = edit->done ? LINE_DONE : 0;
+  len += put_varint(&fixed[len], edit->handled);
+  len += put_varint(&fixed[len], edit->pos);
+  len += put_varint(&fixed[len], edit->start);
+  len += put_varint(&fixed[len], edit->removed);
+
+  return append_header(ab, REMOTE_EDIT, len + edit->inserted_len) &&
+         abuf_append(ab, fixed, len) &&
+         abuf_append(ab, edit->inserted, edit->inserted_len);
+}
+
+/**
+ * finds the change that turns one line into another: what's between their
+ * common start & their common end. `handled`, `pos` & `done` are left for
+ * the caller to fill in.
+ *
+ * @param from the line as it was
+ * @param from_len the length of `from`
+ * @param to the line as it is now. `edit->inserted` points into it.
+ * @param to_len the length of `to`
+ * @param edit where to store the change
+ */
+void remote_diff(const char *from, size_t from_len, const char *to,
+                 size_t to_len, struct RemoteEdit *edit) {
+  assert(from != NULL || from_len == 0);
+  assert(to != NULL || to_len == 0);
+  assert(edit != NULL);
+
+  size_t shorter = from_len < to_len ? from_len : to_len;
+
+  size_t prefix = 0;
+  while (prefix < shorter && from[prefix] == to[prefix]) {
+    ++prefix;
+  }
+
+  size_t suffix = 0;
+  while (suffix < shorter - prefix &&
+         from[from_len - suffix - 1] == to[to_len - suffix - 1]) {
+    ++suffix;
+  }
+
+  edit->start = prefix;
+  edit->removed = from_len - prefix - suffix;
+  edit->inserted = to + prefix;
+  edit->inserted_len = to_len - prefix - suffix;
+}
+
+/**
+ * applies a change to the line it was made to.
+ *
+ * @param text the line, which is changed in place
+ * @param pos set to where the cursor is after the change
+ * @param edit the change
+ *
+ * @return `true` if it was applied, `false` if it doesn't fit the line (it
+ * was made to another one), or memory allocation fails
+ */
+bool remote_apply_edit(struct AppendBuffer *text, size_t *pos,
+                       const struct RemoteEdit *edit) {
+  assert(text != NULL);
+  assert(pos != NULL);
+  assert(edit != NULL);
+
+  if (edit->start > text->len || edit->removed > text->len - edit->start) {
+    return false;
+  }
+
+  size_t len = text->len - edit->removed + edit->inserted_len;
+  if (edit->pos > len) {
+    return false;
+  }
+
+  if (edit->inserted_len > edit->removed &&
+      !abuf_reserve(text, edit->inserted_len - edit->removed)) {
+    return false;
+  }
+
+  size_t tail = edit->start + edit->removed;
+  if (text->len > tail) {
+    memmove(&text->data[edit->start + edit->inserted_len], &text->data[tail],
+            text->len - tail);
+  }
+  if (edit->inserted_len > 0) {
+    memcpy(&text->data[edit->start], edit->inserted, edit->inserted_len);
+  }
+  text->len = len;
+  *pos = edit->pos;
+
+  return true;
+}
+
+/**
+ * parses the message at the start of `buf`. what it points to stays in
+ * `buf`, so it's only valid as long as that is.
+ *
+ * @param buf what was received so far
+ * @param len the length of `buf`
+ * @param msg where to store the message
+ * @param malformed set to whether what's in `buf` isn't a message at all
+ *
+ * @return the length of the message, or 0 if there isn't a whole one yet (or
+ * it's malformed)
+ */
+size_t remote_parse(const char *buf, size_t len, struct RemoteMessage *msg,
+                    bool *malformed) {
+  assert(buf != NULL || len == 0);
+  assert(msg != NULL);
+  assert(malformed != NULL);
+
+  *malformed = false;
+
+  if (len < HEADER_SIZE) {
+    return 0;
+  }
+
+  const char *payload = &buf[HEADER_SIZE];
+  size_t payload_len = get_u32(&buf[1]);
+  if (len - HEADER_SIZE < payload_len) {
+    return 0;
+  }
+
+  switch (buf[0]) {
+  case REMOTE_LINE: {
+    if (payload_len < LINE_FIXED_SIZE) {
+      *malformed = true;
+      return 0;
+    }
+
+    size_t prompt_len = get_u32(&payload[17]);
+    if (prompt_len > payload_len - LINE_FIXED_SIZE) {
+      *malformed = true;
+      return 0;
+    }
+
+    msg->type = REMOTE_LINE;
+    msg->line = (struct RemoteLine){
+        .handled = get_u64(&payload[0]),
+        .pos = get_u32(&payload[8]),
+        .prompt_width = get_u32(&payload[12]),
+        .done = (payload[16] & LINE_DONE) != 0,
+        .prompt = &payload[LINE_FIXED_SIZE],
+        .prompt_len = prompt_len,
+        .text = &payload[LINE_FIXED_SIZE + prompt_len],
+        .len = payload_len - LINE_FIXED_SIZE - prompt_len,
+    };
+
+    if (msg->line.pos > msg->line.len) {
+      *malformed = true;
+      return 0;
+    }
+    break;
+  }
+
+  case REMOTE_OUTPUT:
+    msg->type = REMOTE_OUTPUT;
+    msg->output = payload;
+    msg->output_len = payload_len;
+    break;
+
+  case REMOTE_EDIT: {
+    // after the flags
+    const char *p = payload + 1, *end = payload + payload_len;
+    uint64_t handled, pos, start, removed;
+    if (payload_len == 0 || !get_varint(&p, end, &handled) ||
+        !get_varint(&p, end, &pos) || !get_varint(&p, end, &start) ||
+        !get_varint(&p, end, &removed)) {
+      *malformed = true;
+      return 0;
+    }
+
+    msg->type = REMOTE_EDIT;
+    msg->edit = (struct RemoteEdit){
+        .handled = handled,
+        .pos = pos,
+        .start = start,
+        .removed = removed,
+        .inserted = p,
+        .inserted_len = end - p,
+        .done = (payload[0] & LINE_DONE) != 0,
+    };
+    break;
+  }
+
+  default:
+    *malformed = true;
+    return 0;
+  }
+
+  return HEADER_SIZE + payload_len;
+}
+
+static bool append_header(struct AppendBuffer *ab, enum RemoteMessageType type,
+                          size_t len) {
+  char header[HEADER_SIZE];
+  header[0] = type;
+  put_u32(&header[1], len);
+  return abuf_append(ab, header, sizeof(header));
+}
+
+static void put_u32(char *buf, uint32_t n) {
+  for (int i = 0; i < 4; ++i) {
+    buf[i] = n >> (8 * i);
+  }
+}
+
+static void put_u64(char *buf, uint64_t n) {
+  for (int i = 0; i < 8; ++i) {
+    buf[i] = n >> (8 * i);
+  }
+}
+
+static uint32_t get_u32(const char *buf) {
+  uint32_t n = 0;
+  for (int i = 0; i < 4; ++i) {
+    n |= (uint32_t)(unsigned char)buf[i] << (8 * i);
+  }
+  return n;
+}
+
+static uint64_t get_u64(const char *buf) {
+  uint64_t n = 0;
+  for (int i = 0; i < 8; ++i) {
+    n |= (uint64_t)(unsigned char)buf[i] << (8 * i);
+  }
+  return n;
+}
+
+static size_t put_varint(char *buf, uint64_t n) {
+  size_t len = 0;
+  while (n >= 0x80) {
+    buf[len++] = (char)(0x80 | (n & 0x7f));
+    n >>= 7;
+  }
+  buf[len++] = (char)n;
+  return len;
+}
+
+// reads a varint at `*buf`, moving it past the varint
+static bool get_varint(const char **buf, const char *end, uint64_t *n) {
+  *n = 0;
+  for (int shift = 0; *buf < end && shift < 64; shift += 7) {
+    unsigned char byte = *(*buf)++;
+    *n |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
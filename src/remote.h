@@ -0,0 +1,89 @@
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "abuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * what a REPL server (src/server.cpp) sends its clients (src/client.c). the
+ * client sends the keys it reads as they are.
+ */
+enum RemoteMessageType {
+  REMOTE_LINE = 1, // the state of the line being read
+  REMOTE_OUTPUT,   // output to print below the line
+  REMOTE_EDIT,     // a change to the line that was sent last
+};
+
+/**
+ * the line being read, as the server has it.
+ */
+struct RemoteLine {
+  // how many bytes of the keys the client sent the line reflects (see
+  // `rl_session_input_handled`)
+  uint64_t handled;
+
+  const char *prompt;
+  size_t prompt_len;
+  size_t prompt_width; // the number of columns the prompt takes up
+
+  const char *text;
+  size_t len;
+  size_t pos; // where the cursor is in the line
+
+  // whether the line is complete. the next one starts on a new row.
+  bool done;
+};
+
+/**
+ * a change to the line being read, since the state the server sent last: the
+ * `removed` bytes at `start` were replaced with `inserted`. that's all it
+ * takes for most keys, however long the line is.
+ */
+struct RemoteEdit {
+  uint64_t handled; // like `RemoteLine`'s
+
+  size_t start;
+  size_t removed;
+  const char *inserted;
+  size_t inserted_len;
+
+  size_t pos; // where the cursor is in the line, after the change
+  bool done;
+};
+
+struct RemoteMessage {
+  enum RemoteMessageType type;
+
+  struct RemoteLine line; // REMOTE_LINE
+  struct RemoteEdit edit; // REMOTE_EDIT
+
+  // REMOTE_OUTPUT
+  const char *output;
+  size_t output_len;
+};
+
+bool remote_append_line(struct AppendBuffer *ab, const struct RemoteLine *line);
+bool remote_append_output(struct AppendBuffer *ab, const char *output,
+                          size_t len);
+bool remote_append_edit(struct AppendBuffer *ab, const struct RemoteEdit *edit);
+
+void remote_diff(const char *from, size_t from_len, const char *to,
+                 size_t to_len, struct RemoteEdit *edit);
+bool remote_apply_edit(struct AppendBuffer *text, size_t *pos,
+                       const struct RemoteEdit *edit);
+
+size_t remote_parse(const char *buf, size_t len, struct RemoteMessage *msg,
+                    bool *malformed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,388 @@
+#define _GNU_SOURCE // for memmem()
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h> // for memcpy(), memmem()
+
+#include "./lz.h"
+#include "./scrollback.h"
+#include "./vector.h"
+
+/*
+ * The log is one append-only stream of bytes: each input line followed by its
+ * output. The stream is cut into fixed size blocks; the one being written to
+ * is kept as is, and every full block is compressed & never touched again.
+ *
+ * Every input line gets an entry with the stream offsets of its input & its
+ * output, so an entry can be read back by decompressing only the blocks its
+ * range falls in.
+ *
+ * Once the compressed blocks go over the size cap, the oldest blocks are
+ * dropped, along with every entry that started in them.
+ */
+
+struct Block {
+  char *data;     // the compressed bytes
+  size_t len;     // size of `data`
+  uint64_t start; // stream offset of the first byte in the block
+};
+
+struct Entry {
+  uint64_t id;
+  uint64_t input_start;
+  size_t input_len;
+  uint64_t output_start;
+  size_t output_len;
+};
+
+struct Scrollback {
+  struct Vector *blocks;  // compressed blocks (struct Block), oldest first
+  struct Vector *entries; // struct Entry, oldest first
+
+  char *open;          // the block being written to, not compressed
+  size_t open_len;     // bytes used in `open`
+  uint64_t open_start; // stream offset of `open`
+
+  char *scratch; // room for one compressed block, used while sealing
+
+  // the last block that was decompressed, so reading an entry after another
+  // one from the same block doesn't decompress it again
+  char *cache;
+  uint64_t cache_start;
+
+  // grows to fit the biggest entry searched so far
+  char *search_buf;
+  size_t search_buf_size;
+
+  size_t max_bytes;
+  size_t compressed_bytes;
+  uint64_t raw_bytes;
+  uint64_t next_id;
+  uint64_t evicted_entries;
+};
+
+#define NO_CACHE UINT64_MAX
+
+static void log_write(struct Scrollback *sb, const char *data, size_t len);
+static bool seal_block(struct Scrollback *sb);
+static void evict(struct Scrollback *sb, size_t max_bytes);
+static uint64_t oldest_offset(struct Scrollback *sb);
+static bool read_range(struct Scrollback *sb, uint64_t start, size_t len,
+                       char *dst);
+
+/**
+ * initializes a new scrollback log. returns NULL if memory allocation fails.
+ *
+ * @param max_bytes the most memory the compressed blocks can take up. if 0, it
+ * will be set to `SCROLLBACK_DEFAULT_MAX_BYTES`
+ */
+struct Scrollback *scrollback_init(size_t max_bytes) {
+  struct Scrollback *sb = calloc(1, sizeof(struct Scrollback));
+  if (sb == NULL) {
+    return NULL;
+  }
+
+  if (max_bytes == 0) {
+    max_bytes = SCROLLBACK_DEFAULT_MAX_BYTES;
+  }
+
+  sb->blocks = vector_init(sizeof(struct Block), 0);
+  sb->entries = vector_init(sizeof(struct Entry), 0);
+  sb->open = malloc(SCROLLBACK_BLOCK_SIZE);
+  sb->scratch = malloc(lz_compress_bound(SCROLLBACK_BLOCK_SIZE));
+  sb->cache = malloc(SCROLLBACK_BLOCK_SIZE);
+
+  if (sb->blocks == NULL || sb->entries == NULL || sb->open == NULL ||
+      sb->scratch == NULL || sb->cache == NULL) {
+    scrollback_free(sb);
+    return NULL;
+  }
+
+  sb->cache_start = NO_CACHE;
+  sb->max_bytes = max_bytes;
+
+  return sb;
+}
+
+/**
+ * frees the scrollback log and everything in it
+ *
+ * @param sb the scrollback log to free
+ */
+void scrollback_free(struct Scrollback *sb) {
+  assert(sb != NULL);
+
+  if (sb->blocks != NULL) {
+    for (size_t i = 0; i < vector_length(sb->blocks); ++i) {
+      free(((struct Block *)vector_get(sb->blocks, i))->data);
+    }
+    vector_free(sb->blocks);
+  }
+
+  if (sb->entries != NULL) {
+    vector_free(sb->entries);
+  }
+
+  free(sb->open);
+  free(sb->scratch);
+  free(sb->cache);
+  free(sb->search_buf);
+  free(sb);
+}
+
+/**
+ * logs an input line and the output it produced. returns false if the entry
+ * couldn't be kept, either because memory allocation failed or because it's
+ * bigger than the size cap.
+ *
+ * @param sb the scrollback log to add to
+ * @param input the input line. it doesn't need to be null-terminated.
+ * @param input_len the length of the input line
+ * @param output the output. it doesn't need to be null-terminated.
+ * @param output_len the length of the output
+ */
+bool scrollback_append(struct Scrollback *sb, const char *input,
+                       size_t input_len, const char *output,
+                       size_t output_len) {
+  assert(sb != NULL);
+
+  struct Entry entry = {
+      .id = ++sb->next_id,
+      .input_start = sb->open_start + sb->open_len,
+      .input_len = input_len,
+  };
+
+  log_write(sb, input, input_len);
+
+  entry.output_start = sb->open_start + sb->open_len;
+  entry.output_len = output_len;
+
+  log_write(sb, output, output_len);
+
+  // part of it may have been evicted already, if it didn't fit in the cap
+  if (entry.input_start < oldest_offset(sb)) {
+    ++sb->evicted_entries;
+    return false;
+  }
+
+  if (!vector_push(sb->entries, &entry)) {
+    ++sb->evicted_entries;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * searches the logged outputs for `needle`, oldest first.
+ *
+ * @param sb the scrollback log to search
+ * @param needle the text to search for. it doesn't need to be null-terminated.
+ * @param needle_len the length of `needle`
+ * @param fn called for every entry whose output contains `needle`
+ * @param ctx passed to `fn` as is
+ *
+ * @return the number of matching entries passed to `fn`
+ */
+size_t scrollback_search(struct Scrollback *sb, const char *needle,
+                         size_t needle_len, ScrollbackMatchFn fn, void *ctx) {
+  assert(sb != NULL);
+  assert(needle != NULL);
+  assert(fn != NULL);
+
+  size_t matches = 0;
+
+  for (size_t i = 0; i < vector_length(sb->entries); ++i) {
+    struct Entry *entry = vector_get(sb->entries, i);
+
+    // the input & output are next to each other in the stream
+    size_t len = entry->input_len + entry->output_len;
+    if (len > sb->search_buf_size) {
+      char *buf = realloc(sb->search_buf, len);
+      if (buf == NULL) {
+        continue;
+      }
+
+      sb->search_buf = buf;
+      sb->search_buf_size = len;
+    }
+
+    if (!read_range(sb, entry->input_start, len, sb->search_buf)) {
+      continue;
+    }
+
+    const char *output = &sb->search_buf[entry->input_len];
+    if (memmem(output, entry->output_len, needle, needle_len) == NULL) {
+      continue;
+    }
+
+    ++matches;
+    if (!fn(ctx, entry->id, sb->search_buf, entry->input_len, output,
+            entry->output_len)) {
+      break;
+    }
+  }
+
+  return matches;
+}
+
+/**
+ * fills `stats` with how much is in the scrollback log
+ *
+ * @param sb the scrollback log
+ * @param stats where to write the stats
+ */
+void scrollback_stats(const struct Scrollback *sb,
+                      struct ScrollbackStats *stats) {
+  assert(sb != NULL);
+  assert(stats != NULL);
+
+  stats->entries = vector_length(sb->entries);
+  stats->evicted_entries = sb->evicted_entries;
+  stats->raw_bytes = sb->raw_bytes;
+  stats->compressed_bytes = sb->compressed_bytes;
+}
+
+/*
+ * appends to the stream, sealing the open block every time it fills up
+ */
+static void log_write(struct Scrollback *sb, const char *data, size_t len) {
+  sb->raw_bytes += len;
+
+  while (len > 0) {
+    size_t n = SCROLLBACK_BLOCK_SIZE - sb->open_len;
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(&sb->open[sb->open_len], data, n);
+    sb->open_len += n;
+    data += n;
+    len -= n;
+
+    if (sb->open_len == SCROLLBACK_BLOCK_SIZE && !seal_block(sb)) {
+      // couldn't keep the block, so drop everything up to & including it
+      sb->open_start += sb->open_len;
+      sb->open_len = 0;
+      evict(sb, 0);
+    }
+  }
+}
+
+/*
+ * compresses the open block & starts a new one. returns false if memory
+ * allocation fails, leaving the open block as is.
+ */
+static bool seal_block(struct Scrollback *sb) {
+  size_t len = lz_compress(sb->open, sb->open_len, sb->scratch);
+
+  struct Block block = {.data = malloc(len), .len = len, .start = sb->open_start};
+  if (block.data == NULL) {
+    return false;
+  }
+
+  memcpy(block.data, sb->scratch, len);
+  if (!vector_push(sb->blocks, &block)) {
+    free(block.data);
+    return false;
+  }
+
+  sb->compressed_bytes += len;
+  sb->open_start += sb->open_len;
+  sb->open_len = 0;
+
+  evict(sb, sb->max_bytes);
+
+  return true;
+}
+
+/*
+ * drops the oldest blocks until the compressed ones take up at most
+ * `max_bytes`, then drops every entry that started in them
+ */
+static void evict(struct Scrollback *sb, size_t max_bytes) {
+  size_t num_blocks = 0;
+  while (sb->compressed_bytes > max_bytes &&
+         num_blocks < vector_length(sb->blocks)) {
+    struct Block *block = vector_get(sb->blocks, num_blocks++);
+    if (block->start == sb->cache_start) {
+      sb->cache_start = NO_CACHE;
+    }
+
+    sb->compressed_bytes -= block->len;
+    free(block->data);
+  }
+  vector_remove(sb->blocks, 0, num_blocks);
+
+  uint64_t oldest = oldest_offset(sb);
+  size_t num_entries = 0;
+  while (num_entries < vector_length(sb->entries) &&
+         ((struct Entry *)vector_get(sb->entries, num_entries))->input_start <
+             oldest) {
+    ++num_entries;
+  }
+  vector_remove(sb->entries, 0, num_entries);
+  sb->evicted_entries += num_entries;
+}
+
+/*
+ * the stream offset of the oldest byte still in the log
+ */
+static uint64_t oldest_offset(struct Scrollback *sb) {
+  if (vector_length(sb->blocks) == 0) {
+    return sb->open_start;
+  }
+
+  return ((struct Block *)vector_get(sb->blocks, 0))->start;
+}
+
+/*
+ * copies `len` bytes of the stream starting at `start` into `dst`,
+ * decompressing blocks as needed. returns false if a block is corrupt.
+ */
+static bool read_range(struct Scrollback *sb, uint64_t start, size_t len,
+                       char *dst) {
+  while (len > 0) {
+    const char *src;
+    uint64_t block_start;
+
+    if (start >= sb->open_start) {
+      src = sb->open;
+      block_start = sb->open_start;
+    } else {
+      // blocks are all the same size, so the index can be worked out directly
+      uint64_t first = oldest_offset(sb);
+      size_t index = (start - first) / SCROLLBACK_BLOCK_SIZE;
+      struct Block *block = vector_get(sb->blocks, index);
+
+      if (block->start != sb->cache_start) {
+        if (!lz_decompress(block->data, block->len, sb->cache,
+                           SCROLLBACK_BLOCK_SIZE)) {
+          sb->cache_start = NO_CACHE;
+          return false;
+        }
+
+        sb->cache_start = block->start;
+      }
+
+      src = sb->cache;
+      block_start = block->start;
+    }
+
+    size_t offset = start - block_start;
+    size_t n = SCROLLBACK_BLOCK_SIZE - offset;
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(dst, &src[offset], n);
+    dst += n;
+    start += n;
+    len -= n;
+  }
+
+  return true;
+}
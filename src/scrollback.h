@@ -0,0 +1,40 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct Scrollback;
+
+#define SCROLLBACK_BLOCK_SIZE (64 * 1024)
+#define SCROLLBACK_DEFAULT_MAX_BYTES (8 * 1024 * 1024)
+
+/*
+ * called for every logged input line whose output matched a search. `input`
+ * & `output` are only valid until the callback returns. return false to stop
+ * the search.
+ */
+typedef bool (*ScrollbackMatchFn)(void *ctx, uint64_t id, const char *input,
+                                  size_t input_len, const char *output,
+                                  size_t output_len);
+
+struct ScrollbackStats {
+  uint64_t entries;          // input lines still in the log
+  uint64_t evicted_entries;  // input lines dropped because of the size cap
+  uint64_t raw_bytes;        // bytes logged, before compression
+  uint64_t compressed_bytes; // bytes held by the compressed blocks
+};
+
+struct Scrollback *scrollback_init(size_t max_bytes);
+void scrollback_free(struct Scrollback *sb);
+
+bool scrollback_append(struct Scrollback *sb, const char *input,
+                       size_t input_len, const char *output, size_t output_len);
+size_t scrollback_search(struct Scrollback *sb, const char *needle,
+                         size_t needle_len, ScrollbackMatchFn fn, void *ctx);
+
+void scrollback_stats(const struct Scrollback *sb,
+                      struct ScrollbackStats *stats);
+
+#endif
@@ -0,0 +1,312 @@
+#include <assert.h>
+#include <pthread.h> // for pthread_create(), pthread_mutex_t, etc.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h> // for strcmp(), strchr(), memcpy()
+#include <time.h>   // for clock_gettime()
+
+#include "./segment.h"
+#include "./vector.h"
+
+/*
+ * Prompt segments are small pieces of text, like the current directory, that
+ * take a while to compute. Rendering a prompt never waits for them: it uses
+ * whatever value is cached, and asks the background thread to recompute the
+ * ones older than their TTL. Every time a value actually changes the
+ * generation goes up, which is how the prompt knows to redraw itself.
+ */
+
+struct Segment {
+  char name[SEGMENT_NAME_LEN];
+  SegmentFn fn;
+  void *ctx;
+  uint64_t ttl_ns;
+
+  char value[SEGMENT_VALUE_LEN];
+  uint64_t computed_at; // when `value` was computed, 0 if never
+  bool requested;       // waiting for the background thread
+};
+
+struct SegmentSet {
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // signalled when a segment is requested, or on exit
+
+  struct Vector *segments; // struct Segment
+  uint64_t generation;
+
+  pthread_t thread;
+  bool started;
+  bool stopping;
+};
+
+static void *run_worker(void *arg);
+static struct Segment *find_segment(struct SegmentSet *set, const char *name,
+                                    size_t name_len);
+static uint64_t now_ns(void);
+
+/**
+ * initializes a new set of segments. the background thread is only started
+ * by `segments_start`. returns NULL if memory allocation fails.
+ */
+struct SegmentSet *segments_init(void) {
+  struct SegmentSet *set = calloc(1, sizeof(struct SegmentSet));
+  if (set == NULL) {
+    return NULL;
+  }
+
+  set->segments = vector_init(sizeof(struct Segment), 0);
+  if (set->segments == NULL) {
+    free(set);
+    return NULL;
+  }
+
+  pthread_mutex_init(&set->lock, NULL);
+  pthread_cond_init(&set->wake, NULL);
+
+  return set;
+}
+
+/**
+ * stops the background thread, waiting for the segment it's computing (if
+ * any), and frees the set.
+ *
+ * @param set the set of segments to free
+ */
+void segments_free(struct SegmentSet *set) {
+  assert(set != NULL);
+
+  if (set->started) {
+    pthread_mutex_lock(&set->lock);
+    set->stopping = true;
+    pthread_cond_signal(&set->wake);
+    pthread_mutex_unlock(&set->lock);
+
+    pthread_join(set->thread, NULL);
+  }
+
+  pthread_mutex_destroy(&set->lock);
+  pthread_cond_destroy(&set->wake);
+  vector_free(set->segments);
+  free(set);
+}
+
+/**
+ * adds a segment, which a prompt can then show by including "{name}". its
+ * value is empty until it's computed for the first time. returns false if the
+ * name is taken or too long, or if memory allocation fails.
+ *
+ * @param set the set of segments to add to
+ * @param name the name of the segment
+ * @param fn computes the segment's value
+ * @param ctx passed to `fn` as is
+ * @param ttl_ms how long a value can be shown before it's recomputed. if 0,
+ * it's recomputed every time a prompt is shown.
+ */
+bool segments_add(struct SegmentSet *set, const char *name, SegmentFn fn,
+                  void *ctx, unsigned int ttl_ms) {
+  assert(set != NULL);
+  assert(name != NULL);
+  assert(fn != NULL);
+
+  size_t name_len = strlen(name);
+  if (name_len == 0 || name_len >= SEGMENT_NAME_LEN) {
+    return false;
+  }
+
+  pthread_mutex_lock(&set->lock);
+
+  bool ok = find_segment(set, name, name_len) == NULL;
+  if (ok) {
+    struct Segment segment = {
+        .fn = fn,
+        .ctx = ctx,
+        .ttl_ns = (uint64_t)ttl_ms * 1000000,
+    };
+    memcpy(segment.name, name, name_len + 1);
+
+    ok = vector_push(set->segments, &segment);
+  }
+
+  pthread_mutex_unlock(&set->lock);
+
+  return ok;
+}
+
+/**
+ * starts the background thread, if it isn't running yet, so segments get
+ * computed. until then, they're only marked as requested when a prompt shows
+ * them, which lets a program show its first prompt before paying for the
+ * thread. returns false if the thread can't be started.
+ *
+ * @param set the set of segments
+ */
+bool segments_start(struct SegmentSet *set) {
+  assert(set != NULL);
+
+  pthread_mutex_lock(&set->lock);
+
+  bool ok = true;
+  if (!set->started && vector_length(set->segments) > 0) {
+    set->started = pthread_create(&set->thread, NULL, run_worker, set) == 0;
+    ok = set->started;
+  }
+
+  pthread_mutex_unlock(&set->lock);
+
+  return ok;
+}
+
+/**
+ * expands a prompt template, replacing every "{name}" with the cached value of
+ * the segment. a "{" that isn't a segment's name is left as is. segments
+ * whose value is older than their TTL are recomputed in the background.
+ *
+ * @param set the set of segments
+ * @param tmpl the prompt template
+ * @param out where to append the prompt
+ *
+ * @return `false` if memory allocation fails, else `true`
+ */
+bool segments_render(struct SegmentSet *set, const char *tmpl,
+                     struct AppendBuffer *out) {
+  assert(set != NULL);
+  assert(tmpl != NULL);
+  assert(out != NULL);
+
+  bool ok = true;
+  bool requested = false;
+  uint64_t now = now_ns();
+
+  pthread_mutex_lock(&set->lock);
+
+  const char *p = tmpl;
+  while (*p != '\0') {
+    const char *open = strchr(p, '{');
+    const char *close = open != NULL ? strchr(open, '}') : NULL;
+    if (close == NULL) {
+      ok = ok && abuf_append(out, p, strlen(p));
+      break;
+    }
+
+    struct Segment *segment = find_segment(set, open + 1, close - open - 1);
+    if (segment == NULL) {
+      // not a segment, keep the "{" & carry on after it
+      ok = ok && abuf_append(out, p, open + 1 - p);
+      p = open + 1;
+      continue;
+    }
+
+    ok = ok && abuf_append(out, p, open - p);
+    ok = ok && abuf_append(out, segment->value, strlen(segment->value));
+    p = close + 1;
+
+    bool stale = segment->computed_at == 0 ||
+                 now - segment->computed_at >= segment->ttl_ns;
+    if (stale && !segment->requested) {
+      segment->requested = true;
+      requested = true;
+    }
+  }
+
+  if (requested) {
+    pthread_cond_signal(&set->wake);
+  }
+
+  pthread_mutex_unlock(&set->lock);
+
+  return ok;
+}
+
+/**
+ * gets a number that goes up every time a segment's value changes.
+ *
+ * @param set the set of segments
+ */
+uint64_t segments_generation(struct SegmentSet *set) {
+  assert(set != NULL);
+
+  pthread_mutex_lock(&set->lock);
+  uint64_t generation = set->generation;
+  pthread_mutex_unlock(&set->lock);
+
+  return generation;
+}
+
+/*
+ * the background thread. it computes the requested segments one by one,
+ * without holding the lock, so rendering is never blocked by them.
+ */
+static void *run_worker(void *arg) {
+  struct SegmentSet *set = arg;
+
+  pthread_mutex_lock(&set->lock);
+
+  while (!set->stopping) {
+    size_t index = vector_length(set->segments);
+    for (size_t i = 0; i < vector_length(set->segments); ++i) {
+      if (((struct Segment *)vector_get(set->segments, i))->requested) {
+        index = i;
+        break;
+      }
+    }
+
+    if (index == vector_length(set->segments)) {
+      pthread_cond_wait(&set->wake, &set->lock);
+      continue;
+    }
+
+    struct Segment *segment = vector_get(set->segments, index);
+    SegmentFn fn = segment->fn;
+    void *ctx = segment->ctx;
+
+    pthread_mutex_unlock(&set->lock);
+
+    char value[SEGMENT_VALUE_LEN];
+    bool computed = fn(value, sizeof(value), ctx);
+    value[sizeof(value) - 1] = '\0';
+
+    pthread_mutex_lock(&set->lock);
+
+    // segments are never removed, but adding one may have moved them
+    segment = vector_get(set->segments, index);
+    segment->requested = false;
+    segment->computed_at = now_ns();
+
+    if (computed && strcmp(segment->value, value) != 0) {
+      memcpy(segment->value, value, sizeof(value));
+      ++set->generation;
+    }
+  }
+
+  pthread_mutex_unlock(&set->lock);
+
+  return NULL;
+}
+
+/*
+ * `lock` MUST be held.
+ */
+static struct Segment *find_segment(struct SegmentSet *set, const char *name,
+                                    size_t name_len) {
+  if (name_len >= SEGMENT_NAME_LEN) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < vector_length(set->segments); ++i) {
+    struct Segment *segment = vector_get(set->segments, i);
+    if (strncmp(segment->name, name, name_len) == 0 &&
+        segment->name[name_len] == '\0') {
+      return segment;
+    }
+  }
+
+  return NULL;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
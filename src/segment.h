@@ -0,0 +1,32 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "abuf.h"
+
+struct SegmentSet;
+
+#define SEGMENT_NAME_LEN 32
+#define SEGMENT_VALUE_LEN 256
+
+/*
+ * computes a segment's text into `buf` (null-terminated). it runs on the
+ * background thread, so it may take its time, but must be thread-safe. return
+ * false to keep the previous value.
+ */
+typedef bool (*SegmentFn)(char *buf, size_t size, void *ctx);
+
+struct SegmentSet *segments_init(void);
+void segments_free(struct SegmentSet *set);
+
+bool segments_add(struct SegmentSet *set, const char *name, SegmentFn fn,
+                  void *ctx, unsigned int ttl_ms);
+bool segments_start(struct SegmentSet *set);
+bool segments_render(struct SegmentSet *set, const char *tmpl,
+                     struct AppendBuffer *out);
+uint64_t segments_generation(struct SegmentSet *set);
+
+#endif
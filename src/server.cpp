@@ -0,0 +1,251 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>      // for open()
+#include <poll.h>       // for poll()
+#include <sys/socket.h> // for socket(), bind(), listen(), accept4()
+#include <sys/un.h>     // for struct sockaddr_un
+#include <unistd.h>     // for close(), write(), unlink()
+
+#include "abuf.h"
+#include "executor.hpp"
+#include "remote.h"
+
+/*
+ * A REPL server for bin/repl-client: it listens on a unix socket, & runs a
+ * session per connection on one executor. The keys a client sends are its
+ * session's input, but the session draws nowhere: what's sent back is the
+ * state of the line each time keys were handled (see src/remote.h), so the
+ * client draws it on its own terminal, for its own width, & can tell which
+ * of its keys it reflects. That's what lets the client echo keys before they
+ * got here (see src/predict.c).
+ *
+ * Once a line was sent, only what changed in it is, so a key takes about the
+ * same few bytes however long the line is. While keys are still coming in,
+ * nothing is sent until they run out, & then only the line they led to.
+ *
+ *   bin/repl-server /tmp/repl.sock
+ */
+
+#define PROMPT "> "
+
+static rl::Task listen_task(rl::Executor &executor, int listener, int out);
+// what a client was sent last, so only what changed since is sent next
+struct SentLine {
+  bool begun = false; // whether any of the line being read was sent
+  std::string prompt;
+  std::string text;
+};
+
+static rl::Task serve(int fd, rl::Executor &executor, int out);
+static bool send_line(int fd, SentLine &sent, const RLLineView &view,
+                      std::uint64_t handled, bool done);
+static bool input_waiting(int fd);
+static bool send_output(int fd, std::string_view output);
+static bool send_all(int fd, const AppendBuffer &ab);
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <socket path>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // a client going away mid-write shouldn't take the others down with it
+  signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path too long: %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  strcpy(addr.sun_path, argv[1]);
+
+  // non-blocking, in case a client gives up between it being readable & it
+  // being accepted
+  int listener =
+      socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (listener == -1) {
+    perror("failed to create socket");
+    return EXIT_FAILURE;
+  }
+
+  unlink(argv[1]);
+  if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ==
+          -1 ||
+      listen(listener, SOMAXCONN) == -1) {
+    perror("failed to listen on socket");
+    return EXIT_FAILURE;
+  }
+
+  // the sessions draw their lines here, since the clients draw them instead
+  int out = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    return EXIT_FAILURE;
+  }
+
+  rl::Executor executor;
+  executor.spawn(listen_task(executor, listener, out));
+  executor.run();
+
+  rl_cleanup();
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * accepts connections for as long as the server runs, serving each one in a
+ * task of its own.
+ */
+static rl::Task listen_task(rl::Executor &executor, int listener, int out) {
+  for (;;) {
+    co_await executor.readable(listener);
+
+    // the connection itself blocks: the session polls before it reads
+    int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd == -1) {
+      if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+        perror("failed to accept connection");
+      }
+      continue;
+    }
+
+    executor.spawn(serve(fd, executor, out));
+  }
+}
+
+/*
+ * reads lines from a client until it goes away or says "exit", sending it the
+ * line as keys are handled.
+ */
+static rl::Task serve(int fd, rl::Executor &executor, int out) {
+  {
+    rl::AsyncSession session(executor, fd, out);
+    SentLine sent;
+
+    // the prompt of the line being read, for when it's done
+    std::string prompt;
+    std::size_t prompt_width = 0;
+
+    for (;;) {
+      auto result = co_await session.read_keys(PROMPT);
+      std::uint64_t handled = session.session().input_handled();
+
+      RLLineView view;
+      if (result.status == rl::Session::Status::pending) {
+        if (session.session().pending_line(view)) {
+          prompt.assign(view.prompt, view.prompt_len);
+          prompt_width = view.prompt_width;
+          if (!input_waiting(fd) &&
+              !send_line(fd, sent, view, handled, false)) {
+            break;
+          }
+        }
+        continue;
+      }
+
+      if (result.status != rl::Session::Status::line &&
+          result.status != rl::Session::Status::over_budget) {
+        break;
+      }
+
+      view = {prompt.data(), prompt.size(), prompt_width,
+              result.line.data(), result.line.size(), result.line.size()};
+      if (!send_line(fd, sent, view, handled, true)) {
+        break;
+      }
+
+      if (result.line == "exit") {
+        break;
+      }
+
+      std::string output = result.status == rl::Session::Status::line
+                               ? "you said: " + std::string(result.line) + "\n"
+                               : "line too long\n";
+      if (!send_output(fd, output)) {
+        break;
+      }
+    }
+  }
+
+  close(fd);
+}
+
+/*
+ * sends the line, or just what changed in it if the client has the rest
+ * already.
+ */
+static bool send_line(int fd, SentLine &sent, const RLLineView &view,
+                      std::uint64_t handled, bool done) {
+  std::string_view prompt(view.prompt, view.prompt_len);
+  AppendBuffer ab = ABUF_INIT;
+  bool appended;
+
+  if (sent.begun && sent.prompt == prompt) {
+    RemoteEdit edit = {};
+    remote_diff(sent.text.data(), sent.text.size(), view.line, view.len,
+                &edit);
+    edit.handled = handled;
+    edit.pos = view.pos;
+    edit.done = done;
+    appended = remote_append_edit(&ab, &edit);
+  } else {
+    RemoteLine line = {};
+    line.handled = handled;
+    line.prompt = view.prompt;
+    line.prompt_len = view.prompt_len;
+    line.prompt_width = view.prompt_width;
+    line.text = view.line;
+    line.len = view.len;
+    line.pos = view.pos;
+    line.done = done;
+    appended = remote_append_line(&ab, &line);
+  }
+
+  bool ok = appended && send_all(fd, ab);
+  abuf_free(&ab);
+
+  // the next line is sent whole
+  sent.begun = !done;
+  sent.prompt = prompt;
+  sent.text.assign(view.line, view.len);
+
+  return ok;
+}
+
+// whether there are more keys to handle already
+static bool input_waiting(int fd) {
+  pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, 0) == 1;
+}
+
+static bool send_output(int fd, std::string_view output) {
+  AppendBuffer ab = ABUF_INIT;
+  bool sent = remote_append_output(&ab, output.data(), output.size()) &&
+              send_all(fd, ab);
+  abuf_free(&ab);
+
+  return sent;
+}
+
+static bool send_all(int fd, const AppendBuffer &ab) {
+  std::size_t written = 0;
+  while (written < ab.len) {
+    ssize_t n = write(fd, ab.data + written, ab.len - written);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += n;
+  }
+
+  return true;
+}
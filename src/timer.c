@@ -0,0 +1,410 @@
+#include <assert.h>
+#include <limits.h> // for INT_MAX
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h> // for clock_gettime()
+
+#include "./timer.h"
+
+/*
+ * A hierarchical timing wheel, for the thousands of timers a process full of
+ * sessions has going at once (an ESC waiting for the rest of its escape
+ * sequence, idle logouts, prompt refreshes), most of which are cancelled or
+ * pushed back long before they expire, e.g. on every key press.
+ *
+ * Time is counted in ticks of 1ms. The wheel has a few levels of 64 slots:
+ * a slot on level 0 holds the timers that expire on one tick, a slot on
+ * level 1 those that expire within one 64-tick stretch, & so on. A timer goes
+ * on the lowest level whose slot can tell its deadline apart from the current
+ * time, which takes a couple of bit operations, so starting & cancelling a
+ * timer are O(1): the slots are doubly linked lists. Once the time reaches a
+ * slot on a higher level, its timers are moved down to where they now belong,
+ * so each timer is moved at most once per level.
+ *
+ * Every level keeps a bitmap of which slots have timers, so finding the next
+ * time anything happens (for a poll timeout) is a find-first-set per level,
+ * and time can jump straight there instead of ticking through empty slots.
+ */
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+// 5 levels reach 2^30ms, about 12 days. timers further out wait in
+// `overflow`, which is sorted out every time the top level wraps around.
+#define WHEEL_LEVELS 5
+
+struct TimerWheel {
+  uint64_t now;   // all the timers with earlier deadlines have expired
+  size_t size;    // pending timers
+  bool advancing; // `timer_wheel_advance` is running
+
+  uint64_t occupied[WHEEL_LEVELS]; // a bit for each slot with timers
+
+  // list heads. a list is empty when its head points back to itself.
+  struct Timer slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  struct Timer overflow;
+};
+
+static void place(struct TimerWheel *wheel, struct Timer *timer);
+static void unlink_timer(struct Timer *timer);
+static struct Timer *slot_head(struct TimerWheel *wheel, unsigned level,
+                               unsigned slot);
+static void take_list(struct Timer *head, struct Timer *into);
+static uint64_t next_event(const struct TimerWheel *wheel);
+static void cascade(struct TimerWheel *wheel);
+static size_t expire(struct TimerWheel *wheel);
+static void forget_list(struct Timer *head);
+static void list_init(struct Timer *head);
+static bool list_empty(const struct Timer *head);
+
+/**
+ * makes a wheel with no timers. returns NULL if memory allocation fails.
+ *
+ * @param now the current time, in milliseconds (see `timer_now`)
+ */
+struct TimerWheel *timer_wheel_init(uint64_t now) {
+  struct TimerWheel *wheel = malloc(sizeof(struct TimerWheel));
+  if (wheel == NULL) {
+    return NULL;
+  }
+
+  wheel->now = now;
+  wheel->size = 0;
+  wheel->advancing = false;
+
+  for (unsigned level = 0; level < WHEEL_LEVELS; ++level) {
+    wheel->occupied[level] = 0;
+    for (unsigned slot = 0; slot < WHEEL_SLOTS; ++slot) {
+      list_init(&wheel->slots[level][slot]);
+    }
+  }
+  list_init(&wheel->overflow);
+
+  return wheel;
+}
+
+/**
+ * frees the wheel. its timers stop being pending, without expiring.
+ *
+ * @param wheel the wheel to free
+ */
+void timer_wheel_free(struct TimerWheel *wheel) {
+  assert(wheel != NULL);
+
+  for (unsigned level = 0; level < WHEEL_LEVELS; ++level) {
+    for (unsigned slot = 0; slot < WHEEL_SLOTS; ++slot) {
+      forget_list(&wheel->slots[level][slot]);
+    }
+  }
+  forget_list(&wheel->overflow);
+
+  free(wheel);
+}
+
+/**
+ * sets up a timer that isn't pending. it MUST be called before the timer is
+ * started for the first time.
+ *
+ * @param timer the timer
+ * @param fn called when the timer expires
+ * @param arg passed to `fn` as is
+ */
+void timer_init(struct Timer *timer, TimerFn fn, void *arg) {
+  assert(timer != NULL);
+  assert(fn != NULL);
+
+  *timer = (struct Timer){.fn = fn, .arg = arg};
+}
+
+/**
+ * starts a timer, or moves its deadline if it's pending already. O(1).
+ *
+ * @param wheel the wheel that times it
+ * @param timer the timer
+ * @param deadline when it expires, in milliseconds. a deadline that's past
+ * expires on the next `timer_wheel_advance` that moves the time forward.
+ */
+void timer_start(struct TimerWheel *wheel, struct Timer *timer,
+                 uint64_t deadline) {
+  assert(wheel != NULL);
+  assert(timer != NULL);
+
+  timer_cancel(timer);
+
+  timer->wheel = wheel;
+  timer->deadline = deadline > wheel->now ? deadline : wheel->now + 1;
+  place(wheel, timer);
+  ++wheel->size;
+}
+
+/**
+ * stops a timer from expiring, if it's pending. O(1).
+ *
+ * @param timer the timer
+ */
+void timer_cancel(struct Timer *timer) {
+  assert(timer != NULL);
+
+  if (!timer_pending(timer)) {
+    return;
+  }
+
+  unlink_timer(timer);
+  --timer->wheel->size;
+}
+
+/**
+ * whether the timer was started & hasn't expired or been cancelled since.
+ */
+bool timer_pending(const struct Timer *timer) {
+  assert(timer != NULL);
+
+  return timer->prev != NULL;
+}
+
+/**
+ * moves the time forward, expiring the timers whose deadline it reaches, in
+ * the order of their deadlines.
+ *
+ * @param wheel the wheel
+ * @param now the current time, in milliseconds. a time that's past is
+ * ignored.
+ *
+ * @return the number of timers that expired
+ */
+size_t timer_wheel_advance(struct TimerWheel *wheel, uint64_t now) {
+  assert(wheel != NULL);
+  assert(!wheel->advancing); // a timer's callback can't advance its wheel
+
+  wheel->advancing = true;
+
+  size_t expired = 0;
+  while (true) {
+    uint64_t next = next_event(wheel);
+    if (next > now) {
+      break;
+    }
+
+    // nothing happens in between, so the timers stay where they are
+    wheel->now = next;
+    cascade(wheel);
+    expired += expire(wheel);
+  }
+
+  if (now > wheel->now) {
+    wheel->now = now;
+  }
+
+  wheel->advancing = false;
+
+  return expired;
+}
+
+/**
+ * how long a poll can wait before the wheel has to be advanced again. that's
+ * when the next timer expires, or earlier, when timers have to be moved down
+ * a level on the way.
+ *
+ * @param wheel the wheel
+ * @param now the current time, in milliseconds
+ *
+ * @return the timeout in milliseconds, or -1 if there are no timers, like
+ * `poll` takes it
+ */
+int timer_wheel_timeout(const struct TimerWheel *wheel, uint64_t now) {
+  assert(wheel != NULL);
+
+  if (wheel->size == 0) {
+    return -1;
+  }
+
+  uint64_t next = next_event(wheel);
+  if (next <= now) {
+    return 0;
+  }
+
+  return next - now > INT_MAX ? INT_MAX : (int)(next - now);
+}
+
+// the number of pending timers
+size_t timer_wheel_size(const struct TimerWheel *wheel) {
+  assert(wheel != NULL);
+
+  return wheel->size;
+}
+
+/**
+ * the current time in milliseconds, from a clock that never goes back.
+ */
+uint64_t timer_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * puts a timer on the lowest level whose slots tell its deadline apart from
+ * the current time: the one of the highest group of bits where they differ.
+ * its deadline MUST NOT be before the current time.
+ */
+static void place(struct TimerWheel *wheel, struct Timer *timer) {
+  assert(timer->deadline >= wheel->now);
+
+  uint64_t diff = timer->deadline ^ wheel->now;
+  unsigned level = diff == 0 ? 0 : (63 - __builtin_clzll(diff)) / WHEEL_BITS;
+
+  if (level >= WHEEL_LEVELS) {
+    timer->level = WHEEL_LEVELS;
+    timer->slot = 0;
+  } else {
+    timer->level = level;
+    timer->slot = (timer->deadline >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    wheel->occupied[level] |= 1ULL << timer->slot;
+  }
+
+  // at the end, so timers with the same deadline expire in the order they
+  // were started
+  struct Timer *head = slot_head(wheel, timer->level, timer->slot);
+  timer->next = head;
+  timer->prev = head->prev;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+static void unlink_timer(struct Timer *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = NULL;
+  timer->next = NULL;
+
+  struct TimerWheel *wheel = timer->wheel;
+  if (timer->level < WHEEL_LEVELS &&
+      list_empty(&wheel->slots[timer->level][timer->slot])) {
+    wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+  }
+}
+
+static struct Timer *slot_head(struct TimerWheel *wheel, unsigned level,
+                               unsigned slot) {
+  return level < WHEEL_LEVELS ? &wheel->slots[level][slot] : &wheel->overflow;
+}
+
+/*
+ * moves all of the timers from one list to another, empty one.
+ */
+static void take_list(struct Timer *head, struct Timer *into) {
+  list_init(into);
+  if (list_empty(head)) {
+    return;
+  }
+
+  into->next = head->next;
+  into->prev = head->prev;
+  into->next->prev = into;
+  into->prev->next = into;
+  list_init(head);
+}
+
+/*
+ * the next time something happens: a timer expires, or a slot on a higher
+ * level is reached & its timers have to be moved down. UINT64_MAX if there
+ * are no timers.
+ */
+static uint64_t next_event(const struct TimerWheel *wheel) {
+  for (unsigned level = 0; level < WHEEL_LEVELS; ++level) {
+    unsigned shift = level * WHEEL_BITS;
+    unsigned current = (wheel->now >> shift) & WHEEL_MASK;
+
+    // only the slots after the current one can have timers: the deadlines
+    // in earlier ones would be in the past
+    uint64_t later = wheel->occupied[level] & ~((2ULL << current) - 1);
+    if (later != 0) {
+      unsigned slot = __builtin_ctzll(later);
+      unsigned block = shift + WHEEL_BITS;
+      return (wheel->now >> block << block) | ((uint64_t)slot << shift);
+    }
+  }
+
+  if (!list_empty(&wheel->overflow)) {
+    unsigned block = WHEEL_LEVELS * WHEEL_BITS;
+    return ((wheel->now >> block) + 1) << block;
+  }
+
+  return UINT64_MAX;
+}
+
+/*
+ * moves the timers of the slots the current time just reached down to the
+ * levels they belong on now, from the top down, so a timer can go down more
+ * than one level at once.
+ */
+static void cascade(struct TimerWheel *wheel) {
+  for (unsigned level = WHEEL_LEVELS; level > 0; --level) {
+    unsigned shift = level * WHEEL_BITS;
+    if ((wheel->now & ((1ULL << shift) - 1)) != 0) {
+      continue; // not at the start of a slot on this level
+    }
+
+    unsigned slot = (wheel->now >> shift) & WHEEL_MASK;
+    struct Timer *head = slot_head(wheel, level, slot);
+    if (level < WHEEL_LEVELS) {
+      wheel->occupied[level] &= ~(1ULL << slot);
+    }
+
+    struct Timer moving;
+    take_list(head, &moving);
+    while (!list_empty(&moving)) {
+      struct Timer *timer = moving.next;
+      moving.next = timer->next;
+      timer->next->prev = &moving;
+      place(wheel, timer);
+    }
+  }
+}
+
+/*
+ * expires the timers of the current tick.
+ */
+static size_t expire(struct TimerWheel *wheel) {
+  unsigned slot = wheel->now & WHEEL_MASK;
+  wheel->occupied[0] &= ~(1ULL << slot);
+
+  // taken off the slot first, since callbacks can start timers. cancelling
+  // one of these unlinks it from `expiring`.
+  struct Timer expiring;
+  take_list(&wheel->slots[0][slot], &expiring);
+
+  size_t expired = 0;
+  while (!list_empty(&expiring)) {
+    struct Timer *timer = expiring.next;
+    unlink_timer(timer);
+    --wheel->size;
+
+    timer->fn(timer, timer->arg);
+    ++expired;
+  }
+
+  return expired;
+}
+
+/*
+ * marks the timers of a list as not pending, without unlinking them.
+ */
+static void forget_list(struct Timer *head) {
+  for (struct Timer *timer = head->next; timer != head;) {
+    struct Timer *next = timer->next;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer = next;
+  }
+}
+
+static void list_init(struct Timer *head) {
+  head->next = head;
+  head->prev = head;
+}
+
+static bool list_empty(const struct Timer *head) { return head->next == head; }
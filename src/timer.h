@@ -0,0 +1,58 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct TimerWheel;
+struct Timer;
+
+/*
+ * called when a timer expires, from `timer_wheel_advance`. it may start or
+ * cancel any timer, including this one.
+ */
+typedef void (*TimerFn)(struct Timer *timer, void *arg);
+
+/**
+ * a timer, meant to be embedded in whatever it times out, so starting &
+ * cancelling one never allocates. the fields are the wheel's: set them with
+ * `timer_init`.
+ */
+struct Timer {
+  struct Timer *next;
+  struct Timer *prev; // NULL when the timer isn't pending
+
+  uint64_t deadline; // in milliseconds
+  uint8_t level;
+  uint8_t slot;
+
+  struct TimerWheel *wheel;
+  TimerFn fn;
+  void *arg;
+};
+
+struct TimerWheel *timer_wheel_init(uint64_t now);
+void timer_wheel_free(struct TimerWheel *wheel);
+
+void timer_init(struct Timer *timer, TimerFn fn, void *arg);
+void timer_start(struct TimerWheel *wheel, struct Timer *timer,
+                 uint64_t deadline);
+void timer_cancel(struct Timer *timer);
+bool timer_pending(const struct Timer *timer);
+
+size_t timer_wheel_advance(struct TimerWheel *wheel, uint64_t now);
+int timer_wheel_timeout(const struct TimerWheel *wheel, uint64_t now);
+size_t timer_wheel_size(const struct TimerWheel *wheel);
+
+uint64_t timer_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,9 +1,9 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
-#include <stdlib.h>
-#include <string.h> // for memcpy()
+#include <string.h> // for memcpy(), memmove()
 
+#include "./alloc.h"
 #include "./vector.h"
 
 struct Vector {
@@ -11,9 +11,9 @@ struct Vector {
   size_t length;
   size_t capacity;
   size_t elem_size;
-};
 
-static void safe_free(void **);
+  const struct Allocator *allocator; // NULL for malloc()
+};
 
 /**
  * initializes a new vector. returns NULL if memory allocation fails.
@@ -23,9 +23,23 @@ static void safe_free(void **);
  * `VECTOR_INIT_CAPACITY`
  */
 struct Vector *vector_init(size_t elem_size, size_t capacity) {
+  return vector_init_with(elem_size, capacity, NULL);
+}
+
+/**
+ * like `vector_init`, but the vector & its data are allocated with
+ * `allocator`, which MUST outlive the vector.
+ *
+ * @param elem_size the size of each element in the vector in bytes
+ * @param capacity the initial capacity of the vector. if 0, it will be set to
+ * `VECTOR_INIT_CAPACITY`
+ * @param allocator the allocator to use, or NULL for malloc()
+ */
+struct Vector *vector_init_with(size_t elem_size, size_t capacity,
+                                const struct Allocator *allocator) {
   assert(elem_size > 0);
 
-  struct Vector *vector = malloc(sizeof(struct Vector));
+  struct Vector *vector = mem_alloc(allocator, sizeof(struct Vector));
   if (vector == NULL) {
     return NULL;
   }
@@ -34,15 +48,16 @@ struct Vector *vector_init(size_t elem_size, size_t capacity) {
     capacity = VECTOR_INIT_CAPACITY;
   }
 
-  vector->data = malloc(elem_size * capacity);
+  vector->data = mem_alloc(allocator, elem_size * capacity);
   if (vector->data == NULL) {
-    free(vector);
+    mem_free(allocator, vector, sizeof(struct Vector));
     return NULL;
   }
 
   vector->length = 0;
   vector->capacity = capacity;
   vector->elem_size = elem_size;
+  vector->allocator = allocator;
 
   return vector;
 }
@@ -55,8 +70,9 @@ struct Vector *vector_init(size_t elem_size, size_t capacity) {
 void vector_free(struct Vector *vector) {
   assert(vector != NULL);
 
-  safe_free(&vector->data);
-  safe_free((void **)&vector);
+  const struct Allocator *allocator = vector->allocator;
+  mem_free(allocator, vector->data, vector->capacity * vector->elem_size);
+  mem_free(allocator, vector, sizeof(struct Vector));
 }
 
 /**
@@ -71,12 +87,15 @@ bool vector_push(struct Vector *vector, void *element) {
   // if the vector is full, double its capacity
   if (vector->length == vector->capacity) {
     size_t new_capacity = vector->capacity * 2;
-    vector->data = realloc(vector->data, vector->elem_size * new_capacity);
-    if (vector->data == NULL) {
+    void *data = mem_realloc(vector->allocator, vector->data,
+                             vector->elem_size * vector->capacity,
+                             vector->elem_size * new_capacity);
+    if (data == NULL) {
       return false;
     }
 
-    vector->capacity *= 2;
+    vector->data = data;
+    vector->capacity = new_capacity;
   }
 
   // copy the element to the end of the vector
@@ -88,6 +107,69 @@ bool vector_push(struct Vector *vector, void *element) {
   return true;
 }
 
+/**
+ * makes room for `count` more elements, so pushing them doesn't grow the
+ * vector again. it still grows by doubling, at least. returns false on
+ * failure.
+ *
+ * @param vector the vector to make room in
+ * @param count the number of elements about to be pushed
+ */
+bool vector_reserve(struct Vector *vector, size_t count) {
+  assert(vector != NULL);
+
+  if (vector->capacity - vector->length >= count) {
+    return true;
+  }
+
+  size_t new_capacity = vector->capacity * 2;
+  if (new_capacity < vector->length + count) {
+    new_capacity = vector->length + count;
+  }
+
+  void *data = mem_realloc(vector->allocator, vector->data,
+                           vector->elem_size * vector->capacity,
+                           vector->elem_size * new_capacity);
+  if (data == NULL) {
+    return false;
+  }
+
+  vector->data = data;
+  vector->capacity = new_capacity;
+
+  return true;
+}
+
+/**
+ * shrinks the vector's capacity to its length (but at least 1, so that it can
+ * still grow by doubling), e.g. once it's done growing for a while.
+ *
+ * @param vector the vector to shrink
+ *
+ * @return the number of bytes freed
+ */
+size_t vector_shrink(struct Vector *vector) {
+  assert(vector != NULL);
+
+  size_t capacity = vector->length > 0 ? vector->length : 1;
+  if (capacity >= vector->capacity) {
+    return 0;
+  }
+
+  void *data = mem_realloc(vector->allocator, vector->data,
+                           vector->elem_size * vector->capacity,
+                           vector->elem_size * capacity);
+  if (data == NULL) {
+    return 0; // the vector is still as big as it was
+  }
+
+  size_t freed = vector->elem_size * (vector->capacity - capacity);
+  vector->data = data;
+  vector->capacity = capacity;
+
+  return freed;
+}
+
 void *vector_pop(struct Vector *vector) {
   assert(vector != NULL);
   assert(vector->length > 0);
@@ -125,6 +207,26 @@ void vector_set(struct Vector *vector, size_t index, void *element) {
          vector->elem_size);
 }
 
+/**
+ * removes `count` elements starting at `index`, shifting the ones after them
+ * down.
+ *
+ * @param vector the vector to remove the elements from
+ * @param index the index of the first element to remove
+ * @param count the number of elements to remove
+ */
+void vector_remove(struct Vector *vector, size_t index, size_t count) {
+  assert(vector != NULL);
+  assert(index <= vector->length && count <= vector->length - index);
+
+  char *data = vector->data;
+  memmove(&data[index * vector->elem_size],
+          &data[(index + count) * vector->elem_size],
+          (vector->length - index - count) * vector->elem_size);
+
+  vector->length -= count;
+}
+
 /**
  * clears the vector's data. it DOES NOT free the data. it just sets the length
  * to 0.
@@ -180,18 +282,3 @@ size_t vector_elem_size(struct Vector *vector) {
 
   return vector->elem_size;
 }
-
-/**
- * frees the `malloc`'d memory. it takes a pointer to a pointer so that it can
- * set the pointer to NULL after freeing it.
- */
-static void safe_free(void **ptr) {
-  assert(ptr != NULL);
-
-  if (*ptr == NULL) {
-    return;
-  }
-
-  free(*ptr);
-  *ptr = NULL;
-}
\ No newline at end of file
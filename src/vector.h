@@ -4,20 +4,27 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "alloc.h"
+
 struct Vector;
 
 #define VECTOR_INIT_CAPACITY 8
 
 struct Vector *vector_init(size_t elem_size, size_t capacity);
+struct Vector *vector_init_with(size_t elem_size, size_t capacity,
+                                const struct Allocator *allocator);
 void vector_free(struct Vector *vector);
 
 bool vector_push(struct Vector *vector, void *element);
+bool vector_reserve(struct Vector *vector, size_t count);
 void *vector_pop(struct Vector *vector);
 
 void *vector_get(struct Vector *vector, size_t index);
 void vector_set(struct Vector *vector, size_t index, void *element);
 
+void vector_remove(struct Vector *vector, size_t index, size_t count);
 void vector_clear(struct Vector *vector);
+size_t vector_shrink(struct Vector *vector);
 
 // ----- getters ----- //
 
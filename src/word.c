@@ -0,0 +1,173 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h> // for uint64_t
+#include <string.h> // for memcpy()
+
+#include "word.h"
+
+/*
+ * Word boundaries are found 8 bytes at a time using SWAR ("SIMD within a
+ * register"): a chunk of the line is loaded into a `uint64_t` and every byte
+ * of it is classified at once with a handful of additions and masks. The
+ * result is a mask with bit 7 of each byte set if that byte is in the class,
+ * so the first (or last) match in the chunk is found by counting trailing (or
+ * leading) zero bits.
+ *
+ * This needs no intrinsics, so it works the same on x86 and ARM.
+ */
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+#define LOWS 0x7f7f7f7f7f7f7f7fULL
+
+/*
+ * bytes of `v` (all < 0x80) that are in [lo, hi].
+ *
+ * adding (0x80 - lo) sets bit 7 iff byte >= lo, adding (0x7f - hi) sets bit 7
+ * iff byte > hi. since every byte is < 0x80, neither addition can carry into
+ * the next byte.
+ */
+static inline uint64_t bytes_in_range(uint64_t v, unsigned char lo,
+                                      unsigned char hi) {
+  uint64_t ge_lo = v + ONES * (0x80 - lo);
+  uint64_t gt_hi = v + ONES * (0x7f - hi);
+  return ge_lo & ~gt_hi & HIGHS;
+}
+
+/*
+ * bytes of `v` that are equal to `c`.
+ */
+static inline uint64_t bytes_equal(uint64_t v, unsigned char c) {
+  uint64_t x = v ^ (ONES * c);
+  return ~(((x & LOWS) + LOWS) | x | LOWS);
+}
+
+static inline uint64_t class_mask(uint64_t v, enum CharClass cls) {
+  switch (cls) {
+  case CC_WORD: {
+    uint64_t low = v & LOWS;
+    return (v & HIGHS) | bytes_in_range(low, '0', '9') |
+           bytes_in_range(low, 'A', 'Z') | bytes_in_range(low, 'a', 'z');
+  }
+
+  case CC_SPACE:
+    return bytes_equal(v, ' ');
+  }
+
+  return 0;
+}
+
+static inline bool in_class(unsigned char c, enum CharClass cls) {
+  switch (cls) {
+  case CC_WORD:
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+           (c >= 'a' && c <= 'z');
+
+  case CC_SPACE:
+    return c == ' ';
+  }
+
+  return false;
+}
+
+/*
+ * loads 8 bytes so that s[0] ends up in the lowest byte of the result.
+ */
+static inline uint64_t load_chunk(const char *s) {
+  uint64_t v;
+  memcpy(&v, s, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/**
+ * finds the first index in [pos, len) whose byte is (if `want` is true) or is
+ * not (if `want` is false) in the class `cls`.
+ *
+ * @return the index found, or `len` if there is none
+ */
+size_t word_scan_forward(const char *s, size_t len, size_t pos,
+                         enum CharClass cls, bool want) {
+  assert(s != NULL);
+  assert(pos <= len);
+
+  while (len - pos >= 8) {
+    uint64_t mask = class_mask(load_chunk(&s[pos]), cls);
+    if (!want) {
+      mask = ~mask & HIGHS;
+    }
+
+    if (mask != 0) {
+      return pos + __builtin_ctzll(mask) / 8;
+    }
+
+    pos += 8;
+  }
+
+  for (; pos < len; ++pos) {
+    if (in_class(s[pos], cls) == want) {
+      break;
+    }
+  }
+
+  return pos;
+}
+
+/**
+ * the mirror image of `word_scan_forward`: finds the largest index i < `pos`
+ * such that s[i] is (or is not) in the class `cls`, and returns i + 1.
+ *
+ * @return the index just after the byte found, or 0 if there is none
+ */
+size_t word_scan_backward(const char *s, size_t pos, enum CharClass cls,
+                          bool want) {
+  assert(s != NULL);
+
+  while (pos >= 8) {
+    uint64_t mask = class_mask(load_chunk(&s[pos - 8]), cls);
+    if (!want) {
+      mask = ~mask & HIGHS;
+    }
+
+    if (mask != 0) {
+      return pos - 8 + (63 - __builtin_clzll(mask)) / 8 + 1;
+    }
+
+    pos -= 8;
+  }
+
+  for (; pos > 0; --pos) {
+    if (in_class(s[pos - 1], cls) == want) {
+      break;
+    }
+  }
+
+  return pos;
+}
+
+/**
+ * where Alt+F takes the cursor: the end of the next word.
+ */
+size_t word_forward(const char *s, size_t len, size_t pos) {
+  pos = word_scan_forward(s, len, pos, CC_WORD, true);
+  return word_scan_forward(s, len, pos, CC_WORD, false);
+}
+
+/**
+ * where Alt+B takes the cursor: the start of the previous word.
+ */
+size_t word_backward(const char *s, size_t pos) {
+  pos = word_scan_backward(s, pos, CC_WORD, true);
+  return word_scan_backward(s, pos, CC_WORD, false);
+}
+
+/**
+ * where Ctrl+W kills back to: the start of the previous whitespace delimited
+ * word (like readline's `unix-word-rubout`).
+ */
+size_t word_backward_space(const char *s, size_t pos) {
+  pos = word_scan_backward(s, pos, CC_SPACE, false);
+  return word_scan_backward(s, pos, CC_SPACE, true);
+}
@@ -0,0 +1,28 @@
+#ifndef WORD_H
+#define WORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * character classes used to find word boundaries.
+ */
+enum CharClass {
+  // letters, digits and every non-ASCII byte (so that UTF-8 text is treated as
+  // part of a word, like readline does)
+  CC_WORD,
+
+  // the space character
+  CC_SPACE,
+};
+
+size_t word_scan_forward(const char *s, size_t len, size_t pos,
+                         enum CharClass cls, bool want);
+size_t word_scan_backward(const char *s, size_t pos, enum CharClass cls,
+                          bool want);
+
+size_t word_forward(const char *s, size_t len, size_t pos);
+size_t word_backward(const char *s, size_t pos);
+size_t word_backward_space(const char *s, size_t pos);
+
+#endif
@@ -0,0 +1,279 @@
+#include <fcntl.h> // for open()
+#include <math.h>  // for log()
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // for strcmp(), memset()
+#include <time.h>   // for clock_gettime()
+#include <unistd.h> // for write(), lseek(), unlink()
+
+#include "../src/readline.h"
+
+/*
+ * Drives the line editor headlessly at input sizes that grow geometrically,
+ * fits how the time taken scales with the size (the exponent k in t ~ n^k),
+ * and fails if any operation is worse than near-linear. Each operation is fed
+ * from a file, so a size takes the same input every time, and the line is
+ * drawn to /dev/null.
+ *
+ * Run with --full to go up to 10M history entries (it takes a while & a few
+ * GB of memory).
+ */
+
+// anything above this is taken to be quadratic creeping in
+#define MAX_EXPONENT 1.3
+
+// each size is run this many times & the fastest run counts
+#define REPETITIONS 3
+
+// once a size takes longer than this (in seconds), the bigger ones are
+// skipped (unless running with --full). by then there are enough sizes to
+// fit, & a quadratic operation would take forever on the rest.
+#define TIME_LIMIT 2.0
+
+struct Operation {
+  const char *name;
+
+  // writes the keys for size `n` to `fd`
+  void (*write_input)(int fd, size_t n);
+
+  // the size of the line buffer `rl_read_line` gets
+  size_t (*line_size)(size_t n);
+
+  size_t min_n;
+  size_t max_n;
+  size_t full_max_n; // with --full
+};
+
+static void write_typing(int fd, size_t n);
+static void write_paste_at_start(int fd, size_t n);
+static void write_backspaces(int fd, size_t n);
+static void write_history_walk(int fd, size_t n);
+static size_t long_line(size_t n);
+static size_t short_line(size_t n);
+
+static double run_once(int fd, size_t line_size);
+static double fit_exponent(const double *sizes, const double *times,
+                           size_t count);
+static void write_keys(int fd, const char *keys, size_t len);
+static void write_repeated(int fd, char c, size_t n);
+static double now(void);
+
+static const struct Operation operations[] = {
+    {"type at end of line", write_typing, long_line, 1000, 1000000, 1000000},
+    {"paste at start of line", write_paste_at_start, long_line, 1000, 1000000,
+     1000000},
+    {"backspace at end of line", write_backspaces, long_line, 1000, 1000000,
+     1000000},
+    {"walk history", write_history_walk, short_line, 1000, 1000000, 10000000},
+};
+
+int main(int argc, char **argv) {
+  bool full = argc > 1 && strcmp(argv[1], "--full") == 0;
+
+  int out = open("/dev/null", O_WRONLY);
+  if (out == -1) {
+    perror("failed to open /dev/null");
+    return EXIT_FAILURE;
+  }
+
+  char path[] = "/tmp/complexity-XXXXXX";
+  int in = mkstemp(path);
+  if (in == -1) {
+    perror("failed to create input file");
+    return EXIT_FAILURE;
+  }
+  unlink(path);
+
+  printf("%-26s %10s %12s\n", "operation", "n", "best time");
+
+  bool passed = true;
+  size_t num_operations = sizeof(operations) / sizeof(operations[0]);
+  for (size_t i = 0; i < num_operations; ++i) {
+    const struct Operation *op = &operations[i];
+    size_t max_n = full ? op->full_max_n : op->max_n;
+
+    double sizes[32];
+    double times[32];
+    size_t count = 0;
+
+    // 1K, 3K, 10K, 30K, ...
+    for (size_t n = op->min_n; n <= max_n && count < 32;
+         n = n % 3 == 0 ? n / 3 * 10 : n * 3) {
+      if (ftruncate(in, 0) == -1 || lseek(in, 0, SEEK_SET) == -1) {
+        perror("failed to reset input file");
+        return EXIT_FAILURE;
+      }
+      op->write_input(in, n);
+
+      double best = 0;
+      for (int rep = 0; rep < REPETITIONS; ++rep) {
+        lseek(in, 0, SEEK_SET);
+        rl_set_headless(in, out);
+
+        double t = run_once(in, op->line_size(n));
+        if (rep == 0 || t < best) {
+          best = t;
+        }
+
+        rl_cleanup();
+      }
+
+      printf("%-26s %10zu %10.2fms\n", op->name, n, best * 1e3);
+      fflush(stdout);
+
+      sizes[count] = n;
+      times[count] = best;
+      ++count;
+
+      if (!full && best > TIME_LIMIT) {
+        break;
+      }
+    }
+
+    double k = fit_exponent(sizes, times, count);
+    bool ok = k <= MAX_EXPONENT;
+    printf("%-26s %10s %10.2f   %s\n\n", op->name, "exponent", k,
+           ok ? "ok" : "FAIL");
+
+    passed = passed && ok;
+  }
+
+  close(in);
+  close(out);
+
+  if (!passed) {
+    printf("some operations scale worse than n^%.1f\n", MAX_EXPONENT);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * n characters typed one after the other at the end of the line.
+ */
+static void write_typing(int fd, size_t n) {
+  write_repeated(fd, 'a', n);
+  write_keys(fd, "\r", 1);
+}
+
+/*
+ * half a line typed, then Ctrl+A & the other half pasted in front of it, so
+ * everything inserted has text after it to move along.
+ */
+static void write_paste_at_start(int fd, size_t n) {
+  write_repeated(fd, 'a', n / 2);
+  write_keys(fd, "\x01", 1);
+  write_repeated(fd, 'b', n - n / 2);
+  write_keys(fd, "\r", 1);
+}
+
+/*
+ * a line of n characters, deleted again one Backspace at a time.
+ */
+static void write_backspaces(int fd, size_t n) {
+  write_repeated(fd, 'a', n);
+  write_repeated(fd, 0x7f, n);
+  write_keys(fd, "x\r", 2);
+}
+
+/*
+ * n lines entered, then all the way back up the history with arrow UP.
+ */
+static void write_history_walk(int fd, size_t n) {
+  char buf[65536];
+  size_t len = 0;
+
+  for (size_t i = 0; i < n; ++i) {
+    if (len > sizeof(buf) - 32) {
+      write_keys(fd, buf, len);
+      len = 0;
+    }
+    len += snprintf(&buf[len], sizeof(buf) - len, "line %zu\r", i);
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    if (len > sizeof(buf) - 3) {
+      write_keys(fd, buf, len);
+      len = 0;
+    }
+    memcpy(&buf[len], "\x1b[A", 3);
+    len += 3;
+  }
+
+  buf[len++] = '\r';
+  write_keys(fd, buf, len);
+}
+
+static size_t long_line(size_t n) { return n + 16; }
+
+static size_t short_line(size_t n) {
+  (void)n;
+  return 1024;
+}
+
+/*
+ * reads lines until the input runs out & returns how long it took, in
+ * seconds.
+ */
+static double run_once(int fd, size_t line_size) {
+  char *line = malloc(line_size);
+  if (line == NULL) {
+    perror("failed to allocate line");
+    exit(EXIT_FAILURE);
+  }
+
+  double start = now();
+  while (rl_read_line(line, line_size, "> ") == RL_SUCCESS) {
+  }
+  double elapsed = now() - start;
+
+  free(line);
+
+  return elapsed;
+}
+
+/*
+ * the slope of the least-squares line through (log n, log t).
+ */
+static double fit_exponent(const double *sizes, const double *times,
+                           size_t count) {
+  double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    double x = log(sizes[i]);
+    double y = log(times[i] > 1e-9 ? times[i] : 1e-9);
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+  }
+
+  return (count * sum_xy - sum_x * sum_y) / (count * sum_xx - sum_x * sum_x);
+}
+
+static void write_keys(int fd, const char *keys, size_t len) {
+  if (write(fd, keys, len) != (ssize_t)len) {
+    perror("failed to write input file");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void write_repeated(int fd, char c, size_t n) {
+  char buf[65536];
+  memset(buf, c, sizeof(buf));
+
+  while (n > 0) {
+    size_t len = n < sizeof(buf) ? n : sizeof(buf);
+    write_keys(fd, buf, len);
+    n -= len;
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}